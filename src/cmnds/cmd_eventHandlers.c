@@ -271,26 +271,98 @@ typedef struct eventHandler_s {
 	int requiredArgument3;
 	// command to execute when it happens
 	char *command;
+	// the same command, already split and resolved
+	preparedCommand_t prepared;
 	// for UART event handlers?
 	char *requiredArgumentText;
 
+	// next handler with the same event code
 	struct eventHandler_s *next;
+	// next handler with the same event code and the same requiredArgument hash
+	struct eventHandler_s *nextSameArgument;
 } eventHandler_t;
 
-static eventHandler_t *g_eventHandlers = 0;
-
+// Handlers are kept per event code, so firing an event only visits handlers
+// for that code. Within a bucket, integer handlers are also hashed by
+// requiredArgument (pin or channel index), so FireEvent only visits handlers
+// that can match.
+#define EVENT_ARGUMENT_HASH_SIZE 8
+
+typedef struct eventBucket_s {
+	// all handlers for this event code, newest first
+	eventHandler_t *handlers;
+	// integer handlers by requiredArgument hash
+	eventHandler_t *byArgument[EVENT_ARGUMENT_HASH_SIZE];
+	int count;
+	// statistics for listEventHandlers
+	unsigned int fired;
+	unsigned int executed;
+} eventBucket_t;
+
+// allocated on first handler for given event code
+static eventBucket_t *g_eventBuckets[CMD_EVENT_MAX_TYPES];
+
+static int EVENT_HashArgument(int argument) {
+	return ((unsigned int)argument) % EVENT_ARGUMENT_HASH_SIZE;
+}
+static eventBucket_t *EVENT_GetBucket(byte eventCode) {
+	if (eventCode >= CMD_EVENT_MAX_TYPES)
+		return 0;
+	return g_eventBuckets[eventCode];
+}
+static void EVENT_FreeHandler(eventHandler_t *ev) {
+	CMD_FreePreparedCommand(&ev->prepared);
+	free(ev->command);
+	free(ev->requiredArgumentText);
+	free(ev);
+}
+// Takes ownership of handler, it is freed if it can't be added
+static void EVENT_AddHandlerToBucket(eventHandler_t *ev) {
+	eventBucket_t *b;
+	int h;
+
+	if (ev->eventCode >= CMD_EVENT_MAX_TYPES) {
+		ADDLOG_ERROR(LOG_FEATURE_EVENT, "Event code %i is out of range", ev->eventCode);
+		EVENT_FreeHandler(ev);
+		return;
+	}
+	b = g_eventBuckets[ev->eventCode];
+	if (b == 0) {
+		b = malloc(sizeof(eventBucket_t));
+		if (b == 0) {
+			ADDLOG_ERROR(LOG_FEATURE_EVENT, "No memory for handlers of event %i", ev->eventCode);
+			EVENT_FreeHandler(ev);
+			return;
+		}
+		memset(b, 0, sizeof(eventBucket_t));
+		g_eventBuckets[ev->eventCode] = b;
+	}
+	ev->next = b->handlers;
+	b->handlers = ev;
+	if (ev->requiredArgumentText == 0) {
+		h = EVENT_HashArgument(ev->requiredArgument);
+		ev->nextSameArgument = b->byArgument[h];
+		b->byArgument[h] = ev;
+	}
+	b->count++;
+}
 
 void EventHandlers_ProcessVariableChange_Integer(byte eventCode, int oldValue, int newValue) {
 	struct eventHandler_s *ev;
+	eventBucket_t *b;
 
-	ev = g_eventHandlers;
+	b = EVENT_GetBucket(eventCode);
+	if (b == 0)
+		return;
+	b->fired++;
+
+	ev = b->handlers;
 
 	while(ev) {
-		if(eventCode==ev->eventCode) {
-			if(EVENT_EvaluateChangeCondition(ev->eventType, ev->requiredArgument, oldValue, newValue)) {
-				ADDLOG_INFO(LOG_FEATURE_EVENT, "EventHandlers_ProcessVariableChange_Integer: executing command %s",ev->command);
-				CMD_ExecuteCommand(ev->command, COMMAND_FLAG_SOURCE_SCRIPT);
-			}
+		if(EVENT_EvaluateChangeCondition(ev->eventType, ev->requiredArgument, oldValue, newValue)) {
+			ADDLOG_INFO(LOG_FEATURE_EVENT, "EventHandlers_ProcessVariableChange_Integer: executing command %s",ev->command);
+			b->executed++;
+			CMD_ExecutePreparedCommand(&ev->prepared, ev->command, COMMAND_FLAG_SOURCE_SCRIPT);
 		}
 		ev = ev->next;
 	}
@@ -299,96 +371,137 @@ void EventHandlers_ProcessVariableChange_Integer(byte eventCode, int oldValue, i
 void EventHandlers_AddEventHandler_Integer(byte eventCode, int type, int requiredArgument, int requiredArgument2, int requiredArgument3, const char *commandToRun)
 {
 	eventHandler_t *ev = malloc(sizeof(eventHandler_t));
+	if (ev == 0)
+		return;
 	memset(ev,0,sizeof(eventHandler_t));
 
-	ev->next = g_eventHandlers;
-	g_eventHandlers = ev;
-
 	ev->requiredArgumentText = NULL;
 	ev->eventType = type;
 	ev->command = strdup(commandToRun);
+	if (ev->command == 0) {
+		free(ev);
+		return;
+	}
+	CMD_PrepareCommand(&ev->prepared, ev->command);
 	ev->eventCode = eventCode;
 	ev->requiredArgument = requiredArgument;
 	ev->requiredArgument2 = requiredArgument2;
 	ev->requiredArgument3 = requiredArgument3;
+
+	EVENT_AddHandlerToBucket(ev);
 }
 
 void EventHandlers_AddEventHandler_String(byte eventCode, int type, const char *requiredArgument, const char *commandToRun)
 {
 	eventHandler_t *ev = malloc(sizeof(eventHandler_t));
+	if (ev == 0)
+		return;
 	memset(ev,0,sizeof(eventHandler_t));
 
-	ev->next = g_eventHandlers;
-	g_eventHandlers = ev;
-
 	ev->requiredArgumentText = strdup(requiredArgument);
 	ev->eventType = type;
 	ev->command = strdup(commandToRun);
+	if (ev->requiredArgumentText == 0 || ev->command == 0) {
+		free(ev->requiredArgumentText);
+		free(ev->command);
+		free(ev);
+		return;
+	}
+	CMD_PrepareCommand(&ev->prepared, ev->command);
 	ev->eventCode = eventCode;
 	ev->requiredArgument = 0;
 	ev->requiredArgument2 = 0;
+
+	EVENT_AddHandlerToBucket(ev);
 }
 void EventHandlers_FireEvent3(byte eventCode, int argument, int argument2, int argument3) {
 	struct eventHandler_s *ev;
+	eventBucket_t *b;
 
-	ev = g_eventHandlers;
+	b = EVENT_GetBucket(eventCode);
+	if (b == 0)
+		return;
+	b->fired++;
+
+	ev = b->byArgument[EVENT_HashArgument(argument)];
 
 	while (ev) {
-		if (eventCode == ev->eventCode) {
-			if (argument == ev->requiredArgument && argument2 == ev->requiredArgument2 && argument3 == ev->requiredArgument3) {
-				ADDLOG_INFO(LOG_FEATURE_EVENT, "EventHandlers_FireEvent3: executing command %s", ev->command);
-				CMD_ExecuteCommand(ev->command, COMMAND_FLAG_SOURCE_SCRIPT);
-			}
+		if (argument == ev->requiredArgument && argument2 == ev->requiredArgument2 && argument3 == ev->requiredArgument3) {
+			ADDLOG_INFO(LOG_FEATURE_EVENT, "EventHandlers_FireEvent3: executing command %s", ev->command);
+			b->executed++;
+			CMD_ExecutePreparedCommand(&ev->prepared, ev->command, COMMAND_FLAG_SOURCE_SCRIPT);
 		}
-		ev = ev->next;
+		ev = ev->nextSameArgument;
 	}
 }
 void EventHandlers_FireEvent2(byte eventCode, int argument, int argument2) {
 	struct eventHandler_s *ev;
+	eventBucket_t *b;
+
+	b = EVENT_GetBucket(eventCode);
+	if (b == 0)
+		return;
+	b->fired++;
 
-	ev = g_eventHandlers;
+	ev = b->byArgument[EVENT_HashArgument(argument)];
 
 	while(ev) {
-		if(eventCode==ev->eventCode) {
-			if(argument == ev->requiredArgument && argument2 == ev->requiredArgument2) {
-				ADDLOG_INFO(LOG_FEATURE_EVENT, "EventHandlers_FireEvent2: executing command %s",ev->command);
-				CMD_ExecuteCommand(ev->command, COMMAND_FLAG_SOURCE_SCRIPT);
-			}
+		if(argument == ev->requiredArgument && argument2 == ev->requiredArgument2) {
+			ADDLOG_INFO(LOG_FEATURE_EVENT, "EventHandlers_FireEvent2: executing command %s",ev->command);
+			b->executed++;
+			CMD_ExecutePreparedCommand(&ev->prepared, ev->command, COMMAND_FLAG_SOURCE_SCRIPT);
 		}
-		ev = ev->next;
+		ev = ev->nextSameArgument;
 	}
 }
 void EventHandlers_FireEvent(byte eventCode, int argument) {
 	struct eventHandler_s *ev;
+	eventBucket_t *b;
 
-	ev = g_eventHandlers;
+	b = EVENT_GetBucket(eventCode);
+	if (b != 0) {
+		b->fired++;
 
-	while(ev) {
-		if(eventCode==ev->eventCode) {
-			if(argument == ev->requiredArgument) {
-				ADDLOG_INFO(LOG_FEATURE_EVENT, "EventHandlers_FireEvent: executing command %s",ev->command);
-				CMD_ExecuteCommand(ev->command, COMMAND_FLAG_SOURCE_SCRIPT);
+		ev = b->byArgument[EVENT_HashArgument(argument)];
+
+		while (ev) {
+			if (argument == ev->requiredArgument) {
+				ADDLOG_INFO(LOG_FEATURE_EVENT, "EventHandlers_FireEvent: executing command %s", ev->command);
+				b->executed++;
+				CMD_ExecutePreparedCommand(&ev->prepared, ev->command, COMMAND_FLAG_SOURCE_SCRIPT);
 			}
+			ev = ev->nextSameArgument;
 		}
-		ev = ev->next;
 	}
 
 #if defined(PLATFORM_BEKEN) || defined(WINDOWS)
 	CMD_Script_ProcessWaitersForEvent(eventCode, argument);
 #endif
 }
+// Lets callers skip preparing event arguments when nobody listens
+bool EventHandlers_HasHandlers(byte eventCode) {
+	eventBucket_t *b;
+
+	b = EVENT_GetBucket(eventCode);
+	return b != 0 && b->handlers != 0;
+}
 void EventHandlers_FireEvent_String(byte eventCode, const char *argument) {
 	struct eventHandler_s *ev;
+	eventBucket_t *b;
 
-	ev = g_eventHandlers;
+	b = EVENT_GetBucket(eventCode);
+	if (b == 0)
+		return;
+	b->fired++;
+
+	ev = b->handlers;
 
 	while(ev) {
-		if(eventCode==ev->eventCode) {
-			if(ev->requiredArgumentText != 0) {
-				if(!stricmp(argument,ev->requiredArgumentText)) {
-					ADDLOG_INFO(LOG_FEATURE_EVENT, "EventHandlers_FireEvent_String: executing command %s",ev->command);
-					CMD_ExecuteCommand(ev->command, COMMAND_FLAG_SOURCE_SCRIPT);
-				}
+		if(ev->requiredArgumentText != 0) {
+			if(!stricmp(argument,ev->requiredArgumentText)) {
+				ADDLOG_INFO(LOG_FEATURE_EVENT, "EventHandlers_FireEvent_String: executing command %s",ev->command);
+				b->executed++;
+				CMD_ExecutePreparedCommand(&ev->prepared, ev->command, COMMAND_FLAG_SOURCE_SCRIPT);
 			}
 		}
 		ev = ev->next;
@@ -463,22 +576,27 @@ static commandResult_t CMD_AddEventHandler(const void *context, const char *cmd,
 commandResult_t CMD_ClearAllHandlers(const void *context, const char *cmd, const char *args, int cmdFlags){
 
 	int c = 0;
+	int i;
 	eventHandler_t *ev, *next;
 
-	ev = g_eventHandlers;
+	for (i = 0; i < CMD_EVENT_MAX_TYPES; i++) {
+		if (g_eventBuckets[i] == 0)
+			continue;
+		ev = g_eventBuckets[i]->handlers;
 
-	while(ev != 0) {
-		next = ev->next;
+		while(ev != 0) {
+			next = ev->next;
 
-		free(ev->command);
-		free(ev);
+			EVENT_FreeHandler(ev);
 
-		ev = next;
-		c++;
+			ev = next;
+			c++;
+		}
+		free(g_eventBuckets[i]);
+		g_eventBuckets[i] = 0;
 	}
 
 	addLogAdv(LOG_INFO, LOG_FEATURE_CMD, "Fried %i handlers", c);
-	g_eventHandlers = 0;
 
 	return CMD_RES_OK;
 }
@@ -524,30 +642,37 @@ static commandResult_t CMD_AddChangeHandler(const void *context, const char *cmd
 
 static commandResult_t CMD_ListEventHandlers(const void *context, const char *cmd, const char *args, int cmdFlags){
 	struct eventHandler_s *ev;
+	eventBucket_t *b;
 	int c;
+	int i;
 
-	ev = g_eventHandlers;
 	c = 0;
 
-	while(ev) {
-
-		ADDLOG_INFO(LOG_FEATURE_EVENT, "Event %i has code %i and command %s",c,ev->eventCode,ev->command);
-		ev = ev->next;
-		c++;
+	for (i = 0; i < CMD_EVENT_MAX_TYPES; i++) {
+		b = g_eventBuckets[i];
+		if (b == 0)
+			continue;
+		ADDLOG_INFO(LOG_FEATURE_EVENT, "Code %i has %i handlers, fired %u times, ran %u commands",
+			i, b->count, b->fired, b->executed);
+		ev = b->handlers;
+		while (ev) {
+			ADDLOG_INFO(LOG_FEATURE_EVENT, "Event %i has code %i and command %s",c,ev->eventCode,ev->command);
+			ev = ev->next;
+			c++;
+		}
 	}
 
 	return CMD_RES_OK;
 }
 int EventHandlers_GetActiveCount() {
-	struct eventHandler_s *ev;
 	int c;
+	int i;
 
-	ev = g_eventHandlers;
 	c = 0;
-
-	while (ev) {
-		ev = ev->next;
-		c++;
+	for (i = 0; i < CMD_EVENT_MAX_TYPES; i++) {
+		if (g_eventBuckets[i]) {
+			c += g_eventBuckets[i]->count;
+		}
 	}
 	return c;
 }
@@ -564,7 +689,7 @@ void EventHandlers_Init() {
 	//cmddetail:"examples":""}
     CMD_RegisterCommand("AddChangeHandler", CMD_AddChangeHandler, NULL);
 	//cmddetail:{"name":"listEventHandlers","args":"",
-	//cmddetail:"descr":"Prints full list of added event handlers",
+	//cmddetail:"descr":"Prints full list of added event handlers, grouped by event code, with per-code fire and run counters",
 	//cmddetail:"fn":"CMD_ListEventHandlers","file":"cmnds/cmd_eventHandlers.c","requires":"",
 	//cmddetail:"examples":""}
     CMD_RegisterCommand("listEventHandlers", CMD_ListEventHandlers, NULL);
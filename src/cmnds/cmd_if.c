@@ -569,7 +569,57 @@ char *CMD_ExpandingStrdup(const char *in) {
 	CMD_ExpandConstantsWithinString(in, ret, realLen);
 	return ret;
 }
-float CMD_EvaluateExpression(const char *s, const char *stop) {
+static float CMD_ApplyOperator(byte opCode, float a, float b) {
+	float c;
+
+	switch(opCode)
+	{
+	case OP_EQUAL:
+		c = a == b;
+		break;
+	case OP_EQUAL_OR_GREATER:
+		c = a >= b;
+		break;
+	case OP_EQUAL_OR_LESS:
+		c = a <= b;
+		break;
+	case OP_NOT_EQUAL:
+		c = a != b;
+		break;
+	case OP_GREATER:
+		c = a > b;
+		break;
+	case OP_LESS:
+		c = a < b;
+		break;
+	case OP_AND:
+		c = ((int)a) && ((int)b);
+		break;
+	case OP_OR:
+		c = ((int)a) || ((int)b);
+		break;
+	case OP_ADD:
+		c = a + b;
+		break;
+	case OP_SUB:
+		c = a - b;
+		break;
+	case OP_MUL:
+		c = a * b;
+		break;
+	case OP_DIV:
+		c = a / b;
+		break;
+	default:
+		c = 0;
+		break;
+	}
+	return c;
+}
+// Legacy recursive interpreter, it rescans the source text on every call.
+// Kept as a reference for the compiled expressions (see selftest_expressions.c)
+// and as a fallback for expressions that are too large to compile.
+float CMD_InterpretExpression(const char *s, const char *stop) {
 	byte opCode;
 	const char *op;
 	float a, b, c;
@@ -613,8 +663,8 @@ float CMD_EvaluateExpression(const char *s, const char *stop) {
 		// second token block begins at 'p2' and ends at NULL
 		p2 = op + g_operators[opCode].len;
 
-		a = CMD_EvaluateExpression(s, op);
-		b = CMD_EvaluateExpression(p2, stop);
+		a = CMD_InterpretExpression(s, op);
+		b = CMD_InterpretExpression(p2, stop);
 
 		// Why, again, %f crashes?
 		//ADDLOG_INFO(LOG_FEATURE_EVENT, "CMD_EvaluateExpression: a = %f, b = %f", a, b);
@@ -622,52 +672,11 @@ float CMD_EvaluateExpression(const char *s, const char *stop) {
 		//sprintf(g_expDebugBuffer,"CMD_EvaluateExpression: a = %f, b = %f", a, b);
 		//ADDLOG_INFO(LOG_FEATURE_EVENT, g_expDebugBuffer);
 
-		switch(opCode)
-		{
-		case OP_EQUAL:
-			c = a == b;
-			break;
-		case OP_EQUAL_OR_GREATER:
-			c = a >= b;
-			break;
-		case OP_EQUAL_OR_LESS:
-			c = a <= b;
-			break;
-		case OP_NOT_EQUAL:
-			c = a != b;
-			break;
-		case OP_GREATER:
-			c = a > b;
-			break;
-		case OP_LESS:
-			c = a < b;
-			break;
-		case OP_AND:
-			c = ((int)a) && ((int)b);
-			break;
-		case OP_OR:
-			c = ((int)a) || ((int)b);
-			break;
-		case OP_ADD:
-			c = a + b;
-			break;
-		case OP_SUB:
-			c = a - b;
-			break;
-		case OP_MUL:
-			c = a * b;
-			break;
-		case OP_DIV:
-			c = a / b;
-			break;
-		default:
-			c = 0;
-			break;
-		}
+		c = CMD_ApplyOperator(opCode, a, b);
 		return c;
 	}
 	if(s[0] == '!') {
-		return !CMD_EvaluateExpression(s+1,stop);
+		return !CMD_InterpretExpression(s+1,stop);
 	}
 	if(CMD_ExpandConstant(s,stop,&c)) {
 		return c;
@@ -682,6 +691,372 @@ float CMD_EvaluateExpression(const char *s, const char *stop) {
 	return atof(g_expDebugBuffer);
 }
 
+// Compiled expressions.
+// The expression is parsed once (with exactly the same rules as the interpreter above)
+// into a flat postfix program. Constants like $led_dimmer are resolved to an index in
+// g_constants and $CH** to a channel index, so running the program does no string work.
+// For example, "$CH1*10+$CH2" becomes:
+//	EXP_OP_CHANNEL 1, EXP_OP_VALUE 10, OP_MUL, EXP_OP_CHANNEL 2, OP_ADD
+// Binary operations are stored with their opCode_t value.
+enum {
+	EXP_OP_VALUE = 32,
+	EXP_OP_CHANNEL,
+	EXP_OP_CONSTANT,
+	EXP_OP_NOT,
+};
+
+#define EXPRESSION_MAX_INSTRUCTIONS 48
+#define EXPRESSION_MAX_STACK 24
+
+typedef struct expCompiler_s {
+	expInstruction_t code[EXPRESSION_MAX_INSTRUCTIONS];
+	int numInstructions;
+	int depth;
+	int maxDepth;
+	bool bOverflow;
+} expCompiler_t;
+
+static expCompiler_t *g_expCompiler = 0;
+
+static expInstruction_t *EXP_Emit(expCompiler_t *c, byte op, int stackChange) {
+	expInstruction_t *i;
+
+	if (c->numInstructions >= EXPRESSION_MAX_INSTRUCTIONS) {
+		c->bOverflow = true;
+		return 0;
+	}
+	c->depth += stackChange;
+	if (c->depth > c->maxDepth) {
+		c->maxDepth = c->depth;
+		if (c->maxDepth > EXPRESSION_MAX_STACK) {
+			c->bOverflow = true;
+		}
+	}
+	i = &c->code[c->numInstructions];
+	c->numInstructions++;
+	memset(i, 0, sizeof(*i));
+	i->op = op;
+	return i;
+}
+static void EXP_EmitValue(expCompiler_t *c, float value) {
+	expInstruction_t *i = EXP_Emit(c, EXP_OP_VALUE, 1);
+	if (i) {
+		i->value = value;
+	}
+}
+// mirrors CMD_InterpretExpression, but emits code instead of calculating
+static void EXP_Compile_r(expCompiler_t *c, const char *s, const char *stop) {
+	byte opCode;
+	const char *op;
+	const char *after;
+	const constant_t *var;
+	expInstruction_t *ins;
+	char tmp[EXPRESSION_DEBUG_BUFFER_SIZE];
+	int i, idx;
+
+	if (c->bOverflow)
+		return;
+	if (s == 0 || *s == 0) {
+		EXP_EmitValue(c, 0);
+		return;
+	}
+	if (stop == 0) {
+		stop = s + strlen(s);
+	}
+	while (stop > s && isspace(((int)stop[-1]))) {
+		stop--;
+	}
+	while (isspace(((int)*s))) {
+		s++;
+		if (s >= stop) {
+			EXP_EmitValue(c, 0);
+			return;
+		}
+	}
+	op = CMD_FindOperator(s, stop, &opCode);
+	if (op) {
+		EXP_Compile_r(c, s, op);
+		EXP_Compile_r(c, op + g_operators[opCode].len, stop);
+		// two operands are replaced by a result
+		EXP_Emit(c, opCode, -1);
+		return;
+	}
+	if (s[0] == '!') {
+		EXP_Compile_r(c, s + 1, stop);
+		EXP_Emit(c, EXP_OP_NOT, 0);
+		return;
+	}
+	var = g_constants;
+	for (i = 0; i < g_totalConstants; i++, var++) {
+		bool bAllowWildCard = strstr(var->constantName, "*") != 0;
+		after = strCompareBound(s, var->constantName, stop, bAllowWildCard);
+		if (after) {
+			if (var->getValue == getChannelValue) {
+				ins = EXP_Emit(c, EXP_OP_CHANNEL, 1);
+				if (ins) {
+					ins->index = atoi(s + 3);
+				}
+			}
+			else {
+				ins = EXP_Emit(c, EXP_OP_CONSTANT, 1);
+				if (ins) {
+					ins->index = i;
+				}
+			}
+			return;
+		}
+	}
+	idx = stop - s;
+	if (idx >= sizeof(tmp))
+		idx = sizeof(tmp) - 1;
+	memcpy(tmp, s, idx);
+	tmp[idx] = 0;
+	EXP_EmitValue(c, atof(tmp));
+}
+// Returns a malloced program that must be released with free,
+// or NULL if the expression is too big to be compiled.
+compiledExpression_t *CMD_CompileExpression(const char *s, const char *stop) {
+	compiledExpression_t *ret;
+	expCompiler_t *c;
+	int size;
+
+	if (g_expCompiler == 0) {
+		g_expCompiler = malloc(sizeof(expCompiler_t));
+		if (g_expCompiler == 0)
+			return 0;
+	}
+	c = g_expCompiler;
+	c->numInstructions = 0;
+	c->depth = 0;
+	c->maxDepth = 0;
+	c->bOverflow = false;
+
+	EXP_Compile_r(c, s, stop);
+
+	if (c->bOverflow) {
+		ADDLOG_IF_MATHEXP_DBG(LOG_FEATURE_EVENT, "CMD_CompileExpression: expression too long");
+		return 0;
+	}
+	size = sizeof(compiledExpression_t) + (c->numInstructions - 1) * sizeof(expInstruction_t);
+	ret = malloc(size);
+	if (ret == 0)
+		return 0;
+	ret->numInstructions = c->numInstructions;
+	memcpy(ret->code, c->code, c->numInstructions * sizeof(expInstruction_t));
+	return ret;
+}
+float CMD_RunCompiledExpression(const compiledExpression_t *e) {
+	float stack[EXPRESSION_MAX_STACK];
+	const expInstruction_t *i, *end;
+	int sp;
+
+	sp = 0;
+	i = e->code;
+	end = i + e->numInstructions;
+	for (; i < end; i++) {
+		switch (i->op) {
+		case EXP_OP_VALUE:
+			stack[sp++] = i->value;
+			break;
+		case EXP_OP_CHANNEL:
+			stack[sp++] = CHANNEL_Get(i->index);
+			break;
+		case EXP_OP_CONSTANT:
+			stack[sp++] = g_constants[i->index].getValue(g_constants[i->index].constantName);
+			break;
+		case EXP_OP_NOT:
+			stack[sp - 1] = !stack[sp - 1];
+			break;
+		default:
+			sp--;
+			stack[sp - 1] = CMD_ApplyOperator(i->op, stack[sp - 1], stack[sp]);
+			break;
+		}
+	}
+	return stack[0];
+}
+
+// Cache of compiled expressions, keyed by the source text.
+// Event handlers, change handlers and script lines keep passing the same text
+// here, so after the first run they only pay for a hash and a memcmp.
+// Size follows the number of registered commands that can hold an expression
+// (event handlers, repeating events, loaded script lines), with some room left
+// for one-off expressions from console and MQTT. Entries are found through hash
+// chains, so any expression can take any entry; when cache is full,
+// least recently used one is replaced.
+#define EXPRESSION_CACHE_MIN_SIZE	32
+#define EXPRESSION_CACHE_MAX_SIZE	256
+
+typedef struct expCacheEntry_s {
+	char *source;
+	int len;
+	unsigned int hash;
+	unsigned int lastUse;
+	compiledExpression_t *code;
+	// next entry in the same hash chain, -1 if none
+	int next;
+} expCacheEntry_t;
+
+static expCacheEntry_t *g_expCache;
+// first entry of each hash chain, there is one chain per entry
+static int *g_expCacheChains;
+static int g_expCacheSize;
+static int g_expCacheUsed;
+static unsigned int g_expCacheClock;
+static int g_expCacheHits;
+static int g_expCacheMisses;
+
+void CMD_FreeExpressionCache() {
+	int i;
+
+	for (i = 0; i < g_expCacheUsed; i++) {
+		free(g_expCache[i].source);
+		free(g_expCache[i].code);
+	}
+	free(g_expCache);
+	free(g_expCacheChains);
+	g_expCache = 0;
+	g_expCacheChains = 0;
+	g_expCacheSize = 0;
+	g_expCacheUsed = 0;
+	g_expCacheHits = 0;
+	g_expCacheMisses = 0;
+}
+void CMD_GetExpressionCacheStats(int *hits, int *misses) {
+	*hits = g_expCacheHits;
+	*misses = g_expCacheMisses;
+}
+int CMD_GetExpressionCacheSize() {
+	return g_expCacheSize;
+}
+static int CMD_GetWantedExpressionCacheSize() {
+	int count;
+	int size;
+
+	count = EventHandlers_GetActiveCount() + RepeatingEvents_GetActiveCount() + SVM_GetLoadedLineCount();
+	size = EXPRESSION_CACHE_MIN_SIZE;
+	while (size < count + EXPRESSION_CACHE_MIN_SIZE / 2 && size < EXPRESSION_CACHE_MAX_SIZE) {
+		size *= 2;
+	}
+	return size;
+}
+// Grows the cache, compiled entries are kept. On failure old cache is kept.
+static void CMD_ResizeExpressionCache(int size) {
+	expCacheEntry_t *entries;
+	int *chains;
+	int i, c;
+
+	entries = malloc(size * sizeof(expCacheEntry_t));
+	chains = malloc(size * sizeof(int));
+	if (entries == 0 || chains == 0) {
+		free(entries);
+		free(chains);
+		ADDLOG_ERROR(LOG_FEATURE_EVENT, "Expression cache: no memory for %i entries", size);
+		return;
+	}
+	for (i = 0; i < size; i++) {
+		chains[i] = -1;
+	}
+	for (i = 0; i < g_expCacheUsed; i++) {
+		entries[i] = g_expCache[i];
+		c = entries[i].hash % size;
+		entries[i].next = chains[c];
+		chains[c] = i;
+	}
+	free(g_expCache);
+	free(g_expCacheChains);
+	g_expCache = entries;
+	g_expCacheChains = chains;
+	g_expCacheSize = size;
+}
+// Returns entry linked into chain of given hash; free one first, then least recently used
+static expCacheEntry_t *CMD_TakeExpressionCacheEntry(unsigned int hash) {
+	expCacheEntry_t *e;
+	int *link;
+	int i, victim;
+
+	if (g_expCacheUsed < g_expCacheSize) {
+		victim = g_expCacheUsed++;
+	}
+	else {
+		victim = 0;
+		for (i = 1; i < g_expCacheSize; i++) {
+			if (g_expCache[i].lastUse < g_expCache[victim].lastUse) {
+				victim = i;
+			}
+		}
+		e = &g_expCache[victim];
+		for (link = &g_expCacheChains[e->hash % g_expCacheSize]; *link != victim; link = &g_expCache[*link].next) {
+		}
+		*link = e->next;
+		free(e->source);
+		free(e->code);
+	}
+	e = &g_expCache[victim];
+	e->next = g_expCacheChains[hash % g_expCacheSize];
+	g_expCacheChains[hash % g_expCacheSize] = victim;
+	return e;
+}
+float CMD_EvaluateExpression(const char *s, const char *stop) {
+	expCacheEntry_t *e;
+	compiledExpression_t *code;
+	unsigned int hash;
+	const char *p;
+	char *source;
+	int len;
+	int i;
+
+	if (s == 0)
+		return 0;
+	if (*s == 0)
+		return 0;
+
+	hash = 5381;
+	for (p = s; *p && (stop == 0 || p < stop); p++) {
+		hash = ((hash << 5) + hash) + (byte)*p;
+	}
+	len = p - s;
+	if (g_expCache == 0) {
+		CMD_ResizeExpressionCache(CMD_GetWantedExpressionCacheSize());
+		if (g_expCache == 0) {
+			return CMD_InterpretExpression(s, stop);
+		}
+	}
+	g_expCacheClock++;
+	for (i = g_expCacheChains[hash % g_expCacheSize]; i >= 0; i = e->next) {
+		e = &g_expCache[i];
+		if (e->hash == hash && e->len == len && !memcmp(e->source, s, len)) {
+			e->lastUse = g_expCacheClock;
+			g_expCacheHits++;
+			return CMD_RunCompiledExpression(e->code);
+		}
+	}
+	g_expCacheMisses++;
+	code = CMD_CompileExpression(s, s + len);
+	if (code == 0) {
+		return CMD_InterpretExpression(s, stop);
+	}
+	source = malloc(len + 1);
+	if (source == 0) {
+		free(code);
+		return CMD_InterpretExpression(s, stop);
+	}
+	memcpy(source, s, len);
+	source[len] = 0;
+	// registered commands are counted only on a miss, a hit stays cheap
+	i = CMD_GetWantedExpressionCacheSize();
+	if (i > g_expCacheSize) {
+		CMD_ResizeExpressionCache(i);
+	}
+	e = CMD_TakeExpressionCacheEntry(hash);
+	e->source = source;
+	e->len = len;
+	e->hash = hash;
+	e->lastUse = g_expCacheClock;
+	e->code = code;
+	return CMD_RunCompiledExpression(e->code);
+}
+
 // if MQTTOnline then "qq" else "qq"
 commandResult_t CMD_If(const void *context, const char *cmd, const char *args, int cmdFlags){
 	const char *cmdA;
@@ -15,8 +15,41 @@ command_t *CMD_Find(const char *name);
 void CMD_ListAllCommands(void *userData, void (*callback)(command_t *cmd, void *userData));
 int get_cmd(const char *s, char *dest, int maxlen, int stripnum);
 
+// command text already split into name and arguments, with resolved command_t
+typedef struct preparedCommand_s {
+	// command name as typed, eg. "POWER1", passed to handler
+	char *name;
+	// points into the text that command was prepared from
+	const char *args;
+	command_t *cmd;
+	// commands table generation at the time of lookup
+	int generation;
+} preparedCommand_t;
+
+void CMD_PrepareCommand(preparedCommand_t *pc, const char *s);
+commandResult_t CMD_ExecutePreparedCommand(preparedCommand_t *pc, const char *s, int cmdFlags);
+void CMD_FreePreparedCommand(preparedCommand_t *pc);
+
+
+typedef struct expInstruction_s {
+	byte op;
+	// channel index or index of the constant, depending on op
+	short index;
+	float value;
+} expInstruction_t;
+
+typedef struct compiledExpression_s {
+	int numInstructions;
+	expInstruction_t code[1];
+} compiledExpression_t;
 
 float CMD_EvaluateExpression(const char *s, const char *stop);
+float CMD_InterpretExpression(const char *s, const char *stop);
+compiledExpression_t *CMD_CompileExpression(const char *s, const char *stop);
+float CMD_RunCompiledExpression(const compiledExpression_t *e);
+void CMD_FreeExpressionCache();
+void CMD_GetExpressionCacheStats(int *hits, int *misses);
+int CMD_GetExpressionCacheSize();
 commandResult_t CMD_If(const void *context, const char *cmd, const char *args, int cmdFlags);
 void CMD_ExpandConstantsWithinString(const char *in, char *out, int outLen);
 const char *CMD_ExpandConstant(const char *s, const char *stop, float *out);
@@ -9,6 +9,7 @@
 #include "../driver/drv_public.h"
 #include "../hal/hal_adc.h"
 #include "../hal/hal_flashVars.h"
+#include "../mqtt/new_mqtt.h"
 
 int cmd_uartInitIndex = 0;
 
@@ -41,6 +42,9 @@ static int generateHashValue(const char* fname) {
 }
 
 command_t* g_commands[HASH_SIZE] = { NULL };
+// bumped every time a command is added or freed, so prepared commands
+// know when their cached command_t pointer must be looked up again
+static int g_commandsGeneration = 1;
 bool g_powersave;
 
 static commandResult_t CMD_PowerSave(const void* context, const char* cmd, const char* args, int cmdFlags) {
@@ -218,6 +222,8 @@ static commandResult_t CMD_ClearAll(const void* context, const char* cmd, const
 #if defined(WINDOWS) || defined(PLATFORM_BL602) || defined(PLATFORM_BEKEN)
 	CMD_resetSVM(0, 0, 0, 0);
 #endif
+	CMD_FreeExpressionCache();
+	MQTT_Dedup_ClearRules();
 
 	ADDLOG_INFO(LOG_FEATURE_CMD, "CMD_ClearAll: all clear");
 
@@ -344,6 +350,25 @@ static commandResult_t CMD_SafeMode(const void* context, const char* cmd, const
 
 	return CMD_RES_OK;
 }
+static commandResult_t CMD_FlashVarsCommitDelay(const void* context, const char* cmd, const char* args, int cmdFlags) {
+
+	Tokenizer_TokenizeString(args, 0);
+	// following check must be done after 'Tokenizer_TokenizeString',
+	// so we know arguments count in Tokenizer. 'cmd' argument is
+	// only for warning display
+	if (Tokenizer_CheckArgsCountAndPrintWarning(cmd, 1)) {
+		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
+	}
+	HAL_FlashVars_SetCommitDelay(Tokenizer_GetArgInteger(0));
+
+	return CMD_RES_OK;
+}
+static commandResult_t CMD_FlashVarsInfo(const void* context, const char* cmd, const char* args, int cmdFlags) {
+
+	HAL_FlashVars_PrintInfo();
+
+	return CMD_RES_OK;
+}
 
 
 
@@ -568,6 +593,16 @@ void CMD_Init_Early() {
 	//cmddetail:"fn":"CMD_SafeMode","file":"cmnds/cmd_main.c","requires":"",
 	//cmddetail:"examples":""}
 	CMD_RegisterCommand("SafeMode", CMD_SafeMode, NULL);
+	//cmddetail:{"name":"FlashVarsCommitDelay","args":"[IntegerSeconds]",
+	//cmddetail:"descr":"Remembered channel and LED state changes are collected for that many seconds before being written to flash, so fast changes (like dimmer slider) cause a single write. 0 writes at once. Default is 2",
+	//cmddetail:"fn":"CMD_FlashVarsCommitDelay","file":"cmnds/cmd_main.c","requires":"",
+	//cmddetail:"examples":""}
+	CMD_RegisterCommand("FlashVarsCommitDelay", CMD_FlashVarsCommitDelay, NULL);
+	//cmddetail:{"name":"FlashVarsInfo","args":"",
+	//cmddetail:"descr":"Prints flash vars journal usage, sector erase counts and write statistics",
+	//cmddetail:"fn":"CMD_FlashVarsInfo","file":"cmnds/cmd_main.c","requires":"",
+	//cmddetail:"examples":""}
+	CMD_RegisterCommand("FlashVarsInfo", CMD_FlashVarsInfo, NULL);
 	//cmddetail:{"name":"PingInterval","args":"[IntegerSeconds]",
 	//cmddetail:"descr":"Sets the interval between ping attempts for ping watchdog mechanism",
 	//cmddetail:"fn":"CMD_PingInterval","file":"cmnds/cmd_main.c","requires":"",
@@ -628,6 +663,7 @@ void CMD_FreeAllCommands() {
 		}
 		g_commands[i] = 0;
 	}
+	g_commandsGeneration++;
 
 }
 void CMD_RegisterCommand(const char* name, commandHandler_t handler, void* context) {
@@ -649,6 +685,7 @@ void CMD_RegisterCommand(const char* name, commandHandler_t handler, void* conte
 	newCmd->next = g_commands[hash];
 	newCmd->context = context;
 	g_commands[hash] = newCmd;
+	g_commandsGeneration++;
 }
 
 command_t* CMD_Find(const char* name) {
@@ -690,27 +727,32 @@ int get_cmd(const char* s, char* dest, int maxlen, int stripnum) {
 }
 
 
+// find a command by name, and if not found, try again without the trailing
+// numbers, so "POWER1" will find "POWER"
+static command_t* CMD_FindWithNumberSuffix(const char* cmd) {
+	command_t* newCmd;
+	char nonums[32];
+
+	// look for complete commmand
+	newCmd = CMD_Find(cmd);
+	if (newCmd) {
+		return newCmd;
+	}
+	// not found, so get the complete string up to numbers.
+	get_cmd(cmd, nonums, 32, 1);
+	return CMD_Find(nonums);
+}
+
 // execute a command from cmd and args - used below and in MQTT
 commandResult_t CMD_ExecuteCommandArgs(const char* cmd, const char* args, int cmdFlags) {
 	command_t* newCmd;
 	//int len;
 
-	// look for complete commmand
-	newCmd = CMD_Find(cmd);
+	newCmd = CMD_FindWithNumberSuffix(cmd);
 	if (!newCmd) {
-		// not found, so...
-		char nonums[32];
-		// get the complete string up to numbers.
-		//len =
-		get_cmd(cmd, nonums, 32, 1);
-		newCmd = CMD_Find(nonums);
-		if (!newCmd) {
-			// if still not found, then error
-			ADDLOG_ERROR(LOG_FEATURE_CMD, "cmd %s NOT found (args %s)", cmd, args);
-			return CMD_RES_UNKNOWN_COMMAND;
-		}
-	}
-	else {
+		// if still not found, then error
+		ADDLOG_ERROR(LOG_FEATURE_CMD, "cmd %s NOT found (args %s)", cmd, args);
+		return CMD_RES_UNKNOWN_COMMAND;
 	}
 
 	if (newCmd->handler) {
@@ -760,4 +802,60 @@ commandResult_t CMD_ExecuteCommand(const char* s, int cmdFlags) {
 	return CMD_ExecuteCommandArgs(copy, args, cmdFlags);
 }
 
+// Split command text once into name and arguments and resolve the command_t,
+// so event handlers and repeating events can skip the lookup every time they fire.
+// The arguments are kept as text and the handler still tokenizes them, so $CH1
+// and other constants are expanded at the time of execution, just like before.
+// 's' must stay valid for as long as the prepared command is used.
+void CMD_PrepareCommand(preparedCommand_t* pc, const char* s) {
+	char copy[128];
+	int len;
 
+	memset(pc, 0, sizeof(preparedCommand_t));
+	if (s == 0) {
+		return;
+	}
+	while (isWhiteSpace(*s)) {
+		s++;
+	}
+	if (*s == 0) {
+		return;
+	}
+	len = get_cmd(s, copy, sizeof(copy), 0);
+	if (len >= sizeof(copy) - 1) {
+		// too long to be a command name, leave it for CMD_ExecuteCommand
+		return;
+	}
+	s += len;
+	while (*s && isWhiteSpace(*s)) {
+		s++;
+	}
+	pc->name = strdup(copy);
+	pc->args = s;
+	if (pc->name) {
+		pc->cmd = CMD_FindWithNumberSuffix(pc->name);
+		pc->generation = g_commandsGeneration;
+	}
+}
+// run the prepared command; 's' is the text it was prepared from and is used
+// when the command could not be resolved
+commandResult_t CMD_ExecutePreparedCommand(preparedCommand_t* pc, const char* s, int cmdFlags) {
+	if (pc->name == 0) {
+		return CMD_ExecuteCommand(s, cmdFlags);
+	}
+	if (pc->generation != g_commandsGeneration) {
+		// commands were added or freed since last lookup
+		pc->cmd = CMD_FindWithNumberSuffix(pc->name);
+		pc->generation = g_commandsGeneration;
+	}
+	if (pc->cmd == 0 || pc->cmd->handler == 0) {
+		// not registered (yet?) - this will also print the error
+		return CMD_ExecuteCommand(s, cmdFlags);
+	}
+	ADDLOG_DEBUG(LOG_FEATURE_CMD, "cmd [%s]", s);
+	return pc->cmd->handler(pc->cmd->context, pc->name, pc->args, cmdFlags);
+}
+void CMD_FreePreparedCommand(preparedCommand_t* pc) {
+	free(pc->name);
+	memset(pc, 0, sizeof(preparedCommand_t));
+}
@@ -164,15 +164,34 @@ bool Tokenizer_IsArgInteger(int i);
 float Tokenizer_GetArgFloat(int i);
 int Tokenizer_GetArgIntegerRange(int i, int rangeMax, int rangeMin);
 void Tokenizer_TokenizeString(const char* s, int flags);
+// cmd_timerHeap.c
+typedef struct heapTimer_s {
+	// in owner's time units, usually milliseconds
+	unsigned int deadline;
+	// -1 if not scheduled
+	int heapIndex;
+} heapTimer_t;
+typedef struct timerHeap_s {
+	heapTimer_t** items;
+	int count;
+	int capacity;
+} timerHeap_t;
+void TimerHeap_InitTimer(heapTimer_t* t);
+bool TimerHeap_IsScheduled(heapTimer_t* t);
+void TimerHeap_Schedule(timerHeap_t* h, heapTimer_t* t, unsigned int deadline);
+void TimerHeap_Remove(timerHeap_t* h, heapTimer_t* t);
+heapTimer_t* TimerHeap_PopExpired(timerHeap_t* h, unsigned int now);
+void TimerHeap_Clear(timerHeap_t* h);
 // cmd_repeatingEvents.c
 void RepeatingEvents_Init();
-void RepeatingEvents_RunUpdate(float deltaTimeSeconds);
+void RepeatingEvents_RunUpdate(int deltaMS);
 void SIM_GenerateRepeatingEventsDesc(char *o, int outLen);
 // cmd_eventHandlers.c
 void EventHandlers_Init();
 // This is useful to fire an event when a certain UART string command is received.
 // For example, you can fire an event while getting 55 AA 01 02 00 03 FF 01 01 06  on UART..
 void EventHandlers_FireEvent_String(byte eventCode, const char* argument);
+bool EventHandlers_HasHandlers(byte eventCode);
 // This is useful to fire an event when, for example, a button is pressed.
 // Then eventCode is a BUTTON_PRESS and argument is a button index.
 void EventHandlers_FireEvent(byte eventCode, int argument);
@@ -242,6 +261,7 @@ int CMD_InitSendCommands();
 void CMD_StartTCPCommandLine();
 // cmd_script.c
 int CMD_GetCountActiveScriptThreads();
+int SVM_GetLoadedLineCount();
 
 const char* CMD_GetResultString(commandResult_t r);
 
@@ -12,13 +12,16 @@
 // turn off TuyaMCU after 5 seconds
 // addRepeatingEvent 5 1 setChannel 1 0
 typedef struct repeatingEvent_s {
+	// must be first, next run time in g_repeatingEventsTime
+	heapTimer_t timer;
 	// command string to execute
 	char *command;
+	// the same command, already split and resolved
+	preparedCommand_t prepared;
 	//char *condition;
 	// how often event repeats
 	float intervalSeconds;
-	// current value until next repeat (decremented every second)
-	float currentInterval;
+	int intervalMS;
 	// number of times to repeat.
 	// If set to -1, then it's infinite repeater
 	// If set to EVENT_CANCELED_TIMES, then event structure is ready to be reused
@@ -31,6 +34,17 @@ typedef struct repeatingEvent_s {
 #define EVENT_CANCELED_TIMES -999
 
 static repeatingEvent_t *g_repeatingEvents = 0;
+// events waiting to run, ordered by time
+static timerHeap_t g_repeatingEventsHeap;
+static unsigned int g_repeatingEventsTime = 0;
+
+static void RepeatingEvents_SetInterval(repeatingEvent_t *ev, float secondsInterval) {
+	ev->intervalSeconds = secondsInterval;
+	ev->intervalMS = (int)(secondsInterval * 1000.0f + 0.5f);
+	if (ev->intervalMS < 1) {
+		ev->intervalMS = 1;
+	}
+}
 
 void RepeatingEvents_CancelRepeatingEvents(int userID)
 {
@@ -41,6 +55,7 @@ void RepeatingEvents_CancelRepeatingEvents(int userID)
 		if(ev->userID == userID) {
 			// mark as finished
 			ev->times = EVENT_CANCELED_TIMES;
+			TimerHeap_Remove(&g_repeatingEventsHeap, &ev->timer);
 			addLogAdv(LOG_INFO, LOG_FEATURE_CMD,"Event with id %i and cmd %s has been canceled",ev->userID,ev->command);
 		}
 	}
@@ -56,9 +71,9 @@ void RepeatingEvents_AddRepeatingEvent(const char *command, float secondsInterva
 		// is this event canceled/empty?
 		if(ev->times == EVENT_CANCELED_TIMES) {
 			if(!strcmp(ev->command,command)) {
-				ev->intervalSeconds = secondsInterval;
+				RepeatingEvents_SetInterval(ev, secondsInterval);
 				// fire after delay
-				ev->currentInterval = secondsInterval;
+				TimerHeap_Schedule(&g_repeatingEventsHeap, &ev->timer, g_repeatingEventsTime + ev->intervalMS);
 				ev->times = times;
 				return;
 			}
@@ -80,14 +95,13 @@ void RepeatingEvents_AddRepeatingEvent(const char *command, float secondsInterva
 	ev->next = g_repeatingEvents;
 	g_repeatingEvents = ev;
 	ev->command = cmd_copy;
-	ev->intervalSeconds = secondsInterval;
+	CMD_PrepareCommand(&ev->prepared, ev->command);
+	RepeatingEvents_SetInterval(ev, secondsInterval);
 	ev->times = times;
 	ev->userID = userID;
-	// fire next frame
-	// TODO: is this what we want? or do we want to fire after full interval?
-	//ev->currentInterval = 1;
 	// fire after full interval
-	ev->currentInterval = secondsInterval;
+	TimerHeap_InitTimer(&ev->timer);
+	TimerHeap_Schedule(&g_repeatingEventsHeap, &ev->timer, g_repeatingEventsTime + ev->intervalMS);
 }
 void SIM_GenerateRepeatingEventsDesc(char *o, int outLen) {
 	repeatingEvent_t *cur;
@@ -101,7 +115,7 @@ void SIM_GenerateRepeatingEventsDesc(char *o, int outLen) {
 			snprintf(buffer, outLen,"ID %i, repeats %i",(int) cur->userID, (int)cur->times);
 			strcat_safe(o, buffer, outLen);
 			snprintf(buffer, outLen, ", interval %i", (int)cur->intervalSeconds);
-			snprintf(buffer, outLen, " (cur left %i), cmd: ", (int)cur->currentInterval);
+			snprintf(buffer, outLen, " (cur left %i), cmd: ", (int)(cur->timer.deadline - g_repeatingEventsTime) / 1000);
 			strcat_safe(o, buffer, outLen);
 			strcat_safe(o, cur->command, outLen);
 		}
@@ -123,41 +137,30 @@ int RepeatingEvents_GetActiveCount() {
 	}
 	return c_active;
 }
-void RepeatingEvents_RunUpdate(float deltaTimeSeconds) {
+void RepeatingEvents_RunUpdate(int deltaMS) {
 	repeatingEvent_t *cur;
-	int c_checked = 0;
 	int c_ran = 0;
 
-	cur = g_repeatingEvents;
-	while(cur) {
-		c_checked++;
-		// debug only check
-		if(cur == cur->next) {
-			addLogAdv(LOG_ERROR, LOG_FEATURE_CMD,"RepeatingEvents_OnEverySecond: single linked list was broken?");
-			cur->next = 0;
-			return;
-		}
+	g_repeatingEventsTime += deltaMS;
+	// only events that are due are visited
+	while ((cur = (repeatingEvent_t*)TimerHeap_PopExpired(&g_repeatingEventsHeap, g_repeatingEventsTime)) != 0) {
+		c_ran++;
 		// -1 means 'forever'
-		if(cur->times > 0 || cur->times == -1) {
-			cur->currentInterval-= deltaTimeSeconds;
-			if(cur->currentInterval<=0){
-				c_ran++;
-				// -1 means 'forever'
-				if(cur->times != -1) {
-					cur->times -= 1;
-					if (cur->times <= 0) {
-						// if finished all calls, mark as empty so we can reuse later
-						cur->times = EVENT_CANCELED_TIMES;
-					}
-				}
-				cur->currentInterval = cur->intervalSeconds;
-				CMD_ExecuteCommand(cur->command, COMMAND_FLAG_SOURCE_SCRIPT);
+		if(cur->times != -1) {
+			cur->times -= 1;
+			if (cur->times <= 0) {
+				// if finished all calls, mark as empty so we can reuse later
+				cur->times = EVENT_CANCELED_TIMES;
 			}
 		}
-		cur = cur->next;
+		if (cur->times != EVENT_CANCELED_TIMES) {
+			TimerHeap_Schedule(&g_repeatingEventsHeap, &cur->timer, g_repeatingEventsTime + cur->intervalMS);
+		}
+		// command may even clear all events, so don't touch cur after that
+		CMD_ExecutePreparedCommand(&cur->prepared, cur->command, COMMAND_FLAG_SOURCE_SCRIPT);
 	}
 
-	//addLogAdv(LOG_INFO, LOG_FEATURE_CMD,"RepeatingEvents_OnEverySecond checked %i events, ran %i\n",c_checked,c_ran);
+	//addLogAdv(LOG_INFO, LOG_FEATURE_CMD,"RepeatingEvents_RunUpdate ran %i\n",c_ran);
 }
 // addRepeatingEventID 1234 5 -1 DGR_SendPower "testgr" 1 1 
 // cancelRepeatingEvent 1234
@@ -201,10 +204,12 @@ commandResult_t RepeatingEvents_Cmd_ClearRepeatingEvents(const void *context, co
 	repeatingEvent_t *rem;
 	int c = 0;
 
+	TimerHeap_Clear(&g_repeatingEventsHeap);
 	cur = g_repeatingEvents;
 	while (cur) {
 		rem = cur;
 		cur = cur->next;
+		CMD_FreePreparedCommand(&rem->prepared);
 		free(rem->command);
 		free(rem);
 		c++;
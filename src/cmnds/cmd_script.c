@@ -225,18 +225,48 @@ addEventHandler OnHold 20 backlog AddChannel 10 2 0 255; DGR_SendBrightness room
 
 */
 
+// label in compiled script image
+typedef struct scriptLabel_s {
+	// name is stored in image text
+	const char *name;
+	unsigned int hash;
+	// index of first line after the label
+	int line;
+	// next label in the same hash bucket, -1 if none
+	int next;
+} scriptLabel_t;
+
+#define SVM_LABEL_BUCKETS 16
+#define SVM_DEFAULT_MAX_LOOPS 10
+
+// Script file is compiled once, when loaded: comments, labels and empty lines are stripped,
+// each line is trimmed and terminated in text, and labels go into a hash table
 typedef struct scriptFile_s {
 	char *fname;
-	char *data;
+	// lines to execute, one after another, each terminated with 0
+	char *text;
+	// offsets of lines in text
+	int *lines;
+	int numLines;
+	scriptLabel_t *labels;
+	int numLabels;
+	int labelBuckets[SVM_LABEL_BUCKETS];
 
 	struct scriptFile_s *next;
 } scriptFile_t;
 
 typedef struct scriptInstance_s {
+	// must be first, scheduled in g_scriptDelays while thread sleeps
+	heapTimer_t timer;
+	// 0 if thread is free
 	scriptFile_t *curFile;
 	int uniqueID;
-	const char *curLine;
+	// index of next line to execute
+	int curLine;
+	// delay requested by current line
 	int currentDelayMS;
+	// how many lines can be executed in one frame
+	int maxLoops;
 
 	int waitingForEvent;
 	int waitingForArgument;
@@ -251,6 +281,9 @@ int svm_deltaMS;
 scriptFile_t *g_scriptFiles = 0;
 scriptInstance_t *g_scriptThreads = 0;
 scriptInstance_t *g_activeThread = 0;
+// sleeping threads, by wake up time
+static timerHeap_t g_scriptDelays;
+static unsigned int g_scriptTime = 0;
 
 scriptInstance_t *SVM_RegisterThread() {
 	scriptInstance_t *r;
@@ -258,7 +291,7 @@ scriptInstance_t *SVM_RegisterThread() {
 	r = g_scriptThreads;
 
 	while(r) {
-		if(r->curLine == 0) {
+		if(r->curFile == 0) {
 			break;
 		}
 		r = r->next;
@@ -266,18 +299,150 @@ scriptInstance_t *SVM_RegisterThread() {
 	if(r == 0) {
 		r = malloc(sizeof(scriptInstance_t));
 		memset(r,0,sizeof(scriptInstance_t));
+		TimerHeap_InitTimer(&r->timer);
 		r->next = g_scriptThreads;
 		g_scriptThreads = r;
 	}
+	TimerHeap_Remove(&g_scriptDelays, &r->timer);
 	r->uniqueID = 0;
 	r->curLine = 0;
 	r->curFile = 0;
 	r->currentDelayMS = 0;
+	r->maxLoops = SVM_DEFAULT_MAX_LOOPS;
 	return r;
 }
+const char *SVM_SkipWS(const char *p) {
+	if(p==0)
+		return 0;
+	// skip also whitespaces
+	while(*p == ' ' || *p == '\r' || *p == '\t') {
+		p++;
+	}
+	return p;
+}
+const char *SVM_SkipLine(const char *p) {
+	if(p==0)
+		return 0;
+	while(*p) {
+		if(*p == '\n') {
+			p++;
+			return p;
+		}
+		p++;
+	}
+	return p;
+}
+static unsigned int SVM_HashLabel(const char *s, int len) {
+	unsigned int h = 5381;
+
+	while(len--) {
+		h = h * 33 + (unsigned char)*s;
+		s++;
+	}
+	return h;
+}
+// Finds next line that is not empty or a comment, trimmed. Returns false at end of text.
+static bool SVM_NextLine(const char **p, const char **start, int *len) {
+	const char *end;
+
+	while(**p) {
+		*start = *p;
+		end = SVM_SkipLine(*start);
+		*p = SVM_SkipWS(end);
+		if((*start)[0] == '/' && (*start)[1] == '/') {
+			continue;
+		}
+		while(end > *start && (end[-1]==' '||end[-1]=='\r'||end[-1]=='\n'||end[-1]=='\t')) {
+			end--;
+		}
+		*len = (end - *start);
+		if(*len == 0) {
+			continue;
+		}
+		return true;
+	}
+	return false;
+}
+// Builds compiled image of script text. Text is not kept.
+// Returns false if there was not enough memory, file is left empty then.
+static bool SVM_CompileFile(scriptFile_t *f, const char *data) {
+	const char *start, *p;
+	int len, textLen, numLines, numLabels;
+	scriptLabel_t *l;
+
+	f->numLines = 0;
+	f->numLabels = 0;
+	for(len = 0; len < SVM_LABEL_BUCKETS; len++) {
+		f->labelBuckets[len] = -1;
+	}
+	// first pass only counts, so arrays are not oversized
+	numLines = 0;
+	numLabels = 0;
+	p = SVM_SkipWS(data);
+	while(SVM_NextLine(&p, &start, &len)) {
+		if(start[len-1] == ':') {
+			numLabels++;
+		}
+		else {
+			numLines++;
+		}
+	}
+	f->text = malloc(strlen(data) + 1);
+	f->lines = malloc((numLines > 0 ? numLines : 1) * sizeof(int));
+	f->labels = malloc((numLabels > 0 ? numLabels : 1) * sizeof(scriptLabel_t));
+	if(f->text == 0 || f->lines == 0 || f->labels == 0) {
+		ADDLOG_ERROR(LOG_FEATURE_CMD, "SVM: no memory to load %s (%i lines, %i labels)", f->fname, numLines, numLabels);
+		free(f->text);
+		free(f->lines);
+		free(f->labels);
+		f->text = 0;
+		f->lines = 0;
+		f->labels = 0;
+		return false;
+	}
+	textLen = 0;
+	p = SVM_SkipWS(data);
+	while(SVM_NextLine(&p, &start, &len)) {
+		if(start[len-1] == ':') {
+			// label, points to the next line
+			len--;
+			l = &f->labels[f->numLabels];
+			l->name = f->text + textLen;
+			l->hash = SVM_HashLabel(start, len);
+			l->line = f->numLines;
+			l->next = f->labelBuckets[l->hash % SVM_LABEL_BUCKETS];
+			f->labelBuckets[l->hash % SVM_LABEL_BUCKETS] = f->numLabels;
+			f->numLabels++;
+		}
+		else {
+			if(len >= MAX_SCRIPT_LINE) {
+				len = MAX_SCRIPT_LINE-1;
+			}
+			f->lines[f->numLines] = textLen;
+			f->numLines++;
+		}
+		memcpy(f->text + textLen, start, len);
+		textLen += len;
+		f->text[textLen] = 0;
+		textLen++;
+	}
+	ADDLOG_EXTRADEBUG(LOG_FEATURE_CMD, "SVM: %s compiled to %i lines, %i labels, %i bytes", f->fname, f->numLines, f->numLabels, textLen);
+	return true;
+}
+static void SVM_FreeFile(scriptFile_t *f) {
+	free(f->text);
+	free(f->lines);
+	free(f->labels);
+	f->text = 0;
+	f->lines = 0;
+	f->labels = 0;
+	f->numLines = 0;
+	f->numLabels = 0;
+}
 
 scriptFile_t *SVM_RegisterFile(const char *fname) {
 	scriptFile_t *r;
+	char *data;
 
 	if (!stricmp(fname, "this") || fname[0] == '*') {
 		if (g_activeThread != 0)
@@ -289,78 +454,62 @@ scriptFile_t *SVM_RegisterFile(const char *fname) {
 
 	while(r) {
 		if(!stricmp(fname,r->fname)) {
-			if(r->data == 0)
+			if(r->text == 0)
 				return 0;
 			return r;
 		}
 		r = r->next;
 	}
 	r = malloc(sizeof(scriptFile_t));
+	if(r == 0)
+		return 0;
 	memset(r,0,sizeof(scriptFile_t));
 	r->fname = strdup(fname);
+	if(r->fname == 0) {
+		free(r);
+		return 0;
+	}
 	// cast from byte* to char*
-	r->data = (char*)LFS_ReadFile(fname);
+	data = (char*)LFS_ReadFile(fname);
 	r->next = g_scriptFiles;
 	g_scriptFiles = r;
-	if(r->data == 0)
-		return 0;
-	return r;
-}
-const char *SVM_SkipWS(const char *p) {
-	if(p==0)
+	if(data == 0)
 		return 0;
-	// skip also whitespaces
-	while(*p == ' ' || *p == '\r' || *p == '\t') {
-		p++;
-	}
-	return p;
-}
-const char *SVM_SkipLine(const char *p) {
-	if(p==0)
+	if(SVM_CompileFile(r, data) == false) {
+		free(data);
 		return 0;
-	while(*p) {
-		if(*p == '\n') {
-			p++;
-			return p;
-		}
-		p++;
 	}
-	return p;
+	free(data);
+	return r;
 }
 
-const char *SVM_FindLabel(const char *text, const char *label, const char *fname) {
-	int labLen;
+// Returns index of line after label, or 0 (start of file) if there is no such label
+int SVM_FindLabel(scriptFile_t *f, const char *label) {
+	unsigned int hash;
+	int labLen, i;
+	scriptLabel_t *l;
 
 	if(label == 0)
-		return text;
+		return 0;
 	if (!strcmp(label, "*"))
-		return text;
+		return 0;
 	if (*label == 0)
-		return text;
+		return 0;
 
 	labLen = strlen(label);
-
-	while(*text) {
-		text = SVM_SkipWS(text); 
-		if(strncmp(text,label,labLen) == 0 && text[labLen] == ':') {
-			return text;
-		}
-		if(text[0] == '/' && text[1] == '/') {
-			text = SVM_SkipLine(text); 
-			text = SVM_SkipWS(text); 
-		} else {
-			text = SVM_SkipLine(text); 
-			text = SVM_SkipWS(text); 
+	hash = SVM_HashLabel(label, labLen);
+	for(i = f->labelBuckets[hash % SVM_LABEL_BUCKETS]; i != -1; i = l->next) {
+		l = &f->labels[i];
+		if(l->hash == hash && !strcmp(l->name, label)) {
+			return l->line;
 		}
 	}
-	ADDLOG_INFO(LOG_FEATURE_CMD, "Label %s not found in %s - will go to the start of file",label,fname);
-	return text;
+	ADDLOG_INFO(LOG_FEATURE_CMD, "Label %s not found in %s - will go to the start of file",label,f->fname);
+	return 0;
 }
 void SVM_RunThread(scriptInstance_t *t) {
-	int maxLoops = 10;
 	int loop = 0;
-	const char *start, *end;
-	int len, p;
+	const char *line;
 
 	while(1) {
 		loop++;
@@ -368,51 +517,29 @@ void SVM_RunThread(scriptInstance_t *t) {
 		if (t->waitingForEvent) {
 			return;
 		}
-		if(t->curLine == 0) {
-			t->curLine = 0;
-			t->curFile = 0;
+		if(t->curFile == 0) {
 			return;
 		}
-		if (loop > maxLoops) {
+		if (loop > t->maxLoops) {
 			return;
 		}
-		t->curLine = SVM_SkipWS(t->curLine); 
-		if(t->curLine[0] == 0) {
+		if(t->curLine >= t->curFile->numLines) {
 			t->curLine = 0;
 			t->curFile = 0;
 			return;
 		}
-		if(t->curLine[0] == '/' && t->curLine[1] == '/') {
-			t->curLine = SVM_SkipLine(t->curLine); 
-			t->curLine = SVM_SkipWS(t->curLine); 
-		} else {
-			start = t->curLine;
-			end = SVM_SkipLine(start);
-			t->curLine = SVM_SkipWS(end); 
-
-			while(end > start && (end[-1]==' '||end[-1]=='\r'||end[-1]=='\n'||end[-1]=='\t')) {
-				end--;
-			}
-			len = (end - start);
-			//ADDLOG_EXTRADEBUG(LOG_FEATURE_CMD, "Script len: %i",len);
-
-			// skip empty lines and skip labels
-			if(len > 0 && start[len-1] != ':') {
-				if(len >= MAX_SCRIPT_LINE) {
-					len = MAX_SCRIPT_LINE-1;
-				}
-				memcpy(g_scrBuffer,start,len);
-				g_scrBuffer[len] = 0;
-
-				p = start-t->curFile->data;
-				///ADDLOG_EXTRADEBUG(LOG_FEATURE_CMD, "[Loop %i] Script line: %s, char index %i",loop,g_scrBuffer,p);
-				CMD_ExecuteCommand(g_scrBuffer,0);
-
-				// did we get a sleep?
-				if(t->currentDelayMS > 0) {
-					return;
-				}	
-			}
+		line = t->curFile->text + t->curFile->lines[t->curLine];
+		t->curLine++;
+		// copy, because command may free the file (resetSVM)
+		strcpy(g_scrBuffer,line);
+		//ADDLOG_EXTRADEBUG(LOG_FEATURE_CMD, "[Loop %i] Script line: %s, line index %i",loop,g_scrBuffer,t->curLine-1);
+		CMD_ExecuteCommand(g_scrBuffer,0);
+
+		// did we get a sleep?
+		if(t->currentDelayMS > 0) {
+			TimerHeap_Schedule(&g_scriptDelays, &t->timer, g_scriptTime + t->currentDelayMS);
+			t->currentDelayMS = 0;
+			return;
 		}
 	}
 }
@@ -428,6 +555,11 @@ void SVM_RunThreads(int deltaMS) {
 		g_scrBuffer = malloc(MAX_SCRIPT_LINE);
 	}
 
+	// wake up threads whose delay has passed
+	g_scriptTime += deltaMS;
+	while (TimerHeap_PopExpired(&g_scriptDelays, g_scriptTime)) {
+	}
+
 	g_activeThread = g_scriptThreads;
 	while(g_activeThread) {
 		if (g_activeThread->waitingForEvent) {
@@ -435,12 +567,7 @@ void SVM_RunThreads(int deltaMS) {
 			c_sleep++;
 		}
 		else {
-			if (g_activeThread->currentDelayMS > 0) {
-				g_activeThread->currentDelayMS -= deltaMS;
-				// the following block is needed to handle with long freezes on simulator
-				if (g_activeThread->currentDelayMS < 0) {
-					g_activeThread->currentDelayMS = 0;
-				}
+			if (TimerHeap_IsScheduled(&g_activeThread->timer)) {
 				c_sleep++;
 			}
 			else {
@@ -477,16 +604,12 @@ void SVM_GoTo(scriptInstance_t *th, const char *fname, const char *label) {
 
 		return;
 	}
-	if(f->data == 0) {
-
-		return;
-	}
 	if(th == 0) {
 
 		return;
 	}
 	th->curFile = f;
-	th->curLine = SVM_FindLabel(f->data,label,f->fname);
+	th->curLine = SVM_FindLabel(f,label);
 
 	return;
 }
@@ -499,7 +622,7 @@ void SVM_FreeAllFiles() {
 
 		n = f->next;
 
-		free(f->data);
+		SVM_FreeFile(f);
 		free(f->fname);
 		free(f);
 
@@ -516,6 +639,7 @@ void SVM_StopAllScripts() {
 		t->curFile = 0;
 		t->uniqueID = 0;
 		t->currentDelayMS = 0;
+		TimerHeap_Remove(&g_scriptDelays, &t->timer);
 
 		t = t->next;
 	}
@@ -533,6 +657,7 @@ void SVM_StopScripts(int id, int bExcludeSelf) {
 				t->curFile = 0;
 				t->uniqueID = 0;
 				t->currentDelayMS = 0;
+				TimerHeap_Remove(&g_scriptDelays, &t->timer);
 			} 
 		}
 		t = t->next;
@@ -544,7 +669,11 @@ void SVM_GoToLocal(scriptInstance_t *th, const char *label) {
 
 		return;
 	}
-	th->curLine = SVM_FindLabel(th->curFile->data,label,th->curFile->fname);
+	if(th->curFile == 0) {
+
+		return;
+	}
+	th->curLine = SVM_FindLabel(th->curFile,label);
 
 	return;
 }
@@ -558,11 +687,6 @@ void SVM_StartScript(const char *fname, const char *label, int uniqueID) {
 
 		return;
 	}
-	if(f->data == 0) {
-		ADDLOG_INFO(LOG_FEATURE_CMD, "CMD_StartScript: failed to get file %s dataa",fname);
-
-		return;
-	}
 	th = SVM_RegisterThread();
 	if(th == 0) {
 		ADDLOG_INFO(LOG_FEATURE_CMD, "CMD_StartScript: failed to alloc thread");
@@ -571,7 +695,7 @@ void SVM_StartScript(const char *fname, const char *label, int uniqueID) {
 	}
 	th->uniqueID = uniqueID;
 	th->curFile = f;
-	th->curLine = SVM_FindLabel(f->data,label,f->fname);
+	th->curLine = SVM_FindLabel(f,label);
 
 	if(label==0) {
 		ADDLOG_INFO(LOG_FEATURE_CMD, "CMD_StartScript: started %s at the beginning",fname);
@@ -734,6 +858,17 @@ int CMD_GetCountActiveScriptThreads() {
 
 	return cnt;
 }
+// lines of all loaded script files, used to size the expression cache
+int SVM_GetLoadedLineCount() {
+	scriptFile_t *f;
+	int cnt;
+
+	cnt = 0;
+	for (f = g_scriptFiles; f; f = f->next) {
+		cnt += f->numLines;
+	}
+	return cnt;
+}
 static commandResult_t CMD_ListScripts(const void *context, const char *cmd, const char *args, int cmdFlags){
 	scriptInstance_t *t;
 	int cnt;
@@ -802,6 +937,41 @@ commandResult_t CMD_waitFor(const void *context, const char *cmd, const char *ar
 
 	return CMD_RES_OK;
 }
+// setScriptMaxLoops [MaxLoops] [OptionalUniqueID]
+// Without ID, applies to the current script thread
+static commandResult_t CMD_SetScriptMaxLoops(const void *context, const char *cmd, const char *args, int cmdFlags) {
+	scriptInstance_t *t;
+	int maxLoops, id;
+
+	Tokenizer_TokenizeString(args, 0);
+	// following check must be done after 'Tokenizer_TokenizeString',
+	// so we know arguments count in Tokenizer. 'cmd' argument is
+	// only for warning display
+	if (Tokenizer_CheckArgsCountAndPrintWarning(cmd, 1)) {
+		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
+	}
+	maxLoops = Tokenizer_GetArgInteger(0);
+	if (maxLoops < 1) {
+		return CMD_RES_BAD_ARGUMENT;
+	}
+	if (Tokenizer_GetArgsCount() == 1) {
+		if (g_activeThread == 0) {
+			ADDLOG_INFO(LOG_FEATURE_CMD, "CMD_SetScriptMaxLoops: without ID this can be only used from a script");
+			return CMD_RES_ERROR;
+		}
+		g_activeThread->maxLoops = maxLoops;
+		return CMD_RES_OK;
+	}
+	id = Tokenizer_GetArgInteger(1);
+	t = g_scriptThreads;
+	while (t) {
+		if (t->curFile && t->uniqueID == id) {
+			t->maxLoops = maxLoops;
+		}
+		t = t->next;
+	}
+	return CMD_RES_OK;
+}
 void CMD_InitScripting(){
 	//cmddetail:{"name":"startScript","args":"[FileName][Label][UniqueID]",
 	//cmddetail:"descr":"Starts a script thread from given file, at given label - can be * for whole file, with given unique ID",
@@ -853,6 +1023,11 @@ void CMD_InitScripting(){
 	//cmddetail:"fn":"CMD_waitFor","file":"cmnds/cmd_script.c","requires":"",
 	//cmddetail:"examples":""}
 	CMD_RegisterCommand("waitFor", CMD_waitFor, NULL);
+	//cmddetail:{"name":"setScriptMaxLoops","args":"[MaxLines][OptionalUniqueID]",
+	//cmddetail:"descr":"Sets how many script lines can be executed by a script thread in one frame (default is 10). If called from a script without ID, sets it for the current thread, otherwise for all threads with given unique ID.",
+	//cmddetail:"fn":"CMD_SetScriptMaxLoops","file":"cmnds/cmd_script.c","requires":"",
+	//cmddetail:"examples":""}
+	CMD_RegisterCommand("setScriptMaxLoops", CMD_SetScriptMaxLoops, NULL);
 
 }
 
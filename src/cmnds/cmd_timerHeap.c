@@ -0,0 +1,113 @@
+#include "../new_common.h"
+#include "cmd_public.h"
+#include "../logging/logging.h"
+
+// Binary min-heap of timers, ordered by deadline.
+// Timer is embedded in owner structure, so scheduling doesn't allocate anything,
+// except when heap array has to grow.
+// Deadlines are compared with wrap in mind, so unsigned millisecond counters can overflow.
+// Used by repeating events, script delays and clock events, so on every tick
+// only expired timers are touched, not all of them.
+
+#define TIMERHEAP_BEFORE(a, b) ((int)((a)->deadline - (b)->deadline) < 0)
+
+static void TimerHeap_Place(timerHeap_t *h, heapTimer_t *t, int i) {
+	h->items[i] = t;
+	t->heapIndex = i;
+}
+static void TimerHeap_SiftUp(timerHeap_t *h, int i) {
+	heapTimer_t *t = h->items[i];
+	int parent;
+
+	while (i > 0) {
+		parent = (i - 1) / 2;
+		if (!TIMERHEAP_BEFORE(t, h->items[parent]))
+			break;
+		TimerHeap_Place(h, h->items[parent], i);
+		i = parent;
+	}
+	TimerHeap_Place(h, t, i);
+}
+static void TimerHeap_SiftDown(timerHeap_t *h, int i) {
+	heapTimer_t *t = h->items[i];
+	int child;
+
+	while (1) {
+		child = i * 2 + 1;
+		if (child >= h->count)
+			break;
+		if (child + 1 < h->count && TIMERHEAP_BEFORE(h->items[child + 1], h->items[child]))
+			child++;
+		if (!TIMERHEAP_BEFORE(h->items[child], t))
+			break;
+		TimerHeap_Place(h, h->items[child], i);
+		i = child;
+	}
+	TimerHeap_Place(h, t, i);
+}
+void TimerHeap_InitTimer(heapTimer_t *t) {
+	t->deadline = 0;
+	t->heapIndex = -1;
+}
+bool TimerHeap_IsScheduled(heapTimer_t *t) {
+	return t->heapIndex >= 0;
+}
+// Schedules timer at given deadline. If it's already scheduled, it's moved.
+void TimerHeap_Schedule(timerHeap_t *h, heapTimer_t *t, unsigned int deadline) {
+	heapTimer_t **n;
+
+	if (t->heapIndex >= 0) {
+		t->deadline = deadline;
+		TimerHeap_SiftUp(h, t->heapIndex);
+		TimerHeap_SiftDown(h, t->heapIndex);
+		return;
+	}
+	if (h->count >= h->capacity) {
+		n = realloc(h->items, (h->capacity + 16) * sizeof(heapTimer_t*));
+		if (n == 0) {
+			ADDLOG_ERROR(LOG_FEATURE_CMD, "TimerHeap_Schedule: failed to grow heap");
+			return;
+		}
+		h->items = n;
+		h->capacity += 16;
+	}
+	t->deadline = deadline;
+	h->count++;
+	TimerHeap_Place(h, t, h->count - 1);
+	TimerHeap_SiftUp(h, t->heapIndex);
+}
+void TimerHeap_Remove(timerHeap_t *h, heapTimer_t *t) {
+	int i = t->heapIndex;
+
+	if (i < 0)
+		return;
+	t->heapIndex = -1;
+	h->count--;
+	if (i == h->count)
+		return;
+	// move last one into the hole
+	TimerHeap_Place(h, h->items[h->count], i);
+	TimerHeap_SiftUp(h, i);
+	TimerHeap_SiftDown(h, h->items[i]->heapIndex);
+}
+// Removes and returns first timer with deadline <= now, or 0 if none has expired
+heapTimer_t *TimerHeap_PopExpired(timerHeap_t *h, unsigned int now) {
+	heapTimer_t *t;
+
+	if (h->count == 0)
+		return 0;
+	t = h->items[0];
+	if ((int)(t->deadline - now) > 0)
+		return 0;
+	TimerHeap_Remove(h, t);
+	return t;
+}
+// Forgets all timers. Call it before freeing their owners.
+void TimerHeap_Clear(timerHeap_t *h) {
+	int i;
+
+	for (i = 0; i < h->count; i++) {
+		h->items[i]->heapIndex = -1;
+	}
+	h->count = 0;
+}
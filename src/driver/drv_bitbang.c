@@ -0,0 +1,253 @@
+#include "../new_common.h"
+#include "../new_pins.h"
+#include "../logging/logging.h"
+#include "../hal/hal_pins.h"
+#include "drv_bitbang.h"
+
+#if PLATFORM_BEKEN
+#include "../../beken378/driver/gpio/gpio.h"
+#endif
+
+// Direct access to BK GPIO config register: one write changes direction, pull and level together.
+// Same values as gpio_config() uses for GMODE_OUTPUT and GMODE_INPUT_PULLUP.
+#if PLATFORM_BEKEN && defined(REG_GPIO_CFG_BASE_ADDR) && defined(GCFG_PULL_ENABLE_POS)
+#define BB_DIRECT_REGS			1
+#define BB_REG_OUTPUT_LOW		0x00
+#define BB_REG_OUTPUT_HIGH		(1 << GCFG_OUTPUT_POS)
+#define BB_REG_INPUT			((1 << GCFG_INPUT_ENABLE_POS) | (1 << GCFG_OUTPUT_ENABLE_POS))
+#define BB_REG_INPUT_PULLUP		(BB_REG_INPUT | (1 << GCFG_PULL_MODE_POS) | (1 << GCFG_PULL_ENABLE_POS))
+#else
+#define BB_DIRECT_REGS			0
+#endif
+
+// Until calibration is done, assume a fast CPU, so delays are too long rather than too short
+#define BB_DEFAULT_LOOPS_PER_MS	50000
+// length of one calibration run
+#define BB_CALIBRATION_MS		10
+// give up if tick doesn't move at all
+#define BB_CALIBRATION_MAX_LOOPS	100000000
+
+#ifdef WINDOWS
+// one loop is one nanosecond of virtual time
+static int g_loopsPerMs = 1000000;
+#else
+static int g_loopsPerMs = BB_DEFAULT_LOOPS_PER_MS;
+#endif
+
+#ifdef WINDOWS
+static unsigned int g_simNs;
+static bbEdge_t *g_simEdges;
+static int g_simMaxEdges;
+static int g_simEdgeCount;
+static signed char g_simInput[PLATFORM_GPIO_MAX];
+static signed char g_simLevel[PLATFORM_GPIO_MAX];
+static byte g_simInputsSet;
+// bits answered by simulated device, consumed by reads of a released line
+static int g_simBitsPin = -1;
+static const byte *g_simBits;
+static int g_simBitsCount;
+static int g_simBitsPos;
+
+static int SIM_BitBang_LineLevel(bbPin_t *p) {
+	switch (p->mode) {
+	case BB_MODE_LOW:
+	case BB_MODE_OUT_LOW:
+		return 0;
+	case BB_MODE_OUT_HIGH:
+		return 1;
+	}
+	if (g_simInputsSet && g_simInput[p->pin] >= 0)
+		return g_simInput[p->pin];
+	// pull-up
+	return 1;
+}
+static void SIM_BitBang_Update(bbPin_t *p) {
+	int level;
+
+	level = SIM_BitBang_LineLevel(p);
+	if (g_simLevel[p->pin] == level)
+		return;
+	g_simLevel[p->pin] = level;
+	if (g_simEdges == 0 || g_simEdgeCount >= g_simMaxEdges)
+		return;
+	g_simEdges[g_simEdgeCount].ns = g_simNs;
+	g_simEdges[g_simEdgeCount].pin = p->pin;
+	g_simEdges[g_simEdgeCount].level = level;
+	g_simEdgeCount++;
+}
+void SIM_BitBang_StartTrace(bbEdge_t *edges, int maxEdges) {
+	g_simNs = 0;
+	g_simEdges = edges;
+	g_simMaxEdges = maxEdges;
+	g_simEdgeCount = 0;
+}
+int SIM_BitBang_StopTrace() {
+	g_simEdges = 0;
+	return g_simEdgeCount;
+}
+void SIM_BitBang_SetInput(int pin, int level) {
+	if (g_simInputsSet == 0) {
+		memset(g_simInput, -1, sizeof(g_simInput));
+		memset(g_simLevel, -1, sizeof(g_simLevel));
+		g_simInputsSet = 1;
+	}
+	if (pin >= 0 && pin < PLATFORM_GPIO_MAX) {
+		g_simInput[pin] = level;
+	}
+}
+void SIM_BitBang_SetInputBits(int pin, const byte *data, int bitCount) {
+	g_simBitsPin = pin;
+	g_simBits = data;
+	g_simBitsCount = bitCount;
+	g_simBitsPos = 0;
+}
+int SIM_BitBang_GetInputBitsUsed() {
+	return g_simBitsPos;
+}
+#endif
+
+void BitBang_Delay(int loops) {
+#ifdef WINDOWS
+	if (loops > 0)
+		g_simNs += loops;
+#else
+	volatile int i;
+
+	for (i = 0; i < loops; i++) {
+	}
+#endif
+}
+
+// Count delay loops over a few RTOS ticks. Best of three runs is kept,
+// because a run interrupted by other tasks only ever gives fewer loops.
+void BitBang_Calibrate() {
+#ifndef WINDOWS
+	unsigned int start, elapsed;
+	int run, loops, best;
+
+	best = 0;
+	for (run = 0; run < 3; run++) {
+		// begin right after tick change
+		start = xTaskGetTickCount();
+		for (loops = 0; xTaskGetTickCount() == start && loops < BB_CALIBRATION_MAX_LOOPS; loops++) {
+		}
+		start = xTaskGetTickCount();
+		loops = 0;
+		do {
+			BitBang_Delay(1000);
+			loops += 1000;
+			elapsed = (xTaskGetTickCount() - start) * portTICK_RATE_MS;
+		} while (elapsed < BB_CALIBRATION_MS && loops < BB_CALIBRATION_MAX_LOOPS);
+		// scheduler not running yet, keep default
+		if (elapsed == 0)
+			break;
+		loops /= elapsed;
+		if (loops > best)
+			best = loops;
+	}
+	if (best > 0)
+		g_loopsPerMs = best;
+	addLogAdv(LOG_INFO, LOG_FEATURE_MAIN, "BitBang: %i delay loops per ms", g_loopsPerMs);
+#endif
+}
+int BitBang_HalfPeriodLoops(int kHz) {
+	if (kHz <= 0)
+		return 0;
+	// 500 * 1000 / kHz ns, loops per ms scaled by ns
+	return (g_loopsPerMs / kHz) * 500 / 1000;
+}
+
+void BitBang_PinInit(bbPin_t *p, int pin) {
+	if (pin < 0 || pin >= PLATFORM_GPIO_MAX) {
+		p->pin = -1;
+		return;
+	}
+	p->pin = pin;
+	p->mode = BB_MODE_NONE;
+#if BB_DIRECT_REGS
+	// let SDK configure pin function once, then only the config register is touched
+	HAL_PIN_Setup_Input_Pullup(pin);
+	p->reg = (volatile unsigned int *)(REG_GPIO_CFG_BASE_ADDR + pin * 4);
+	p->mode = BB_MODE_RELEASED;
+#endif
+#ifdef WINDOWS
+	if (g_simInputsSet == 0) {
+		SIM_BitBang_SetInput(-1, -1);
+	}
+#endif
+}
+void BitBang_Low(bbPin_t *p) {
+	if (p->pin < 0 || p->mode == BB_MODE_LOW)
+		return;
+#if BB_DIRECT_REGS
+	*p->reg = BB_REG_OUTPUT_LOW;
+#else
+	if (p->mode != BB_MODE_OUT_LOW && p->mode != BB_MODE_OUT_HIGH)
+		HAL_PIN_Setup_Output(p->pin);
+	HAL_PIN_SetOutputValue(p->pin, 0);
+#endif
+	p->mode = BB_MODE_LOW;
+#ifdef WINDOWS
+	SIM_BitBang_Update(p);
+#endif
+}
+void BitBang_Release(bbPin_t *p) {
+	if (p->pin < 0 || p->mode == BB_MODE_RELEASED)
+		return;
+#if BB_DIRECT_REGS
+	*p->reg = BB_REG_INPUT_PULLUP;
+#else
+	HAL_PIN_Setup_Input_Pullup(p->pin);
+#endif
+	p->mode = BB_MODE_RELEASED;
+#ifdef WINDOWS
+	SIM_BitBang_Update(p);
+#endif
+}
+void BitBang_Write(bbPin_t *p, int level) {
+	byte mode;
+
+	mode = level ? BB_MODE_OUT_HIGH : BB_MODE_OUT_LOW;
+	if (p->pin < 0 || p->mode == mode)
+		return;
+#if BB_DIRECT_REGS
+	*p->reg = level ? BB_REG_OUTPUT_HIGH : BB_REG_OUTPUT_LOW;
+#else
+	if (p->mode != BB_MODE_OUT_LOW && p->mode != BB_MODE_OUT_HIGH && p->mode != BB_MODE_LOW)
+		HAL_PIN_Setup_Output(p->pin);
+	HAL_PIN_SetOutputValue(p->pin, level);
+#endif
+	p->mode = mode;
+#ifdef WINDOWS
+	SIM_BitBang_Update(p);
+#endif
+}
+void BitBang_SetupInput(bbPin_t *p) {
+	if (p->pin < 0 || p->mode == BB_MODE_INPUT)
+		return;
+#if BB_DIRECT_REGS
+	*p->reg = BB_REG_INPUT;
+#else
+	HAL_PIN_Setup_Input(p->pin);
+#endif
+	p->mode = BB_MODE_INPUT;
+#ifdef WINDOWS
+	SIM_BitBang_Update(p);
+#endif
+}
+int BitBang_Read(bbPin_t *p) {
+	if (p->pin < 0)
+		return 1;
+#ifdef WINDOWS
+	if (p->pin == g_simBitsPin && g_simBitsPos < g_simBitsCount
+		&& (p->mode == BB_MODE_RELEASED || p->mode == BB_MODE_INPUT)) {
+		g_simBitsPos++;
+		return (g_simBits[(g_simBitsPos - 1) / 8] >> (7 - (g_simBitsPos - 1) % 8)) & 1;
+	}
+	return SIM_BitBang_LineLevel(p);
+#elif BB_DIRECT_REGS
+	return (*p->reg >> GCFG_INPUT_POS) & 1;
+#else
+	return HAL_PIN_ReadDigitalInput(p->pin);
+#endif
+}
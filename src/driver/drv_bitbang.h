@@ -0,0 +1,63 @@
+#ifndef __DRV_BITBANG_H__
+#define __DRV_BITBANG_H__
+
+#include "../new_common.h"
+
+// Pin and timing layer shared by software I2C and SPI.
+// Delays are busy loops calibrated once at boot against RTOS tick,
+// pins keep a direct handle where platform allows it, so a bit costs a few register writes
+// instead of full HAL pin reconfiguration.
+// On Windows nothing waits, time is virtual and edges can be recorded for selftests.
+
+typedef struct bbPin_s {
+	short pin;
+	// BB_MODE_*, last state set, so HAL is called only when it changes
+	byte mode;
+#if PLATFORM_BEKEN
+	volatile unsigned int *reg;
+#endif
+} bbPin_t;
+
+enum {
+	BB_MODE_NONE,
+	// open drain
+	BB_MODE_LOW,
+	BB_MODE_RELEASED,
+	// push-pull
+	BB_MODE_OUT_LOW,
+	BB_MODE_OUT_HIGH,
+	BB_MODE_INPUT,
+};
+
+void BitBang_Calibrate();
+// delay loops for half of a clock period at given bus speed
+int BitBang_HalfPeriodLoops(int kHz);
+void BitBang_Delay(int loops);
+void BitBang_PinInit(bbPin_t *p, int pin);
+// open drain, line goes high through pull-up when released
+void BitBang_Low(bbPin_t *p);
+void BitBang_Release(bbPin_t *p);
+// push-pull
+void BitBang_Write(bbPin_t *p, int level);
+void BitBang_SetupInput(bbPin_t *p);
+int BitBang_Read(bbPin_t *p);
+
+#ifdef WINDOWS
+typedef struct bbEdge_s {
+	unsigned int ns;
+	short pin;
+	short level;
+} bbEdge_t;
+
+// Records every change of line level with virtual time, until stopped
+void SIM_BitBang_StartTrace(bbEdge_t *edges, int maxEdges);
+// returns number of recorded edges
+int SIM_BitBang_StopTrace();
+// Level seen by BitBang_Read while line is released, -1 means pull-up
+void SIM_BitBang_SetInput(int pin, int level);
+// Answer of simulated device, every read of released pin takes next bit, MSB first
+void SIM_BitBang_SetInputBits(int pin, const byte *data, int bitCount);
+int SIM_BitBang_GetInputBitsUsed();
+#endif
+
+#endif
@@ -2,8 +2,8 @@
 
 #include "../new_cfg.h"
 #include "../new_pins.h"
-#include "../cJSON/cJSON.h"
 #include "../hal/hal_flashVars.h"
+#include "../httpserver/json_writer.h"
 #include "../logging/logging.h"
 #include "../mqtt/new_mqtt.h"
 #include "../ota/ota.h"
@@ -15,7 +15,9 @@
 #include <math.h>
 #include <time.h>
 
+// days kept in RAM by default, at least that many are published in consumption_daily
 #define DAILY_STATS_LENGTH 4
+#define HOURLY_STATS_LENGTH 24
 
 int stat_updatesSkipped = 0;
 int stat_updatesSent = 0;
@@ -33,16 +35,45 @@ float lastReadingFrequency = 0.0f;
 //
 // what are the last values we sent over the MQTT?
 float lastSentValues[OBK_NUM_MEASUREMENTS];
+// topic hashes for generic MQTT deduper, computed once in BL_Shared_Init
+static unsigned int sensor_mqttHashes[OBK_NUM_MEASUREMENTS];
+// Total consumption is integrated in fixed point, in mWh.
+// Part of the update below 1 mWh is carried over to the next update as an
+// integer number of W*ms (3600 W*ms = 1 mWh), so it is not rounded away
+// however many updates there are.
+static long long energyCounterMilliWh = 0;
+static int energyCounterResidual = 0;
+// the same total in Wh, for publishing
 float energyCounter = 0.0f;
 portTickType energyCounterStamp;
 
+// Consumption history with a fixed number of samples, in mWh.
+// Sample at head is being filled now, older ones are before it,
+// so moving to the next sample doesn't shift anything.
+// Samples get the same whole mWh as the total, so they add up exactly.
+typedef struct energyHistory_s {
+	int *samples;
+	int size;
+	int head;
+	long long sum;
+} energyHistory_t;
+
 bool energyCounterStatsEnable = false;
 int energyCounterSampleCount = 60;
 int energyCounterSampleInterval = 60;
-float *energyCounterMinutes = NULL;
+static energyHistory_t energyCounterMinutes;
 portTickType energyCounterMinutesStamp;
 long energyCounterMinutesIndex;
 bool energyCounterStatsJSONEnable = false;
+static energyHistory_t energyCounterHours;
+static int energyCounterHourCount = HOURLY_STATS_LENGTH;
+static portTickType energyCounterHoursStamp;
+// index 0 is today
+static energyHistory_t dailyStats;
+static int dailyStatsCount = DAILY_STATS_LENGTH;
+// local day number of today, -1 if not known yet
+static int energyDayNumber = -1;
+static int energyHistoryStart = 0;
 
 // how much update frames has passed without sending MQTT update of read values?
 int noChangeFrames[OBK_NUM_MEASUREMENTS];
@@ -50,7 +81,6 @@ int noChangeFrameEnergyCounter;
 float lastSentEnergyCounterValue = 0.0f; 
 float changeSendThresholdEnergy = 0.1f;
 float lastSentEnergyCounterLastHour = 0.0f;
-float dailyStats[DAILY_STATS_LENGTH];
 int actual_mday = -1;
 float lastSavedEnergyCounterValue = 0.0f;
 float changeSavedThresholdEnergy = 10.0f;
@@ -72,6 +102,127 @@ float g_apparentPower = 0;
 float g_powerFactor = 0;
 float g_reactivePower = 0;
 
+static void EnergyHistory_Free(energyHistory_t *h) {
+	if (h->samples != NULL)
+		os_free(h->samples);
+	h->samples = NULL;
+	h->size = 0;
+	h->head = 0;
+	h->sum = 0;
+}
+static void EnergyHistory_Clear(energyHistory_t *h) {
+	if (h->samples != NULL)
+		memset(h->samples, 0, h->size * sizeof(int));
+	h->head = 0;
+	h->sum = 0;
+}
+// keeps current samples if size doesn't change
+static void EnergyHistory_Alloc(energyHistory_t *h, int size) {
+	if (h->samples != NULL && h->size == size)
+		return;
+	EnergyHistory_Free(h);
+	h->samples = (int*)os_malloc(size * sizeof(int));
+	if (h->samples == NULL)
+		return;
+	h->size = size;
+	EnergyHistory_Clear(h);
+}
+static void EnergyHistory_Add(energyHistory_t *h, int milliWh) {
+	if (h->samples == NULL)
+		return;
+	h->samples[h->head] += milliWh;
+	h->sum += milliWh;
+}
+// age 0 is the sample being filled now, result is in Wh
+static float EnergyHistory_Get(energyHistory_t *h, int age) {
+	if (h->samples == NULL || age < 0 || age >= h->size)
+		return 0.0f;
+	return h->samples[(h->head - age + h->size) % h->size] * 0.001f;
+}
+static void EnergyHistory_SetMilliWh(energyHistory_t *h, int age, int milliWh) {
+	int i;
+
+	if (h->samples == NULL || age < 0 || age >= h->size)
+		return;
+	i = (h->head - age + h->size) % h->size;
+	h->sum += milliWh - h->samples[i];
+	h->samples[i] = milliWh;
+}
+static void EnergyHistory_Set(energyHistory_t *h, int age, float energy) {
+	EnergyHistory_SetMilliWh(h, age, (int)(energy * 1000.0f + 0.5f));
+}
+// newest samples are kept, as many as fit
+static void EnergyHistory_Resize(energyHistory_t *h, int size) {
+	energyHistory_t n;
+	int i;
+
+	if (h->samples == NULL || h->size == size) {
+		EnergyHistory_Alloc(h, size);
+		return;
+	}
+	memset(&n, 0, sizeof(n));
+	EnergyHistory_Alloc(&n, size);
+	if (n.samples == NULL)
+		return;
+	for (i = 0; i < size && i < h->size; i++)
+		EnergyHistory_SetMilliWh(&n, i, h->samples[(h->head - i + h->size) % h->size]);
+	EnergyHistory_Free(h);
+	*h = n;
+}
+// starts a new sample, the oldest one is dropped
+static void EnergyHistory_Advance(energyHistory_t *h) {
+	if (h->samples == NULL)
+		return;
+	h->head++;
+	if (h->head >= h->size)
+		h->head = 0;
+	h->sum -= h->samples[h->head];
+	h->samples[h->head] = 0;
+}
+
+static void BL_SetEnergyCounterMilliWh(long long milliWh) {
+	energyCounterMilliWh = milliWh;
+	energyCounterResidual = 0;
+	energyCounter = (float)(energyCounterMilliWh * 0.001);
+}
+// returns whole mWh added to the total
+static int BL_AddEnergyWattMs(long long wattMs) {
+	int whole;
+
+	wattMs += energyCounterResidual;
+	whole = (int)(wattMs / 3600);
+	energyCounterResidual = (int)(wattMs % 3600);
+	energyCounterMilliWh += whole;
+	energyCounter = (float)(energyCounterMilliWh * 0.001);
+	return whole;
+}
+// days since 1970 of a calendar date, so consecutive days always differ by one
+static int BL_GetDayNumber(struct tm *ltm) {
+	int y = ltm->tm_year + 1900;
+	int m = ltm->tm_mon + 1;
+	int era, yoe, doy, doe;
+
+	y -= m <= 2;
+	era = (y >= 0 ? y : y - 399) / 400;
+	yoe = y - era * 400;
+	doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + ltm->tm_mday - 1;
+	doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + doe - 719468;
+}
+// fills days before today from flash vars
+static void BL_LoadSavedDays() {
+	float day;
+	int i;
+
+	if (energyDayNumber == -1)
+		return;
+	for (i = 1; i < dailyStats.size && energyDayNumber - i >= energyHistoryStart; i++)
+	{
+		if (HAL_FlashVars_GetEnergyDay(energyDayNumber - i, &day))
+			EnergyHistory_Set(&dailyStats, i, day);
+	}
+}
+
 void BL09XX_AppendInformationToHTTPIndexPage(http_request_t *request)
 {
     int i;
@@ -127,11 +278,11 @@ void BL09XX_AppendInformationToHTTPIndexPage(http_request_t *request)
     if (NTP_IsTimeSynced()) {
         poststr(request, "<tr><td><b>Energy Today</b></td><td "
                          "style='text-align: right;'>");
-        hprintf255(request, "%.1f</td><td>Wh</td>", dailyStats[0]);
+        hprintf255(request, "%.1f</td><td>Wh</td>", EnergyHistory_Get(&dailyStats, 0));
 
         poststr(request, "<tr><td><b>Energy Yesterday</b></td><td "
                          "style='text-align: right;'>");
-        hprintf255(request, "%.1f</td><td>Wh</td>", dailyStats[1]);
+        hprintf255(request, "%.1f</td><td>Wh</td>", EnergyHistory_Get(&dailyStats, 1));
     }
     poststr(request,
             "<tr><td><b>Energy Total</b></td><td style='text-align: right;'>");
@@ -150,15 +301,15 @@ void BL09XX_AppendInformationToHTTPIndexPage(http_request_t *request)
         hprintf255(request,"%1.1f Wh<br>", DRV_GetReading(OBK_CONSUMPTION_LAST_HOUR));
         hprintf255(request,"Sampling interval: %d sec<br>History length: ",energyCounterSampleInterval);
         hprintf255(request,"%d samples<br>History per samples:<br>",energyCounterSampleCount);
-        if (energyCounterMinutes != NULL)
+        if (energyCounterMinutes.samples != NULL)
         {
-            for(i=0; i<energyCounterSampleCount; i++)
+            for(i=0; i<energyCounterMinutes.size; i++)
             {
                 if ((i%20)==0)
                 {
-                    hprintf255(request, "%1.1f", energyCounterMinutes[i]);
+                    hprintf255(request, "%1.1f", EnergyHistory_Get(&energyCounterMinutes, i));
                 } else {
-                    hprintf255(request, ", %1.1f", energyCounterMinutes[i]);
+                    hprintf255(request, ", %1.1f", EnergyHistory_Get(&energyCounterMinutes, i));
                 }
                 if ((i%20)==19)
                 {
@@ -174,13 +325,13 @@ void BL09XX_AppendInformationToHTTPIndexPage(http_request_t *request)
 
         if(NTP_IsTimeSynced() == true)
         {
-            hprintf255(request, "Today: %1.1f Wh DailyStats: [", dailyStats[0]);
-            for(i = 1; i < DAILY_STATS_LENGTH; i++)
+            hprintf255(request, "Today: %1.1f Wh DailyStats: [", EnergyHistory_Get(&dailyStats, 0));
+            for(i = 1; i < dailyStats.size; i++)
             {
                 if (i==1)
-                    hprintf255(request, "%1.1f", dailyStats[i]);
+                    hprintf255(request, "%1.1f", EnergyHistory_Get(&dailyStats, i));
                 else
-                    hprintf255(request, ",%1.1f", dailyStats[i]);
+                    hprintf255(request, ",%1.1f", EnergyHistory_Get(&dailyStats, i));
             }
             hprintf255(request, "]<br>");
             ltm = localtime(&ConsumptionResetTime);
@@ -199,6 +350,23 @@ void BL09XX_AppendInformationToHTTPIndexPage(http_request_t *request)
     /********************************************************************************************************************/
 }
 
+// Small record with the total, this is what is saved periodically
+void BL09XX_SaveEnergyTotal()
+{
+    ENERGY_TOTAL_DATA data;
+
+    memset(&data, 0, sizeof(ENERGY_TOTAL_DATA));
+    data.TotalMilliWh = energyCounterMilliWh;
+    data.TodayConsumption = EnergyHistory_Get(&dailyStats, 0);
+    data.DayNumber = energyDayNumber < 0 ? 0 : energyDayNumber;
+    data.HistoryStart = energyHistoryStart;
+    ConsumptionSaveCounter++;
+
+    HAL_FlashVars_SaveEnergyTotal(&data);
+}
+
+// Whole structure, saved only on reset and when day changes.
+// It's still kept up to date for platforms without separate energy records.
 void BL09XX_SaveEmeteringStatistics()
 {
     ENERGY_METERING_DATA data;
@@ -206,46 +374,41 @@ void BL09XX_SaveEmeteringStatistics()
     memset(&data, 0, sizeof(ENERGY_METERING_DATA));
 
     data.TotalConsumption = energyCounter;
-    data.TodayConsumpion = dailyStats[0];
-    data.YesterdayConsumption = dailyStats[1];
+    data.TodayConsumpion = EnergyHistory_Get(&dailyStats, 0);
+    data.YesterdayConsumption = EnergyHistory_Get(&dailyStats, 1);
     data.actual_mday = actual_mday;
-    data.ConsumptionHistory[0] = dailyStats[2];
-    data.ConsumptionHistory[1] = dailyStats[3];
+    data.ConsumptionHistory[0] = EnergyHistory_Get(&dailyStats, 2);
+    data.ConsumptionHistory[1] = EnergyHistory_Get(&dailyStats, 3);
     data.ConsumptionResetTime = ConsumptionResetTime;
-    ConsumptionSaveCounter++;
-    data.save_counter = ConsumptionSaveCounter;
+    // BL09XX_SaveEnergyTotal below counts this save
+    data.save_counter = ConsumptionSaveCounter + 1;
 
     HAL_SetEnergyMeterStatus(&data);
+    BL09XX_SaveEnergyTotal();
 }
 
 commandResult_t BL09XX_ResetEnergyCounter(const void *context, const char *cmd, const char *args, int cmdFlags)
 {
-    float value;
-    int i;
+    double value;
 
     if(args==0||*args==0) 
     {
-        energyCounter = 0.0f;
+        BL_SetEnergyCounterMilliWh(0);
         energyCounterStamp = xTaskGetTickCount();
         if (energyCounterStatsEnable == true)
         {
-            if (energyCounterMinutes != NULL)
-            {
-                for(i = 0; i < energyCounterSampleCount; i++)
-                {
-                    energyCounterMinutes[i] = 0.0;
-                }
-            }
+            EnergyHistory_Clear(&energyCounterMinutes);
             energyCounterMinutesStamp = xTaskGetTickCount();
             energyCounterMinutesIndex = 0;
         }
-        for(i = 0; i < DAILY_STATS_LENGTH; i++)
-        {
-            dailyStats[i] = 0.0;
-        }
+        EnergyHistory_Clear(&energyCounterHours);
+        energyCounterHoursStamp = xTaskGetTickCount();
+        EnergyHistory_Clear(&dailyStats);
+        // saved days before today are not loaded again
+        energyHistoryStart = energyDayNumber < 0 ? 0 : energyDayNumber;
     } else {
         value = atof(args);
-        energyCounter = value;
+        BL_SetEnergyCounterMilliWh((long long)(value * 1000.0));
         energyCounterStamp = xTaskGetTickCount();
     }
     ConsumptionResetTime = (time_t)NTP_GetCurrentTime();
@@ -308,9 +471,7 @@ commandResult_t BL09XX_SetupEnergyStatistic(const void *context, const char *cmd
         if (energyCounterSampleCount != sample_count)
         {
             /* upgrade sample count, free memory */
-            if (energyCounterMinutes != NULL)
-                os_free(energyCounterMinutes);
-            energyCounterMinutes = NULL;
+            EnergyHistory_Free(&energyCounterMinutes);
             energyCounterSampleCount = sample_count;
         }
         addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER, "Sample Count:    %d", energyCounterSampleCount);
@@ -318,19 +479,11 @@ commandResult_t BL09XX_SetupEnergyStatistic(const void *context, const char *cmd
         {
             /* change sample time */            
             energyCounterSampleInterval = sample_time;
-            if (energyCounterMinutes != NULL)
-                memset(energyCounterMinutes, 0, energyCounterSampleCount*sizeof(float));
+            EnergyHistory_Clear(&energyCounterMinutes);
         }
         
-        if (energyCounterMinutes == NULL)
-        {
-            /* allocate new memeory */
-            energyCounterMinutes = (float*)os_malloc(sample_count*sizeof(float));
-            if (energyCounterMinutes != NULL)
-            {
-                memset(energyCounterMinutes, 0, energyCounterSampleCount*sizeof(float));
-            }
-        }
+        /* allocate new memeory */
+        EnergyHistory_Alloc(&energyCounterMinutes, energyCounterSampleCount);
         addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER, "Sample Interval: %d", energyCounterSampleInterval);
 
         energyCounterMinutesStamp = xTaskGetTickCount();
@@ -339,11 +492,7 @@ commandResult_t BL09XX_SetupEnergyStatistic(const void *context, const char *cmd
         /* Disable Consimption Nistory */
         addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER, "Consumption History disabled");
         energyCounterStatsEnable = false;
-        if (energyCounterMinutes != NULL)
-        {
-            os_free(energyCounterMinutes);
-            energyCounterMinutes = NULL;
-        }
+        EnergyHistory_Free(&energyCounterMinutes);
         energyCounterSampleCount = sample_count;
         energyCounterSampleInterval = sample_time;
     }
@@ -408,6 +557,77 @@ commandResult_t BL09XX_SetupConsumptionThreshold(const void *context, const char
 
     return CMD_RES_OK;
 }
+commandResult_t BL09XX_SetupEnergyHistory(const void *context, const char *cmd, const char *args, int cmdFlags)
+{
+    int hours, days;
+
+    Tokenizer_TokenizeString(args,0);
+	// following check must be done after 'Tokenizer_TokenizeString',
+	// so we know arguments count in Tokenizer. 'cmd' argument is
+	// only for warning display
+	if (Tokenizer_CheckArgsCountAndPrintWarning(cmd, 2)) {
+		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
+	}
+    hours = Tokenizer_GetArgInteger(0);
+    days = Tokenizer_GetArgInteger(1);
+
+    if (hours < 1)
+        hours = 1;
+    if (hours > 168)
+        hours = 168;
+    if (days < DAILY_STATS_LENGTH)
+        days = DAILY_STATS_LENGTH;
+    if (days > MAX_SAVED_ENERGY_DAYS)
+        days = MAX_SAVED_ENERGY_DAYS;
+
+    energyCounterHourCount = hours;
+    EnergyHistory_Resize(&energyCounterHours, hours);
+    if (days > dailyStatsCount)
+    {
+        EnergyHistory_Resize(&dailyStats, days);
+        // older days may still be in flash
+        BL_LoadSavedDays();
+    }
+    else
+    {
+        EnergyHistory_Resize(&dailyStats, days);
+    }
+    dailyStatsCount = days;
+    addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER, "Energy history: %d hours, %d days", hours, days);
+
+    return CMD_RES_OK;
+}
+static void BL09XX_WriteHistoryJSON(jsonWriter_t *w, const char *key, energyHistory_t *h, int decimals)
+{
+    int i;
+
+    JSONWriter_BeginArray(w, key);
+    for (i = 0; i < h->size; i++)
+    {
+        JSONWriter_AddFloat(w, NULL, EnergyHistory_Get(h, i), decimals);
+    }
+    JSONWriter_EndArray(w);
+}
+// Consumption in Wh for /api/energy, history arrays start with the current (unfinished) sample
+void BL09XX_AppendEnergyJSON(http_request_t *request)
+{
+    jsonWriter_t w;
+
+    JSONWriter_InitPrinter(&w, request, (jsonCb_t)hprintf255);
+    JSONWriter_BeginObject(&w, NULL);
+    JSONWriter_AddFloat(&w, "total", energyCounterMilliWh * 0.001, 3);
+    JSONWriter_AddFloat(&w, "power", lastReadings[OBK_POWER], 2);
+    JSONWriter_AddInt(&w, "day", energyDayNumber);
+    BL09XX_WriteHistoryJSON(&w, "hours", &energyCounterHours, 2);
+    BL09XX_WriteHistoryJSON(&w, "days", &dailyStats, 2);
+    if (energyCounterStatsEnable == true && energyCounterMinutes.samples != NULL)
+    {
+        JSONWriter_AddInt(&w, "interval", energyCounterSampleInterval);
+        BL09XX_WriteHistoryJSON(&w, "samples", &energyCounterMinutes, 2);
+    }
+    JSONWriter_EndObject(&w);
+    JSONWriter_Finish(&w);
+}
 bool Channel_AreAllRelaysOpen() {
 	int i, role, ch;
 
@@ -439,11 +659,13 @@ void BL_ProcessUpdate(float voltage, float current, float power,
 					  float frequency) 
 {
     int i;
-    float energy;    
+    long long energy;
     int xPassedTicks;
-    cJSON* root;
-    cJSON* stats;
+    int dayNumber;
+    int milliWh;
+    jsonWriter_t w;
     char *msg;
+    int msgSize;
     portTickType interval;
     time_t ntpTime;
     struct tm *ltm;
@@ -489,17 +711,15 @@ void BL_ProcessUpdate(float voltage, float current, float power,
     xPassedTicks = (int)(xTaskGetTickCount() - energyCounterStamp);
     if (xPassedTicks <= 0)
         xPassedTicks = 1;
-    energy = (float)xPassedTicks;
-    energy *= power;
-    energy /= (3600000.0f / (float)portTICK_PERIOD_MS);
+    // W * ms, rounded to whole W*ms
+    energy = (long long)((double)power * xPassedTicks * portTICK_PERIOD_MS + 0.5);
     if (energy < 0)
     {
-        energy = 0.0;
+        energy = 0;
     }
 
-    energyCounter += energy;
+    milliWh = BL_AddEnergyWattMs(energy);
     energyCounterStamp = xTaskGetTickCount();
-    HAL_FlashVars_SaveTotalConsumption(energyCounter);
     
     if(NTP_IsTimeSynced() == true) 
     {
@@ -508,18 +728,29 @@ void BL_ProcessUpdate(float voltage, float current, float power,
         if (ConsumptionResetTime == 0)
             ConsumptionResetTime = (time_t)ntpTime;
 
-        if (actual_mday == -1)
+        dayNumber = BL_GetDayNumber(ltm);
+        if (energyDayNumber == -1)
         {
-            actual_mday = ltm->tm_mday;
+            // day of saved today is not known, old flash vars had only day of month
+            if (actual_mday != -1 && actual_mday != ltm->tm_mday)
+                energyDayNumber = dayNumber - 1;
+            else
+                energyDayNumber = dayNumber;
         }
-        if (actual_mday != ltm->tm_mday)
+        if (dayNumber < energyDayNumber)
         {
-            for (i = DAILY_STATS_LENGTH - 1; i > 0; i--)
-                dailyStats[i] = dailyStats[i - 1];
-
-            dailyStats[0] = 0.0;
+            // clock went back, keep counting into the same day
+            energyDayNumber = dayNumber;
+        }
+        if (energyDayNumber != dayNumber)
+        {
+            // finished day is kept in flash too, following ones (if device was off) had nothing
+            HAL_FlashVars_SaveEnergyDay(energyDayNumber, EnergyHistory_Get(&dailyStats, 0));
+            for (i = energyDayNumber; i < dayNumber && i < energyDayNumber + dailyStats.size; i++)
+                EnergyHistory_Advance(&dailyStats);
+            energyDayNumber = dayNumber;
             actual_mday = ltm->tm_mday;
-            MQTT_PublishMain_StringFloat(counter_mqttNames[3], dailyStats[1]);
+            MQTT_PublishMain_StringFloat(counter_mqttNames[3], EnergyHistory_Get(&dailyStats, 1));
             stat_updatesSent++;
 #if WINDOWS
 #elif PLATFORM_BL602
@@ -552,7 +783,15 @@ void BL_ProcessUpdate(float voltage, float current, float power,
         }
     }
 
-    dailyStats[0] += energy;
+    EnergyHistory_Add(&dailyStats, milliWh);
+
+    interval = 3600 * 1000 / portTICK_PERIOD_MS;
+    while ((xTaskGetTickCount() - energyCounterHoursStamp) >= interval)
+    {
+        EnergyHistory_Advance(&energyCounterHours);
+        energyCounterHoursStamp += interval;
+    }
+    EnergyHistory_Add(&energyCounterHours, milliWh);
 
     if (energyCounterStatsEnable == true)
     {
@@ -562,74 +801,64 @@ void BL_ProcessUpdate(float voltage, float current, float power,
         {
             if ((energyCounterStatsJSONEnable == true) && (MQTT_IsReady() == true))
             {
-                root = cJSON_CreateObject();
-                cJSON_AddNumberToObject(root, "uptime", Time_getUpTimeSeconds());
-                cJSON_AddNumberToObject(root, "consumption_total", energyCounter );
-                cJSON_AddNumberToObject(root, "consumption_last_hour",  DRV_GetReading(OBK_CONSUMPTION_LAST_HOUR));
-                cJSON_AddNumberToObject(root, "consumption_stat_index", energyCounterMinutesIndex);
-                cJSON_AddNumberToObject(root, "consumption_sample_count", energyCounterSampleCount);
-                cJSON_AddNumberToObject(root, "consumption_sampling_period", energyCounterSampleInterval);
-                if(NTP_IsTimeSynced() == true)
+                // one flat buffer, big enough for every sample, instead of a cJSON node per value
+                msgSize = 512 + (energyCounterMinutes.size + dailyStats.size) * 16;
+                msg = (char*)os_malloc(msgSize);
+                if (msg != NULL)
                 {
-                    cJSON_AddNumberToObject(root, "consumption_today", dailyStats[0]);
-                    cJSON_AddNumberToObject(root, "consumption_yesterday", dailyStats[1]);
-                    ltm = localtime(&ConsumptionResetTime);
-                    if (NTP_GetTimesZoneOfsSeconds()>0)
+                    JSONWriter_InitBuffer(&w, msg, msgSize);
+                    JSONWriter_BeginObject(&w, NULL);
+                    JSONWriter_AddInt(&w, "uptime", Time_getUpTimeSeconds());
+                    JSONWriter_AddFloat(&w, "consumption_total", energyCounterMilliWh * 0.001, 3);
+                    JSONWriter_AddFloat(&w, "consumption_last_hour", DRV_GetReading(OBK_CONSUMPTION_LAST_HOUR), 3);
+                    JSONWriter_AddInt(&w, "consumption_stat_index", energyCounterMinutesIndex);
+                    JSONWriter_AddInt(&w, "consumption_sample_count", energyCounterSampleCount);
+                    JSONWriter_AddInt(&w, "consumption_sampling_period", energyCounterSampleInterval);
+                    if(NTP_IsTimeSynced() == true)
                     {
-                       snprintf(datetime,sizeof(datetime), "%04i-%02i-%02iT%02i:%02i+%02i:%02i",
-                               ltm->tm_year+1900, ltm->tm_mon+1, ltm->tm_mday, ltm->tm_hour, ltm->tm_min,
-                               NTP_GetTimesZoneOfsSeconds()/3600, (NTP_GetTimesZoneOfsSeconds()/60) % 60);
-                    } else {
-                       snprintf(datetime, sizeof(datetime), "%04i-%02i-%02iT%02i:%02i-%02i:%02i",
-                               ltm->tm_year+1900, ltm->tm_mon+1, ltm->tm_mday, ltm->tm_hour, ltm->tm_min,
-                               abs(NTP_GetTimesZoneOfsSeconds()/3600), (abs(NTP_GetTimesZoneOfsSeconds())/60) % 60);
+                        JSONWriter_AddFloat(&w, "consumption_today", EnergyHistory_Get(&dailyStats, 0), 3);
+                        JSONWriter_AddFloat(&w, "consumption_yesterday", EnergyHistory_Get(&dailyStats, 1), 3);
+                        ltm = localtime(&ConsumptionResetTime);
+                        if (NTP_GetTimesZoneOfsSeconds()>0)
+                        {
+                           snprintf(datetime,sizeof(datetime), "%04i-%02i-%02iT%02i:%02i+%02i:%02i",
+                                   ltm->tm_year+1900, ltm->tm_mon+1, ltm->tm_mday, ltm->tm_hour, ltm->tm_min,
+                                   NTP_GetTimesZoneOfsSeconds()/3600, (NTP_GetTimesZoneOfsSeconds()/60) % 60);
+                        } else {
+                           snprintf(datetime, sizeof(datetime), "%04i-%02i-%02iT%02i:%02i-%02i:%02i",
+                                   ltm->tm_year+1900, ltm->tm_mon+1, ltm->tm_mday, ltm->tm_hour, ltm->tm_min,
+                                   abs(NTP_GetTimesZoneOfsSeconds()/3600), (abs(NTP_GetTimesZoneOfsSeconds())/60) % 60);
+                        }
+                        JSONWriter_AddString(&w, "consumption_clear_date", datetime);
                     }
-                    cJSON_AddStringToObject(root, "consumption_clear_date", datetime);
-                }
 
-                if (energyCounterMinutes != NULL)
-                {
-                    stats = cJSON_CreateArray();
-                    for(i = 0; i < energyCounterSampleCount; i++)
+                    if (energyCounterMinutes.samples != NULL)
                     {
-                        cJSON_AddItemToArray(stats, cJSON_CreateNumber(energyCounterMinutes[i]));
+                        BL09XX_WriteHistoryJSON(&w, "consumption_samples", &energyCounterMinutes, 3);
                     }
-                    cJSON_AddItemToObject(root, "consumption_samples", stats);
-                }
 
-                if(NTP_IsTimeSynced() == true)
-                {
-                    stats = cJSON_CreateArray();
-                    for(i = 0; i < DAILY_STATS_LENGTH; i++)
+                    if(NTP_IsTimeSynced() == true)
                     {
-                        cJSON_AddItemToArray(stats, cJSON_CreateNumber(dailyStats[i]));
+                        BL09XX_WriteHistoryJSON(&w, "consumption_daily", &dailyStats, 3);
                     }
-                    cJSON_AddItemToObject(root, "consumption_daily", stats);
-                }
-
-                msg = cJSON_PrintUnformatted(root);
-                cJSON_Delete(root);
+                    JSONWriter_EndObject(&w);
 
-               // addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER, "JSON Printed: %d bytes", strlen(msg));
+                   // addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER, "JSON Printed: %d bytes", w.len);
 
-                MQTT_PublishMain_StringString(counter_mqttNames[2], msg, 0);
-                stat_updatesSent++;
-                os_free(msg);
-            }
-
-            if (energyCounterMinutes != NULL)
-            {
-                for (i=energyCounterSampleCount-1;i>0;i--)
-                {
-                    if (energyCounterMinutes[i-1]>0.0)
+                    if (JSONWriter_Finish(&w) >= 0)
                     {
-                        energyCounterMinutes[i] = energyCounterMinutes[i-1];
-                    } else {
-                        energyCounterMinutes[i] = 0.0;
+                        MQTT_PublishMain_StringString(counter_mqttNames[2], msg, 0);
+                        stat_updatesSent++;
                     }
+                    else
+                    {
+                        addLogAdv(LOG_ERROR, LOG_FEATURE_ENERGYMETER, "consumption_stats JSON does not fit in %d bytes", msgSize);
+                    }
+                    os_free(msg);
                 }
-                energyCounterMinutes[0] = 0.0;
             }
+
+            EnergyHistory_Advance(&energyCounterMinutes);
             energyCounterMinutesStamp = xTaskGetTickCount();
             energyCounterMinutesIndex++;
 
@@ -642,8 +871,7 @@ void BL_ProcessUpdate(float voltage, float current, float power,
             }
         }
 
-        if (energyCounterMinutes != NULL)
-            energyCounterMinutes[0] += energy;
+        EnergyHistory_Add(&energyCounterMinutes, milliWh);
     }
 
     for(i = 0; i < OBK_NUM_MEASUREMENTS; i++)
@@ -672,7 +900,7 @@ void BL_ProcessUpdate(float voltage, float current, float power,
             if (MQTT_IsReady() == true)
             {
                 lastSentValues[i] = lastReadings[i];
-                MQTT_PublishMain_StringFloat(sensor_mqttNames[i],lastReadings[i]);
+                MQTT_PublishMain_StringFloat_Filtered(sensor_mqttHashes[i], sensor_mqttNames[i], lastReadings[i], 0);
                 stat_updatesSent++;
             }
         } else {
@@ -706,9 +934,9 @@ void BL_ProcessUpdate(float voltage, float current, float power,
             stat_updatesSent++;
             if(NTP_IsTimeSynced() == true)
             {
-                MQTT_PublishMain_StringFloat(counter_mqttNames[3], dailyStats[1]);
+                MQTT_PublishMain_StringFloat(counter_mqttNames[3], EnergyHistory_Get(&dailyStats, 1));
                 stat_updatesSent++;
-                MQTT_PublishMain_StringFloat(counter_mqttNames[4], dailyStats[0]);
+                MQTT_PublishMain_StringFloat(counter_mqttNames[4], EnergyHistory_Get(&dailyStats, 0));
                 stat_updatesSent++;
                 ltm = localtime(&ConsumptionResetTime);
                 snprintf(datetime,sizeof(datetime), "%04i-%02i-%02i %02i:%02i:%02i",
@@ -733,7 +961,7 @@ void BL_ProcessUpdate(float voltage, float current, float power,
 #endif
         {
             lastSavedEnergyCounterValue = energyCounter;
-            BL09XX_SaveEmeteringStatistics();
+            BL09XX_SaveEnergyTotal();
             lastConsumptionSaveStamp = xTaskGetTickCount();
         }
     }
@@ -743,47 +971,54 @@ void BL_Shared_Init(void)
 {
     int i;
     ENERGY_METERING_DATA data;
+    ENERGY_TOTAL_DATA total;
 
     for(i = 0; i < OBK_NUM_MEASUREMENTS; i++)
     {
         noChangeFrames[i] = 0;
         lastReadings[i] = 0;
+        sensor_mqttHashes[i] = MQTT_Dedup_HashTopic(sensor_mqttNames[i]);
     }
     noChangeFrameEnergyCounter = 0;
     energyCounterStamp = xTaskGetTickCount(); 
 
     if (energyCounterStatsEnable == true)
     {
-        if (energyCounterMinutes == NULL)
-        {
-            energyCounterMinutes = (float*)os_malloc(energyCounterSampleCount*sizeof(float));
-        }
-        if (energyCounterMinutes != NULL)
-        {
-            for(i = 0; i < energyCounterSampleCount; i++)
-            {
-                energyCounterMinutes[i] = 0.0;
-            }   
-        }
+        EnergyHistory_Alloc(&energyCounterMinutes, energyCounterSampleCount);
+        EnergyHistory_Clear(&energyCounterMinutes);
         energyCounterMinutesStamp = xTaskGetTickCount();
         energyCounterMinutesIndex = 0;
     }
-
-    for(i = 0; i < DAILY_STATS_LENGTH; i++)
-    {
-        dailyStats[i] = 0;
-    }
+    EnergyHistory_Alloc(&energyCounterHours, energyCounterHourCount);
+    EnergyHistory_Clear(&energyCounterHours);
+    energyCounterHoursStamp = xTaskGetTickCount();
+    EnergyHistory_Alloc(&dailyStats, dailyStatsCount);
+    EnergyHistory_Clear(&dailyStats);
 
     addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER, "Read ENERGYMETER status values. sizeof(ENERGY_METERING_DATA)=%d\n", sizeof(ENERGY_METERING_DATA));
 
     HAL_GetEnergyMeterStatus(&data);
-    energyCounter = data.TotalConsumption;
-    dailyStats[0] = data.TodayConsumpion;
-    dailyStats[1] = data.YesterdayConsumption;
+    if (HAL_FlashVars_GetEnergyTotal(&total))
+    {
+        BL_SetEnergyCounterMilliWh(total.TotalMilliWh);
+        energyDayNumber = total.DayNumber ? total.DayNumber : -1;
+        energyHistoryStart = total.HistoryStart;
+        EnergyHistory_Set(&dailyStats, 0, total.TodayConsumption);
+        BL_LoadSavedDays();
+    }
+    else
+    {
+        // saved by older version, or platform without energy records
+        BL_SetEnergyCounterMilliWh((long long)(data.TotalConsumption * 1000.0));
+        energyDayNumber = -1;
+        energyHistoryStart = 0;
+        EnergyHistory_Set(&dailyStats, 0, data.TodayConsumpion);
+        EnergyHistory_Set(&dailyStats, 1, data.YesterdayConsumption);
+        EnergyHistory_Set(&dailyStats, 2, data.ConsumptionHistory[0]);
+        EnergyHistory_Set(&dailyStats, 3, data.ConsumptionHistory[1]);
+    }
     actual_mday = data.actual_mday;    
     lastSavedEnergyCounterValue = energyCounter;
-    dailyStats[2] = data.ConsumptionHistory[0];
-    dailyStats[3] = data.ConsumptionHistory[1];
     ConsumptionResetTime = data.ConsumptionResetTime;
     ConsumptionSaveCounter = data.save_counter;
     lastConsumptionSaveStamp = xTaskGetTickCount();
@@ -800,6 +1035,11 @@ void BL_Shared_Init(void)
 	//cmddetail:"fn":"BL09XX_SetupEnergyStatistic","file":"driver/drv_bl_shared.c","requires":"",
 	//cmddetail:"examples":""}
     CMD_RegisterCommand("SetupEnergyStats", BL09XX_SetupEnergyStatistic, NULL);
+	//cmddetail:{"name":"SetupEnergyHistory","args":"[HourSamples][DaySamples]",
+	//cmddetail:"descr":"Sets how many hours [1..168] and days [4..31] of consumption history are kept. Finished days are saved in flash. History is available at /api/energy.",
+	//cmddetail:"fn":"BL09XX_SetupEnergyHistory","file":"driver/drv_bl_shared.c","requires":"",
+	//cmddetail:"examples":""}
+    CMD_RegisterCommand("SetupEnergyHistory", BL09XX_SetupEnergyHistory, NULL);
 	//cmddetail:{"name":"ConsumptionThreshold","args":"[FloatValue]",
 	//cmddetail:"descr":"Setup value for automatic save of consumption data [1..100]",
 	//cmddetail:"fn":"BL09XX_SetupConsumptionThreshold","file":"driver/drv_bl_shared.c","requires":"",
@@ -820,8 +1060,6 @@ void BL_Shared_Init(void)
 // OBK_POWER etc
 float DRV_GetReading(int type) 
 {
-    int i;
-    float hourly_sum = 0.0;
     switch (type)
     {
         case OBK_VOLTAGE: // must match order in cmd_public.h
@@ -833,19 +1071,13 @@ float DRV_GetReading(int type)
         case OBK_CONSUMPTION_LAST_HOUR:
             if (energyCounterStatsEnable == true)
             {
-                if (energyCounterMinutes != NULL)
-                {
-                    for(i=0;i<energyCounterSampleCount;i++)
-                    {
-                        hourly_sum += energyCounterMinutes[i];
-                    }
-                }
+                return energyCounterMinutes.sum * 0.001f;
             }
-            return hourly_sum;
+            return 0.0f;
         case OBK_CONSUMPTION_YESTERDAY:
-            return dailyStats[1];
+            return EnergyHistory_Get(&dailyStats, 1);
         case OBK_CONSUMPTION_TODAY:
-            return dailyStats[0];
+            return EnergyHistory_Get(&dailyStats, 0);
         default:
             break;
     }
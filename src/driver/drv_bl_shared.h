@@ -6,6 +6,7 @@ void BL_Shared_Init(void);
 void BL_ProcessUpdate(float voltage, float current, float power,
                       float frequency);
 void BL09XX_AppendInformationToHTTPIndexPage(http_request_t *request);
+void BL09XX_AppendEnergyJSON(http_request_t *request);
 
 extern float g_apparentPower;
 extern float g_powerFactor;
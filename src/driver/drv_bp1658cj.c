@@ -88,6 +88,7 @@ void BP1658CJ_Init() {
 	g_softI2C.pin_clk = PIN_FindPinIndexForRole(IOR_BP1658CJ_CLK,g_softI2C.pin_clk);
 	g_softI2C.pin_data = PIN_FindPinIndexForRole(IOR_BP1658CJ_DAT,g_softI2C.pin_data);
 
+    LED_I2CDriver_SetupBus(&g_softI2C);
     Soft_I2C_PreInit(&g_softI2C);
 
 	//cmddetail:{"name":"BP1658CJ_RGBCW","args":"[HexColor]",
@@ -61,8 +61,7 @@ static void BP5758D_SetCurrent(byte curValRGB, byte curValCW) {
 	usleep(SM2135_DELAY);
 }
 static void BP5758D_PreInit() {
-	HAL_PIN_Setup_Output(g_softI2C.pin_clk);
-	HAL_PIN_Setup_Output(g_softI2C.pin_data);
+	Soft_I2C_PreInit(&g_softI2C);
 
 	Soft_I2C_Stop(&g_softI2C);
 
@@ -169,6 +168,7 @@ void BP5758D_Init() {
 	g_softI2C.pin_clk = PIN_FindPinIndexForRole(IOR_BP5758D_CLK,g_softI2C.pin_clk);
 	g_softI2C.pin_data = PIN_FindPinIndexForRole(IOR_BP5758D_DAT,g_softI2C.pin_data);
 
+    LED_I2CDriver_SetupBus(&g_softI2C);
     BP5758D_PreInit();
 
 	//cmddetail:{"name":"BP5758D_RGBCW","args":"[HexColor]",
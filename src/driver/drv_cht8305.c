@@ -11,9 +11,12 @@
 #include "../hal/hal_pins.h"
 
 #include "drv_cht8305.h"
+#include "drv_sensor_sched.h"
 
 
 #define CHT8305_I2C_ADDR (0x40 << 1)
+// temperature and humidity at 14 bit take 6.5ms each
+#define CHT8305_MEASURE_MS	20
 
 static byte channel_temp = 0, channel_humid = 0;
 static float g_temp = 0.0, g_humid = 0.0;
@@ -21,29 +24,44 @@ static softI2C_t g_softI2C;
 static float g_calTemp = 0, g_calHum = 0;
 
 
-static void CHT8305_ReadEnv(float* temp, float* hum) {
-	uint8_t buff[4];
-	unsigned int th, tl, hh, hl;
+static int CHT8305_StartMeasure(sensorJob_t *job);
+static bool CHT8305_FetchMeasure(sensorJob_t *job);
+static sensorJob_t g_chtJob = { "CHT8305", CHT8305_StartMeasure, CHT8305_FetchMeasure, 1000 };
 
-	Soft_I2C_Start(&g_softI2C, CHT8305_I2C_ADDR);
-	Soft_I2C_WriteByte(&g_softI2C, 0x00);
-	Soft_I2C_Stop(&g_softI2C);
+// Pointing at temperature register starts conversion of both values
+static int CHT8305_StartMeasure(sensorJob_t *job) {
+	byte reg = 0x00;
 
-	rtos_delay_milliseconds(20);	//give the sensor time to do the conversion
+	if (Soft_I2C_Transfer(&g_softI2C, CHT8305_I2C_ADDR, &reg, 1, 0, 0) == false)
+		return SENSOR_SCHED_ERROR;
+	return CHT8305_MEASURE_MS;
+}
+static bool CHT8305_FetchMeasure(sensorJob_t *job) {
+	uint8_t buff[4];
+	unsigned int th, tl, hh, hl;
 
-	Soft_I2C_Start(&g_softI2C, CHT8305_I2C_ADDR | 1);
-	Soft_I2C_ReadBytes(&g_softI2C, buff, 4);
-	Soft_I2C_Stop(&g_softI2C);
+	// sensor NACKs while conversion is running
+	if (Soft_I2C_Transfer(&g_softI2C, CHT8305_I2C_ADDR, 0, 0, buff, 4) == false)
+		return false;
 
 	th = buff[0];
 	tl = buff[1];
 	hh = buff[2];
 	hl = buff[3];
 
-	(*temp) = ((th << 8 | tl) * 165.0 / 65535.0 - 40.0)+ g_calTemp;
+	g_temp = ((th << 8 | tl) * 165.0 / 65535.0 - 40.0) + g_calTemp;
 
-	(*hum) = ((hh << 8 | hl) * 100.0 / 65535.0)+ g_calHum;
+	g_humid = ((hh << 8 | hl) * 100.0 / 65535.0) + g_calHum;
 
+	channel_temp = g_cfg.pins.channels[g_softI2C.pin_data];
+	channel_humid = g_cfg.pins.channels2[g_softI2C.pin_data];
+	// don't want to loose accuracy, so multiply by 10
+	// We have a channel types to handle that
+	CHANNEL_Set(channel_temp, (int)(g_temp * 10), 0);
+	CHANNEL_Set(channel_humid, (int)(g_humid), 0);
+
+	addLogAdv(LOG_INFO, LOG_FEATURE_SENSOR, "DRV_CHT8304_readEnv: Temperature:%fC Humidity:%f%%", g_temp, g_humid);
+	return true;
 }
 
 commandResult_t CHT_Calibrate(const void* context, const char* cmd, const char* args, int cmdFlags) {
@@ -92,22 +110,13 @@ void CHT8305_Init() {
 	//cmddetail:"examples":"SHT_Calibrate -4 10"}
 	CMD_RegisterCommand("CHT_Calibrate", CHT_Calibrate, NULL);
 
+	SensorSched_Add(&g_chtJob);
 
 }
 
 
-void CHT8305_OnEverySecond() {
-
-	CHT8305_ReadEnv(&g_temp, &g_humid);
-
-	channel_temp = g_cfg.pins.channels[g_softI2C.pin_data];
-	channel_humid = g_cfg.pins.channels2[g_softI2C.pin_data];
-	// don't want to loose accuracy, so multiply by 10
-	// We have a channel types to handle that
-	CHANNEL_Set(channel_temp, (int)(g_temp * 10), 0);
-	CHANNEL_Set(channel_humid, (int)(g_humid), 0);
-
-	addLogAdv(LOG_INFO, LOG_FEATURE_SENSOR, "DRV_CHT8304_readEnv: Temperature:%fC Humidity:%f%%", g_temp, g_humid);
+void CHT8305_StopDriver() {
+	SensorSched_Remove(&g_chtJob);
 }
 
 void CHT8305_AppendInformationToHTTPIndexPage(http_request_t* request)
@@ -116,5 +125,6 @@ void CHT8305_AppendInformationToHTTPIndexPage(http_request_t* request)
 	if (channel_humid == channel_temp) {
 		hprintf255(request, "WARNING: You don't have configured target channels for temp and humid results, set the first and second channel index in Pins!");
 	}
+	SensorSched_AppendInformationToHTTPIndexPage(request, &g_chtJob);
 }
 
@@ -10,6 +10,76 @@
 #include "drv_local.h"
 #include "drv_dht_internal.h"
 
+// Reads are non-blocking where pin edges can be timestamped.
+// Start pulse is ended by quick tick (DHT11/DHT12) or right away (DHT21/DHT22, ~1ms),
+// then falling edges are timestamped by GPIO interrupt and decoded on next quick tick.
+// Only one sensor is read at time and sensors are spread across seconds.
+// Elsewhere it falls back to blocking DHT_read, still one sensor per second.
+#if PLATFORM_BEKEN
+#include "bk_timer_pub.h"
+#include "drv_model_pub.h"
+#include <gpio_pub.h>
+#include <rtos_pub.h>
+#elif WINDOWS
+int rtos_get_time();
+#endif
+
+#if PLATFORM_BEKEN && defined(CMD_TIMER_READ_CNT)
+#define DHT_EDGE_CAPTURE 1
+// free running, shared by all sensors; timers 0-1 are used by IR
+static UINT32 g_dhtClockChan = BKTIMER2;
+static UINT32 g_dhtClockLastUs = 0;
+static uint32_t g_dhtClockUs = 0;
+static bool g_dhtClockStarted = false;
+// timers 0-2 count 26MHz clock
+#define DHT_CLOCK_TICKS_PER_US		26
+#define DHT_CLOCK_PERIOD_US			1000000
+
+static void DHT_ClockISR(UINT8 t) {
+}
+static void DHT_StartClock() {
+	timer_param_t params = {
+		(unsigned char)g_dhtClockChan,
+		1, // div
+		DHT_CLOCK_PERIOD_US, // us
+		DHT_ClockISR
+	};
+	if (g_dhtClockStarted)
+		return;
+	sddev_control((char *)TIMER_DEV_NAME, CMD_TIMER_INIT_PARAM_US, &params);
+	sddev_control((char *)TIMER_DEV_NAME, CMD_TIMER_UNIT_ENABLE, &g_dhtClockChan);
+	g_dhtClockStarted = true;
+}
+// Counter wraps every second, but a read takes ~5ms, so one wrap at most is seen between calls
+static uint32_t DHT_GetMicros() {
+	UINT32 cnt = g_dhtClockChan;
+
+	sddev_control((char *)TIMER_DEV_NAME, CMD_TIMER_READ_CNT, &cnt);
+	cnt /= DHT_CLOCK_TICKS_PER_US;
+	if (cnt < g_dhtClockLastUs) {
+		g_dhtClockUs += cnt + DHT_CLOCK_PERIOD_US - g_dhtClockLastUs;
+	}
+	else {
+		g_dhtClockUs += cnt - g_dhtClockLastUs;
+	}
+	g_dhtClockLastUs = cnt;
+	return g_dhtClockUs;
+}
+#elif WINDOWS
+// simulator answers with synthetic edges
+#define DHT_EDGE_CAPTURE 1
+#else
+#define DHT_EDGE_CAPTURE 0
+#endif
+
+// DHT11 needs at least 18ms low, DHT22 at least 1ms (and at most 20ms)
+#define DHT_START_PULSE_MS		20
+#define DHT22_START_PULSE_US	1100
+// whole answer takes less than 5ms
+#define DHT_RECEIVE_MS			6
+// sensors heat up when read too often
+#define DHT_MIN_INTERVAL		3
+
 // test device
 static dht_t *test = 0;
 // per-pin devices
@@ -41,6 +111,170 @@ int translateDHTType(int role) {
 	return 0;
 }
 int g_dhtsCount = 0;
+// sensor which is being read now
+static dht_t * volatile g_dhtActive = 0;
+// round robin position
+static int g_dhtNext = 0;
+
+#if DHT_EDGE_CAPTURE
+static void DHT_OnEdge(dht_t *dht, uint32_t nowUs) {
+	if (dht->edgeCount < DHT_MAX_EDGES) {
+		dht->edges[dht->edgeCount++] = nowUs;
+	}
+}
+#endif
+// ms clock for start pulse and receive window
+static uint32_t DHT_GetMillis() {
+#if DHT_EDGE_CAPTURE
+	return rtos_get_time();
+#else
+	// reads are blocking here, states are not used
+	return 0;
+#endif
+}
+#if PLATFORM_BEKEN && DHT_EDGE_CAPTURE
+static void DHT_EdgeISR(unsigned char index) {
+	dht_t *dht = g_dhtActive;
+
+	if (dht == 0 || dht->_pin != index || dht->state != DHT_STATE_RECEIVING)
+		return;
+	DHT_OnEdge(dht, DHT_GetMicros());
+}
+#endif
+#if WINDOWS
+// Falling edges of an answer with 19C and 67%, in format of given sensor type
+static void DHT_SimulateAnswer(dht_t *dht, int startPulseMs) {
+	byte d[5];
+	uint32_t us;
+	int i, t, h;
+
+	// DHT11 ignores start pulse shorter than 18ms
+	if ((dht->_type == DHT11 || dht->_type == DHT12) && startPulseMs < 18)
+		return;
+	t = 19;
+	h = 67;
+	if (dht->_type == DHT11 || dht->_type == DHT12) {
+		d[0] = h;
+		d[1] = 0;
+		d[2] = t;
+		d[3] = 0;
+	}
+	else {
+		d[0] = (h * 10) >> 8;
+		d[1] = (h * 10) & 0xFF;
+		d[2] = (t * 10) >> 8;
+		d[3] = (t * 10) & 0xFF;
+	}
+	d[4] = d[0] + d[1] + d[2] + d[3];
+	us = 1000;
+	DHT_OnEdge(dht, us);
+	us += 160;
+	for (i = 0; i < 40; i++) {
+		DHT_OnEdge(dht, us);
+		us += 50 + ((d[i / 8] >> (7 - i % 8)) & 1 ? 70 : 27);
+	}
+	DHT_OnEdge(dht, us);
+}
+#endif
+static void DHT_PublishResult(dht_t *dht) {
+	float temp, humid;
+
+	humid = DHT_convertHumidity(dht);
+	temp = DHT_convertTemperature(dht, false);
+	// don't want to loose accuracy, so multiply by 10
+	// We have a channel types to handle that
+	CHANNEL_Set(g_cfg.pins.channels[dht->_pin], (int)(temp * 10), 0);
+	CHANNEL_Set(g_cfg.pins.channels2[dht->_pin], (int)(humid), 0);
+}
+static void DHT_StopCapture(dht_t *dht) {
+	if (g_dhtActive != dht)
+		return;
+#if PLATFORM_BEKEN && DHT_EDGE_CAPTURE
+	gpio_int_disable(dht->_pin);
+#endif
+	dht->state = DHT_STATE_IDLE;
+	g_dhtActive = 0;
+	HAL_PIN_Setup_Input_Pullup(dht->_pin);
+}
+static void DHT_Free(int index) {
+	if (g_dhts[index] == 0)
+		return;
+	DHT_StopCapture(g_dhts[index]);
+	free(g_dhts[index]);
+	g_dhts[index] = 0;
+}
+// End of start pulse, sensor answers 20-40us after line is released
+static void DHT_Release(dht_t *dht) {
+#if WINDOWS
+	int startPulseMs = DHT_GetMillis() - dht->stateStart;
+#endif
+	dht->edgeCount = 0;
+	dht->state = DHT_STATE_RECEIVING;
+	dht->stateStart = DHT_GetMillis();
+	HAL_PIN_Setup_Input_Pullup(dht->_pin);
+#if PLATFORM_BEKEN && DHT_EDGE_CAPTURE
+	// resync clock, then listen; if response edge is missed, decoder doesn't need it
+	DHT_GetMicros();
+	gpio_int_enable(dht->_pin, IRQ_TRIGGER_FALLING_EDGE, DHT_EdgeISR);
+#elif WINDOWS
+	DHT_SimulateAnswer(dht, startPulseMs);
+#endif
+}
+static void DHT_StartRead(dht_t *dht) {
+	dht->_lastreadtime = Time_getUpTimeSeconds();
+	g_dhtActive = dht;
+#if PLATFORM_BEKEN && DHT_EDGE_CAPTURE
+	DHT_StartClock();
+#endif
+	HAL_PIN_Setup_Output(dht->_pin);
+	HAL_PIN_SetOutputValue(dht->_pin, false);
+	dht->state = DHT_STATE_START;
+	dht->stateStart = DHT_GetMillis();
+	if (dht->_type == DHT22 || dht->_type == DHT21) {
+		// too short for quick tick, and quick tick would be too long for these
+		usleep2(DHT22_START_PULSE_US);
+		DHT_Release(dht);
+	}
+}
+static void DHT_FinishRead(dht_t *dht) {
+	int res;
+
+	DHT_StopCapture(dht);
+	res = DHT_DecodeEdges(dht->edges, dht->edgeCount, dht->data);
+	if (res == DHT_DECODE_OK) {
+		dht->_lastresult = true;
+		DHT_PublishResult(dht);
+		return;
+	}
+	dht->_lastresult = false;
+	if (res == DHT_DECODE_TOO_FEW_EDGES) {
+		addLogAdv(LOG_INFO, LOG_FEATURE_SENSOR, "DHT on pin %i: no answer, %i edges", (int)dht->_pin, dht->edgeCount);
+	}
+	else if (res == DHT_DECODE_BAD_PULSE) {
+		addLogAdv(LOG_INFO, LOG_FEATURE_SENSOR, "DHT on pin %i: bad pulse length", (int)dht->_pin);
+	}
+	else {
+		addLogAdv(LOG_INFO, LOG_FEATURE_SENSOR, "DHT on pin %i: checksum failure!", (int)dht->_pin);
+	}
+}
+// next sensor that wasn't read for long enough, round robin so none is starved
+static dht_t *DHT_FindNextDue() {
+	uint32_t now = Time_getUpTimeSeconds();
+	dht_t *dht;
+	int i, j;
+
+	for (j = 0; j < PLATFORM_GPIO_MAX; j++) {
+		i = (g_dhtNext + j) % PLATFORM_GPIO_MAX;
+		dht = g_dhts[i];
+		if (dht == 0)
+			continue;
+		if (dht->_lastreadtime != 0 && now - dht->_lastreadtime < DHT_MIN_INTERVAL)
+			continue;
+		g_dhtNext = i + 1;
+		return dht;
+	}
+	return 0;
+}
 
 void DHT_OnPinsConfigChanged() {
 	int i;
@@ -55,10 +289,7 @@ void DHT_OnPinsConfigChanged() {
 	if (g_dhtsCount == 0) {
 		if (g_dhts) {
 			for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
-				if (g_dhts[i]) {
-					free(g_dhts[i]);
-					g_dhts[i] = 0;
-				}
+				DHT_Free(i);
 			}
 			free(g_dhts);
 			g_dhts = 0;
@@ -77,14 +308,12 @@ void DHT_OnPinsConfigChanged() {
 			}
 		}
 		else {
-			if (g_dhts[i] != 0) {
-				free(g_dhts[i]);
-				g_dhts[i] = 0;
-			}
+			DHT_Free(i);
 		}
 	}
 }
 void DHT_OnEverySecond() {
+	dht_t *dht;
 	int i;
 
 	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
@@ -92,25 +321,41 @@ void DHT_OnEverySecond() {
 			if (g_dhts[i] == 0) {
 				g_dhts[i] = DHT_Create(i, translateDHTType(g_cfg.pins.roles[i]));
 			}
-			if (g_dhts[i]) {
-				float temp, humid;
-
-				humid = DHT_readHumidity(g_dhts[i], false);
-				temp = DHT_readTemperature(g_dhts[i], false, false);
-
-				if (g_dhts[i]->_lastresult != 0) {
-					// don't want to loose accuracy, so multiply by 10
-					// We have a channel types to handle that
-					CHANNEL_Set(g_cfg.pins.channels[i], (int)(temp * 10), 0);
-					CHANNEL_Set(g_cfg.pins.channels2[i], (int)(humid), 0);
-				}
-			}
 		}
 		else {
-			if (g_dhts[i] != 0) {
-				free(g_dhts[i]);
-				g_dhts[i] = 0;
-			}
+			DHT_Free(i);
+		}
+	}
+	// previous read is still running
+	if (g_dhtActive)
+		return;
+	dht = DHT_FindNextDue();
+	if (dht == 0)
+		return;
+#if DHT_EDGE_CAPTURE
+	DHT_StartRead(dht);
+#else
+	if (DHT_read(dht, true)) {
+		DHT_PublishResult(dht);
+	}
+#endif
+}
+void DHT_OnQuickTick() {
+	dht_t *dht = g_dhtActive;
+	int elapsed;
+
+	if (dht == 0)
+		return;
+	// quick tick is not in phase with state changes, so measure from state start
+	elapsed = DHT_GetMillis() - dht->stateStart;
+	if (dht->state == DHT_STATE_START) {
+		if (elapsed >= DHT_START_PULSE_MS) {
+			DHT_Release(dht);
+		}
+	}
+	else if (dht->state == DHT_STATE_RECEIVING) {
+		if (elapsed >= DHT_RECEIVE_MS) {
+			DHT_FinishRead(dht);
 		}
 	}
 }
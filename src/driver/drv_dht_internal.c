@@ -128,44 +128,56 @@ dht_t *DHT_Create(byte pin, byte type) {
  *	@return Temperature value in selected scale
  */
 float DHT_readTemperature(dht_t *dht, bool S, bool force) {
+	if (DHT_read(dht,force)) {
+		return DHT_convertTemperature(dht, S);
+	}
+	return 0;
+}
+/*!
+ *  @brief  Convert temperature from last received data
+ *  @param  S
+ *          Scale. Boolean value:
+ *					- true = Fahrenheit
+ *					- false = Celcius
+ *	@return Temperature value in selected scale
+ */
+float DHT_convertTemperature(dht_t *dht, bool S) {
 	float f = 0;
 	byte *data;
 	data = dht->data;
 
-	if (DHT_read(dht,force)) {
-		switch (dht->_type) {
-		case DHT11:
-			f = data[2];
-			if (data[3] & 0x80) {
-				f = -1 - f;
-			}
-			f += (data[3] & 0x0f) * 0.1;
-			if (S) {
-				f = convertCtoF(f);
-			}
-			break;
-		case DHT12:
-			f = data[2];
-			f += (data[3] & 0x0f) * 0.1;
-			if (data[2] & 0x80) {
-				f *= -1;
-			}
-			if (S) {
-				f = convertCtoF(f);
-			}
-			break;
-		case DHT22:
-		case DHT21:
-			f = ((unsigned short)(data[2] & 0x7F)) << 8 | data[3];
-			f *= 0.1;
-			if (data[2] & 0x80) {
-				f *= -1;
-			}
-			if (S) {
-				f = convertCtoF(f);
-			}
-			break;
+	switch (dht->_type) {
+	case DHT11:
+		f = data[2];
+		if (data[3] & 0x80) {
+			f = -1 - f;
+		}
+		f += (data[3] & 0x0f) * 0.1;
+		if (S) {
+			f = convertCtoF(f);
+		}
+		break;
+	case DHT12:
+		f = data[2];
+		f += (data[3] & 0x0f) * 0.1;
+		if (data[2] & 0x80) {
+			f *= -1;
+		}
+		if (S) {
+			f = convertCtoF(f);
+		}
+		break;
+	case DHT22:
+	case DHT21:
+		f = ((unsigned short)(data[2] & 0x7F)) << 8 | data[3];
+		f *= 0.1;
+		if (data[2] & 0x80) {
+			f *= -1;
 		}
+		if (S) {
+			f = convertCtoF(f);
+		}
+		break;
 	}
 	return f;
 }
@@ -195,19 +207,28 @@ void DHT_begin(dht_t *dht, uint8_t usec) {
  *	@return float value - humidity in percent
  */
 float DHT_readHumidity(dht_t *dht, bool force) {
-	float f = 0;
 	if (DHT_read(dht, force)) {
-		switch (dht->_type) {
-		case DHT11:
-		case DHT12:
-			f = dht->data[0] + dht->data[1] * 0.1;
-			break;
-		case DHT22:
-		case DHT21:
-			f = ((unsigned short)dht->data[0]) << 8 | dht->data[1];
-			f *= 0.1;
-			break;
-		}
+		return DHT_convertHumidity(dht);
+	}
+	return 0;
+}
+/*!
+ *  @brief  Convert humidity from last received data
+ *	@return float value - humidity in percent
+ */
+float DHT_convertHumidity(dht_t *dht) {
+	float f = 0;
+
+	switch (dht->_type) {
+	case DHT11:
+	case DHT12:
+		f = dht->data[0] + dht->data[1] * 0.1;
+		break;
+	case DHT22:
+	case DHT21:
+		f = ((unsigned short)dht->data[0]) << 8 | dht->data[1];
+		f *= 0.1;
+		break;
 	}
 	return f;
 }
@@ -439,5 +460,31 @@ uint32_t DHT_expectPulse(dht_t *dht, bool level) {
 	}
 	return count;
 }
+// Same rule as above, but the whole bit period is measured from one falling edge to the next,
+// so edges can be timestamped by interrupt while the rest of the system keeps running.
+// The answer is at the end of capture, anything before it (noise on line release,
+// response edge) is skipped.
+int DHT_DecodeEdges(const uint32_t *edgesUs, int count, byte *data) {
+	int i, start;
+	uint32_t period;
 
-
+	data[0] = data[1] = data[2] = data[3] = data[4] = 0;
+	if (count < DHT_EDGES_PER_READ - 1) {
+		return DHT_DECODE_TOO_FEW_EDGES;
+	}
+	start = count - (DHT_EDGES_PER_READ - 1);
+	for (i = 0; i < 40; i++) {
+		period = edgesUs[start + i + 1] - edgesUs[start + i];
+		if (period < DHT_BIT_MIN_US || period > DHT_BIT_MAX_US) {
+			return DHT_DECODE_BAD_PULSE;
+		}
+		data[i / 8] <<= 1;
+		if (period > DHT_BIT_ONE_US) {
+			data[i / 8] |= 1;
+		}
+	}
+	if (data[4] != ((data[0] + data[1] + data[2] + data[3]) & 0xFF)) {
+		return DHT_DECODE_CHECKSUM;
+	}
+	return DHT_DECODE_OK;
+}
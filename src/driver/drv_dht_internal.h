@@ -5,16 +5,55 @@
 #define DHT22 22
 #define AM2301 21
 
-typedef struct dht_s { 
+// Sensor answers with falling edge, 80us low, 80us high, then every bit is
+// 50us low followed by 26-28us (0) or 70us (1) high, then final 50us low.
+// Only falling edges are captured: response, 40 bit starts and the end one.
+#define DHT_EDGES_PER_READ		42
+#define DHT_MAX_EDGES			48
+// falling edge to falling edge, 0 is ~78us, 1 is ~120us
+#define DHT_BIT_MIN_US			50
+#define DHT_BIT_ONE_US			100
+#define DHT_BIT_MAX_US			150
+
+enum {
+	DHT_DECODE_OK,
+	DHT_DECODE_TOO_FEW_EDGES,
+	DHT_DECODE_BAD_PULSE,
+	DHT_DECODE_CHECKSUM,
+};
+
+enum {
+	DHT_STATE_IDLE,
+	// line is held low by us
+	DHT_STATE_START,
+	// line released, falling edges are being captured
+	DHT_STATE_RECEIVING,
+};
+
+typedef struct dht_s {
 	byte data[5];
 	byte _pin, _type;
 	uint32_t _lastreadtime, _maxcycles;
 	bool _lastresult;
 	uint8_t pullTime; // Time (in usec) to pull up data line before reading
 
+	// non-blocking read, see drv_dht.c
+	byte state;
+	// rtos_get_time() when current state was entered
+	uint32_t stateStart;
+	// written by edge ISR
+	uint32_t edges[DHT_MAX_EDGES];
+	volatile int edgeCount;
 } dht_t;
 
 dht_t *DHT_Create(byte pin, byte type);
 float DHT_readHumidity(dht_t *dht, bool force);
 float DHT_readTemperature(dht_t *dht, bool S, bool force);
-
+// blocking read, with interrupts disabled for ~5ms
+bool DHT_read(dht_t *dht, bool force);
+void usleep2(int r);
+// only convert what is already in data
+float DHT_convertHumidity(dht_t *dht);
+float DHT_convertTemperature(dht_t *dht, bool S);
+// Falling edge timestamps (us) into 40 bits. Extra edges before the answer are skipped.
+int DHT_DecodeEdges(const uint32_t *edgesUs, int count, byte *data);
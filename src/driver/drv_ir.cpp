@@ -40,6 +40,7 @@ extern "C" {
 }
 
 #include "drv_ir.h"
+#include "drv_ir_capture.h"
 
 //#define USE_IRREMOTE_HPP_AS_PLAIN_INCLUDE 1
 #undef read
@@ -131,6 +132,68 @@ extern "C" void DRV_IR_ISR(UINT8 t);
 static UINT32 ir_chan = BKTIMER0;
 static UINT32 ir_div = 1;
 static UINT32 ir_periodus = 50;
+static bool ir_timer_running = false;
+
+// Timestamps for received edges.
+// If SDK can read timer counter, they come from a free running timer,
+// so the 50us timer is needed only for sending.
+// Otherwise they come from the 50us tick, and it has to run while receiver is enabled.
+#if defined(CMD_TIMER_READ_CNT)
+#define IR_HAS_FREE_RUNNING_CLOCK 1
+static UINT32 ir_clock_chan = BKTIMER1;
+static volatile UINT32 ir_clock_seconds = 0;
+// last read, to notice counter wrap whose interrupt has not run yet
+static UINT32 ir_clock_lastSeconds = 0;
+static UINT32 ir_clock_lastCnt = 0;
+static bool ir_clock_wrapPending = false;
+// timers 0-2 count 26MHz clock
+#define IR_CLOCK_TICKS_PER_US 26
+
+static void IR_ClockISR(UINT8 t) {
+    ir_clock_seconds++;
+}
+static void IR_StartClock() {
+    timer_param_t params = {
+        (unsigned char) ir_clock_chan,
+        (unsigned char) ir_div,
+        1000000, // us
+        IR_ClockISR
+    };
+    sddev_control((char *)TIMER_DEV_NAME, CMD_TIMER_INIT_PARAM_US, &params);
+    sddev_control((char *)TIMER_DEV_NAME, CMD_TIMER_UNIT_ENABLE, &ir_clock_chan);
+}
+// Called from edge ISR too. There the clock interrupt cannot run, so counter
+// may already have wrapped while ir_clock_seconds is not incremented yet.
+// Counter going back within the same second means just that.
+static unsigned int IR_GetMicros() {
+    UINT32 seconds, cnt;
+    GLOBAL_INT_DECLARATION();
+
+    GLOBAL_INT_DISABLE();
+    seconds = ir_clock_seconds;
+    cnt = ir_clock_chan;
+    sddev_control((char *)TIMER_DEV_NAME, CMD_TIMER_READ_CNT, &cnt);
+    if (seconds != ir_clock_lastSeconds) {
+        ir_clock_wrapPending = false;
+    } else if (cnt < ir_clock_lastCnt) {
+        ir_clock_wrapPending = true;
+    }
+    ir_clock_lastSeconds = seconds;
+    ir_clock_lastCnt = cnt;
+    if (ir_clock_wrapPending) {
+        seconds++;
+    }
+    GLOBAL_INT_RESTORE();
+    return seconds * 1000000 + cnt / IR_CLOCK_TICKS_PER_US;
+}
+#else
+#define IR_HAS_FREE_RUNNING_CLOCK 0
+static void IR_StartClock() {
+}
+static unsigned int IR_GetMicros() {
+    return ir_counter * 50;
+}
+#endif
 
 void timerConfigForReceive(){
     // nothing here`
@@ -182,12 +245,14 @@ static void timer_disable(){
 static void _timer_enable(){
     UINT32 res;
     res = sddev_control((char *)TIMER_DEV_NAME, CMD_TIMER_UNIT_ENABLE, &ir_chan);
-	ADDLOG_INFO(LOG_FEATURE_IR, (char *)"ir timer enabled %u", res);
+    ir_timer_running = true;
+	ADDLOG_DEBUG(LOG_FEATURE_IR, (char *)"ir timer enabled %u", res);
 }
 static void _timer_disable(){
     UINT32 res;
     res = sddev_control((char *)TIMER_DEV_NAME, CMD_TIMER_UNIT_DISABLE, &ir_chan);
-	ADDLOG_INFO(LOG_FEATURE_IR, (char *)"ir timer disabled %u", res);
+    ir_timer_running = false;
+	ADDLOG_DEBUG(LOG_FEATURE_IR, (char *)"ir timer disabled %u", res);
 }
 
 #define TIMER_ENABLE_RECEIVE_INTR timer_enable();
@@ -344,6 +409,9 @@ class myIRsend : public IRsend {
 // our send/receive instances
 myIRsend *pIRsend = NULL;
 IRrecv *ourReceiver = NULL;
+static int ir_rxpin = -1;
+// set by timer ISR while there is something to send
+static volatile int ir_sending = 0;
 
 // this is our ISR.
 // it is called every 50us, so we need to work on making it as efficient as possible.
@@ -406,16 +474,26 @@ extern "C" void DRV_IR_ISR(UINT8 t){
 #endif
     }
 
-    // is someone really wants rx and TX at the same time, then allow it.
-    if (gEnableIRSendWhilstReceive){
-        sending = 0;
-    }
+    ir_sending = sending;
+    ir_counter++;
+}
 
+// Receive pin edge interrupt.
+// It only notes how long the line was in previous state, decoding is done in DRV_IR_RunFrame.
+extern "C" void DRV_IR_EdgeISR(unsigned char index){
+    int level = bk_gpio_input((GPIO_INDEX)index);
+
+    // is someone really wants rx and TX at the same time, then allow it.
     // don't receive if we are currently sending
-    if (ourReceiver && !sending){
-        IR_ISR();
+    if (!ir_sending || gEnableIRSendWhilstReceive){
+        IRCapture_OnEdge(IR_GetMicros(), level == INPUT_MARK);
+    }
+    // BK GPIO interrupt triggers on one edge only, so wait for the opposite one now
+    if (level == 0){
+        gpio_int_enable(index, IRQ_TRIGGER_RISING_EDGE, DRV_IR_EdgeISR);
+    } else {
+        gpio_int_enable(index, IRQ_TRIGGER_FALLING_EDGE, DRV_IR_EdgeISR);
     }
-    ir_counter++;
 }
 
 extern "C" commandResult_t IR_Send_Cmd(const void *context, const char *cmd, const char *args_in, int cmdFlags) {
@@ -475,6 +553,10 @@ extern "C" commandResult_t IR_Send_Cmd(const void *context, const char *cmd, con
         // add a 100ms delay after command
         // NOTE: this is NOT a delay here.  it adds 100ms 'space' in the TX queue
         pIRsend->delay(100);
+        // timer is needed only while there is something to send
+        if (!ir_timer_running){
+            _timer_enable();
+        }
         ADDLOG_INFO(LOG_FEATURE_IR, (char *)"IR send %s protocol %d addr 0x%X cmd 0x%X repeats %d", args, (int)data.protocol, (int)data.address, (int)data.command, (int)repeats);
         return CMD_RES_OK;
     } else {
@@ -576,16 +658,17 @@ extern "C" void DRV_IR_Init(){
 	pin = PIN_FindPinIndexForRole(IOR_IRRecv,pin);
 	txpin = PIN_FindPinIndexForRole(IOR_IRSend,txpin);
 
+    if (ir_rxpin >= 0){
+        gpio_int_disable(ir_rxpin);
+        ir_rxpin = -1;
+    }
     if (ourReceiver){
         IRrecv *temp = ourReceiver;
         ourReceiver = NULL;
         delete temp;
     }
 	ADDLOG_INFO(LOG_FEATURE_IR, (char *)"DRV_IR_Init: recv pin %i",pin);
-    if ((pin > 0) || (txpin > 0)){
-    } else {
-        _timer_disable();
-    }
+    _timer_disable();
 
 
     if (pin > 0){
@@ -594,6 +677,12 @@ extern "C" void DRV_IR_Init(){
 
         ourReceiver = new IRrecv(pin);
         ourReceiver->start();
+
+        IR_StartClock();
+        IRCapture_Reset(IR_GetMicros());
+        ir_rxpin = pin;
+        // first edge is the one that starts a mark
+        gpio_int_enable(pin, (INPUT_MARK == 0) ? IRQ_TRIGGER_FALLING_EDGE : IRQ_TRIGGER_RISING_EDGE, DRV_IR_EdgeISR);
     }
 
     if (pIRsend){
@@ -639,9 +728,13 @@ extern "C" void DRV_IR_Init(){
         }
     }
     if ((pin > 0) || (txpin > 0)){
-        // both tx and rx need the interrupt
         _timerConfigForReceive();
-        _timer_enable();
+        // sending starts the timer when needed, receiving needs it only for timestamps
+        if ((pin > 0) && !IR_HAS_FREE_RUNNING_CLOCK){
+            _timer_enable();
+        } else {
+            _timer_disable();
+        }
     }
 }
 
@@ -712,9 +805,32 @@ void PrintIRData(IRData *aIRDataPtr){
 }
 
 
+// Puts next captured frame where IRremote decoders expect it, as if its own ISR recorded it.
+static bool DRV_IR_NextFrame(){
+    irFrame_t *frame = IRCapture_PeekFrame();
+    if (frame == NULL){
+        return false;
+    }
+    for (int i = 0; i < frame->len; i++){
+        irparams.rawbuf[i] = frame->ticks[i];
+    }
+    irparams.rawlen = frame->len;
+    irparams.OverflowFlag = frame->bOverflow;
+    irparams.StateForISR = IR_REC_STATE_STOP;
+    IRCapture_PopFrame();
+    return true;
+}
+
+static bool DRV_IR_IsSendIdle(){
+    return pIRsend == NULL || (pIRsend->timein == pIRsend->timeout && pIRsend->currentsendtime == 0);
+}
+
 ////////////////////////////////////////////////////
 // this polls the IR receive to see off there was any IR received
 extern "C" void DRV_IR_RunFrame(){
+    static int lastDroppedEdges = 0;
+    static int lastDroppedFrames = 0;
+
 	// Debug-only check to see if the timer interrupt is running
     if (ir_counter){
         //ADDLOG_INFO(LOG_FEATURE_IR, (char *)"IR counter: %u", ir_counter);
@@ -727,8 +843,25 @@ extern "C" void DRV_IR_RunFrame(){
             //ADDLOG_INFO(LOG_FEATURE_IR, (char *)"IR send count %d remains %d currentus %d", (int)pIRsend->timecounttotal, (int)pIRsend->timecount, (int)pIRsend->currentsendtime);
         }
     }
+    // stop the 50us timer when there is nothing more to send, unless receiver needs its ticks
+    if (ir_timer_running && DRV_IR_IsSendIdle() && (IR_HAS_FREE_RUNNING_CLOCK || ourReceiver == NULL)){
+        _timer_disable();
+        // IRSend may have been called in the meantime
+        if (!DRV_IR_IsSendIdle()){
+            _timer_enable();
+        }
+    }
 
     if (ourReceiver){
+        IRCapture_Process(IR_GetMicros());
+        if (IRCapture_GetDroppedEdges() != lastDroppedEdges || IRCapture_GetDroppedFrames() != lastDroppedFrames){
+            lastDroppedEdges = IRCapture_GetDroppedEdges();
+            lastDroppedFrames = IRCapture_GetDroppedFrames();
+            ADDLOG_INFO(LOG_FEATURE_IR, (char *)"IR receive dropped %d edges, %d frames so far", lastDroppedEdges, lastDroppedFrames);
+        }
+    }
+    // decode every frame captured since last call, not only the first one
+    while (ourReceiver && DRV_IR_NextFrame()){
         if (ourReceiver->decode()) {
 			const char *name = ProtocolNames[ourReceiver->decodedIRData.protocol];
             if (!(gIRProtocolEnable & (1 << (int)ourReceiver->decodedIRData.protocol))){
@@ -770,9 +903,9 @@ extern "C" void DRV_IR_RunFrame(){
                     if (publishrepeats || !repeat){
         				//ADDLOG_INFO(LOG_FEATURE_IR, (char *)"IR MQTT publish %s", out);
 
-                        uint32_t counter_in = ir_counter;
+                        uint32_t counter_in = IR_GetMicros();
                         MQTT_PublishMain_StringString("ir",out, 0);
-                        uint32_t counter_dur = ((ir_counter - counter_in)*50)/1000;
+                        uint32_t counter_dur = (IR_GetMicros() - counter_in)/1000;
         				ADDLOG_INFO(LOG_FEATURE_IR, (char *)"IR MQTT publish %s took %dms", out, counter_dur);
                     } else {
                         ADDLOG_INFO(LOG_FEATURE_IR, (char *)"IR %s", out);
@@ -818,9 +951,9 @@ extern "C" void DRV_IR_RunFrame(){
 
                     // we should include repeat here?
                     // e.g. on/off button should not toggle on repeats, but up/down probably should eat them.
-                    uint32_t counter_in = ir_counter;
+                    uint32_t counter_in = IR_GetMicros();
 					EventHandlers_FireEvent2(tgType,ourReceiver->decodedIRData.address,ourReceiver->decodedIRData.command);
-                    uint32_t counter_dur = ((ir_counter - counter_in)*50)/1000;
+                    uint32_t counter_dur = (IR_GetMicros() - counter_in)/1000;
       				ADDLOG_DEBUG(LOG_FEATURE_IR, (char *)"IR fire event took %dms", counter_dur);
 				}
 			}
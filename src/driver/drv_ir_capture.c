@@ -0,0 +1,191 @@
+#include "drv_ir_capture.h"
+
+// Ring entry: how long line was in state that has just ended.
+// Top bit is set for mark, next one tells that edges were lost just before this one.
+#define IRCAPTURE_ENTRY_MARK		0x80000000
+#define IRCAPTURE_ENTRY_LOST		0x40000000
+#define IRCAPTURE_ENTRY_DURATION	0x3FFFFFFF
+
+// written by ISR only
+static volatile unsigned int g_irRing[IRCAPTURE_RING_SIZE];
+static volatile unsigned int g_irRingHead;
+static volatile unsigned int g_irLastEdgeUs;
+static volatile bool g_irLastMark;
+static volatile bool g_irRingLost;
+static volatile int g_irDroppedEdges;
+// written by task only
+static volatile unsigned int g_irRingTail;
+
+// frame assembly, task only
+static irFrame_t g_irFrames[IRCAPTURE_MAX_FRAMES];
+static int g_irFirstFrame;
+static int g_irFrameCount;
+static int g_irDroppedFrames;
+// frame being built, NULL when line is idle
+static irFrame_t *g_irFrame;
+// frame is being received, but there was no room for it
+static bool g_irDiscarding;
+// how long line has been idle
+static unsigned int g_irIdleUs;
+
+void IRCapture_Reset(unsigned int nowUs) {
+	g_irRingHead = 0;
+	g_irRingTail = 0;
+	g_irLastEdgeUs = nowUs;
+	g_irLastMark = false;
+	g_irRingLost = false;
+	g_irDroppedEdges = 0;
+	g_irFirstFrame = 0;
+	g_irFrameCount = 0;
+	g_irDroppedFrames = 0;
+	g_irFrame = 0;
+	g_irDiscarding = false;
+	g_irIdleUs = 0;
+}
+void IRCapture_OnEdge(unsigned int nowUs, bool bMark) {
+	unsigned int d;
+
+	// missed edge, line is still in the same state
+	if (bMark == g_irLastMark)
+		return;
+	if (g_irRingHead - g_irRingTail >= IRCAPTURE_RING_SIZE) {
+		g_irRingLost = true;
+		g_irDroppedEdges++;
+	}
+	else {
+		d = nowUs - g_irLastEdgeUs;
+		if (d > IRCAPTURE_ENTRY_DURATION)
+			d = IRCAPTURE_ENTRY_DURATION;
+		if (g_irLastMark)
+			d |= IRCAPTURE_ENTRY_MARK;
+		if (g_irRingLost) {
+			d |= IRCAPTURE_ENTRY_LOST;
+			g_irRingLost = false;
+		}
+		g_irRing[g_irRingHead & (IRCAPTURE_RING_SIZE - 1)] = d;
+		g_irRingHead++;
+	}
+	g_irLastEdgeUs = nowUs;
+	g_irLastMark = bMark;
+}
+static unsigned short IRCapture_ToTicks(unsigned int us) {
+	us = (us + IRCAPTURE_MICROS_PER_TICK / 2) / IRCAPTURE_MICROS_PER_TICK;
+	if (us > 0xFFFF)
+		return 0xFFFF;
+	return us;
+}
+static void IRCapture_EndFrame(bool bOverflow) {
+	if (g_irFrame) {
+		if (bOverflow)
+			g_irFrame->bOverflow = true;
+		g_irFrameCount++;
+		g_irFrame = 0;
+	}
+	g_irDiscarding = false;
+	g_irIdleUs = 0;
+}
+static void IRCapture_BeginFrame() {
+	if (g_irFrameCount >= IRCAPTURE_MAX_FRAMES) {
+		// keep older frames, they were first
+		g_irDroppedFrames++;
+		g_irDiscarding = true;
+		return;
+	}
+	g_irFrame = &g_irFrames[(g_irFirstFrame + g_irFrameCount) % IRCAPTURE_MAX_FRAMES];
+	g_irFrame->ticks[0] = IRCapture_ToTicks(g_irIdleUs);
+	g_irFrame->len = 1;
+	g_irFrame->bOverflow = false;
+}
+static void IRCapture_Append(unsigned int us) {
+	if (g_irFrame == 0)
+		return;
+	if (g_irFrame->len >= IRCAPTURE_FRAME_LENGTH) {
+		// rest of this transmission is skipped, next frame starts after a gap
+		IRCapture_EndFrame(true);
+		return;
+	}
+	g_irFrame->ticks[g_irFrame->len++] = IRCapture_ToTicks(us);
+}
+static void IRCapture_Feed(unsigned int entry) {
+	unsigned int us = entry & IRCAPTURE_ENTRY_DURATION;
+	bool bInFrame = g_irFrame || g_irDiscarding;
+
+	if (entry & IRCAPTURE_ENTRY_LOST) {
+		// mark/space order can't be trusted anymore
+		if (bInFrame)
+			IRCapture_EndFrame(true);
+		g_irIdleUs = 0;
+		bInFrame = false;
+	}
+	if (entry & IRCAPTURE_ENTRY_MARK) {
+		if (bInFrame) {
+			IRCapture_Append(us);
+			return;
+		}
+		// like IRremote, frame starts only after a long enough gap,
+		// otherwise it's the middle of transmission that began before we were listening
+		if (g_irIdleUs > IRCAPTURE_GAP_US) {
+			IRCapture_BeginFrame();
+			IRCapture_Append(us);
+		}
+		else {
+			g_irIdleUs = 0;
+		}
+		return;
+	}
+	if (bInFrame) {
+		if (us > IRCAPTURE_GAP_US) {
+			IRCapture_EndFrame(false);
+			g_irIdleUs = us;
+		}
+		else {
+			IRCapture_Append(us);
+		}
+		return;
+	}
+	g_irIdleUs += us;
+	if (g_irIdleUs > IRCAPTURE_ENTRY_DURATION)
+		g_irIdleUs = IRCAPTURE_ENTRY_DURATION;
+}
+void IRCapture_Process(unsigned int nowUs) {
+	unsigned int head, lastEdgeUs;
+	bool bLastMark;
+
+	head = g_irRingHead;
+	while (g_irRingTail != head) {
+		IRCapture_Feed(g_irRing[g_irRingTail & (IRCAPTURE_RING_SIZE - 1)]);
+		g_irRingTail++;
+	}
+	// edges are being lost right now, frame can't be complete
+	if (g_irRingLost && g_irFrame)
+		g_irFrame->bOverflow = true;
+	if (g_irFrame == 0 && !g_irDiscarding)
+		return;
+	// Last space of a frame is ended only by the next edge, so frame is closed when line
+	// has been idle for long enough. If an edge came while we were here, wait for next call.
+	lastEdgeUs = g_irLastEdgeUs;
+	bLastMark = g_irLastMark;
+	if (head != g_irRingHead)
+		return;
+	if (!bLastMark && nowUs - lastEdgeUs > IRCAPTURE_GAP_US) {
+		// the space will come as a whole with next edge and it will be counted as idle time
+		IRCapture_EndFrame(false);
+	}
+}
+irFrame_t *IRCapture_PeekFrame() {
+	if (g_irFrameCount == 0)
+		return 0;
+	return &g_irFrames[g_irFirstFrame];
+}
+void IRCapture_PopFrame() {
+	if (g_irFrameCount == 0)
+		return;
+	g_irFirstFrame = (g_irFirstFrame + 1) % IRCAPTURE_MAX_FRAMES;
+	g_irFrameCount--;
+}
+int IRCapture_GetDroppedEdges() {
+	return g_irDroppedEdges;
+}
+int IRCapture_GetDroppedFrames() {
+	return g_irDroppedFrames;
+}
@@ -0,0 +1,50 @@
+#ifndef __DRV_IR_CAPTURE_H__
+#define __DRV_IR_CAPTURE_H__
+
+#include "../new_common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// IR receive, split in two halves.
+// Edge interrupt only stores how long the line was in previous state (IRCapture_OnEdge),
+// into a lock-free single producer/single consumer ring.
+// IRCapture_Process runs at task level and cuts durations into frames,
+// in the same format as IRremote rawbuf, so decoding can be done later, frame by frame.
+// Nothing here touches hardware, so it can be fed with recorded timings.
+
+// must be power of two
+#define IRCAPTURE_RING_SIZE			256
+#define IRCAPTURE_MAX_FRAMES		4
+// same as RAW_BUFFER_LENGTH of IRremote
+#define IRCAPTURE_FRAME_LENGTH		100
+// space longer than that ends a frame, same as RECORD_GAP_MICROS of IRremote
+#define IRCAPTURE_GAP_US			5000
+#define IRCAPTURE_MICROS_PER_TICK	50
+
+typedef struct irFrame_s {
+	// [0] is gap before frame, then mark, space, mark ... and it always ends with mark.
+	// Values are in IRCAPTURE_MICROS_PER_TICK ticks.
+	unsigned short ticks[IRCAPTURE_FRAME_LENGTH];
+	unsigned short len;
+	// frame didn't fit, or some of its edges were lost
+	bool bOverflow;
+} irFrame_t;
+
+void IRCapture_Reset(unsigned int nowUs);
+// ISR. bMark tells in what state line is after the edge
+void IRCapture_OnEdge(unsigned int nowUs, bool bMark);
+// Task. Moves edges from ring into frames and closes frame that has timed out
+void IRCapture_Process(unsigned int nowUs);
+// oldest complete frame or NULL
+irFrame_t *IRCapture_PeekFrame();
+void IRCapture_PopFrame();
+int IRCapture_GetDroppedEdges();
+int IRCapture_GetDroppedFrames();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -2,6 +2,7 @@
 
 #include "../httpserver/new_http.h"
 #include "../cmnds/cmd_public.h"
+#include "drv_bitbang.h"
 
 void DRV_DGR_Init();
 void DRV_DGR_RunQuickTick();
@@ -65,17 +66,15 @@ void DRV_HTTPButtons_AddToHtmlPage(http_request_t* request);
 void DRV_InitHTTPButtons();
 
 void CHT8305_Init();
-void CHT8305_OnEverySecond();
+void CHT8305_StopDriver();
 void CHT8305_AppendInformationToHTTPIndexPage(http_request_t* request);
 
 void SHT3X_Init();
 void SHT3X_AppendInformationToHTTPIndexPage(http_request_t* request);
-void SHT3X_OnEverySecond();
 void SHT3X_StopDriver();
 
 void SGP_Init();
 void SGP_AppendInformationToHTTPIndexPage(http_request_t* request);
-void SGP_OnEverySecond();
 void SGP_StopDriver();
 
 void Batt_Init();
@@ -93,6 +92,12 @@ void WEMO_Init();
 void WEMO_AppendInformationToHTTPIndexPage(http_request_t* request);
 
 #define SM2135_DELAY         4
+// used when softI2C_t speedKHz is 0
+#define SOFT_I2C_DEFAULT_KHZ	100
+// LED drivers only write and are fine with fast mode, old NOP delay gave roughly 250kHz
+#define SOFT_I2C_LED_KHZ		400
+// how long to wait for slave holding SCL low, in reads of SCL
+#define SOFT_I2C_STRETCH_READS	1000
 
 // Software I2C 
 typedef struct softI2C_s {
@@ -100,6 +105,13 @@ typedef struct softI2C_s {
 	short pin_data;
 	// I really have to place it here for a GN6932 driver, which is an SPI version of TM1637
 	short pin_stb;
+	// bus speed, 0 means SOFT_I2C_DEFAULT_KHZ
+	short speedKHz;
+	// set up on first use and whenever pins or speed change, see Soft_I2C_Prepare
+	bbPin_t clk, data;
+	short preparedKHz;
+	bool bPrepared;
+	int halfLoops;
 } softI2C_t;
 
 void Soft_I2C_SetLow(uint8_t pin);
@@ -110,11 +122,16 @@ bool Soft_I2C_Start(softI2C_t* i2c, uint8_t addr);
 void Soft_I2C_Stop(softI2C_t* i2c);
 uint8_t Soft_I2C_ReadByte(softI2C_t* i2c, bool nack);
 void Soft_I2C_ReadBytes(softI2C_t* i2c, uint8_t* buf, int numOfBytes);
+// Whole transaction: write tx, then repeated start and read rx. addr is the first byte
+// as sent on bus (7 bit address << 1), either part may be empty. Returns true if every byte was ACKed.
+bool Soft_I2C_Transfer(softI2C_t* i2c, uint8_t addr, const uint8_t* tx, int txLen, uint8_t* rx, int rxLen);
 
 // Shared LED driver
 commandResult_t CMD_LEDDriver_Map(const void* context, const char* cmd, const char* args, int flags);
 commandResult_t CMD_LEDDriver_WriteRGBCW(const void* context, const char* cmd, const char* args, int flags);
 void LED_I2CDriver_WriteRGBCW(float* finalRGBCW);
+// called by LED driver init, applies speed set by LED_I2CSpeed
+void LED_I2CDriver_SetupBus(softI2C_t* i2c);
 
 /* Bridge driver *********************************************/
 void Bridge_driver_Init();
@@ -8,10 +8,12 @@
 #include "drv_local.h"
 #include "drv_ntp.h"
 #include "drv_public.h"
+#include "drv_sensor_sched.h"
 #include "drv_ssdp.h"
 #include "drv_test_drivers.h"
 #include "drv_tuyaMCU.h"
 #include "drv_uart.h"
+#include "../quicktick.h"
 
 const char* sensor_mqttNames[OBK_NUM_MEASUREMENTS] = {
 	"voltage",
@@ -107,7 +109,7 @@ static driver_t g_drivers[] = {
 	//drvdetail:"title":"TODO",
 	//drvdetail:"descr":"Generic I2C, not used for LED drivers, but may be useful for displays or port expanders. Supports both hardware and software I2C.",
 	//drvdetail:"requires":""}
-	{ "I2C",		DRV_I2C_Init,		DRV_I2C_EverySecond,		NULL, NULL, NULL, NULL, false },
+	{ "I2C",		DRV_I2C_Init,		DRV_I2C_EverySecond,		NULL, DRV_I2C_RunQuickTick, DRV_I2C_Shutdown, NULL, false },
 #endif
 #ifdef ENABLE_DRIVER_BL0942
 	//drvdetail:{"name":"BL0942",
@@ -220,7 +222,7 @@ static driver_t g_drivers[] = {
 	//drvdetail:"title":"TODO",
 	//drvdetail:"descr":"CHT8305 is a Temperature and Humidity sensor with I2C interface.",
 	//drvdetail:"requires":""}
-	{ "CHT8305",	CHT8305_Init,		CHT8305_OnEverySecond,		CHT8305_AppendInformationToHTTPIndexPage, NULL, NULL, NULL, false },
+	{ "CHT8305",	CHT8305_Init,		NULL,		CHT8305_AppendInformationToHTTPIndexPage, NULL, CHT8305_StopDriver, NULL, false },
 	//drvdetail:{"name":"KP18068",
 	//drvdetail:"title":"TODO",
 	//drvdetail:"descr":"KP18068 I2C LED driver",
@@ -245,12 +247,12 @@ static driver_t g_drivers[] = {
 	//drvdetail:"title":"TODO",
 	//drvdetail:"descr":"Humidity/temperature sensor. See [SHT Sensor tutorial topic here](https://www.elektroda.com/rtvforum/topic3958369.html), also see [this sensor teardown](https://www.elektroda.com/rtvforum/topic3945688.html)",
 	//drvdetail:"requires":""}
-	{ "SHT3X",	    SHT3X_Init,		SHT3X_OnEverySecond,		SHT3X_AppendInformationToHTTPIndexPage, NULL, SHT3X_StopDriver, NULL, false },
+	{ "SHT3X",	    SHT3X_Init,		NULL,		SHT3X_AppendInformationToHTTPIndexPage, NULL, SHT3X_StopDriver, NULL, false },
 	//drvdetail:{"name":"SGP",
 	//drvdetail:"title":"TODO",
 	//drvdetail:"descr":"SGP Air Quality sensor with I2C interface.",
 	//drvdetail:"requires":""}
-	{ "SGP",	    SGP_Init,		SGP_OnEverySecond,		SGP_AppendInformationToHTTPIndexPage, NULL, SGP_StopDriver, NULL, false },
+	{ "SGP",	    SGP_Init,		NULL,		SGP_AppendInformationToHTTPIndexPage, NULL, SGP_StopDriver, NULL, false },
 
 	//drvdetail:{"name":"ShiftRegister",
 	//drvdetail:"title":"TODO",
@@ -336,6 +338,8 @@ void DRV_RunQuickTick() {
 			}
 		}
 	}
+	// I2C sensors of all drivers share one bus slot per tick
+	SensorSched_RunQuickTick();
 	DRV_Mutex_Free();
 }
 void DRV_OnChannelChanged(int channel, int iVal) {
@@ -465,6 +469,7 @@ void DRV_Generic_Init() {
 	//cmddetail:"fn":"DRV_Stop","file":"driver/drv_main.c","requires":"",
 	//cmddetail:"examples":""}
 	CMD_RegisterCommand("stopDriver", DRV_Stop, NULL);
+	SensorSched_Init();
 }
 void DRV_AppendInformationToHTTPIndexPage(http_request_t* request) {
 	int i, j;
@@ -18,6 +18,7 @@ int NTP_GetSecond();
 // for Simulator only, on Windows, for unit testing
 void NTP_SetSimulatedTime(unsigned int timeNow);
 // drv_ntp_events.c
+void NTP_RunEvents(unsigned int newTime, bool bTimeValid);
 int NTP_PrintEventList();
 int NTP_RemoveClockEvent(int id);
 int NTP_ClearEvents();
@@ -16,6 +16,8 @@
 unsigned int ntp_eventsTime = 0;
 
 typedef struct ntpEvent_s {
+	// must be first, next fire time (NTP seconds) in ntp_eventsHeap
+	heapTimer_t timer;
 	byte hour;
 	byte minute;
 	byte second;
@@ -26,37 +28,56 @@ typedef struct ntpEvent_s {
 } ntpEvent_t;
 
 ntpEvent_t *ntp_events = 0;
+// events ordered by next fire time, so every second only the due ones are checked
+static timerHeap_t ntp_eventsHeap;
 
-
-void NTP_RunEventsForSecond(unsigned int runTime) {
-	ntpEvent_t *e;
+// Returns first time >= from when event should fire, or 0 if it never fires
+static unsigned int NTP_GetNextEventTime(ntpEvent_t *e, unsigned int from) {
 	struct tm *ltm;
-
-	// NOTE: on windows, you need _USE_32BIT_TIME_T 
-	ltm = localtime((time_t*)&runTime);
-	
-	if (ltm == 0) {
-		return;
+	time_t day;
+	unsigned int candidate;
+	int d;
+
+	for (d = 0; d < 8; d++) {
+		day = from + d * (24 * 60 * 60);
+		ltm = localtime(&day);
+		if (ltm == 0) {
+			return 0;
+		}
+		if (BIT_CHECK(e->weekDayFlags, ltm->tm_wday) == 0) {
+			continue;
+		}
+		// that day's midnight, plus event time
+		candidate = day - (ltm->tm_hour * 3600 + ltm->tm_min * 60 + ltm->tm_sec);
+		candidate += e->hour * 3600 + e->minute * 60 + e->second;
+		if (candidate >= from) {
+			return candidate;
+		}
 	}
+	return 0;
+}
+static void NTP_ScheduleEvent(ntpEvent_t *e, unsigned int from) {
+	unsigned int next;
 
-	e = ntp_events;
+	next = NTP_GetNextEventTime(e, from);
+	if (next) {
+		TimerHeap_Schedule(&ntp_eventsHeap, &e->timer, next);
+	}
+	else {
+		TimerHeap_Remove(&ntp_eventsHeap, &e->timer);
+	}
+}
+// Used when time changes other way than by running forward
+static void NTP_ScheduleAllEvents(unsigned int from) {
+	ntpEvent_t *e;
 
-	while (e) {
-		if (e->command) {
-			// base check
-			if (e->hour == ltm->tm_hour && e->second == ltm->tm_sec && e->minute == ltm->tm_min) {
-				// weekday check
-				if (BIT_CHECK(e->weekDayFlags, ltm->tm_wday)) {
-					CMD_ExecuteCommand(e->command, 0);
-				}
-			}
-		}
-		e = e->next;
+	for (e = ntp_events; e; e = e->next) {
+		NTP_ScheduleEvent(e, from);
 	}
 }
 void NTP_RunEvents(unsigned int newTime, bool bTimeValid) {
-	unsigned int delta;
-	unsigned int i;
+	unsigned int delta, end;
+	ntpEvent_t *e;
 
 	// new time invalid?
 	if (bTimeValid == false) {
@@ -66,22 +87,29 @@ void NTP_RunEvents(unsigned int newTime, bool bTimeValid) {
 	// old time invalid, but new one ok?
 	if (ntp_eventsTime == 0) {
 		ntp_eventsTime = newTime;
+		NTP_ScheduleAllEvents(newTime);
 		return;
 	}
 	// time went backwards
 	if (newTime < ntp_eventsTime) {
 		ntp_eventsTime = newTime;
+		NTP_ScheduleAllEvents(newTime);
 		return;
 	}
-	if (ntp_events) {
-		// NTP resynchronization could cause us to skip some seconds in some rare cases?
-		delta = newTime - ntp_eventsTime;
-		// a large shift in time is not expected, so limit to a constant number of seconds
-		if (delta > 100)
-			delta = 100;
-		for (i = 0; i < delta; i++) {
-			NTP_RunEventsForSecond(ntp_eventsTime + i);
-		}
+	// NTP resynchronization could cause us to skip some seconds in some rare cases?
+	delta = newTime - ntp_eventsTime;
+	// a large shift in time is not expected, so limit to a constant number of seconds
+	if (delta > 100)
+		delta = 100;
+	end = ntp_eventsTime + delta;
+	while ((e = (ntpEvent_t*)TimerHeap_PopExpired(&ntp_eventsHeap, end - 1)) != 0) {
+		// schedule next run first, command may remove this event
+		NTP_ScheduleEvent(e, e->timer.deadline + 1);
+		CMD_ExecuteCommand(e->command, 0);
+	}
+	if (end != newTime) {
+		// skipped seconds are not run
+		NTP_ScheduleAllEvents(newTime);
 	}
 	ntp_eventsTime = newTime;
 }
@@ -99,8 +127,12 @@ void NTP_AddClockEvent(int hour, int minute, int second, int weekDayFlags, int i
 	newEvent->id = id;
 	newEvent->command = strdup(command);
 	newEvent->next = ntp_events;
+	TimerHeap_InitTimer(&newEvent->timer);
 
 	ntp_events = newEvent;
+	if (ntp_eventsTime) {
+		NTP_ScheduleEvent(newEvent, ntp_eventsTime);
+	}
 }
 int NTP_RemoveClockEvent(int id) {
 	int ret = 0;
@@ -115,6 +147,7 @@ int NTP_RemoveClockEvent(int id) {
 			else {
 				prev->next = curr->next;
 			}
+			TimerHeap_Remove(&ntp_eventsHeap, &curr->timer);
 			free(curr->command);
 			free(curr);
 			ret++;
@@ -248,6 +281,7 @@ int NTP_ClearEvents() {
 	ntpEvent_t* e;
 	int t;
 
+	TimerHeap_Clear(&ntp_eventsHeap);
 	e = ntp_events;
 	t = 0;
 
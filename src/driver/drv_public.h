@@ -36,6 +36,7 @@ void DRV_AppendInformationToHTTPIndexPage(http_request_t* request);
 void DRV_OnEverySecond();
 void DHT_OnEverySecond();
 void DHT_OnPinsConfigChanged();
+void DHT_OnQuickTick();
 void DRV_RunQuickTick();
 void DRV_StartDriver(const char* name);
 void DRV_StopDriver(const char* name);
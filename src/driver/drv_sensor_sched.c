@@ -0,0 +1,172 @@
+#include "../new_common.h"
+#include "../logging/logging.h"
+#include "../cmnds/cmd_public.h"
+#include "drv_sensor_sched.h"
+
+enum {
+	// not due until triggered
+	SS_STATE_STOPPED,
+	// waiting for dueMs
+	SS_STATE_WAITING,
+	// command sent, waiting for fetchMs
+	SS_STATE_CONVERTING,
+};
+
+static sensorJob_t *g_jobs = 0;
+// scheduler clock, taken from system tick count once per quick tick.
+// Tick is skipped when drivers are busy, so summing deltas would lose time.
+static unsigned int g_nowMs = 0;
+
+#define SS_IS_DUE(t) ((int)(g_nowMs - (t)) >= 0)
+
+static unsigned int SensorSched_GetTimeMs() {
+	return xTaskGetTickCount() * portTICK_PERIOD_MS;
+}
+
+int SensorSched_GetJobCount() {
+	sensorJob_t *j;
+	int c = 0;
+
+	for (j = g_jobs; j; j = j->next) {
+		c++;
+	}
+	return c;
+}
+void SensorSched_Trigger(sensorJob_t *job, int delayMs) {
+	job->triggerDelayMs = delayMs;
+	job->bTriggerPending = true;
+}
+// jobs are also added from outside of quick tick, so it reads clock again
+static void SensorSched_Schedule(sensorJob_t *job, int delayMs) {
+	job->dueMs = SensorSched_GetTimeMs() + delayMs;
+	job->state = SS_STATE_WAITING;
+}
+void SensorSched_Add(sensorJob_t *job) {
+	sensorJob_t **p;
+	int slot;
+
+	slot = 0;
+	for (p = &g_jobs; *p && *p != job; p = &(*p)->next) {
+		slot++;
+	}
+	if (*p == 0) {
+		job->next = 0;
+		*p = job;
+		job->reads = 0;
+		job->errors = 0;
+		job->lastLatencyMs = 0;
+		job->maxLatencyMs = 0;
+	}
+	job->state = SS_STATE_STOPPED;
+	job->bTriggerPending = false;
+	if (job->intervalMs > 0) {
+		SensorSched_Schedule(job, SENSOR_SCHED_FIRST_MS + (slot * SENSOR_SCHED_SPREAD_MS) % 1000);
+	}
+}
+void SensorSched_Remove(sensorJob_t *job) {
+	sensorJob_t **p;
+
+	for (p = &g_jobs; *p; p = &(*p)->next) {
+		if (*p == job) {
+			*p = job->next;
+			job->next = 0;
+			job->state = SS_STATE_STOPPED;
+			return;
+		}
+	}
+}
+// Next due time stays on interval grid, unless job fell behind
+static void SensorSched_Reschedule(sensorJob_t *job) {
+	if (job->intervalMs <= 0) {
+		job->state = SS_STATE_STOPPED;
+		return;
+	}
+	job->dueMs += job->intervalMs;
+	if (SS_IS_DUE(job->dueMs)) {
+		job->dueMs = g_nowMs + job->intervalMs;
+	}
+	job->state = SS_STATE_WAITING;
+}
+static void SensorSched_Fetch(sensorJob_t *job) {
+	int latency;
+
+	if (job->fetch(job)) {
+		latency = g_nowMs - job->dueMs;
+		job->reads++;
+		job->lastLatencyMs = latency;
+		if (latency > job->maxLatencyMs)
+			job->maxLatencyMs = latency;
+	}
+	else {
+		job->errors++;
+		addLogAdv(LOG_DEBUG, LOG_FEATURE_SENSOR, "%s: fetch failed", job->name);
+	}
+	SensorSched_Reschedule(job);
+}
+static void SensorSched_Start(sensorJob_t *job) {
+	int wait;
+
+	if (job->bPeriodic) {
+		SensorSched_Fetch(job);
+		return;
+	}
+	wait = job->start(job);
+	if (wait == SENSOR_SCHED_ERROR) {
+		job->errors++;
+		addLogAdv(LOG_DEBUG, LOG_FEATURE_SENSOR, "%s: no answer to measure command", job->name);
+		SensorSched_Reschedule(job);
+		return;
+	}
+	job->fetchMs = g_nowMs + wait;
+	job->state = SS_STATE_CONVERTING;
+}
+void SensorSched_RunQuickTick() {
+	sensorJob_t *j;
+
+	if (g_jobs == 0)
+		return;
+	g_nowMs = SensorSched_GetTimeMs();
+	// triggers are taken over only here, so job state is changed by scheduler alone;
+	// result of running conversion comes first
+	for (j = g_jobs; j; j = j->next) {
+		if (j->bTriggerPending && j->state != SS_STATE_CONVERTING) {
+			j->bTriggerPending = false;
+			SensorSched_Schedule(j, j->triggerDelayMs);
+		}
+	}
+	// results first, they are already waiting on the chip
+	for (j = g_jobs; j; j = j->next) {
+		if (j->state == SS_STATE_CONVERTING && SS_IS_DUE(j->fetchMs)) {
+			SensorSched_Fetch(j);
+			return;
+		}
+	}
+	for (j = g_jobs; j; j = j->next) {
+		if (j->state == SS_STATE_WAITING && SS_IS_DUE(j->dueMs)) {
+			SensorSched_Start(j);
+			return;
+		}
+	}
+}
+void SensorSched_AppendInformationToHTTPIndexPage(http_request_t *request, sensorJob_t *job) {
+	hprintf255(request, "<h5>%s: %i reads, %i errors, latency %i ms (max %i ms)%s</h5>",
+		job->name, job->reads, job->errors, job->lastLatencyMs, job->maxLatencyMs,
+		job->bPeriodic ? ", periodic mode" : "");
+}
+static commandResult_t CMD_SensorStats(const void *context, const char *cmd, const char *args, int cmdFlags) {
+	sensorJob_t *j;
+
+	for (j = g_jobs; j; j = j->next) {
+		ADDLOG_INFO(LOG_FEATURE_SENSOR, "%s: reads %i, errors %i, latency %i ms, max %i ms, every %i ms%s",
+			j->name, j->reads, j->errors, j->lastLatencyMs, j->maxLatencyMs, j->intervalMs,
+			j->bPeriodic ? ", periodic" : "");
+	}
+	return CMD_RES_OK;
+}
+void SensorSched_Init() {
+	//cmddetail:{"name":"SensorStats","args":"",
+	//cmddetail:"descr":"Prints read and error counters and acquisition latency of I2C sensors (SHT3X, SGP, CHT8305)",
+	//cmddetail:"fn":"CMD_SensorStats","file":"driver/drv_sensor_sched.c","requires":"",
+	//cmddetail:"examples":"SensorStats"}
+	CMD_RegisterCommand("SensorStats", CMD_SensorStats, NULL);
+}
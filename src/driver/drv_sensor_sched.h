@@ -0,0 +1,59 @@
+#ifndef __DRV_SENSOR_SCHED_H__
+#define __DRV_SENSOR_SCHED_H__
+
+#include "../new_common.h"
+#include "../httpserver/new_http.h"
+
+// Sensor acquisition without sleeping.
+// Each sensor is a job with two phases: start sends measurement command,
+// fetch reads result in a later quick tick, once conversion time has passed.
+// Sensors in periodic mode measure on their own, so only fetch is done.
+// Jobs are spread over the second and only one job touches the bus per tick.
+
+#define SENSOR_SCHED_ERROR		-1
+// first job starts that long after being added, next ones are spread by SENSOR_SCHED_SPREAD_MS
+#define SENSOR_SCHED_FIRST_MS	100
+#define SENSOR_SCHED_SPREAD_MS	250
+
+typedef struct sensorJob_s sensorJob_t;
+
+struct sensorJob_s {
+	const char *name;
+	// returns ms to wait before fetch, or SENSOR_SCHED_ERROR if sensor did not answer
+	int (*start)(sensorJob_t *job);
+	// returns false on bus or CRC error
+	bool (*fetch)(sensorJob_t *job);
+	// 0 means only when triggered
+	int intervalMs;
+	// no start phase, chip measures by itself
+	bool bPeriodic;
+
+	// set by SensorSched_Trigger, taken over by scheduler on next tick
+	volatile bool bTriggerPending;
+	volatile int triggerDelayMs;
+
+	// owned by scheduler
+	sensorJob_t *next;
+	byte state;
+	unsigned int dueMs;
+	unsigned int fetchMs;
+	// statistics, latency is from due time to result, so waiting for bus is included
+	int reads;
+	int errors;
+	int lastLatencyMs;
+	int maxLatencyMs;
+};
+
+void SensorSched_Init();
+// Adding job that is already there only reschedules it
+void SensorSched_Add(sensorJob_t *job);
+void SensorSched_Remove(sensorJob_t *job);
+// run job as soon as possible, after given delay.
+// It only marks the job, so it is safe from commands and from job callbacks;
+// scheduler picks it up on next tick, after running conversion is done.
+void SensorSched_Trigger(sensorJob_t *job, int delayMs);
+void SensorSched_RunQuickTick();
+void SensorSched_AppendInformationToHTTPIndexPage(http_request_t *request, sensorJob_t *job);
+int SensorSched_GetJobCount();
+
+#endif
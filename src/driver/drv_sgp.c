@@ -11,16 +11,38 @@
 #include "../hal/hal_pins.h"
 
 #include "drv_sgp.h"
+#include "drv_sensor_sched.h"
 
 
 #define SGP_I2C_ADDRESS (0x58 << 1)
 
-static byte channel_co2 = 0, channel_tvoc = 0, g_sgpcycle = 1, g_sgpcycleref = 10, g_sgpstate = 0;
+static byte channel_co2 = 0, channel_tvoc = 0, g_sgpcycleref = 10, g_sgpstate = 0;
 static float g_co2 = 0.0, g_tvoc = 0.0;
 static softI2C_t g_sgpI2C;
 
+static int SGP_StartMeasure(sensorJob_t *job);
+static bool SGP_FetchMeasure(sensorJob_t *job);
+static uint8_t SGP_CalcCrc(uint8_t* data);
+// every second until baseline is ready, sensor needs that for its compensation
+static sensorJob_t g_sgpJob = { "SGP", SGP_StartMeasure, SGP_FetchMeasure, 1000 };
 
-void SGP_Readmeasure() {
+
+// IAQ measure command, result is read by SGP_FetchMeasure after conversion time
+static int SGP_StartMeasure(sensorJob_t *job) {
+#if WINDOWS
+	return SGP30_CMD_IAQ_MEASURE_DURATION_US / 1000;
+#else
+	byte cmd[2];
+
+	// launch measurement on sensor. 
+	cmd[0] = 0x20;
+	cmd[1] = 0x08;
+	if (Soft_I2C_Transfer(&g_sgpI2C, SGP_I2C_ADDRESS, cmd, 2, 0, 0) == false)
+		return SENSOR_SCHED_ERROR;
+	return SGP30_CMD_IAQ_MEASURE_DURATION_US / 1000;
+#endif
+}
+static bool SGP_FetchMeasure(sensorJob_t *job) {
 #if WINDOWS
 	// TODO: values for simulator so I can test SGP
 	// on my Windows machine
@@ -30,17 +52,12 @@ void SGP_Readmeasure() {
 	uint8_t buff[6];
 	unsigned int th, tl, hh, hl;
 
-	// launch measurement on sensor. 
-	Soft_I2C_Start(&g_sgpI2C, SGP_I2C_ADDRESS);
-	Soft_I2C_WriteByte(&g_sgpI2C, 0x20);
-	Soft_I2C_WriteByte(&g_sgpI2C, 0x08);
-	Soft_I2C_Stop(&g_sgpI2C);
-
-	rtos_delay_milliseconds(12);
-
-	Soft_I2C_Start(&g_sgpI2C, SGP_I2C_ADDRESS | 1);
-	Soft_I2C_ReadBytes(&g_sgpI2C, buff, 6);
-	Soft_I2C_Stop(&g_sgpI2C);
+	if (Soft_I2C_Transfer(&g_sgpI2C, SGP_I2C_ADDRESS, 0, 0, buff, 6) == false)
+		return false;
+	if (SGP_CalcCrc(buff) != buff[2] || SGP_CalcCrc(buff + 3) != buff[5]) {
+		addLogAdv(LOG_DEBUG, LOG_FEATURE_SENSOR, "SGP_Measure: CRC error");
+		return false;
+	}
 
 	th = buff[0];
 	tl = buff[1];
@@ -59,18 +76,22 @@ void SGP_Readmeasure() {
 	{
 		addLogAdv(LOG_INFO, LOG_FEATURE_SENSOR, "SGP_Measure: Baseline init in progress");
 		g_sgpstate = 0;
+		job->intervalMs = 1000;
 	}
 	else {
 		g_sgpstate = 1;
+		job->intervalMs = g_sgpcycleref * 1000;
 		CHANNEL_Set(channel_co2, (int)(g_co2), 0);
 		CHANNEL_Set(channel_tvoc, (int)(g_tvoc), 0);
 	}
 	addLogAdv(LOG_INFO, LOG_FEATURE_SENSOR, "SGP_Measure: CO2 :%.1f ppm tvoc:%.0f ppb", g_co2, g_tvoc);
+	return true;
 }
 
 // StopDriver SGP
 void SGP_StopDriver() {
 	addLogAdv(LOG_INFO, LOG_FEATURE_SENSOR, "SGP : Stopping Driver and reset sensor");
+	SensorSched_Remove(&g_sgpJob);
 }
 
 
@@ -199,6 +220,12 @@ commandResult_t SGP_cycle(const void* context, const char* cmd, const char* args
 		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
 	}
 	g_sgpcycleref = Tokenizer_GetArgFloat(0);
+	if (g_sgpstate) {
+		g_sgpJob.intervalMs = g_sgpcycleref * 1000;
+		if (g_sgpcycleref > 0) {
+			SensorSched_Trigger(&g_sgpJob, 0);
+		}
+	}
 
 	ADDLOG_INFO(LOG_FEATURE_CMD, "SGP Cycle : Measurement will run every %i seconds", g_sgpcycleref);
 
@@ -216,10 +243,11 @@ void SGP_Init() {
 
 	Soft_I2C_PreInit(&g_sgpI2C);
 
-	//init the baseline
+	//init the baseline, it takes 10ms, first measurement is scheduled later than that
 	SGP_INIT_BASELINE();
-
-	rtos_delay_milliseconds(10);
+	g_sgpstate = 0;
+	g_sgpJob.intervalMs = 1000;
+	SensorSched_Add(&g_sgpJob);
 
 	//cmddetail:{"name":"SGP_cycle","args":"[int]",
 	//cmddetail:"descr":"change cycle of measurement by default every 10 seconds 0 to deactivate",
@@ -242,19 +270,6 @@ void SGP_Init() {
 	//cmddetail:"examples":"SGP_SoftReset"}
 	CMD_RegisterCommand("SGP_SoftReset", SGP_SoftResetcmd, NULL);
 }
-void SGP_OnEverySecond()
-{
-
-	if (g_sgpcycle == 1 || g_sgpstate == 0) {
-		SGP_Readmeasure();
-		g_sgpcycle = g_sgpcycleref;
-	}
-	if (g_sgpcycle > 0) {
-		--g_sgpcycle;
-	}
-	ADDLOG_DEBUG(LOG_FEATURE_DRV, "DRV_SGP : Measurement will run in %i cycle", g_sgpcycle);
-}
-
 void SGP_AppendInformationToHTTPIndexPage(http_request_t* request)
 {
 
@@ -265,4 +280,5 @@ void SGP_AppendInformationToHTTPIndexPage(http_request_t* request)
 	if (g_sgpstate == 0) {
 		hprintf255(request, "WARNING: Baseline calculation in progress");
 	}
+	SensorSched_AppendInformationToHTTPIndexPage(request, &g_sgpJob);
 }
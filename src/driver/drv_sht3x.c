@@ -11,15 +11,36 @@
 #include "../hal/hal_pins.h"
 
 #include "drv_sht3x.h"
+#include "drv_sensor_sched.h"
 
 
 #define SHT3X_I2C_ADDR (0x44 << 1)
-
-static byte channel_temp = 0, channel_humid = 0, g_shtcycle = 1, g_shtcycleref = 10;
+// single shot, medium repeatability takes 6ms, high 15ms
+#define SHT3X_MEASURE_MS	20
+// after break command, before next command is accepted
+#define SHT3X_BREAK_MS		25
+// first result in periodic mode, slowest rate is 0.5 mps
+#define SHT3X_PERIODIC_FIRST_MS	2000
+
+static byte channel_temp = 0, channel_humid = 0, g_shtcycleref = 10;
 static float g_temp = 0.0, g_humid = 0.0, g_caltemp = 0.0, g_calhum = 0.0;
 static bool g_shtper = false;
+// Periodic mode changes asked by commands. Job does them,
+// so only scheduler touches the bus while driver is running.
+enum {
+	SHT3X_PER_NONE,
+	SHT3X_PER_STOP,
+	// break first if periodic mode is running, then start with g_shtperMsb/Lsb
+	SHT3X_PER_START,
+};
+static volatile byte g_shtperRequest = SHT3X_PER_NONE;
+static byte g_shtperMsb, g_shtperLsb;
 static softI2C_t g_softI2C;
 
+static int SHT3X_StartMeasure(sensorJob_t *job);
+static bool SHT3X_FetchMeasure(sensorJob_t *job);
+static sensorJob_t g_shtJob = { "SHT3X", SHT3X_StartMeasure, SHT3X_FetchMeasure };
+
 
 commandResult_t SHT3X_Calibrate(const void* context, const char* cmd, const char* args, int cmdFlags) {
 
@@ -47,6 +68,7 @@ void SHT3X_StopPer() {
 	Soft_I2C_WriteByte(&g_softI2C, 0x93);
 	Soft_I2C_Stop(&g_softI2C);
 	g_shtper = false;
+	g_shtJob.bPeriodic = false;
 }
 
 void SHT3X_StartPer(uint8_t msb, uint8_t lsb) {
@@ -72,12 +94,12 @@ commandResult_t SHT3X_ChangePer(const void* context, const char* cmd, const char
 		g_msb = Tokenizer_GetArgInteger(0);
 		g_lsb = Tokenizer_GetArgInteger(1);
 	}
-	SHT3X_StopPer();
-	//give some time for SHT to stop Periodicity
-	rtos_delay_milliseconds(25);
-	SHT3X_StartPer(g_msb, g_lsb);
+	g_shtperMsb = g_msb;
+	g_shtperLsb = g_lsb;
+	g_shtperRequest = SHT3X_PER_START;
+	SensorSched_Trigger(&g_shtJob, 0);
 
-	ADDLOG_INFO(LOG_FEATURE_SENSOR, "SHT Change Per : change done");
+	ADDLOG_INFO(LOG_FEATURE_SENSOR, "SHT Change Per : change scheduled");
 
 	return CMD_RES_OK;
 
@@ -109,37 +131,9 @@ commandResult_t SHT3X_Heater(const void* context, const char* cmd, const char* a
 	return CMD_RES_OK;
 }
 
-void SHT3X_MeasurePercmd() {
-#if WINDOWS
-	// TODO: values for simulator so I can test SHT30 
-	// on my Windows machine
-	g_temp = 23.4f;
-	g_humid = 56.7f;
-#else
-
-	uint8_t buff[6];
-	unsigned int th, tl, hh, hl;
-
-	Soft_I2C_Start(&g_softI2C, SHT3X_I2C_ADDR);
-	// Ask for fetching data
-	Soft_I2C_WriteByte(&g_softI2C, 0xE0);
-	// medium repeteability
-	Soft_I2C_WriteByte(&g_softI2C, 0x00);
-	Soft_I2C_Stop(&g_softI2C);
-
-	Soft_I2C_Start(&g_softI2C, SHT3X_I2C_ADDR | 1);
-	Soft_I2C_ReadBytes(&g_softI2C, buff, 6);
-	Soft_I2C_Stop(&g_softI2C);
-
-	th = buff[0];
-	tl = buff[1];
-	hh = buff[3];
-	hl = buff[4];
-
-	g_temp = 175 * ((th * 256 + tl) / 65535.0) - 45.0;
-	g_humid = 100 * ((hh * 256 + hl) / 65535.0);
-#endif
+static uint8_t SHT3X_CalcCrc(uint8_t* data);
 
+static void SHT3X_PublishResult() {
 	g_temp = (int)((g_temp + g_caltemp) * 10.0) / 10.0f;
 	g_humid = (int)(g_humid + g_calhum);
 
@@ -148,14 +142,37 @@ void SHT3X_MeasurePercmd() {
 	CHANNEL_Set(channel_temp, (int)(g_temp * 10), 0);
 	CHANNEL_Set(channel_humid, (int)(g_humid), 0);
 
-	addLogAdv(LOG_INFO, LOG_FEATURE_SENSOR, "SHT3X_Measure: Period Temperature:%.2fC Humidity:%.0f%%", g_temp, g_humid);
+	addLogAdv(LOG_INFO, LOG_FEATURE_SENSOR, "SHT3X_Measure: %sTemperature:%.1fC Humidity:%.0f%%",
+		g_shtper ? "Period " : "", g_temp, g_humid);
 }
+// Measure command, result is read by SHT3X_FetchMeasure after conversion time
+static int SHT3X_StartMeasure(sensorJob_t *job) {
+#if !WINDOWS
+	byte cmd[2];
+#endif
 
-commandResult_t SHT3X_MeasurePer(const void* context, const char* cmd, const char* args, int cmdFlags) {
-	SHT3X_MeasurePercmd();
-	return CMD_RES_OK;
+	// periodic mode is not running here, so there is nothing to stop
+	if (g_shtperRequest == SHT3X_PER_STOP) {
+		g_shtperRequest = SHT3X_PER_NONE;
+	}
+	if (g_shtperRequest == SHT3X_PER_START) {
+		g_shtperRequest = SHT3X_PER_NONE;
+		SHT3X_StartPer(g_shtperMsb, g_shtperLsb);
+		job->bPeriodic = true;
+		return SHT3X_PERIODIC_FIRST_MS;
+	}
+#if WINDOWS
+	return SHT3X_MEASURE_MS;
+#else
+	// no clock stretching, medium repeteability
+	cmd[0] = 0x24;
+	cmd[1] = 0x16;
+	if (Soft_I2C_Transfer(&g_softI2C, SHT3X_I2C_ADDR, cmd, 2, 0, 0) == false)
+		return SENSOR_SCHED_ERROR;
+	return SHT3X_MEASURE_MS;
+#endif
 }
-void SHT3X_Measurecmd() {
+static bool SHT3X_ReadMeasure() {
 #if WINDOWS
 	// TODO: values for simulator so I can test SHT30 
 	// on my Windows machine
@@ -163,20 +180,26 @@ void SHT3X_Measurecmd() {
 	g_humid = 56.7f;
 #else
 	uint8_t buff[6];
+	byte cmd[2];
 	unsigned int th, tl, hh, hl;
+	bool bOk;
 
-	Soft_I2C_Start(&g_softI2C, SHT3X_I2C_ADDR);
-	// no clock stretching
-	Soft_I2C_WriteByte(&g_softI2C, 0x24);
-	// medium repeteability
-	Soft_I2C_WriteByte(&g_softI2C, 0x16);
-	Soft_I2C_Stop(&g_softI2C);
-
-	rtos_delay_milliseconds(20);	//give the sensor time to do the conversion
-
-	Soft_I2C_Start(&g_softI2C, SHT3X_I2C_ADDR | 1);
-	Soft_I2C_ReadBytes(&g_softI2C, buff, 6);
-	Soft_I2C_Stop(&g_softI2C);
+	if (g_shtper) {
+		// Ask for fetching data
+		cmd[0] = 0xE0;
+		cmd[1] = 0x00;
+		bOk = Soft_I2C_Transfer(&g_softI2C, SHT3X_I2C_ADDR, cmd, 2, buff, 6);
+	}
+	else {
+		// sensor NACKs if conversion is not done yet
+		bOk = Soft_I2C_Transfer(&g_softI2C, SHT3X_I2C_ADDR, 0, 0, buff, 6);
+	}
+	if (bOk == false)
+		return false;
+	if (SHT3X_CalcCrc(buff) != buff[2] || SHT3X_CalcCrc(buff + 3) != buff[5]) {
+		addLogAdv(LOG_DEBUG, LOG_FEATURE_SENSOR, "SHT3X_Measure: CRC error");
+		return false;
+	}
 
 	th = buff[0];
 	tl = buff[1];
@@ -186,27 +209,39 @@ void SHT3X_Measurecmd() {
 	g_temp = 175 * ((th * 256 + tl) / 65535.0) - 45.0;
 	g_humid = 100 * ((hh * 256 + hl) / 65535.0);
 #endif
-
-	g_temp = (int)((g_temp + g_caltemp) * 10.0) / 10.0f;
-	g_humid = (int)(g_humid + g_calhum);
-
-	channel_temp = g_cfg.pins.channels[g_softI2C.pin_data];
-	channel_humid = g_cfg.pins.channels2[g_softI2C.pin_data];
-	CHANNEL_Set(channel_temp, (int)(g_temp * 10), 0);
-	CHANNEL_Set(channel_humid, (int)(g_humid), 0);
-
-	addLogAdv(LOG_INFO, LOG_FEATURE_SENSOR, "SHT3X_Measure: Temperature:%.1fC Humidity:%.0f%%", g_temp, g_humid);
-
+	SHT3X_PublishResult();
+	return true;
+}
+static bool SHT3X_FetchMeasure(sensorJob_t *job) {
+	bool bOk;
+
+	bOk = SHT3X_ReadMeasure();
+	// periodic mode is left between two reads
+	if (g_shtper && g_shtperRequest != SHT3X_PER_NONE) {
+		SHT3X_StopPer();
+		if (g_shtperRequest == SHT3X_PER_STOP) {
+			g_shtperRequest = SHT3X_PER_NONE;
+		}
+		// next command is accepted only after break
+		SensorSched_Trigger(job, SHT3X_BREAK_MS);
+	}
+	return bOk;
 }
 
+commandResult_t SHT3X_MeasurePer(const void* context, const char* cmd, const char* args, int cmdFlags) {
+	SensorSched_Trigger(&g_shtJob, 0);
+	return CMD_RES_OK;
+}
 commandResult_t SHT3X_Measure(const void* context, const char* cmd, const char* args, int cmdFlags)
 {
-	SHT3X_Measurecmd();
+	SensorSched_Trigger(&g_shtJob, 0);
 	return CMD_RES_OK;
 }
 // StopDriver SHT3X
 void SHT3X_StopDriver() {
 	addLogAdv(LOG_INFO, LOG_FEATURE_SENSOR, "SHT3X : Stopping Driver and reset sensor");
+	SensorSched_Remove(&g_shtJob);
+	g_shtperRequest = SHT3X_PER_NONE;
 	SHT3X_StopPer();
 	// Reset the sensor
 	Soft_I2C_Start(&g_softI2C, SHT3X_I2C_ADDR);
@@ -217,7 +252,8 @@ void SHT3X_StopDriver() {
 
 commandResult_t SHT3X_StopPerCmd(const void* context, const char* cmd, const char* args, int cmdFlags) {
 	addLogAdv(LOG_INFO, LOG_FEATURE_SENSOR, "SHT3X : Stopping periodical capture");
-	SHT3X_StopPer();
+	g_shtperRequest = SHT3X_PER_STOP;
+	SensorSched_Trigger(&g_shtJob, 0);
 	return CMD_RES_OK;
 }
 
@@ -421,6 +457,10 @@ commandResult_t SHT_cycle(const void* context, const char* cmd, const char* args
 		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
 	}
 	g_shtcycleref = Tokenizer_GetArgFloat(0);
+	g_shtJob.intervalMs = g_shtcycleref * 1000;
+	if (g_shtcycleref > 0) {
+		SensorSched_Trigger(&g_shtJob, 0);
+	}
 
 	ADDLOG_INFO(LOG_FEATURE_CMD, "SHT Cycle : Measurement will run every %i seconds", g_shtcycleref);
 
@@ -441,6 +481,8 @@ void SHT3X_Init() {
 
 	SHT3X_GetStatus();
 
+	g_shtJob.intervalMs = g_shtcycleref * 1000;
+	SensorSched_Add(&g_shtJob);
 
 	//cmddetail:{"name":"SHT_cycle","args":"[int]",
 	//cmddetail:"descr":"change cycle of measurement by default every 10 seconds 0 to deactivate",
@@ -453,7 +495,7 @@ void SHT3X_Init() {
 	//cmddetail:"examples":"SHT_Calibrate -4 10"}
 	CMD_RegisterCommand("SHT_Calibrate", SHT3X_Calibrate, NULL);
 	//cmddetail:{"name":"SHT_MeasurePer","args":"",
-	//cmddetail:"descr":"Retrieve Periodical measurement for SHT",
+	//cmddetail:"descr":"Retrieve Periodical measurement for SHT, it is fetched in one of next quick ticks",
 	//cmddetail:"fn":"SHT3X_MeasurePer","file":"driver/drv_sht3x.c","requires":"",
 	//cmddetail:"examples":"SHT_Measure"}
 	CMD_RegisterCommand("SHT_MeasurePer", SHT3X_MeasurePer, NULL);
@@ -468,7 +510,7 @@ void SHT3X_Init() {
 	//cmddetail:"examples":""}
 	CMD_RegisterCommand("SHT_StopPer", SHT3X_StopPerCmd, NULL);
 	//cmddetail:{"name":"SHT_Measure","args":"",
-	//cmddetail:"descr":"Retrieve OneShot measurement for SHT",
+	//cmddetail:"descr":"Retrieve OneShot measurement for SHT, result is read after conversion, without blocking",
 	//cmddetail:"fn":"SHT3X_Measure","file":"driver/drv_sht3x.c","requires":"",
 	//cmddetail:"examples":"SHT_Measure"}
 	CMD_RegisterCommand("SHT_Measure", SHT3X_Measure, NULL);
@@ -498,31 +540,11 @@ void SHT3X_Init() {
 	//cmddetail:"examples":"SHT_SetAlertCmd"}
 	CMD_RegisterCommand("SHT_SetAlert", SHT3X_SetAlertCmd, NULL);
 }
-void SHT3X_OnEverySecond()
-{
-
-	if (g_shtcycle == 1) {
-		if (g_shtper)
-		{
-			SHT3X_MeasurePercmd();
-		}
-		else
-		{
-			SHT3X_Measurecmd();
-		}
-		g_shtcycle = g_shtcycleref;
-	}
-	if (g_shtcycle > 0) {
-		--g_shtcycle;
-	}
-	ADDLOG_DEBUG(LOG_FEATURE_DRV, "DRV_SHT : Measurement will run in  %i cycle", g_shtcycle);
-
-}
-
 void SHT3X_AppendInformationToHTTPIndexPage(http_request_t* request)
 {
 	hprintf255(request, "<h2>SHT3X Temperature=%.1f°c, Humidity=%.0f%</h2>", g_temp, g_humid);
 	if (channel_humid == channel_temp) {
 		hprintf255(request, "WARNING: You don't have configured target channels for temp and humid results, set the first and second channel index in Pins!");
 	}
+	SensorSched_AppendInformationToHTTPIndexPage(request, &g_shtJob);
 }
@@ -3,6 +3,7 @@
 #include "../new_cfg.h"
 // Commands register, execution API and cmd tokenizer
 #include "../cmnds/cmd_public.h"
+#include "../cmnds/cmd_local.h"
 #include "../mqtt/new_mqtt.h"
 #include "../logging/logging.h"
 #include "drv_local.h"
@@ -63,6 +64,41 @@ void SM2135_Write(float *rgbcw) {
 	}
 }
 
+// bus of LED driver started last
+static softI2C_t *g_ledI2C = 0;
+static int g_ledI2CSpeedKHz = SOFT_I2C_LED_KHZ;
+
+static commandResult_t CMD_LEDDriver_I2CSpeed(const void *context, const char *cmd, const char *args, int flags) {
+	int kHz;
+
+	Tokenizer_TokenizeString(args, 0);
+	if (Tokenizer_GetArgsCount() < 1) {
+		ADDLOG_INFO(LOG_FEATURE_CMD, "LED I2C speed is %i kHz", g_ledI2CSpeedKHz);
+		return CMD_RES_OK;
+	}
+	kHz = Tokenizer_GetArgInteger(0);
+	if (kHz <= 0 || kHz > 1000) {
+		return CMD_RES_BAD_ARGUMENT;
+	}
+	g_ledI2CSpeedKHz = kHz;
+	if (g_ledI2C) {
+		// picked up by next transfer
+		g_ledI2C->speedKHz = kHz;
+	}
+	return CMD_RES_OK;
+}
+void LED_I2CDriver_SetupBus(softI2C_t *i2c) {
+	g_ledI2C = i2c;
+	i2c->speedKHz = g_ledI2CSpeedKHz;
+	if (CMD_Find("LED_I2CSpeed") == 0) {
+		//cmddetail:{"name":"LED_I2CSpeed","args":"[kHz]",
+		//cmddetail:"descr":"Sets clock speed of software I2C used by LED drivers (SM2135, BP5758D, BP1658CJ, SM2235, KP18068). Default is 400 kHz. Without argument, prints current speed.",
+		//cmddetail:"fn":"CMD_LEDDriver_I2CSpeed","file":"driver/drv_sm2135.c","requires":"",
+		//cmddetail:"examples":"LED_I2CSpeed 200"}
+		CMD_RegisterCommand("LED_I2CSpeed", CMD_LEDDriver_I2CSpeed, NULL);
+	}
+}
+
 commandResult_t CMD_LEDDriver_WriteRGBCW(const void *context, const char *cmd, const char *args, int flags){
 	const char *c = args;
 	float col[5] = { 0, 0, 0, 0, 0 };
@@ -164,6 +200,7 @@ void SM2135_Init() {
 	g_softI2C.pin_clk = PIN_FindPinIndexForRole(IOR_SM2135_CLK,g_softI2C.pin_clk);
 	g_softI2C.pin_data = PIN_FindPinIndexForRole(IOR_SM2135_DAT,g_softI2C.pin_data);
 
+	LED_I2CDriver_SetupBus(&g_softI2C);
 	Soft_I2C_PreInit(&g_softI2C);
 
 	//cmddetail:{"name":"SM2135_RGBCW","args":"[HexColor]",
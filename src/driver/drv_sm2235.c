@@ -92,6 +92,7 @@ void SM2235_Init() {
 	g_softI2C.pin_clk = PIN_FindPinIndexForRole(IOR_SM2235_CLK,g_softI2C.pin_clk);
 	g_softI2C.pin_data = PIN_FindPinIndexForRole(IOR_SM2235_DAT,g_softI2C.pin_data);
 
+	LED_I2CDriver_SetupBus(&g_softI2C);
 	Soft_I2C_PreInit(&g_softI2C);
 
 
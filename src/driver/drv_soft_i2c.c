@@ -29,54 +29,89 @@ void Soft_I2C_SetHigh(uint8_t pin) {
 	HAL_PIN_Setup_Input_Pullup(pin);
 }
 
+// Pins are taken over by bit-bang layer, so every bit costs only register writes.
+// Done lazily, because drivers fill pins into static structs at any time.
+static void Soft_I2C_Prepare(softI2C_t *i2c) {
+	if (i2c->bPrepared && i2c->clk.pin == i2c->pin_clk && i2c->data.pin == i2c->pin_data
+		&& i2c->preparedKHz == i2c->speedKHz)
+		return;
+	BitBang_PinInit(&i2c->clk, i2c->pin_clk);
+	BitBang_PinInit(&i2c->data, i2c->pin_data);
+	i2c->halfLoops = BitBang_HalfPeriodLoops(i2c->speedKHz > 0 ? i2c->speedKHz : SOFT_I2C_DEFAULT_KHZ);
+	i2c->preparedKHz = i2c->speedKHz;
+	i2c->bPrepared = true;
+}
+// release SCL and give slave a chance to stretch the clock
+static void Soft_I2C_ClockHigh(softI2C_t *i2c) {
+	int i;
+
+	BitBang_Release(&i2c->clk);
+	for (i = 0; i < SOFT_I2C_STRETCH_READS && BitBang_Read(&i2c->clk) == 0; i++) {
+	}
+}
+
 bool Soft_I2C_PreInit(softI2C_t *i2c) {
-	HAL_PIN_SetOutputValue(i2c->pin_data, 0);
-	HAL_PIN_SetOutputValue(i2c->pin_clk, 0);
-	Soft_I2C_SetHigh(i2c->pin_data);
-	Soft_I2C_SetHigh(i2c->pin_clk);
-	return (!((HAL_PIN_ReadDigitalInput(i2c->pin_data) == 0 || HAL_PIN_ReadDigitalInput(i2c->pin_clk) == 0)));
+	// pins may have been touched by someone else in the meantime
+	i2c->bPrepared = false;
+	Soft_I2C_Prepare(i2c);
+	BitBang_Release(&i2c->data);
+	BitBang_Release(&i2c->clk);
+	return BitBang_Read(&i2c->data) && BitBang_Read(&i2c->clk);
 }
 
 bool Soft_I2C_WriteByte(softI2C_t *i2c, uint8_t value) {
 	uint8_t curr;
 	uint8_t ack;
 
+	Soft_I2C_Prepare(i2c);
 	for (curr = 0X80; curr != 0; curr >>= 1) {
 		if (curr & value) {
-			Soft_I2C_SetHigh(i2c->pin_data);
+			BitBang_Release(&i2c->data);
 		}
 		else {
-			Soft_I2C_SetLow(i2c->pin_data);
+			BitBang_Low(&i2c->data);
 		}
-		Soft_I2C_SetHigh(i2c->pin_clk);
-		usleep(SM2135_DELAY);
-		Soft_I2C_SetLow(i2c->pin_clk);
+		BitBang_Delay(i2c->halfLoops);
+		Soft_I2C_ClockHigh(i2c);
+		BitBang_Delay(i2c->halfLoops);
+		BitBang_Low(&i2c->clk);
 	}
 	// get Ack or Nak
-	Soft_I2C_SetHigh(i2c->pin_data);
-	Soft_I2C_SetHigh(i2c->pin_clk);
-	usleep(SM2135_DELAY / 2);
-	ack = HAL_PIN_ReadDigitalInput(i2c->pin_data);
-	Soft_I2C_SetLow(i2c->pin_clk);
-	usleep(SM2135_DELAY / 2);
-	Soft_I2C_SetLow(i2c->pin_data);
+	BitBang_Release(&i2c->data);
+	BitBang_Delay(i2c->halfLoops);
+	Soft_I2C_ClockHigh(i2c);
+	BitBang_Delay(i2c->halfLoops);
+	ack = BitBang_Read(&i2c->data);
+	BitBang_Low(&i2c->clk);
+	BitBang_Low(&i2c->data);
 	return (0 == ack);
 }
 
 bool Soft_I2C_Start(softI2C_t *i2c, uint8_t addr) {
-	Soft_I2C_SetLow(i2c->pin_data);
-	usleep(SM2135_DELAY);
-	Soft_I2C_SetLow(i2c->pin_clk);
+	Soft_I2C_Prepare(i2c);
+	BitBang_Low(&i2c->data);
+	BitBang_Delay(i2c->halfLoops);
+	BitBang_Low(&i2c->clk);
 	return Soft_I2C_WriteByte(i2c,addr);
 }
 
 void Soft_I2C_Stop(softI2C_t *i2c) {
-	Soft_I2C_SetLow(i2c->pin_data);
-	usleep(SM2135_DELAY);
-	Soft_I2C_SetHigh(i2c->pin_clk);
-	usleep(SM2135_DELAY);
-	Soft_I2C_SetHigh(i2c->pin_data);
-	usleep(SM2135_DELAY);
+	Soft_I2C_Prepare(i2c);
+	BitBang_Low(&i2c->data);
+	BitBang_Delay(i2c->halfLoops);
+	Soft_I2C_ClockHigh(i2c);
+	BitBang_Delay(i2c->halfLoops);
+	BitBang_Release(&i2c->data);
+	BitBang_Delay(i2c->halfLoops);
+}
+
+// SCL is low after a byte, bring both lines up again and start without stop
+static bool Soft_I2C_RepeatedStart(softI2C_t *i2c, uint8_t addr) {
+	BitBang_Release(&i2c->data);
+	BitBang_Delay(i2c->halfLoops);
+	Soft_I2C_ClockHigh(i2c);
+	BitBang_Delay(i2c->halfLoops);
+	return Soft_I2C_Start(i2c, addr);
 }
 
 
@@ -96,32 +131,64 @@ uint8_t Soft_I2C_ReadByte(softI2C_t *i2c, bool nack)
 {
 	uint8_t val = 0;
 
-	Soft_I2C_SetHigh(i2c->pin_data);
+	Soft_I2C_Prepare(i2c);
+	BitBang_Release(&i2c->data);
 	for (int i = 0; i < 8; i++)
 	{
-		usleep(SM2135_DELAY);
-		Soft_I2C_SetHigh(i2c->pin_clk);
+		BitBang_Delay(i2c->halfLoops);
+		Soft_I2C_ClockHigh(i2c);
+		BitBang_Delay(i2c->halfLoops);
 		val <<= 1;
-		if (HAL_PIN_ReadDigitalInput(i2c->pin_data))
+		if (BitBang_Read(&i2c->data))
 		{
 			val |= 1;
 		}
-		Soft_I2C_SetLow(i2c->pin_clk);
+		BitBang_Low(&i2c->clk);
 	}
 	if (nack)
 	{
-		Soft_I2C_SetHigh(i2c->pin_data);
+		BitBang_Release(&i2c->data);
 	}
 	else
 	{
-		Soft_I2C_SetLow(i2c->pin_data);
+		BitBang_Low(&i2c->data);
 	}
-	Soft_I2C_SetHigh(i2c->pin_clk);
-	usleep(SM2135_DELAY);
-	Soft_I2C_SetLow(i2c->pin_clk);
-	usleep(SM2135_DELAY);
-	Soft_I2C_SetLow(i2c->pin_data);
+	BitBang_Delay(i2c->halfLoops);
+	Soft_I2C_ClockHigh(i2c);
+	BitBang_Delay(i2c->halfLoops);
+	BitBang_Low(&i2c->clk);
+	BitBang_Low(&i2c->data);
 
 	return val;
 }
 
+bool Soft_I2C_Transfer(softI2C_t *i2c, uint8_t addr, const uint8_t *tx, int txLen, uint8_t *rx, int rxLen) {
+	bool bOk;
+	int i;
+
+	bOk = true;
+	if (txLen > 0 || rxLen <= 0) {
+		// keep sending even if something was not ACKed, LED drivers don't ACK at all
+		bOk &= Soft_I2C_Start(i2c, addr);
+		for (i = 0; i < txLen; i++) {
+			bOk &= Soft_I2C_WriteByte(i2c, tx[i]);
+		}
+		if (rxLen > 0) {
+			bOk &= Soft_I2C_RepeatedStart(i2c, addr | 1);
+		}
+	}
+	else {
+		bOk &= Soft_I2C_Start(i2c, addr | 1);
+	}
+	if (rxLen > 0) {
+		// no point reading from device that is not there
+		if (bOk) {
+			Soft_I2C_ReadBytes(i2c, rx, rxLen);
+		}
+		else {
+			memset(rx, 0xFF, rxLen);
+		}
+	}
+	Soft_I2C_Stop(i2c);
+	return bOk;
+}
@@ -10,47 +10,51 @@
 #include "../httpserver/new_http.h"
 #include "../hal/hal_pins.h"
 
-#define MY_SPI_DELAY usleep(500);
+void Soft_SPI_Transfer(softSPI_t *spi, const byte *tx, byte *rx, int len) {
+	int i, j;
+	byte out, in;
 
-void SPI_Send(softSPI_t *spi, byte dataToSend) {
-	for (int i = 0; i < 8; i++) {
-		MY_SPI_DELAY;
-		HAL_PIN_SetOutputValue(spi->mosi, (dataToSend >> (7 - i)) & 0x01);
-		MY_SPI_DELAY;
-		HAL_PIN_SetOutputValue(spi->sck, 1);
-		MY_SPI_DELAY;
-		HAL_PIN_SetOutputValue(spi->sck, 0);
+	for (i = 0; i < len; i++) {
+		out = tx ? tx[i] : 0xFF;
+		in = 0;
+		for (j = 0; j < 8; j++) {
+			BitBang_Write(&spi->pMosi, (out >> (7 - j)) & 0x01);
+			BitBang_Delay(spi->halfLoops);
+			BitBang_Write(&spi->pSck, 1);
+			BitBang_Delay(spi->halfLoops);
+			in = (in << 1) | BitBang_Read(&spi->pMiso);
+			BitBang_Write(&spi->pSck, 0);
+		}
+		if (rx)
+			rx[i] = in;
 	}
 }
 
+void SPI_Send(softSPI_t *spi, byte dataToSend) {
+	Soft_SPI_Transfer(spi, &dataToSend, 0, 1);
+}
+
 byte SPI_Read(softSPI_t *spi) {
-	byte receivedData = 0;
-	for (int i = 0; i < 8; i++) {
-		MY_SPI_DELAY;
-		HAL_PIN_SetOutputValue(spi->sck, 1);
-		MY_SPI_DELAY;
-		receivedData |= (HAL_PIN_ReadDigitalInput(spi->miso) << (7 - i));
-		MY_SPI_DELAY;
-		HAL_PIN_SetOutputValue(spi->sck, 0);
-	}
+	byte receivedData;
+
+	Soft_SPI_Transfer(spi, 0, &receivedData, 1);
 	return receivedData;
 }
 
 void SPI_Begin(softSPI_t *spi) {
-	HAL_PIN_SetOutputValue(spi->ss, 0); // enable SPI communication with the flash
+	BitBang_Write(&spi->pSs, 0); // enable SPI communication with the flash
 }
 void SPI_End(softSPI_t *spi) {
-	HAL_PIN_SetOutputValue(spi->ss, 1); // disable SPI communication with the flash
+	BitBang_Write(&spi->pSs, 1); // disable SPI communication with the flash
 }
 void SPI_Setup(softSPI_t *spi) {
-	//if (spi->spi_Ready)
-	//	return;
-	//spi->spi_Ready = 1;
-	HAL_PIN_Setup_Output(spi->sck);
-	HAL_PIN_Setup_Input(spi->miso);
-	HAL_PIN_Setup_Output(spi->mosi);
-	HAL_PIN_Setup_Output(spi->ss);
-	HAL_PIN_SetOutputValue(spi->ss, 1); // set SS_PIN to inactive
+	BitBang_PinInit(&spi->pSck, spi->sck);
+	BitBang_PinInit(&spi->pMiso, spi->miso);
+	BitBang_PinInit(&spi->pMosi, spi->mosi);
+	BitBang_PinInit(&spi->pSs, spi->ss);
+	spi->halfLoops = BitBang_HalfPeriodLoops(spi->speedKHz > 0 ? spi->speedKHz : SOFT_SPI_DEFAULT_KHZ);
+	BitBang_Write(&spi->pSck, 0);
+	BitBang_SetupInput(&spi->pMiso);
+	BitBang_Write(&spi->pMosi, 0);
+	BitBang_Write(&spi->pSs, 1); // set SS_PIN to inactive
 }
-
-
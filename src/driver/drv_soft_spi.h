@@ -2,6 +2,10 @@
 #define __DRV_SOFT_SPI__
 
 #include "../new_common.h"
+#include "drv_bitbang.h"
+
+// slow by default, same as it always was, because of the capacitor below
+#define SOFT_SPI_DEFAULT_KHZ	5
 
 // PLEASE REMEMBER ABOUT THE CAPACITOR ON SCK!
 // I had to add it for some FLASH memories, see:
@@ -11,6 +15,11 @@ typedef struct softSPI_s {
 	byte miso;
 	byte mosi;
 	byte ss;
+	// clock speed, 0 means SOFT_SPI_DEFAULT_KHZ
+	short speedKHz;
+	// set up by SPI_Setup
+	bbPin_t pSck, pMiso, pMosi, pSs;
+	int halfLoops;
 } softSPI_t;
 
 void SPI_Send(softSPI_t *spi, byte dataToSend);
@@ -18,5 +27,7 @@ byte SPI_Read(softSPI_t *spi);
 void SPI_Begin(softSPI_t *spi);
 void SPI_End(softSPI_t *spi);
 void SPI_Setup(softSPI_t *spi);
+// Mode 0, MSB first. tx may be NULL to clock out 0xFF, rx may be NULL to ignore input.
+void Soft_SPI_Transfer(softSPI_t *spi, const byte *tx, byte *rx, int len);
 
 #endif
@@ -32,6 +32,7 @@ void spi_test() {
 	softSPI_t spi;
 
 
+	memset(&spi, 0, sizeof(spi));
 	spi.miso = MISO_PIN;
 	spi.mosi = MOSI_PIN;
 	spi.ss = SS_PIN;
@@ -62,6 +63,7 @@ void spi_test_read(int adr, int cnt) {
 	int i;
 	softSPI_t spi;
 
+	memset(&spi, 0, sizeof(spi));
 	spi.miso = MISO_PIN;
 	spi.mosi = MOSI_PIN;
 	spi.ss = SS_PIN;
@@ -80,9 +82,7 @@ void spi_test_read(int adr, int cnt) {
 	SPI_Send(&spi, (adr >> 16) & 0xFF); // send the address MSB
 	SPI_Send(&spi, (adr >> 8) & 0xFF); // send the address middle byte
 	SPI_Send(&spi, adr & 0xFF); // send the address LSB
-	for (i = 0; i < cnt; i++) {
-		data[i] = SPI_Read(&spi);
-	}
+	Soft_SPI_Transfer(&spi, 0, data, cnt);
 	SPI_End(&spi); // disable SPI communication with the flash
 
 	int chunkLen = 8;
@@ -104,6 +104,7 @@ void spi_test_read(int adr, int cnt) {
 void spi_test_erase() {
 	softSPI_t spi;
 
+	memset(&spi, 0, sizeof(spi));
 	spi.miso = MISO_PIN;
 	spi.mosi = MOSI_PIN;
 	spi.ss = SS_PIN;
@@ -128,9 +129,9 @@ void spi_test_erase() {
 
 }
 void spi_test_write(int adr, byte *data, int cnt) {
-	int i;
 	softSPI_t spi;
 
+	memset(&spi, 0, sizeof(spi));
 	spi.miso = MISO_PIN;
 	spi.mosi = MOSI_PIN;
 	spi.ss = SS_PIN;
@@ -152,9 +153,7 @@ void spi_test_write(int adr, byte *data, int cnt) {
 	SPI_Send(&spi, (adr >> 16) & 0xFF); // send the address MSB
 	SPI_Send(&spi, (adr >> 8) & 0xFF); // send the address middle byte
 	SPI_Send(&spi, adr & 0xFF); // send the address LSB
-	for (i = 0; i < cnt; i++) {
-		SPI_Send(&spi, data[i]);
-	}
+	Soft_SPI_Transfer(&spi, data, 0, cnt);
 	SPI_End(&spi); // disable SPI communication with the flash
 
 	OBK_ENABLE_INTERRUPTS;
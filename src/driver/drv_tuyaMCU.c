@@ -142,11 +142,20 @@ typedef struct tuyaMCUMapping_s {
 	int prevValue;
 	// TODO
 	//int mode;
-	// list
-	struct tuyaMCUMapping_s* next;
 } tuyaMCUMapping_t;
 
+// Mappings are kept in one flat array, in order of creation.
+// Lookups by dpId and by channel go through direct indexes that
+// store mapping index + 1, so 0 means "not mapped".
+#define TUYAMCU_MAX_MAPPINGS 255
+#define TUYAMCU_MAX_DPID 256
+
 tuyaMCUMapping_t* g_tuyaMappings = 0;
+static int g_numTuyaMappings = 0;
+static int g_maxTuyaMappings = 0;
+static byte g_tuyaMappingByID[TUYAMCU_MAX_DPID];
+static byte g_tuyaMappingByChannel[CHANNEL_MAX];
+static uint32_t g_tuyaUsedChannels[(CHANNEL_MAX + 31) / 32];
 
 /**
  * Dimmer range
@@ -183,125 +192,165 @@ static int g_sendQueryStatePackets = 0;
 static byte g_defaultTuyaMCUWiFiState = 0x00;
 
 tuyaMCUMapping_t* TuyaMCU_FindDefForID(int fnId) {
-	tuyaMCUMapping_t* cur;
-
-	cur = g_tuyaMappings;
-	while (cur) {
-		if (cur->fnId == fnId)
-			return cur;
-		cur = cur->next;
-	}
-	return 0;
+	if (fnId < 0 || fnId >= TUYAMCU_MAX_DPID || g_tuyaMappingByID[fnId] == 0)
+		return 0;
+	return &g_tuyaMappings[g_tuyaMappingByID[fnId] - 1];
 }
 
 tuyaMCUMapping_t* TuyaMCU_FindDefForChannel(int channel) {
-	tuyaMCUMapping_t* cur;
+	if (channel < 0 || channel >= CHANNEL_MAX || g_tuyaMappingByChannel[channel] == 0)
+		return 0;
+	return &g_tuyaMappings[g_tuyaMappingByChannel[channel] - 1];
+}
+
+// If more dpIDs share a channel, the most recently created mapping wins
+static void TuyaMCU_RebuildChannelIndex() {
+	int i, ch;
 
-	cur = g_tuyaMappings;
-	while (cur) {
-		if (cur->channel == channel)
-			return cur;
-		cur = cur->next;
+	memset(g_tuyaMappingByChannel, 0, sizeof(g_tuyaMappingByChannel));
+	memset(g_tuyaUsedChannels, 0, sizeof(g_tuyaUsedChannels));
+	for (i = 0; i < g_numTuyaMappings; i++) {
+		ch = g_tuyaMappings[i].channel;
+		if (ch < 0 || ch >= CHANNEL_MAX)
+			continue;
+		g_tuyaMappingByChannel[ch] = i + 1;
+		g_tuyaUsedChannels[ch / 32] |= (1U << (ch % 32));
 	}
-	return 0;
 }
 
 void TuyaMCU_MapIDToChannel(int fnId, int dpType, int channel) {
 	tuyaMCUMapping_t* cur;
+	tuyaMCUMapping_t* n;
 
+	if (fnId < 0 || fnId >= TUYAMCU_MAX_DPID) {
+		addLogAdv(LOG_ERROR, LOG_FEATURE_TUYAMCU, "TuyaMCU_MapIDToChannel: dpId %i out of range\n", fnId);
+		return;
+	}
 	cur = TuyaMCU_FindDefForID(fnId);
 
 	if (cur == 0) {
-		cur = (tuyaMCUMapping_t*)malloc(sizeof(tuyaMCUMapping_t));
+		if (g_numTuyaMappings >= g_maxTuyaMappings) {
+			if (g_maxTuyaMappings >= TUYAMCU_MAX_MAPPINGS) {
+				addLogAdv(LOG_ERROR, LOG_FEATURE_TUYAMCU, "TuyaMCU_MapIDToChannel: too many mappings\n");
+				return;
+			}
+			n = (tuyaMCUMapping_t*)realloc(g_tuyaMappings, (g_maxTuyaMappings + 8) * sizeof(tuyaMCUMapping_t));
+			if (n == 0) {
+				addLogAdv(LOG_ERROR, LOG_FEATURE_TUYAMCU, "TuyaMCU_MapIDToChannel: failed to malloc\n");
+				return;
+			}
+			g_tuyaMappings = n;
+			g_maxTuyaMappings += 8;
+			if (g_maxTuyaMappings > TUYAMCU_MAX_MAPPINGS)
+				g_maxTuyaMappings = TUYAMCU_MAX_MAPPINGS;
+		}
+		cur = &g_tuyaMappings[g_numTuyaMappings];
 		cur->fnId = fnId;
 		cur->dpType = dpType;
 		cur->prevValue = 0;
-		cur->next = g_tuyaMappings;
-		g_tuyaMappings = cur;
+		g_numTuyaMappings++;
+		g_tuyaMappingByID[fnId] = g_numTuyaMappings;
 	}
 
 	cur->channel = channel;
+	TuyaMCU_RebuildChannelIndex();
 }
 
 
 // header version command lenght data checksum
 // 55AA     00      00      0000   xx   00
 
-#define MIN_TUYAMCU_PACKET_SIZE (2+1+1+2+1)
-int UART_TryToGetNextTuyaPacket(byte* out, int maxSize) {
-	int cs;
-	int len, i;
+#define TUYAMCU_HEADER_SIZE (2+1+1+2)
+#define MIN_TUYAMCU_PACKET_SIZE (TUYAMCU_HEADER_SIZE+1)
+#define TUYAMCU_UART_RECEIVE_BUFFER_SIZE 512
+
+// Incremental frame parser. Frame stays in UART ring buffer until it's complete,
+// parser only remembers how far it got, so every byte is looked at once,
+// and checksum is summed on the way.
+typedef struct tuyaMCUParser_s {
+	// number of bytes of current frame already scanned
+	int pos;
+	// whole frame length, known after length bytes
+	int frameLen;
+	byte checksum;
+} tuyaMCUParser_t;
+
+static tuyaMCUParser_t g_tuyaParser;
+// used only when frame wraps around end of ring buffer
+static byte g_tuyaFrameScratch[TUYAMCU_UART_RECEIVE_BUFFER_SIZE];
+
+static void TuyaMCU_ResetParser() {
+	g_tuyaParser.pos = 0;
+	g_tuyaParser.frameLen = 0;
+	g_tuyaParser.checksum = 0;
+}
+// drops first byte of current frame candidate and starts scanning again from next one
+static void TuyaMCU_ResyncParser() {
+	UART_ConsumeBytes(1);
+	TuyaMCU_ResetParser();
+}
+// Returns length of complete frame at the start of UART buffer, and its bytes in *out,
+// or 0 if there is no whole frame yet. Frame must be consumed by caller after use.
+int UART_TryToGetNextTuyaPacket(const byte** out) {
+	tuyaMCUParser_t* p = &g_tuyaParser;
+	int cs, len = 0;
 	int c_garbage_consumed = 0;
-	byte a, b, version, command, lena, lenb;
+	byte b;
 	char printfSkipDebug[256];
 	char buffer2[8];
 
 	printfSkipDebug[0] = 0;
-
 	cs = UART_GetDataSize();
-
-	if (cs < MIN_TUYAMCU_PACKET_SIZE) {
-		return 0;
-	}
-	// skip garbage data (should not happen)
-	while (cs > 0) {
-		a = UART_GetNextByte(0);
-		b = UART_GetNextByte(1);
-		if (a != 0x55 || b != 0xAA) {
-			UART_ConsumeBytes(1);
-			if (c_garbage_consumed + 2 < sizeof(printfSkipDebug)) {
-				snprintf(buffer2, sizeof(buffer2), "%02X ", a);
+	while (p->pos < cs) {
+		b = UART_GetNextByte(p->pos);
+		if ((p->pos == 0 && b != 0x55) || (p->pos == 1 && b != 0xAA)) {
+			// skip garbage data (should not happen)
+			if (LOG_IsEnabled(LOG_INFO, LOG_FEATURE_TUYAMCU) && c_garbage_consumed + 2 < sizeof(printfSkipDebug)) {
+				snprintf(buffer2, sizeof(buffer2), "%02X ", UART_GetNextByte(0));
 				strcat_safe(printfSkipDebug, buffer2, sizeof(printfSkipDebug));
 			}
 			c_garbage_consumed++;
+			TuyaMCU_ResyncParser();
 			cs--;
+			continue;
 		}
-		else {
+		if (p->pos == 4) {
+			p->frameLen = b << 8;
+		}
+		else if (p->pos == 5) {
+			p->frameLen = (p->frameLen | b) + MIN_TUYAMCU_PACKET_SIZE;
+			if (p->frameLen >= UART_GetReceiveBufferSize()) {
+				addLogAdv(LOG_INFO, LOG_FEATURE_TUYAMCU, "TuyaMCU packet too large, %i >= %i\n", p->frameLen, UART_GetReceiveBufferSize());
+				TuyaMCU_ResyncParser();
+				cs--;
+				continue;
+			}
+		}
+		else if (p->pos > 5 && p->pos == p->frameLen - 1) {
+			// last byte is checksum of all previous ones
+			if (b != p->checksum) {
+				addLogAdv(LOG_INFO, LOG_FEATURE_TUYAMCU, "TuyaMCU packet with bad checksum %02X wanted %02X, skipping\n", b, p->checksum);
+				TuyaMCU_ResyncParser();
+				cs--;
+				continue;
+			}
+			len = p->frameLen;
+			TuyaMCU_ResetParser();
+			*out = UART_GetDataView(len, g_tuyaFrameScratch);
 			break;
 		}
+		p->checksum += b;
+		p->pos++;
 	}
 	if (c_garbage_consumed > 0) {
 		addLogAdv(LOG_INFO, LOG_FEATURE_TUYAMCU, "Consumed %i unwanted non-header byte in Tuya MCU buffer\n", c_garbage_consumed);
 		addLogAdv(LOG_INFO, LOG_FEATURE_TUYAMCU, "Skipped data (part) %s\n", printfSkipDebug);
 	}
-	if (cs < MIN_TUYAMCU_PACKET_SIZE) {
-		return 0;
-	}
-	a = UART_GetNextByte(0);
-	b = UART_GetNextByte(1);
-	if (a != 0x55 || b != 0xAA) {
-		return 0;
-	}
-	version = UART_GetNextByte(2);
-	command = UART_GetNextByte(3);
-	lena = UART_GetNextByte(4); // hi
-	lenb = UART_GetNextByte(5); // lo
-	len = lenb | lena >> 8;
-	// now check if we have received whole packet
-	len += 2 + 1 + 1 + 2 + 1; // header 2 bytes, version, command, lenght, chekcusm
-	if (cs >= len) {
-		int ret;
-		// can packet fit into the buffer?
-		if (len <= maxSize) {
-			for (i = 0; i < len; i++) {
-				out[i] = UART_GetNextByte(i);
-			}
-			ret = len;
-		}
-		else {
-			addLogAdv(LOG_INFO, LOG_FEATURE_TUYAMCU, "TuyaMCU packet too large, %i > %i\n", len, maxSize);
-			ret = 0;
-		}
-		// consume whole packet (but don't touch next one, if any)
-		UART_ConsumeBytes(len);
-		return ret;
-	}
-	return 0;
+	return len;
 }
 
 
 
-
 // append header, len, everything, checksum
 void TuyaMCU_SendCommandWithData(byte cmdType, byte* data, int payload_len) {
 	int i;
@@ -743,14 +792,11 @@ void TuyaMCU_SendNetworkStatus()
 	TuyaMCU_SendCommandWithData(0x2B, &state, 1);
 }
 void TuyaMCU_ForcePublishChannelValues() {
-	tuyaMCUMapping_t* cur;
+	int i;
 
-	cur = g_tuyaMappings;
-	while (cur) {
-		MQTT_ChannelPublish(cur->channel, 0);
-		cur = cur->next;
+	for (i = 0; i < g_numTuyaMappings; i++) {
+		MQTT_ChannelPublish(g_tuyaMappings[i].channel, 0);
 	}
-	return 0;
 }
 // ntp_timeZoneOfs 2
 // addRepeatingEvent 10 -1 uartSendHex 55AA0008000007
@@ -804,15 +850,9 @@ void TuyaMCU_ApplyMapping(int fnID, int value) {
 }
 
 bool TuyaMCU_IsChannelUsedByTuyaMCU(int channel) {
-	tuyaMCUMapping_t* mapping;
-
-	// find mapping
-	mapping = TuyaMCU_FindDefForChannel(channel);
-
-	if (mapping == 0) {
+	if (channel < 0 || channel >= CHANNEL_MAX)
 		return false;
-	}
-	return true;
+	return (g_tuyaUsedChannels[channel / 32] & (1U << (channel % 32))) != 0;
 }
 void TuyaMCU_OnChannelChanged(int channel, int iVal) {
 	tuyaMCUMapping_t* mapping;
@@ -1133,7 +1173,7 @@ void TuyaMCU_ProcessIncoming(const byte* data, int len) {
 		return;
 	}
 	version = data[2];
-	checkLen = data[5] | data[4] >> 8;
+	checkLen = data[5] | data[4] << 8;
 	checkLen = checkLen + 2 + 1 + 1 + 2 + 1;
 	if (checkLen != len) {
 		addLogAdv(LOG_INFO, LOG_FEATURE_TUYAMCU, "TuyaMCU_ProcessIncoming: discarding packet bad expected len, expected %i and got len %i\n", checkLen, len);
@@ -1309,12 +1349,47 @@ void TuyaMCU_RunWiFiUpdateAndPackets() {
 		//addLogAdv(LOG_INFO, LOG_FEATURE_TUYAMCU,"TuyaMCU_Wifi_State timer");
 	}
 }
-void TuyaMCU_RunFrame() {
-	byte data[128];
+// Writes data as hex into out, truncated to outSize
+static void TuyaMCU_FormatHex(char* out, int outSize, const byte* data, int len, bool bSpaces) {
+	static const char hex[] = "0123456789ABCDEF";
+	int i, step;
+
+	step = bSpaces ? 3 : 2;
+	for (i = 0; i < len && (i + 1) * step < outSize; i++) {
+		*out++ = hex[data[i] >> 4];
+		*out++ = hex[data[i] & 0xF];
+		if (bSpaces)
+			*out++ = ' ';
+	}
+	*out = 0;
+}
+// Processes all complete frames from UART buffer, returns their count
+int TuyaMCU_ProcessReceivedFrames() {
+	const byte* data;
 	char buffer_for_log[256];
-	char buffer2[4];
-	int len, i;
+	int len;
+	int c = 0;
 
+	while ((len = UART_TryToGetNextTuyaPacket(&data)) > 0) {
+		c++;
+		// text versions are made only if someone is going to read them
+		if (LOG_IsEnabled(LOG_INFO, LOG_FEATURE_TUYAMCU)) {
+			TuyaMCU_FormatHex(buffer_for_log, sizeof(buffer_for_log), data, len, true);
+			addLogAdv(LOG_INFO, LOG_FEATURE_TUYAMCU, "TUYAMCU received: %s\n", buffer_for_log);
+		}
+		if (EventHandlers_HasHandlers(CMD_EVENT_ON_UART)) {
+			// fire string event, so we can have event handlers that fire
+			// when an UART string is received...
+			TuyaMCU_FormatHex(buffer_for_log, sizeof(buffer_for_log), data, len, false);
+			EventHandlers_FireEvent_String(CMD_EVENT_ON_UART, buffer_for_log);
+		}
+		TuyaMCU_ProcessIncoming(data, len);
+		// frame is still in UART buffer until now
+		UART_ConsumeBytes(len);
+	}
+	return c;
+}
+void TuyaMCU_RunFrame() {
 	//addLogAdv(LOG_INFO, LOG_FEATURE_TUYAMCU,"UART ring buffer state: %i %i\n",g_recvBufIn,g_recvBufOut);
 
 	// extraDebug log level
@@ -1323,34 +1398,7 @@ void TuyaMCU_RunFrame() {
 		(int)heartbeat_valid, (int)product_information_valid, (int)self_processing_mode,
 		(int)wifi_state_valid, (int)wifi_state_timer);
 
-	while (1)
-	{
-		len = UART_TryToGetNextTuyaPacket(data, sizeof(data));
-		if (len > 0) {
-			buffer_for_log[0] = 0;
-			for (i = 0; i < len; i++) {
-				snprintf(buffer2, sizeof(buffer2), "%02X ", data[i]);
-				strcat_safe(buffer_for_log, buffer2, sizeof(buffer_for_log));
-			}
-			addLogAdv(LOG_INFO, LOG_FEATURE_TUYAMCU, "TUYAMCU received: %s\n", buffer_for_log);
-#if 1
-			// redo sprintf without spaces
-			buffer_for_log[0] = 0;
-			for (i = 0; i < len; i++) {
-				snprintf(buffer2, sizeof(buffer2), "%02X", data[i]);
-				strcat_safe(buffer_for_log, buffer2, sizeof(buffer_for_log));
-			}
-			// fire string event, as we already have it sprintfed
-			// This is so we can have event handlers that fire
-			// when an UART string is received...
-			EventHandlers_FireEvent_String(CMD_EVENT_ON_UART, buffer_for_log);
-#endif
-			TuyaMCU_ProcessIncoming(data, len);
-		}
-		else {
-			break;
-		}
-	}
+	TuyaMCU_ProcessReceivedFrames();
 
 	/* Command controll */
 	if (heartbeat_timer == 0)
@@ -1446,7 +1494,8 @@ commandResult_t TuyaMCU_SetBaudRate(const void* context, const char* cmd, const
 void TuyaMCU_Init()
 {
 	UART_InitUART(g_baudRate);
-	UART_InitReceiveRingBuffer(256);
+	UART_InitReceiveRingBuffer(TUYAMCU_UART_RECEIVE_BUFFER_SIZE);
+	TuyaMCU_ResetParser();
 	// uartSendHex 55AA0008000007
 	//cmddetail:{"name":"tuyaMcu_testSendTime","args":"",
 	//cmddetail:"descr":"Sends a example date by TuyaMCU to clock/callendar MCU",
@@ -2,6 +2,7 @@
 
 void TuyaMCU_Init();
 void TuyaMCU_RunFrame();
+int TuyaMCU_ProcessReceivedFrames();
 void TuyaMCU_Send(byte *data, int size);
 void TuyaMCU_OnChannelChanged(int channel,int iVal);
 void TuyaMCU_Send_RawBuffer(byte *data, int len);
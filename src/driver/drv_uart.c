@@ -108,6 +108,7 @@ void UART_InitReceiveRingBuffer(int size){
 	memset(g_recvBuf,0,size);
 	g_recvBufSize = size;
 	g_recvBufIn = 0;
+	g_recvBufOut = 0;
 }
 int UART_GetDataSize()
 {
@@ -123,16 +124,32 @@ int UART_GetDataSize()
 }
 byte UART_GetNextByte(int index) {
 	int realIndex = g_recvBufOut + index;
-	if(realIndex > g_recvBufSize)
+	if(realIndex >= g_recvBufSize)
 		realIndex -= g_recvBufSize;
 
 	return g_recvBuf[realIndex];
 }
 void UART_ConsumeBytes(int idx) {
 	g_recvBufOut += idx;
-	if(g_recvBufOut > g_recvBufSize)
+	if(g_recvBufOut >= g_recvBufSize)
 		g_recvBufOut -= g_recvBufSize;
 }
+int UART_GetReceiveBufferSize() {
+	return g_recvBufSize;
+}
+// Returns first count bytes of received data without consuming them.
+// Points straight into ring buffer, unless data wraps around its end,
+// then it's copied into scratch (which must hold count bytes).
+const byte *UART_GetDataView(int count, byte *scratch) {
+	int first;
+
+	if(g_recvBufOut + count <= g_recvBufSize)
+		return g_recvBuf + g_recvBufOut;
+	first = g_recvBufSize - g_recvBufOut;
+	memcpy(scratch, g_recvBuf + g_recvBufOut, first);
+	memcpy(scratch + first, g_recvBuf, count - first);
+	return scratch;
+}
 
 void UART_AppendByteToCircularBuffer(int rc) {
     if(UART_GetDataSize() < (g_recvBufSize-1))
@@ -5,6 +5,8 @@ void UART_InitReceiveRingBuffer(int size);
 int UART_GetDataSize();
 byte UART_GetNextByte(int index);
 void UART_ConsumeBytes(int idx);
+int UART_GetReceiveBufferSize();
+const byte *UART_GetDataView(int count, byte *scratch);
 void UART_AppendByteToCircularBuffer(int rc);
 void UART_SendByte(byte b);
 void UART_InitUART(int baud);
@@ -2,16 +2,35 @@
 	This module saves variable data to a flash region in an erase effient way.
 
 	Design:
-	variables to be small - we want as many writes between erases as possible.
-	sector will be all FF (erased), and data added into it.
-	reading consists of searching the first non FF byte from the end, then
-	reading the preceding bytes as the variables.
-	last byte of data is len (!== 0xFF!)
-
+	The region is two erase sectors used as a journal.
+	Each sector starts with a header (magic, sequence number, erase count).
+	The sector with valid magic and highest sequence is the active one.
+	After the header, small typed records are appended:
+		[type][index][len][check] [payload of len bytes]
+	type 0xFF means free (erased) space, so the first 0xFF type ends the journal.
+	Reading replays all records in order, the last record of each kind wins.
+
+	Writes are coalesced in RAM. Channel/LED changes only mark state as dirty
+	and are committed after a short delay (see HAL_FlashVars_SetCommitDelay),
+	so a dimmer slider drag ends up as a single record instead of one per step.
+	Boot counters and energy metering are committed immediately.
+	Energy total and finished days have their own small records, so
+	the periodic consumption save doesn't rewrite the whole metering structure.
+
+	When the active sector is full, the other sector is erased and a snapshot
+	of the whole state is written there with a higher sequence number.
+	Only one sector is erased per compaction, so wear is spread over both.
+
+	Older firmware stored a whole 64 byte FLASH_VARS_STRUCTURE per write,
+	that format is still read once and migrated.
 */
 
 #ifndef PLATFORM_XR809
 
+#if WINDOWS
+#include "../../new_common.h"
+#include "../hal_flashVars.h"
+#else
 #include "include.h"
 #include "mem_pub.h"
 #include "drv_model_pub.h"
@@ -21,39 +40,103 @@
 
 #include "BkDriverFlash.h"
 #include "BkDriverUart.h"
+#endif
 
 #include "../../logging/logging.h"
 
-extern FLASH_VARS_STRUCTURE flash_vars;
-
-
-int flash_vars_init();
-int flash_vars_write();
-
-// for testing only...  only done once at startup...
-extern int flash_vars_offset;
-int flash_vars_read(FLASH_VARS_STRUCTURE* data);
-
-
-
 //#define TEST_MODE
 //#define debug_delay(x) rtos_delay_milliseconds(x)
 #define debug_delay(x)
 
+// magic of the old, whole structure format
 #define FLASH_VARS_MAGIC 0xfefefefe
+// magic of the journal format
+#define FLASH_VARS_JOURNAL_MAGIC 0x4a564b4f
 // NOTE: Changed below according to partitions in SDK!!!!
 static unsigned int flash_vars_start = 0x1e3000; //0x1e1000 + 0x1000 + 0x1000; // after netconfig and mystery SSID
 static unsigned int flash_vars_len = 0x2000; // two blocks in BK7231
 static unsigned int flash_vars_sector_len = 0x1000; // erase size in BK7231
 
+typedef struct flash_vars_sector_header_s {
+	unsigned int magic;
+	// higher is newer
+	unsigned int sequence;
+	// how many times this sector was erased, for wear reporting
+	unsigned int eraseCount;
+} flash_vars_sector_header_t;
+
+typedef struct flash_vars_record_header_s {
+	byte type;
+	byte index;
+	byte len;
+	byte check;
+} flash_vars_record_header_t;
+
+enum {
+	FLASH_VARS_REC_BOOT = 1,
+	FLASH_VARS_REC_CHANNEL = 2,
+	FLASH_VARS_REC_LED = 3,
+	FLASH_VARS_REC_EMETERING = 4,
+	FLASH_VARS_REC_ENERGY_TOTAL = 5,
+	// index is day number modulo MAX_SAVED_ENERGY_DAYS
+	FLASH_VARS_REC_ENERGY_DAY = 6,
+	FLASH_VARS_REC_FREE = 0xFF,
+};
+
+typedef struct flash_vars_boot_s {
+	unsigned short boot_count;
+	unsigned short boot_success_count;
+} flash_vars_boot_t;
+
+typedef struct flash_vars_led_s {
+	byte mode;
+	byte enableAll;
+	byte rgb[3];
+	byte reserved;
+	short brightness;
+	short temperature;
+} flash_vars_led_t;
+
+typedef struct flash_vars_energy_day_s {
+	// 0 means empty slot
+	unsigned short day;
+	unsigned short reserved;
+	float consumption;
+} flash_vars_energy_day_t;
+
+// boot counts and energy metering; channels and LED are kept separately
 FLASH_VARS_STRUCTURE flash_vars;
-int flash_vars_offset = 0; // offset to first FF in our area
-static int flash_vars_initialised = 0; // offset to first FF in our area
-
-static int flash_vars_valid();
-static int flash_vars_write_magic();
+static int flash_vars_channels[MAX_RETAIN_CHANNELS];
+static flash_vars_led_t flash_vars_led;
+static ENERGY_TOTAL_DATA flash_vars_energyTotal;
+static byte flash_vars_hasEnergyTotal = 0;
+static flash_vars_energy_day_t flash_vars_energyDays[MAX_SAVED_ENERGY_DAYS];
+
+int flash_vars_offset = 0; // offset to first free byte in active sector
+static int flash_vars_initialised = 0;
+static int flash_vars_active = -1; // active sector index, 0 or 1
+static unsigned int flash_vars_sequence = 0;
+static unsigned int flash_vars_eraseCounts[2];
+
+// pending changes
+static unsigned int flash_vars_dirtyChannels[(MAX_RETAIN_CHANNELS + 31) / 32];
+static byte flash_vars_dirtyBoot = 0;
+static byte flash_vars_dirtyLED = 0;
+static byte flash_vars_dirtyEnergy = 0;
+static byte flash_vars_dirtyEnergyTotal = 0;
+static unsigned int flash_vars_dirtyEnergyDays = 0;
+static int flash_vars_commitDelay = 2;
+static int flash_vars_commitIn = -1;
+
+// statistics
+static int flash_vars_stat_saves = 0;
+static int flash_vars_stat_records = 0;
+static int flash_vars_stat_commits = 0;
+
+static int flash_vars_read_raw(void* data, unsigned int off_set, unsigned int size);
 static int _flash_vars_write(void* data, unsigned int off_set, unsigned int size);
 static int flash_vars_erase(unsigned int off_set, unsigned int size);
+static int flash_vars_compact();
 int flash_vars_read(FLASH_VARS_STRUCTURE* data);
 
 #if WINDOWS
@@ -66,19 +149,47 @@ int flash_vars_read(FLASH_VARS_STRUCTURE* data);
 
 #ifdef TEST_MODE
 
-static char test_flash_area[0x2000];
-
-#endif
-
-
-static void alignOffset(int* offs) {
-	// do nothing - should work with any offsets
-	/*
-	if ((*offs) % 32){
-		(*offs) += (32- ((*offs)%32));
-	}*/
+static byte test_flash_area[0x2000];
+// wear and latency model of the simulated flash.
+// Times are rough figures for a typical SPI NOR flash.
+#define TEST_FLASH_ERASE_US			45000
+#define TEST_FLASH_PAGE_PROGRAM_US	700
+#define TEST_FLASH_PAGE_SIZE		256
+static int test_flash_eraseCounts[2];
+static int test_flash_bytesWritten = 0;
+static int test_flash_busyUs = 0;
+// writes that tried to flip 0 bits back to 1 without an erase
+static int test_flash_badWrites = 0;
+// power loss simulation - writes allowed after next erase, then all writes fail
+static int test_flash_failAfterErase = -1;
+static int test_flash_writesLeft = -1;
+
+void SIM_FlashVars_GetStats(int* erases0, int* erases1, int* bytesWritten, int* busyUs, int* badWrites) {
+	*erases0 = test_flash_eraseCounts[0];
+	*erases1 = test_flash_eraseCounts[1];
+	*bytesWritten = test_flash_bytesWritten;
+	*busyUs = test_flash_busyUs;
+	*badWrites = test_flash_badWrites;
+}
+// bErase - blank device, otherwise it's a simulated power cycle (RAM state and pending changes are lost)
+void SIM_FlashVars_Reset(bool bErase) {
+	if (bErase) {
+		memset(test_flash_area, 0xff, sizeof(test_flash_area));
+		memset(test_flash_eraseCounts, 0, sizeof(test_flash_eraseCounts));
+		test_flash_bytesWritten = 0;
+		test_flash_busyUs = 0;
+		test_flash_badWrites = 0;
+	}
+	test_flash_failAfterErase = -1;
+	test_flash_writesLeft = -1;
+	flash_vars_initialised = 0;
+	flash_vars_commitIn = -1;
+}
+void SIM_FlashVars_FailWritesAfterErase(int writes) {
+	test_flash_failAfterErase = writes;
 }
 
+#endif
 
 // initialise and read variables from flash
 int flash_vars_init() {
@@ -87,13 +198,11 @@ int flash_vars_init() {
 #else
 	bk_logic_partition_t* pt;
 #endif
-	//direct_serial_log = 1;
 
 	if (!flash_vars_initialised) {
 		ADDLOG_DEBUG(LOG_FEATURE_CFG, "flash vars not initialised - reading");
 		debug_delay(200);
 
-
 #if WINDOWS
 #elif PLATFORM_XR809
 #else
@@ -104,324 +213,430 @@ int flash_vars_init() {
 		flash_vars_len = 0x2000; // two blocks in BK7231
 		flash_vars_sector_len = 0x1000; // erase size in BK7231
 #endif
-		//ADDLOG_DEBUG(LOG_FEATURE_CFG, "got part info");
-		debug_delay(200);
-
-		os_memset(&flash_vars, 0, sizeof(flash_vars));
-		flash_vars.len = sizeof(flash_vars);
-
-		//ADDLOG_DEBUG(LOG_FEATURE_CFG, "cleared structure");
-		debug_delay(200);
 		// read any existing
 		flash_vars_read(&flash_vars);
 		flash_vars_initialised = 1;
-		//ADDLOG_DEBUG(LOG_FEATURE_CFG, "read structure");
-		debug_delay(200);
-	}
-	else {
-		//ADDLOG_DEBUG(LOG_FEATURE_CFG, "flash vars already initialised");
-
 	}
 	return 0;
 }
 
-static int flash_vars_valid() {
-	//uint32_t i;
-	//uint32_t param;
-	UINT32 status;
-#ifndef TEST_MODE
-	DD_HANDLE flash_hdl;
-#endif
-	uint32_t start_addr;
-	unsigned int tmp = 0xffffffff;
-	GLOBAL_INT_DECLARATION();
-	//ADDLOG_DEBUG(LOG_FEATURE_CFG, "flash_vars_valid()");
-	debug_delay(200);
-
-#ifndef TEST_MODE
-	flash_hdl = ddev_open(FLASH_DEV_NAME, &status, 0);
-	ASSERT(DD_HANDLE_UNVALID != flash_hdl);
-	bk_flash_enable_security(FLASH_PROTECT_NONE);
-#endif
-	start_addr = flash_vars_start;
-
-	//ADDLOG_DEBUG(LOG_FEATURE_CFG, "flash_vars_valid() flash open");
-	debug_delay(200);
-
-#ifdef TEST_MODE
-	os_memcpy(&tmp, &test_flash_area[start_addr - flash_vars_start], sizeof(tmp));
-#else
-	GLOBAL_INT_DISABLE();
-	ddev_read(flash_hdl, (char*)&tmp, sizeof(tmp), start_addr);
-	GLOBAL_INT_RESTORE();
-	ddev_close(flash_hdl);
-	bk_flash_enable_security(FLASH_PROTECT_ALL);
-#endif
-	//ADDLOG_DEBUG(LOG_FEATURE_CFG, "flash_vars_valid() copied header 0x%x", tmp);
-	debug_delay(200);
+static byte flash_vars_checksum(flash_vars_record_header_t* h, const byte* payload) {
+	byte c = 0x5A ^ h->type ^ h->index ^ h->len;
+	int i;
+	for (i = 0; i < h->len; i++) {
+		c = (c << 1 | c >> 7) ^ payload[i];
+	}
+	// must never look like erased flash
+	if (c == 0xFF)
+		c = 0;
+	return c;
+}
 
-	// if not our magic, then erase and write magic
-	if (tmp != FLASH_VARS_MAGIC) {
-		ADDLOG_ERROR(LOG_FEATURE_CFG, "flash_vars_valid - not our magic, erase");
-		debug_delay(200);
-		if (flash_vars_write_magic() >= 0) {
-			ADDLOG_DEBUG(LOG_FEATURE_CFG, "flash initialised");
+static void flash_vars_apply(flash_vars_record_header_t* h, const byte* payload) {
+	switch (h->type) {
+	case FLASH_VARS_REC_BOOT:
+		if (h->len == sizeof(flash_vars_boot_t)) {
+			flash_vars_boot_t b;
+			memcpy(&b, payload, sizeof(b));
+			flash_vars.boot_count = b.boot_count;
+			flash_vars.boot_success_count = b.boot_success_count;
 		}
-		else {
-			ADDLOG_ERROR(LOG_FEATURE_CFG, "flash initialise failed");
-			return -1;
+		break;
+	case FLASH_VARS_REC_CHANNEL:
+		if (h->len == sizeof(int) && h->index < MAX_RETAIN_CHANNELS) {
+			memcpy(&flash_vars_channels[h->index], payload, sizeof(int));
 		}
-		return 0;
+		break;
+	case FLASH_VARS_REC_LED:
+		if (h->len == sizeof(flash_vars_led_t)) {
+			memcpy(&flash_vars_led, payload, sizeof(flash_vars_led_t));
+		}
+		break;
+	case FLASH_VARS_REC_EMETERING:
+		if (h->len == sizeof(ENERGY_METERING_DATA)) {
+			memcpy(&flash_vars.emetering, payload, sizeof(ENERGY_METERING_DATA));
+		}
+		break;
+	case FLASH_VARS_REC_ENERGY_TOTAL:
+		if (h->len == sizeof(ENERGY_TOTAL_DATA)) {
+			memcpy(&flash_vars_energyTotal, payload, sizeof(ENERGY_TOTAL_DATA));
+			flash_vars_hasEnergyTotal = 1;
+		}
+		break;
+	case FLASH_VARS_REC_ENERGY_DAY:
+		if (h->len == sizeof(flash_vars_energy_day_t) && h->index < MAX_SAVED_ENERGY_DAYS) {
+			memcpy(&flash_vars_energyDays[h->index], payload, sizeof(flash_vars_energy_day_t));
+		}
+		break;
 	}
-	return 1;
 }
 
-static int flash_vars_write_magic() {
-	//uint32_t i;
-	//uint32_t param;
-	UINT32 status;
-#ifndef TEST_MODE
-	DD_HANDLE flash_hdl;
-#endif
-	uint32_t start_addr;
-	unsigned int tmp = FLASH_VARS_MAGIC;
-	GLOBAL_INT_DECLARATION();
-	//ADDLOG_DEBUG(LOG_FEATURE_CFG, "flash_vars_magic write");
-	debug_delay(200);
-
-	start_addr = flash_vars_start;
-	//ADDLOG_DEBUG(LOG_FEATURE_CFG, "flash open");
-	debug_delay(200);
+// write single record at given offset of given sector, returns -1 if it does not fit or write fails
+static int flash_vars_append_to(int sector, int* offset, byte type, byte index, const void* payload, int len) {
+	byte buffer[sizeof(flash_vars_record_header_t) + 64];
+	flash_vars_record_header_t* h = (flash_vars_record_header_t*)buffer;
+	int total = sizeof(flash_vars_record_header_t) + len;
 
-	if (flash_vars_erase(0, flash_vars_len) >= 0) {
-		ADDLOG_DEBUG(LOG_FEATURE_CFG, "flash erased");
-		debug_delay(200);
+	if (len > 64) {
+		return -1;
 	}
-	else {
-		ADDLOG_ERROR(LOG_FEATURE_CFG, "flash erase failed");
-		debug_delay(200);
+	if (sector < 0 || *offset + total > flash_vars_sector_len) {
 		return -1;
 	}
-#ifdef TEST_MODE
-	os_memcpy(&test_flash_area[start_addr - flash_vars_start], &tmp, sizeof(tmp));
-#else
-	bk_flash_enable_security(FLASH_PROTECT_NONE);
-
-	flash_hdl = ddev_open(FLASH_DEV_NAME, &status, 0);
-	ASSERT(DD_HANDLE_UNVALID != flash_hdl);
-	GLOBAL_INT_DISABLE();
-	ddev_write(flash_hdl, (char*)&tmp, sizeof(tmp), start_addr);
-	GLOBAL_INT_RESTORE();
-	ddev_close(flash_hdl);
-	bk_flash_enable_security(FLASH_PROTECT_ALL);
-#endif
-	ADDLOG_DEBUG(LOG_FEATURE_CFG, "header written");
-	// next write point
-	flash_vars_offset = sizeof(tmp);
-	alignOffset(&flash_vars_offset);
+	h->type = type;
+	h->index = index;
+	h->len = len;
+	memcpy(buffer + sizeof(flash_vars_record_header_t), payload, len);
+	h->check = flash_vars_checksum(h, buffer + sizeof(flash_vars_record_header_t));
+	if (_flash_vars_write(buffer, sector * flash_vars_sector_len + *offset, total) < 0) {
+		return -1;
+	}
+	*offset += total;
+	flash_vars_stat_records++;
+	return 0;
+}
+// append single record to active sector, returns -1 if it does not fit
+static int flash_vars_append(byte type, byte index, const void* payload, int len) {
+	return flash_vars_append_to(flash_vars_active, &flash_vars_offset, type, index, payload, len);
+}
 
-	ADDLOG_DEBUG(LOG_FEATURE_CFG, "header written %d", flash_vars_offset);
-	debug_delay(200);
+static void flash_vars_boot_to_record(flash_vars_boot_t* b) {
+	b->boot_count = flash_vars.boot_count;
+	b->boot_success_count = flash_vars.boot_success_count;
+}
 
-	// write a new structure
-	flash_vars_write();
+static void flash_vars_clear_dirty() {
+	memset(flash_vars_dirtyChannels, 0, sizeof(flash_vars_dirtyChannels));
+	flash_vars_dirtyBoot = 0;
+	flash_vars_dirtyLED = 0;
+	flash_vars_dirtyEnergy = 0;
+	flash_vars_dirtyEnergyTotal = 0;
+	flash_vars_dirtyEnergyDays = 0;
+	flash_vars_commitIn = -1;
+}
 
+// Erase the other sector and write full state snapshot there.
+// Header is written last, so until then boot still picks the old sector;
+// if anything fails, the old sector stays active.
+static int flash_vars_compact() {
+	flash_vars_sector_header_t hdr;
+	flash_vars_boot_t b;
+	int target;
+	int offset;
+	int res;
+	int i;
+
+	target = (flash_vars_active == 0) ? 1 : 0;
+	if (flash_vars_erase(target * flash_vars_sector_len, flash_vars_sector_len) < 0) {
+		ADDLOG_ERROR(LOG_FEATURE_CFG, "flash vars compact - erase failed");
+		return -1;
+	}
+	flash_vars_eraseCounts[target]++;
+	offset = sizeof(hdr);
+	res = 0;
+
+	flash_vars_boot_to_record(&b);
+	res |= flash_vars_append_to(target, &offset, FLASH_VARS_REC_BOOT, 0, &b, sizeof(b));
+	res |= flash_vars_append_to(target, &offset, FLASH_VARS_REC_LED, 0, &flash_vars_led, sizeof(flash_vars_led));
+	res |= flash_vars_append_to(target, &offset, FLASH_VARS_REC_EMETERING, 0, &flash_vars.emetering, sizeof(flash_vars.emetering));
+	if (flash_vars_hasEnergyTotal) {
+		res |= flash_vars_append_to(target, &offset, FLASH_VARS_REC_ENERGY_TOTAL, 0, &flash_vars_energyTotal, sizeof(flash_vars_energyTotal));
+	}
+	for (i = 0; i < MAX_SAVED_ENERGY_DAYS; i++) {
+		if (flash_vars_energyDays[i].day) {
+			res |= flash_vars_append_to(target, &offset, FLASH_VARS_REC_ENERGY_DAY, i, &flash_vars_energyDays[i], sizeof(flash_vars_energy_day_t));
+		}
+	}
+	for (i = 0; i < MAX_RETAIN_CHANNELS; i++) {
+		// missing channel record means 0
+		if (flash_vars_channels[i]) {
+			res |= flash_vars_append_to(target, &offset, FLASH_VARS_REC_CHANNEL, i, &flash_vars_channels[i], sizeof(int));
+		}
+	}
+	if (res < 0) {
+		ADDLOG_ERROR(LOG_FEATURE_CFG, "flash vars compact - snapshot write failed, keeping sector %d", flash_vars_active);
+		return -1;
+	}
+	// commit point
+	hdr.magic = FLASH_VARS_JOURNAL_MAGIC;
+	hdr.sequence = flash_vars_sequence + 1;
+	hdr.eraseCount = flash_vars_eraseCounts[target];
+	if (_flash_vars_write(&hdr, target * flash_vars_sector_len, sizeof(hdr)) < 0) {
+		ADDLOG_ERROR(LOG_FEATURE_CFG, "flash vars compact - header write failed, keeping sector %d", flash_vars_active);
+		return -1;
+	}
+	flash_vars_sequence = hdr.sequence;
+	flash_vars_active = target;
+	flash_vars_offset = offset;
+
+	// snapshot contains everything, nothing is pending anymore
+	flash_vars_clear_dirty();
+	ADDLOG_INFO(LOG_FEATURE_CFG, "flash vars compacted to sector %d, seq %u, erases %u, used %d",
+		target, flash_vars_sequence, flash_vars_eraseCounts[target], flash_vars_offset);
 	return 0;
 }
 
+static int flash_vars_append_or_compact(byte type, byte index, const void* payload, int len) {
+	if (flash_vars_append(type, index, payload, len) == 0) {
+		return 0;
+	}
+	// does not fit - snapshot includes this change too
+	return flash_vars_compact();
+}
 
-// read data from flash vars area.
+// write all pending changes as journal records
+int flash_vars_write() {
+	flash_vars_boot_t b;
+	int i;
+
+	flash_vars_init();
+	flash_vars_stat_commits++;
+	if (flash_vars_dirtyBoot) {
+		flash_vars_dirtyBoot = 0;
+		flash_vars_boot_to_record(&b);
+		flash_vars_append_or_compact(FLASH_VARS_REC_BOOT, 0, &b, sizeof(b));
+	}
+	if (flash_vars_dirtyLED) {
+		flash_vars_dirtyLED = 0;
+		flash_vars_append_or_compact(FLASH_VARS_REC_LED, 0, &flash_vars_led, sizeof(flash_vars_led));
+	}
+	if (flash_vars_dirtyEnergy) {
+		flash_vars_dirtyEnergy = 0;
+		flash_vars_append_or_compact(FLASH_VARS_REC_EMETERING, 0, &flash_vars.emetering, sizeof(flash_vars.emetering));
+	}
+	if (flash_vars_dirtyEnergyTotal) {
+		flash_vars_dirtyEnergyTotal = 0;
+		flash_vars_append_or_compact(FLASH_VARS_REC_ENERGY_TOTAL, 0, &flash_vars_energyTotal, sizeof(flash_vars_energyTotal));
+	}
+	for (i = 0; i < MAX_SAVED_ENERGY_DAYS; i++) {
+		if (flash_vars_dirtyEnergyDays & (1U << i)) {
+			flash_vars_dirtyEnergyDays &= ~(1U << i);
+			flash_vars_append_or_compact(FLASH_VARS_REC_ENERGY_DAY, i, &flash_vars_energyDays[i], sizeof(flash_vars_energy_day_t));
+		}
+	}
+	for (i = 0; i < MAX_RETAIN_CHANNELS; i++) {
+		if (flash_vars_dirtyChannels[i / 32] & (1U << (i % 32))) {
+			flash_vars_dirtyChannels[i / 32] &= ~(1U << (i % 32));
+			flash_vars_append_or_compact(FLASH_VARS_REC_CHANNEL, i, &flash_vars_channels[i], sizeof(int));
+		}
+	}
+	flash_vars_commitIn = -1;
+
+	ADDLOG_DEBUG(LOG_FEATURE_CFG, "flash vars commit - sector %d, offset %d, boot_count %d, success count %d",
+		flash_vars_active,
+		flash_vars_offset,
+		flash_vars.boot_count,
+		flash_vars.boot_success_count
+	);
+	return 1;
+}
+
+// read the old format - whole structure written again and again after magic.
 // design:
 // search from end of flash until we find a non-zero byte.
 // this is length of existing data.
-// clear structure to 00
 // read existing data (excluding len) into structure.
-// set len to current structure defn len.
-// remember first FF byte offset
-int flash_vars_read(FLASH_VARS_STRUCTURE* data) {
-	//uint32_t i;
-	//uint32_t param;
-	UINT32 status;
-#ifndef TEST_MODE
-	DD_HANDLE flash_hdl;
-#endif
+static int flash_vars_read_legacy(FLASH_VARS_STRUCTURE* data) {
 	uint32_t start_addr;
 	int loops = 0x2100 / 4;
 	unsigned int tmp = 0xffffffff;
-	GLOBAL_INT_DECLARATION();
-	//ADDLOG_DEBUG(LOG_FEATURE_CFG, "flash_vars_read len %d", sizeof(*data));
-
-	// check for magic, and reset sector(s) if not.
-	if (flash_vars_valid() >= 0) {
-		//ADDLOG_DEBUG(LOG_FEATURE_CFG, "flash vars valid or initialised");
-	}
-	else {
-		ADDLOG_ERROR(LOG_FEATURE_CFG, "flash_vars_validity error");
-		os_memset(data, 0, sizeof(*data));
-		data->len = sizeof(*data);
-		debug_delay(200);
-		return -1;
-	}
-	debug_delay(200);
-
-#ifndef TEST_MODE
-	flash_hdl = ddev_open(FLASH_DEV_NAME, &status, 0);
-	ASSERT(DD_HANDLE_UNVALID != flash_hdl);
-	bk_flash_enable_security(FLASH_PROTECT_NONE);
-#endif
-	start_addr = flash_vars_start + flash_vars_len;
+	int shifts = 0;
+	int len = 0;
 
+	start_addr = flash_vars_len;
 	do {
 		start_addr -= sizeof(tmp);
-#ifdef TEST_MODE
-		os_memcpy(&tmp, &test_flash_area[start_addr - flash_vars_start], sizeof(tmp));
-#else
-		GLOBAL_INT_DISABLE();
-		ddev_read(flash_hdl, (char*)&tmp, sizeof(tmp), start_addr);
-		GLOBAL_INT_RESTORE();
-#endif
-	} while ((tmp == 0xFFFFFFFF) && (start_addr > flash_vars_start + 4) && (loops--));
-	if (!loops) {
-		ADDLOG_ERROR(LOG_FEATURE_CFG, "loops over addr 0x%X", start_addr);
-	}
+		flash_vars_read_raw(&tmp, start_addr, sizeof(tmp));
+	} while ((tmp == 0xFFFFFFFF) && (start_addr > 4) && (loops--));
 
-	//ADDLOG_DEBUG(LOG_FEATURE_CFG, "found at %u 0x%X", start_addr, tmp);
 	start_addr += sizeof(tmp);
-	debug_delay(200);
-
 	if (tmp == 0xffffffff) {
-		// no data found, all erased
-		// clear result.
-		os_memset(data, 0, sizeof(*data));
-		// set the len to the latest revision's len
-		data->len = sizeof(*data);
-#ifndef TEST_MODE
-		ddev_close(flash_hdl);
-		bk_flash_enable_security(FLASH_PROTECT_ALL);
-#endif
-		ADDLOG_INFO(LOG_FEATURE_CFG, "new flash vars");
 		return 0;
 	}
-	else {
-		int shifts = 0;
-		int len = 0;
-		while ((tmp & 0xFF000000) == 0xFF000000) {
-			tmp <<= 8;
-			shifts++;
-		}
-		len = (tmp >> 24) & 0xff;
-		start_addr -= shifts;
-		start_addr -= len;
+	while ((tmp & 0xFF000000) == 0xFF000000) {
+		tmp <<= 8;
+		shifts++;
+	}
+	len = (tmp >> 24) & 0xff;
+	start_addr -= shifts;
+	start_addr -= len;
+	if (len > sizeof(*data) || len == 0) {
+		ADDLOG_ERROR(LOG_FEATURE_CFG, "len (%d) in flash_var greater than current structure len (%d)", len, sizeof(*data));
+		return 0;
+	}
+	flash_vars_read_raw(data, start_addr, len - 1);
+	return 1;
+}
 
-		if (len > sizeof(*data)) {
-			ADDLOG_ERROR(LOG_FEATURE_CFG, "len (%d) in flash_var greater than current structure len (%d)", len, sizeof(*data));
-#ifndef TEST_MODE
-			ddev_close(flash_hdl);
-			bk_flash_enable_security(FLASH_PROTECT_ALL);
-#endif
-			// erase it all and write a new one
-			flash_vars_write_magic();
+static void flash_vars_migrate_legacy() {
+	FLASH_VARS_STRUCTURE old;
+	int i;
+
+	os_memset(&old, 0, sizeof(old));
+	if (flash_vars_read_legacy(&old) == 0) {
+		return;
+	}
+	ADDLOG_INFO(LOG_FEATURE_CFG, "flash vars - migrating old format, boot count %d", old.boot_count);
+	flash_vars.boot_count = old.boot_count;
+	flash_vars.boot_success_count = old.boot_success_count;
+	memcpy(&flash_vars.emetering, &old.emetering, sizeof(old.emetering));
+	for (i = 0; i < MAX_RETAIN_CHANNELS_LEGACY; i++) {
+		flash_vars_channels[i] = old.savedValues[i];
+	}
+	// old format kept LED state in the last channel slots
+	flash_vars_led.enableAll = old.savedValues[MAX_RETAIN_CHANNELS_LEGACY - 4];
+	flash_vars_led.mode = old.savedValues[MAX_RETAIN_CHANNELS_LEGACY - 3];
+	flash_vars_led.temperature = old.savedValues[MAX_RETAIN_CHANNELS_LEGACY - 2];
+	flash_vars_led.brightness = old.savedValues[MAX_RETAIN_CHANNELS_LEGACY - 1];
+	memcpy(flash_vars_led.rgb, old.rgb, 3);
+}
 
+// read state from flash vars area.
+// picks the newest valid sector and replays its records.
+int flash_vars_read(FLASH_VARS_STRUCTURE* data) {
+	flash_vars_sector_header_t hdr[2];
+	flash_vars_record_header_t rec;
+	byte payload[64];
+	int i, off, best;
+
+	os_memset(data, 0, sizeof(*data));
+	data->len = sizeof(*data);
+	os_memset(flash_vars_channels, 0, sizeof(flash_vars_channels));
+	os_memset(&flash_vars_led, 0, sizeof(flash_vars_led));
+	os_memset(&flash_vars_energyTotal, 0, sizeof(flash_vars_energyTotal));
+	os_memset(flash_vars_energyDays, 0, sizeof(flash_vars_energyDays));
+	flash_vars_hasEnergyTotal = 0;
+	flash_vars_clear_dirty();
+
+	best = -1;
+	for (i = 0; i < 2; i++) {
+		flash_vars_read_raw(&hdr[i], i * flash_vars_sector_len, sizeof(hdr[i]));
+		if (hdr[i].magic == FLASH_VARS_JOURNAL_MAGIC) {
+			flash_vars_eraseCounts[i] = hdr[i].eraseCount;
+			if (best < 0 || hdr[i].sequence > hdr[best].sequence) {
+				best = i;
+			}
 		}
 		else {
-			// clear result.
-			os_memset(data, 0, sizeof(*data));
-			// read the DATA portion into the structure
-#ifdef TEST_MODE
-			os_memcpy(data, &test_flash_area[start_addr - flash_vars_start], len - 1);
-#else
-			GLOBAL_INT_DISABLE();
-			ddev_read(flash_hdl, (char*)data, len - 1, start_addr);
-			GLOBAL_INT_RESTORE();
-			ddev_close(flash_hdl);
-			bk_flash_enable_security(FLASH_PROTECT_ALL);
-#endif
-			// set the len to the latest revision's len
-			data->len = sizeof(*data);
-			flash_vars_offset = (start_addr - flash_vars_start) + len;
-			alignOffset(&flash_vars_offset);
-
-			ADDLOG_DEBUG(LOG_FEATURE_CFG, "new offset after read %d, boot_count %d, success count %d",
-				flash_vars_offset,
-				data->boot_count,
-				data->boot_success_count
-			);
-
+			flash_vars_eraseCounts[i] = 0;
 		}
-		return 1;
 	}
-}
-
-
-int flash_vars_write() {
-	//ADDLOG_DEBUG(LOG_FEATURE_CFG, "flash vars write");
-	flash_vars_init();
-	alignOffset(&flash_vars_offset);
-
-	FLASH_VARS_STRUCTURE* data = &flash_vars;
-	if (flash_vars_offset + data->len > flash_vars_len) {
-		if (flash_vars_write_magic() >= 0) {
-			ADDLOG_ERROR(LOG_FEATURE_CFG, "flash reinitialised");
+	if (best < 0) {
+		// nothing usable - old format or blank; first compaction goes to sector 1 and keeps old data readable until then
+		flash_vars_active = 0;
+		flash_vars_sequence = 0;
+		if (hdr[0].magic == FLASH_VARS_MAGIC) {
+			flash_vars_migrate_legacy();
 		}
 		else {
-			ADDLOG_ERROR(LOG_FEATURE_CFG, "flash reinitialise failed");
-			return -1;
+			ADDLOG_INFO(LOG_FEATURE_CFG, "new flash vars");
+			// no day seen yet
+			flash_vars.emetering.actual_mday = -1;
 		}
+		flash_vars_compact();
+		return 0;
 	}
-
-	//ADDLOG_DEBUG(LOG_FEATURE_CFG, "flash vars write at offset %d len %d", flash_vars_offset, data->len);
-	_flash_vars_write(data, flash_vars_offset, data->len);
-	flash_vars_offset += data->len;
-	alignOffset(&flash_vars_offset);
-
-	ADDLOG_DEBUG(LOG_FEATURE_CFG, "new offset %d, boot_count %d, success count %d",
-		flash_vars_offset,
-		data->boot_count,
-		data->boot_success_count
-	);
+	flash_vars_active = best;
+	flash_vars_sequence = hdr[best].sequence;
+	off = sizeof(flash_vars_sector_header_t);
+	while (off + (int)sizeof(rec) <= flash_vars_sector_len) {
+		flash_vars_read_raw(&rec, best * flash_vars_sector_len + off, sizeof(rec));
+		if (rec.type == FLASH_VARS_REC_FREE) {
+			break;
+		}
+		if (rec.len > sizeof(payload) || off + sizeof(rec) + rec.len > flash_vars_sector_len) {
+			ADDLOG_ERROR(LOG_FEATURE_CFG, "flash vars - bad record at %d", off);
+			// never append after garbage, next commit will compact
+			off = flash_vars_sector_len;
+			break;
+		}
+		flash_vars_read_raw(payload, best * flash_vars_sector_len + off + sizeof(rec), rec.len);
+		if (flash_vars_checksum(&rec, payload) != rec.check) {
+			// torn write, probably power loss during commit
+			ADDLOG_ERROR(LOG_FEATURE_CFG, "flash vars - bad checksum at %d", off);
+			off = flash_vars_sector_len;
+			break;
+		}
+		flash_vars_apply(&rec, payload);
+		off += sizeof(rec) + rec.len;
+	}
+	flash_vars_offset = off;
+	ADDLOG_DEBUG(LOG_FEATURE_CFG, "flash vars read - sector %d, seq %u, offset %d, boot_count %d, success count %d",
+		best, flash_vars_sequence, flash_vars_offset, data->boot_count, data->boot_success_count);
 	return 1;
 }
 
-
-// write updated data to flash vars area.
+// read raw data from flash vars area.
 // off_set is zero based.  size in bytes
-// TODO - test we CAN write at a byte boundary?
-// answer - the flash driver in theroy deals with than... writes are always in chunks of 32 bytes
-// on 32 byte boundaries.
-int _flash_vars_write(void* data, unsigned int off_set, unsigned int size) {
-	//uint32_t i;
-	//uint32_t param;
-	UINT32 status;
+static int flash_vars_read_raw(void* data, unsigned int off_set, unsigned int size) {
 #ifndef TEST_MODE
+	UINT32 status;
 	DD_HANDLE flash_hdl;
-#endif
-	uint32_t start_addr;
 	GLOBAL_INT_DECLARATION();
-	//ADDLOG_DEBUG(LOG_FEATURE_CFG, "_flash vars write offset %d, size %d", off_set, size);
+#endif
 
-#ifndef TEST_MODE
+	if (off_set + size > flash_vars_len) {
+		ADDLOG_ERROR(LOG_FEATURE_CFG, "flash vars read invalid offset 0x%X len 0x%X", off_set, size);
+		os_memset(data, 0xff, size);
+		return -1;
+	}
+#ifdef TEST_MODE
+	os_memcpy(data, &test_flash_area[off_set], size);
+#else
 	flash_hdl = ddev_open(FLASH_DEV_NAME, &status, 0);
 	ASSERT(DD_HANDLE_UNVALID != flash_hdl);
 	bk_flash_enable_security(FLASH_PROTECT_NONE);
+	GLOBAL_INT_DISABLE();
+	ddev_read(flash_hdl, (char*)data, size, flash_vars_start + off_set);
+	GLOBAL_INT_RESTORE();
+	ddev_close(flash_hdl);
+	bk_flash_enable_security(FLASH_PROTECT_ALL);
 #endif
+	return 0;
+}
+
+// write updated data to flash vars area.
+// off_set is zero based.  size in bytes
+// the flash driver deals with byte boundaries, writes are always in chunks of 32 bytes
+// on 32 byte boundaries.
+static int _flash_vars_write(void* data, unsigned int off_set, unsigned int size) {
+#ifndef TEST_MODE
+	UINT32 status;
+	DD_HANDLE flash_hdl;
+	GLOBAL_INT_DECLARATION();
+#else
+	unsigned int i;
+	byte* src = (byte*)data;
+#endif
+	uint32_t start_addr;
+
 	start_addr = flash_vars_start + off_set;
 
-	if (start_addr <= flash_vars_start) {
-		ADDLOG_ERROR(LOG_FEATURE_CFG, "_flash vars write invalid addr 0x%X", start_addr);
-		ddev_close(flash_hdl);
-		bk_flash_enable_security(FLASH_PROTECT_ALL);
-		return -1;
-	}
 	if (start_addr + size > flash_vars_start + flash_vars_len) {
 		ADDLOG_ERROR(LOG_FEATURE_CFG, "_flash vars write invalid addr 0x%X len 0x%X", start_addr, size);
-		ddev_close(flash_hdl);
-		bk_flash_enable_security(FLASH_PROTECT_ALL);
 		return -1;
 	}
 
 #ifdef TEST_MODE
-	os_memcpy(&test_flash_area[start_addr - flash_vars_start], data, size);
+	if (test_flash_writesLeft == 0) {
+		return -1;
+	}
+	if (test_flash_writesLeft > 0) {
+		test_flash_writesLeft--;
+	}
+	// NOR flash program can only clear bits
+	for (i = 0; i < size; i++) {
+		if (src[i] & ~test_flash_area[off_set + i]) {
+			test_flash_badWrites++;
+		}
+		test_flash_area[off_set + i] &= src[i];
+	}
+	test_flash_bytesWritten += size;
+	test_flash_busyUs += ((size + TEST_FLASH_PAGE_SIZE - 1) / TEST_FLASH_PAGE_SIZE) * TEST_FLASH_PAGE_PROGRAM_US;
 #else
+	flash_hdl = ddev_open(FLASH_DEV_NAME, &status, 0);
+	ASSERT(DD_HANDLE_UNVALID != flash_hdl);
+	bk_flash_enable_security(FLASH_PROTECT_NONE);
 	GLOBAL_INT_DISABLE();
 	ddev_write(flash_hdl, data, size, start_addr);
 	GLOBAL_INT_RESTORE();
@@ -429,55 +644,47 @@ int _flash_vars_write(void* data, unsigned int off_set, unsigned int size) {
 	bk_flash_enable_security(FLASH_PROTECT_ALL);
 #endif
 
-	//ADDLOG_DEBUG(LOG_FEATURE_CFG, "_flash vars write wrote offset %d, size %d", off_set, size);
-
 	return 0;
 }
 
 // erase one or more of the sectors we are using.
 // off_set is zero based.  size in bytes
 // in theory, can't erase outside of OUR area.
-int flash_vars_erase(unsigned int off_set, unsigned int size) {
+static int flash_vars_erase(unsigned int off_set, unsigned int size) {
 	uint32_t i;
 	uint32_t param;
-	UINT32 status;
 #ifndef TEST_MODE
+	UINT32 status;
 	DD_HANDLE flash_hdl;
+	GLOBAL_INT_DECLARATION();
 #endif
 	uint32_t start_sector, end_sector;
-	GLOBAL_INT_DECLARATION();
 	ADDLOG_DEBUG(LOG_FEATURE_CFG, "flash vars erase at offset %d len %d", off_set, size);
 
+	start_sector = off_set >> 12;
+	end_sector = (off_set + size - 1) >> 12;
+
+	if ((end_sector + 1) * flash_vars_sector_len > flash_vars_len) {
+		ADDLOG_ERROR(LOG_FEATURE_CFG, "flash vars erase invalid offset 0x%X+0x%X > 0x%X", off_set, size, flash_vars_len);
+		return -1;
+	}
 #ifndef TEST_MODE
 	flash_hdl = ddev_open(FLASH_DEV_NAME, &status, 0);
 	ASSERT(DD_HANDLE_UNVALID != flash_hdl);
 	bk_flash_enable_security(FLASH_PROTECT_NONE);
 #endif
-	start_sector = off_set >> 12;
-	end_sector = (off_set + size - 1) >> 12;
-
 	for (i = start_sector; i <= end_sector; i++)
 	{
 		param = flash_vars_start + (i << 12);
-		if (param < flash_vars_start) {
-			ADDLOG_ERROR(LOG_FEATURE_CFG, "flash vars erase invalid addr 0x%X < 0x%X", param, flash_vars_start);
-#ifndef TEST_MODE
-			ddev_close(flash_hdl);
-			bk_flash_enable_security(FLASH_PROTECT_ALL);
-#endif
-			return -1;
-		}
-		if (param + flash_vars_sector_len > flash_vars_start + flash_vars_len) {
-			ADDLOG_ERROR(LOG_FEATURE_CFG, "flash vars erase invalid addr 0x%X+0x%X > 0x%X", param, flash_vars_sector_len, flash_vars_start + flash_vars_len);
-#ifndef TEST_MODE
-			ddev_close(flash_hdl);
-			bk_flash_enable_security(FLASH_PROTECT_ALL);
-#endif
-			return -1;
-		}
 		ADDLOG_DEBUG(LOG_FEATURE_CFG, "flash vars erase block at addr 0x%X", param);
 #ifdef TEST_MODE
 		os_memset(&test_flash_area[param - flash_vars_start], 0xff, 0x1000);
+		test_flash_eraseCounts[i]++;
+		if (test_flash_failAfterErase >= 0) {
+			test_flash_writesLeft = test_flash_failAfterErase;
+			test_flash_failAfterErase = -1;
+		}
+		test_flash_busyUs += TEST_FLASH_ERASE_US;
 #else
 		GLOBAL_INT_DISABLE();
 		ddev_control(flash_hdl, CMD_FLASH_ERASE_SECTOR, (void*)&param);
@@ -488,11 +695,21 @@ int flash_vars_erase(unsigned int off_set, unsigned int size) {
 	ddev_close(flash_hdl);
 	bk_flash_enable_security(FLASH_PROTECT_ALL);
 #endif
-	//ADDLOG_DEBUG(LOG_FEATURE_CFG, "flash vars erase end");
 
 	return 0;
 }
 
+// start the coalescing window unless it's already running
+static void flash_vars_schedule_commit() {
+	flash_vars_stat_saves++;
+	if (flash_vars_commitDelay <= 0) {
+		flash_vars_write();
+		return;
+	}
+	if (flash_vars_commitIn < 0) {
+		flash_vars_commitIn = flash_vars_commitDelay;
+	}
+}
 
 
 //#define DISABLE_FLASH_VARS_VARS
@@ -501,119 +718,74 @@ int flash_vars_erase(unsigned int off_set, unsigned int size) {
 // call at startup
 void HAL_FlashVars_IncreaseBootCount() {
 #ifndef DISABLE_FLASH_VARS_VARS
-	FLASH_VARS_STRUCTURE data;
-
 	flash_vars_init();
 	flash_vars.boot_count++;
 	ADDLOG_INFO(LOG_FEATURE_CFG, "####### Boot Count %d #######", flash_vars.boot_count);
+	flash_vars_dirtyBoot = 1;
+	// must hit flash before a possible crash, that's the point of it
 	flash_vars_write();
-
-	flash_vars_read(&data);
-	ADDLOG_DEBUG(LOG_FEATURE_CFG, "re-read - offset %d, boot count %d, boot success %d, bootfailures %d",
-		flash_vars_offset,
-		data.boot_count,
-		data.boot_success_count,
-		data.boot_count - data.boot_success_count);
 #endif
 }
 void HAL_FlashVars_SaveChannel(int index, int value) {
 #ifndef DISABLE_FLASH_VARS_VARS
-	FLASH_VARS_STRUCTURE data;
-
-
 	if (index < 0 || index >= MAX_RETAIN_CHANNELS) {
 		ADDLOG_INFO(LOG_FEATURE_CFG, "####### Flash Save Can't Save Channel %d as %d (not enough space in array) #######", index, value);
 		return;
 	}
 
 	flash_vars_init();
-	flash_vars.savedValues[index] = value;
-	ADDLOG_INFO(LOG_FEATURE_CFG, "####### Flash Save Channel %d as %d #######", index, value);
-	flash_vars_write();
-
-	flash_vars_read(&data);
-	ADDLOG_DEBUG(LOG_FEATURE_CFG, "re-read - offset %d, boot count %d, boot success %d, bootfailures %d",
-		flash_vars_offset,
-		data.boot_count,
-		data.boot_success_count,
-		data.boot_count - data.boot_success_count);
+	if (flash_vars_channels[index] == value) {
+		return;
+	}
+	flash_vars_channels[index] = value;
+	flash_vars_dirtyChannels[index / 32] |= 1U << (index % 32);
+	ADDLOG_DEBUG(LOG_FEATURE_CFG, "Flash Save Channel %d as %d (in %d s)", index, value, flash_vars_commitDelay);
+	flash_vars_schedule_commit();
 #endif
 }
 void HAL_FlashVars_ReadLED(byte* mode, short* brightness, short* temperature, byte* rgb, byte* bEnableAll) {
 #ifndef DISABLE_FLASH_VARS_VARS
-	* bEnableAll = flash_vars.savedValues[MAX_RETAIN_CHANNELS - 4];
-	*mode = flash_vars.savedValues[MAX_RETAIN_CHANNELS - 3];
-	*temperature = flash_vars.savedValues[MAX_RETAIN_CHANNELS - 2];
-	*brightness = flash_vars.savedValues[MAX_RETAIN_CHANNELS - 1];
-	rgb[0] = flash_vars.rgb[0];
-	rgb[1] = flash_vars.rgb[1];
-	rgb[2] = flash_vars.rgb[2];
+	flash_vars_init();
+	*bEnableAll = flash_vars_led.enableAll;
+	*mode = flash_vars_led.mode;
+	*temperature = flash_vars_led.temperature;
+	*brightness = flash_vars_led.brightness;
+	rgb[0] = flash_vars_led.rgb[0];
+	rgb[1] = flash_vars_led.rgb[1];
+	rgb[2] = flash_vars_led.rgb[2];
 #endif
 }
 void HAL_FlashVars_SaveLED(byte mode, short brightness, short temperature, byte r, byte g, byte b, byte bEnableAll) {
 #ifndef DISABLE_FLASH_VARS_VARS
-	FLASH_VARS_STRUCTURE data;
-
-
 	flash_vars_init();
-	flash_vars.savedValues[MAX_RETAIN_CHANNELS - 1] = brightness;
-	flash_vars.savedValues[MAX_RETAIN_CHANNELS - 2] = temperature;
-	flash_vars.savedValues[MAX_RETAIN_CHANNELS - 3] = mode;
-	flash_vars.savedValues[MAX_RETAIN_CHANNELS - 4] = bEnableAll;
-	flash_vars.rgb[0] = r;
-	flash_vars.rgb[1] = g;
-	flash_vars.rgb[2] = b;
-	ADDLOG_INFO(LOG_FEATURE_CFG, "####### Flash Save LED #######");
-	flash_vars_write();
-
-	flash_vars_read(&data);
-	ADDLOG_DEBUG(LOG_FEATURE_CFG, "re-read - offset %d, boot count %d, boot success %d, bootfailures %d",
-		flash_vars_offset,
-		data.boot_count,
-		data.boot_success_count,
-		data.boot_count - data.boot_success_count);
-#endif
-}
-
-short HAL_FlashVars_ReadUsage() {
-#ifndef DISABLE_FLASH_VARS_VARS
-	return  flash_vars.savedValues[MAX_RETAIN_CHANNELS - 1];
+	if (flash_vars_led.mode == mode && flash_vars_led.brightness == brightness &&
+		flash_vars_led.temperature == temperature && flash_vars_led.enableAll == bEnableAll &&
+		flash_vars_led.rgb[0] == r && flash_vars_led.rgb[1] == g && flash_vars_led.rgb[2] == b) {
+		return;
+	}
+	flash_vars_led.brightness = brightness;
+	flash_vars_led.temperature = temperature;
+	flash_vars_led.mode = mode;
+	flash_vars_led.enableAll = bEnableAll;
+	flash_vars_led.rgb[0] = r;
+	flash_vars_led.rgb[1] = g;
+	flash_vars_led.rgb[2] = b;
+	flash_vars_dirtyLED = 1;
+	ADDLOG_DEBUG(LOG_FEATURE_CFG, "Flash Save LED (in %d s)", flash_vars_commitDelay);
+	flash_vars_schedule_commit();
 #endif
 }
-void HAL_FlashVars_SaveTotalUsage(short usage) {
-#ifndef DISABLE_FLASH_VARS_VARS
-	FLASH_VARS_STRUCTURE data;
 
-
-	flash_vars_init();
-	flash_vars.savedValues[MAX_RETAIN_CHANNELS - 1] = usage;
-	ADDLOG_INFO(LOG_FEATURE_CFG, "####### Flash Save Usage #######");
-	flash_vars_write();
-
-	flash_vars_read(&data);
-	ADDLOG_DEBUG(LOG_FEATURE_CFG, "re-read - offset %d, boot count %d, boot success %d, bootfailures %d",
-		flash_vars_offset,
-		data.boot_count,
-		data.boot_success_count,
-		data.boot_count - data.boot_success_count);
-#endif
-}
 // call once started (>30s?)
 void HAL_FlashVars_SaveBootComplete() {
 #ifndef DISABLE_FLASH_VARS_VARS
-	FLASH_VARS_STRUCTURE data;
 	// mark that we have completed a boot.
 	ADDLOG_INFO(LOG_FEATURE_CFG, "####### Set Boot Complete #######");
 
+	flash_vars_init();
 	flash_vars.boot_success_count = flash_vars.boot_count;
+	flash_vars_dirtyBoot = 1;
 	flash_vars_write();
-
-	flash_vars_read(&data);
-	ADDLOG_DEBUG(LOG_FEATURE_CFG, "re-read - offset %d, boot count %d, boot success %d, bootfailures %d",
-		flash_vars_offset,
-		data.boot_count,
-		data.boot_success_count,
-		data.boot_count - data.boot_success_count);
 #endif
 }
 
@@ -634,7 +806,8 @@ int HAL_FlashVars_GetChannelValue(int ch) {
 		ADDLOG_INFO(LOG_FEATURE_CFG, "####### Flash Save Can't Get Channel %d (not enough space in array) #######", ch);
 		return 0;
 	}
-	return flash_vars.savedValues[ch];
+	flash_vars_init();
+	return flash_vars_channels[ch];
 }
 
 int HAL_GetEnergyMeterStatus(ENERGY_METERING_DATA* data)
@@ -648,20 +821,20 @@ int HAL_GetEnergyMeterStatus(ENERGY_METERING_DATA* data)
 	{
 		memcpy(data, &flash_vars.emetering, sizeof(ENERGY_METERING_DATA));
 	}
-#endif    
+#endif
 	return 0;
 }
 
 int HAL_SetEnergyMeterStatus(ENERGY_METERING_DATA* data)
 {
 #ifndef DISABLE_FLASH_VARS_VARS
-	FLASH_VARS_STRUCTURE tmp;
-	// mark that we have completed a boot.
 	if (data != NULL)
 	{
+		flash_vars_init();
 		memcpy(&flash_vars.emetering, data, sizeof(ENERGY_METERING_DATA));
+		flash_vars_dirtyEnergy = 1;
+		// caller already rate limits these
 		flash_vars_write();
-		flash_vars_read(&tmp);
 	}
 #endif
 	return 0;
@@ -671,8 +844,99 @@ void HAL_FlashVars_SaveTotalConsumption(float total_consumption)
 {
 #ifndef DISABLE_FLASH_VARS_VARS
 	flash_vars.emetering.TotalConsumption = total_consumption;
+	// no commit here, it goes out with the next one
+	flash_vars_dirtyEnergy = 1;
+#endif
+}
+
+int HAL_FlashVars_GetEnergyTotal(ENERGY_TOTAL_DATA* data)
+{
+#ifndef DISABLE_FLASH_VARS_VARS
+	flash_vars_init();
+	if (flash_vars_hasEnergyTotal) {
+		memcpy(data, &flash_vars_energyTotal, sizeof(ENERGY_TOTAL_DATA));
+		return 1;
+	}
+#endif
+	return 0;
+}
+
+void HAL_FlashVars_SaveEnergyTotal(ENERGY_TOTAL_DATA* data)
+{
+#ifndef DISABLE_FLASH_VARS_VARS
+	flash_vars_init();
+	memcpy(&flash_vars_energyTotal, data, sizeof(ENERGY_TOTAL_DATA));
+	flash_vars_hasEnergyTotal = 1;
+	flash_vars_dirtyEnergyTotal = 1;
+	// caller already rate limits these
+	flash_vars_write();
 #endif
 }
 
+void HAL_FlashVars_SaveEnergyDay(unsigned short dayNumber, float consumption)
+{
+#ifndef DISABLE_FLASH_VARS_VARS
+	int slot = dayNumber % MAX_SAVED_ENERGY_DAYS;
+
+	flash_vars_init();
+	flash_vars_energyDays[slot].day = dayNumber;
+	flash_vars_energyDays[slot].consumption = consumption;
+	flash_vars_dirtyEnergyDays |= 1U << slot;
+	flash_vars_write();
 #endif
+}
+
+int HAL_FlashVars_GetEnergyDay(unsigned short dayNumber, float* consumption)
+{
+#ifndef DISABLE_FLASH_VARS_VARS
+	int slot = dayNumber % MAX_SAVED_ENERGY_DAYS;
+
+	flash_vars_init();
+	if (dayNumber != 0 && flash_vars_energyDays[slot].day == dayNumber) {
+		*consumption = flash_vars_energyDays[slot].consumption;
+		return 1;
+	}
+#endif
+	return 0;
+}
+
+void HAL_FlashVars_SetCommitDelay(int seconds) {
+	flash_vars_commitDelay = seconds;
+}
 
+void HAL_FlashVars_RunEverySecond() {
+	if (flash_vars_commitIn < 0) {
+		return;
+	}
+	if (flash_vars_commitIn > 0) {
+		flash_vars_commitIn--;
+	}
+	if (flash_vars_commitIn == 0) {
+		flash_vars_write();
+	}
+}
+
+void HAL_FlashVars_Flush() {
+	if (flash_vars_commitIn >= 0) {
+		flash_vars_write();
+	}
+}
+
+int HAL_FlashVars_GetEraseCount(int sector) {
+	if (sector < 0 || sector > 1) {
+		return 0;
+	}
+	flash_vars_init();
+	return flash_vars_eraseCounts[sector];
+}
+
+void HAL_FlashVars_PrintInfo() {
+	flash_vars_init();
+	ADDLOG_INFO(LOG_FEATURE_CFG, "Flash vars: sector %d, seq %u, used %d/%d, erases %u/%u",
+		flash_vars_active, flash_vars_sequence, flash_vars_offset, flash_vars_sector_len,
+		flash_vars_eraseCounts[0], flash_vars_eraseCounts[1]);
+	ADDLOG_INFO(LOG_FEATURE_CFG, "Flash vars: %d saves, %d commits, %d records, commit delay %d s",
+		flash_vars_stat_saves, flash_vars_stat_commits, flash_vars_stat_records, flash_vars_commitDelay);
+}
+
+#endif
@@ -136,5 +136,39 @@ void HAL_FlashVars_SaveTotalConsumption(float total_consumption)
     g_bootCounts.emetering.TotalConsumption = total_consumption;
 }
 
+int HAL_FlashVars_GetEnergyTotal(ENERGY_TOTAL_DATA* data)
+{
+    return 0;
+}
+
+// no journal here, so the total goes into the whole structure as before
+void HAL_FlashVars_SaveEnergyTotal(ENERGY_TOTAL_DATA* data)
+{
+    g_bootCounts.emetering.TotalConsumption = data->TotalMilliWh * 0.001f;
+    g_bootCounts.emetering.TodayConsumpion = data->TodayConsumption;
+    BL602_SaveFlashVars(&g_bootCounts,sizeof(g_bootCounts));
+}
+
+void HAL_FlashVars_SaveEnergyDay(unsigned short dayNumber, float consumption)
+{
+}
+
+int HAL_FlashVars_GetEnergyDay(unsigned short dayNumber, float* consumption)
+{
+    return 0;
+}
+
+void HAL_FlashVars_SetCommitDelay(int seconds) {
+}
+void HAL_FlashVars_RunEverySecond() {
+}
+void HAL_FlashVars_Flush() {
+}
+int HAL_FlashVars_GetEraseCount(int sector) {
+    return 0;
+}
+void HAL_FlashVars_PrintInfo() {
+}
+
 #endif // PLATFORM_BL602
 
@@ -5,7 +5,10 @@
 #include "../new_common.h"
 
 #define BOOT_COMPLETE_SECONDS 30
-#define MAX_RETAIN_CHANNELS 12
+// channels that can be remembered in flash (see SPECIAL_CHANNEL_FLASHVARS_FIRST)
+#define MAX_RETAIN_CHANNELS 64
+// size of the channel array in the old, whole structure format
+#define MAX_RETAIN_CHANNELS_LEGACY 12
 
 /* Fixed size 32 bytes */
 typedef struct ENERGY_METERING_DATA {
@@ -19,13 +22,26 @@ typedef struct ENERGY_METERING_DATA {
 	char actual_mday;
 } ENERGY_METERING_DATA;
 
+// how many finished days of consumption can be kept, see HAL_FlashVars_SaveEnergyDay
+#define MAX_SAVED_ENERGY_DAYS 31
+
+/* Fixed size 16 bytes, saved often, so it's separate from ENERGY_METERING_DATA */
+typedef struct ENERGY_TOTAL_DATA {
+	long long TotalMilliWh;
+	float TodayConsumption;
+	// local day number (days since 1970) of TodayConsumption
+	unsigned short DayNumber;
+	// days before this one were cleared by reset
+	unsigned short HistoryStart;
+} ENERGY_TOTAL_DATA;
+
 typedef struct flash_vars_structure
 {
 	// offset  0
 	unsigned short boot_count; // number of times the device has booted
 	unsigned short boot_success_count; // if a device boots completely (>30s), will equal boot_success_count
 	// offset  4
-	short savedValues[MAX_RETAIN_CHANNELS];
+	short savedValues[MAX_RETAIN_CHANNELS_LEGACY];
 	// offset 28
 	ENERGY_METERING_DATA emetering;
 	// offset 60
@@ -50,6 +66,27 @@ int HAL_FlashVars_GetChannelValue(int ch);
 int HAL_GetEnergyMeterStatus(ENERGY_METERING_DATA* data);
 int HAL_SetEnergyMeterStatus(ENERGY_METERING_DATA* data);
 void HAL_FlashVars_SaveTotalConsumption(float total_consumption);
+// returns 0 if there is no saved total (old flash vars or not supported)
+int HAL_FlashVars_GetEnergyTotal(ENERGY_TOTAL_DATA* data);
+void HAL_FlashVars_SaveEnergyTotal(ENERGY_TOTAL_DATA* data);
+// consumption of a finished day, only the last MAX_SAVED_ENERGY_DAYS days are kept
+void HAL_FlashVars_SaveEnergyDay(unsigned short dayNumber, float consumption);
+// returns 0 if there is nothing saved for that day
+int HAL_FlashVars_GetEnergyDay(unsigned short dayNumber, float* consumption);
+// channel and LED saves are coalesced for that many seconds before a flash write, 0 writes at once
+void HAL_FlashVars_SetCommitDelay(int seconds);
+// call once per second, commits pending changes when delay has passed
+void HAL_FlashVars_RunEverySecond();
+// commit pending changes now (before reboot)
+void HAL_FlashVars_Flush();
+int HAL_FlashVars_GetEraseCount(int sector);
+void HAL_FlashVars_PrintInfo();
+#ifdef WINDOWS
+void SIM_FlashVars_GetStats(int* erases0, int* erases1, int* bytesWritten, int* busyUs, int* badWrites);
+void SIM_FlashVars_Reset(bool bErase);
+// after next erase only that many writes succeed, until SIM_FlashVars_Reset
+void SIM_FlashVars_FailWritesAfterErase(int writes);
+#endif
 
 #endif /* __HALK_FLASH_VARS_H__ */
 
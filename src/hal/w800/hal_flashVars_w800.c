@@ -47,7 +47,7 @@ void HAL_FlashVars_IncreaseBootCount() {
 	write_flash_boot_content();
 }
 void HAL_FlashVars_SaveChannel(int index, int value) {
-	if (index < 0 || index >= MAX_RETAIN_CHANNELS) {
+	if (index < 0 || index >= MAX_RETAIN_CHANNELS_LEGACY) {
 		ADDLOG_INFO(LOG_FEATURE_CFG, "####### Flash Save Can't Save Channel %d as %d (not enough space in array) #######", index, value);
 		return;
 	}
@@ -74,7 +74,7 @@ int HAL_FlashVars_GetBootCount() {
 	return flash_vars.boot_count;
 }
 int HAL_FlashVars_GetChannelValue(int ch) {
-	if (ch < 0 || ch >= MAX_RETAIN_CHANNELS) {
+	if (ch < 0 || ch >= MAX_RETAIN_CHANNELS_LEGACY) {
 		ADDLOG_INFO(LOG_FEATURE_CFG, "####### Flash Save Can't Get Channel %d (not enough space in array) #######", ch);
 		return 0;
 	}
@@ -109,4 +109,34 @@ void HAL_FlashVars_SaveTotalConsumption(float total_consumption)
 {
 }
 
+int HAL_FlashVars_GetEnergyTotal(ENERGY_TOTAL_DATA* data)
+{
+	return 0;
+}
+
+void HAL_FlashVars_SaveEnergyTotal(ENERGY_TOTAL_DATA* data)
+{
+}
+
+void HAL_FlashVars_SaveEnergyDay(unsigned short dayNumber, float consumption)
+{
+}
+
+int HAL_FlashVars_GetEnergyDay(unsigned short dayNumber, float* consumption)
+{
+	return 0;
+}
+
+void HAL_FlashVars_SetCommitDelay(int seconds) {
+}
+void HAL_FlashVars_RunEverySecond() {
+}
+void HAL_FlashVars_Flush() {
+}
+int HAL_FlashVars_GetEraseCount(int sector) {
+	return 0;
+}
+void HAL_FlashVars_PrintInfo() {
+}
+
 #endif
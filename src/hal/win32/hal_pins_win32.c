@@ -18,6 +18,7 @@ int g_simulatedPinStates[PLATFORM_GPIO_MAX];
 int g_simulatedPWMs[PLATFORM_GPIO_MAX];
 simulatedPinMode_t g_pinModes[PLATFORM_GPIO_MAX];
 int g_simulatedADCValues[PLATFORM_GPIO_MAX];
+static int g_simulatedPWMUpdates = 0;
 
 void SIM_Hack_ClearSimulatedPinRoles() {
 	memset(g_simulatedPinStates, 0, sizeof(g_simulatedPinStates));
@@ -95,6 +96,9 @@ void SIM_SetVoltageOnADCPin(int index, float v) {
 int SIM_GetPWMValue(int index) {
 	return g_simulatedPWMs[index];
 }
+int SIM_GetPWMUpdatesCount() {
+	return g_simulatedPWMUpdates;
+}
 
 
 void SIM_GeneratePinStatesDesc(char *o, int outLen) {
@@ -214,6 +218,7 @@ void HAL_PIN_PWM_Update(int index, float value) {
 	if (value > 100)
 		value = 100;
 	g_simulatedPWMs[index] = value;
+	g_simulatedPWMUpdates++;
 }
 
 unsigned int HAL_GetGPIOPin(int index) {
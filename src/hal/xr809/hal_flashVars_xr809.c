@@ -49,6 +49,36 @@ void HAL_FlashVars_SaveTotalConsumption(float total_consumption)
 {
 }
 
+int HAL_FlashVars_GetEnergyTotal(ENERGY_TOTAL_DATA* data)
+{
+	return 0;
+}
+
+void HAL_FlashVars_SaveEnergyTotal(ENERGY_TOTAL_DATA* data)
+{
+}
+
+void HAL_FlashVars_SaveEnergyDay(unsigned short dayNumber, float consumption)
+{
+}
+
+int HAL_FlashVars_GetEnergyDay(unsigned short dayNumber, float* consumption)
+{
+	return 0;
+}
+
+void HAL_FlashVars_SetCommitDelay(int seconds) {
+}
+void HAL_FlashVars_RunEverySecond() {
+}
+void HAL_FlashVars_Flush() {
+}
+int HAL_FlashVars_GetEraseCount(int sector) {
+    return 0;
+}
+void HAL_FlashVars_PrintInfo() {
+}
+
 #endif // PLATFORM_XR809
 
 
@@ -13,7 +13,7 @@ Switch - https://www.home-assistant.io/integrations/switch.mqtt/
 Sensor - https://www.home-assistant.io/integrations/sensor.mqtt/
 */
 
-//Buffer used to populate values in cJSON_Add* calls. The values are based on
+//Buffer used to populate values in JSONWriter_Add* calls. The values are based on
 //CFG_GetShortDeviceName and clientId so it needs to be bigger than them. +64 for light/switch/etc.
 static char g_hassBuffer[CGF_MQTT_CLIENT_ID_SIZE + 64];
 
@@ -117,24 +117,24 @@ void hass_populate_device_config_channel(ENTITY_TYPE type, char* uniq_id, HassDe
 	}
 }
 
-/// @brief Builds HomeAssistant device discovery info. The caller needs to free the returned pointer.
-/// @param ids 
-cJSON* hass_build_device_node(cJSON* ids) {
-	cJSON* dev = cJSON_CreateObject();
-	cJSON_AddItemToObject(dev, "ids", ids);     //identifiers
-	cJSON_AddStringToObject(dev, "name", CFG_GetShortDeviceName());
+/// @brief Writes HomeAssistant device discovery info as `dev` node.
+/// @param w 
+void hass_build_device_node(jsonWriter_t* w) {
+	JSONWriter_BeginObject(w, "dev");
+	JSONWriter_BeginArray(w, "ids");     //identifiers
+	JSONWriter_AddString(w, NULL, CFG_GetDeviceName());
+	JSONWriter_EndArray(w);
+	JSONWriter_AddString(w, "name", CFG_GetShortDeviceName());
 
 #ifdef USER_SW_VER
-	cJSON_AddStringToObject(dev, "sw", USER_SW_VER);   //sw_version
+	JSONWriter_AddString(w, "sw", USER_SW_VER);   //sw_version
 #endif
 
-	cJSON_AddStringToObject(dev, "mf", MANUFACTURER);   //manufacturer
-	cJSON_AddStringToObject(dev, "mdl", PLATFORM_MCU_NAME);  //Using chipset for model
+	JSONWriter_AddString(w, "mf", MANUFACTURER);   //manufacturer
+	JSONWriter_AddString(w, "mdl", PLATFORM_MCU_NAME);  //Using chipset for model
 
-	sprintf(g_hassBuffer, "http://%s/index", HAL_GetMyIPString());
-	cJSON_AddStringToObject(dev, "cu", g_hassBuffer);  //configuration_url
-
-	return dev;
+	JSONWriter_AddStringf(w, "cu", "http://%s/index", HAL_GetMyIPString());  //configuration_url
+	JSONWriter_EndObject(w);
 }
 
 /// @brief Initializes HomeAssistant device discovery storage with common values.
@@ -151,13 +151,10 @@ HassDeviceInfo* hass_init_device_info(ENTITY_TYPE type, int index, char* payload
 	hass_populate_unique_id(type, index, info->unique_id);
 	hass_populate_device_config_channel(type, info->unique_id, info);
 
-	info->ids = cJSON_CreateArray();
-	cJSON_AddItemToArray(info->ids, cJSON_CreateString(CFG_GetDeviceName()));
-
-	info->device = hass_build_device_node(info->ids);
-
-	info->root = cJSON_CreateObject();
-	cJSON_AddItemToObject(info->root, "dev", info->device);    //device
+	// discovery JSON is written straight into info->json, there is no tree to build
+	JSONWriter_InitBuffer(&info->writer, info->json, HASS_JSON_SIZE);
+	JSONWriter_BeginObject(&info->writer, NULL);
+	hass_build_device_node(&info->writer);    //device
 
 	bool isSensor = false;	//This does not count binary_sensor
 
@@ -211,8 +208,8 @@ HassDeviceInfo* hass_init_device_info(ENTITY_TYPE type, int index, char* payload
 		sprintf(g_hassBuffer, "%s Voltage", CFG_GetShortDeviceName());
 		break;
 	}
-	cJSON_AddStringToObject(info->root, "name", g_hassBuffer);
-	cJSON_AddStringToObject(info->root, "~", CFG_GetMQTTClientId());      //base topic
+	JSONWriter_AddString(&info->writer, "name", g_hassBuffer);
+	JSONWriter_AddString(&info->writer, "~", CFG_GetMQTTClientId());      //base topic
 	// remove availability information for sensor to keep last value visible on Home Assistant
 	bool flagavty = false;
 	flagavty = CFG_HasFlag(OBK_FLAG_NOT_PUBLISH_AVAILABILITY_SENSOR);
@@ -222,19 +219,17 @@ HassDeviceInfo* hass_init_device_info(ENTITY_TYPE type, int index, char* payload
 #endif
 	{
 		if (!isSensor || !flagavty) {
-			cJSON_AddStringToObject(info->root, "avty_t", "~/connected");   //availability_topic, `online` value is broadcasted
+			JSONWriter_AddString(&info->writer, "avty_t", "~/connected");   //availability_topic, `online` value is broadcasted
 		}
 	}
 
 	if (!isSensor) {	//Sensors (except binary_sensor) don't use payload 
-		cJSON_AddStringToObject(info->root, "pl_on", payload_on);    //payload_on
-		cJSON_AddStringToObject(info->root, "pl_off", payload_off);   //payload_off
+		JSONWriter_AddString(&info->writer, "pl_on", payload_on);    //payload_on
+		JSONWriter_AddString(&info->writer, "pl_off", payload_off);   //payload_off
 	}
 
-	cJSON_AddStringToObject(info->root, "uniq_id", info->unique_id);  //unique_id
-	cJSON_AddNumberToObject(info->root, "qos", 1);
-
-	addLogAdv(LOG_DEBUG, LOG_FEATURE_HASS, "root=%p", info->root);
+	JSONWriter_AddString(&info->writer, "uniq_id", info->unique_id);  //unique_id
+	JSONWriter_AddInt(&info->writer, "qos", 1);
 	return info;
 }
 
@@ -245,9 +240,9 @@ HassDeviceInfo* hass_init_relay_device_info(int index, ENTITY_TYPE type) {
 	HassDeviceInfo* info = hass_init_device_info(type, index, "1", "0");
 
 	sprintf(g_hassBuffer, "~/%i/get", index);
-	cJSON_AddStringToObject(info->root, STATE_TOPIC_KEY, g_hassBuffer);   //state_topic
+	JSONWriter_AddString(&info->writer, STATE_TOPIC_KEY, g_hassBuffer);   //state_topic
 	sprintf(g_hassBuffer, "~/%i/set", index);
-	cJSON_AddStringToObject(info->root, COMMAND_TOPIC_KEY, g_hassBuffer);    //command_topic
+	JSONWriter_AddString(&info->writer, COMMAND_TOPIC_KEY, g_hassBuffer);    //command_topic
 
 	return info;
 }
@@ -267,12 +262,12 @@ HassDeviceInfo* hass_init_light_device_info(ENTITY_TYPE type) {
 	switch (type) {
 	case LIGHT_RGBCW:
 	case LIGHT_RGB:
-		cJSON_AddStringToObject(info->root, "rgb_cmd_tpl", "{{'#%02x%02x%02x0000'|format(red,green,blue)}}");  //rgb_command_template
-		cJSON_AddStringToObject(info->root, "rgb_val_tpl", "{{ value[0:2]|int(base=16) }},{{ value[2:4]|int(base=16) }},{{ value[4:6]|int(base=16) }}");  //rgb_value_template
+		JSONWriter_AddString(&info->writer, "rgb_cmd_tpl", "{{'#%02x%02x%02x0000'|format(red,green,blue)}}");  //rgb_command_template
+		JSONWriter_AddString(&info->writer, "rgb_val_tpl", "{{ value[0:2]|int(base=16) }},{{ value[2:4]|int(base=16) }},{{ value[4:6]|int(base=16) }}");  //rgb_value_template
 
-		cJSON_AddStringToObject(info->root, "rgb_stat_t", "~/led_basecolor_rgb/get"); //rgb_state_topic
+		JSONWriter_AddString(&info->writer, "rgb_stat_t", "~/led_basecolor_rgb/get"); //rgb_state_topic
 		sprintf(g_hassBuffer, "cmnd/%s/led_basecolor_rgb", clientId);
-		cJSON_AddStringToObject(info->root, "rgb_cmd_t", g_hassBuffer);  //rgb_command_topic
+		JSONWriter_AddString(&info->writer, "rgb_cmd_t", g_hassBuffer);  //rgb_command_topic
 		break;
 
 	case LIGHT_ON_OFF:
@@ -286,7 +281,7 @@ HassDeviceInfo* hass_init_light_device_info(ENTITY_TYPE type) {
 		//Using `last` (the default) will send any style (brightness, color, etc) topics first and then a payload_on to the command_topic. 
 		//Using `first` will send the payload_on and then any style topics. 
 		//Using `brightness` will only send brightness commands instead of the payload_on to turn the light on.
-		cJSON_AddStringToObject(info->root, "on_cmd_type", "first");	//on_command_type
+		JSONWriter_AddString(&info->writer, "on_cmd_type", "first");	//on_command_type
 		break;
 
 	default:
@@ -295,26 +290,26 @@ HassDeviceInfo* hass_init_light_device_info(ENTITY_TYPE type) {
 
 	if ((type == LIGHT_PWMCW) || (type == LIGHT_RGBCW)) {
 		sprintf(g_hassBuffer, "cmnd/%s/led_temperature", clientId);
-		cJSON_AddStringToObject(info->root, "clr_temp_cmd_t", g_hassBuffer);    //color_temp_command_topic
+		JSONWriter_AddString(&info->writer, "clr_temp_cmd_t", g_hassBuffer);    //color_temp_command_topic
 
-		cJSON_AddStringToObject(info->root, "clr_temp_stat_t", "~/led_temperature/get");    //color_temp_state_topic
+		JSONWriter_AddString(&info->writer, "clr_temp_stat_t", "~/led_temperature/get");    //color_temp_state_topic
 
 		sprintf(g_hassBuffer, "%.0f", led_temperature_min);
-		cJSON_AddStringToObject(info->root, "min_mirs", g_hassBuffer);    //min_mireds
+		JSONWriter_AddString(&info->writer, "min_mirs", g_hassBuffer);    //min_mireds
 
 		sprintf(g_hassBuffer, "%.0f", led_temperature_max);
-		cJSON_AddStringToObject(info->root, "max_mirs", g_hassBuffer);    //max_mireds
+		JSONWriter_AddString(&info->writer, "max_mirs", g_hassBuffer);    //max_mireds
 	}
 
-	cJSON_AddStringToObject(info->root, STATE_TOPIC_KEY, "~/led_enableAll/get");  //state_topic
+	JSONWriter_AddString(&info->writer, STATE_TOPIC_KEY, "~/led_enableAll/get");  //state_topic
 	sprintf(g_hassBuffer, "cmnd/%s/led_enableAll", clientId);
-	cJSON_AddStringToObject(info->root, COMMAND_TOPIC_KEY, g_hassBuffer);  //command_topic
+	JSONWriter_AddString(&info->writer, COMMAND_TOPIC_KEY, g_hassBuffer);  //command_topic
 
-	cJSON_AddStringToObject(info->root, "bri_stat_t", "~/led_dimmer/get");  //brightness_state_topic
+	JSONWriter_AddString(&info->writer, "bri_stat_t", "~/led_dimmer/get");  //brightness_state_topic
 	sprintf(g_hassBuffer, "cmnd/%s/led_dimmer", clientId);
-	cJSON_AddStringToObject(info->root, "bri_cmd_t", g_hassBuffer);  //brightness_command_topic
+	JSONWriter_AddString(&info->writer, "bri_cmd_t", g_hassBuffer);  //brightness_command_topic
 
-	cJSON_AddNumberToObject(info->root, "bri_scl", brightness_scale);	//brightness_scale
+	JSONWriter_AddNumber(&info->writer, "bri_scl", brightness_scale);	//brightness_scale
 
 	return info;
 }
@@ -326,7 +321,7 @@ HassDeviceInfo* hass_init_binary_sensor_device_info(int index) {
 	HassDeviceInfo* info = hass_init_device_info(BINARY_SENSOR, index, "1", "0");
 
 	sprintf(g_hassBuffer, "~/%i/get", index);
-	cJSON_AddStringToObject(info->root, STATE_TOPIC_KEY, g_hassBuffer);   //state_topic
+	JSONWriter_AddString(&info->writer, STATE_TOPIC_KEY, g_hassBuffer);   //state_topic
 
 	return info;
 }
@@ -343,27 +338,27 @@ HassDeviceInfo* hass_init_power_sensor_device_info(int index) {
 	//device_class automatically assigns unit,icon
 	if ((index >= OBK_VOLTAGE) && (index <= OBK_POWER))
 	{
-		cJSON_AddStringToObject(info->root, "dev_cla", sensor_mqtt_device_classes[index]);   //device_class=voltage,current,power
-		cJSON_AddStringToObject(info->root, "unit_of_meas", sensor_mqtt_device_units[index]);   //unit_of_measurement
+		JSONWriter_AddString(&info->writer, "dev_cla", sensor_mqtt_device_classes[index]);   //device_class=voltage,current,power
+		JSONWriter_AddString(&info->writer, "unit_of_meas", sensor_mqtt_device_units[index]);   //unit_of_measurement
 
 		sprintf(g_hassBuffer, "~/%s/get", sensor_mqttNames[index]);
-		cJSON_AddStringToObject(info->root, STATE_TOPIC_KEY, g_hassBuffer);
+		JSONWriter_AddString(&info->writer, STATE_TOPIC_KEY, g_hassBuffer);
 
-		cJSON_AddStringToObject(info->root, "stat_cla", "measurement");
+		JSONWriter_AddString(&info->writer, "stat_cla", "measurement");
 	}
 	else if ((index >= OBK_CONSUMPTION_TOTAL) && (index <= OBK_CONSUMPTION_STATS))
 	{
 		const char* device_class_value = counter_devClasses[index - OBK_CONSUMPTION_TOTAL];
 		if (strlen(device_class_value) > 0) {
-			cJSON_AddStringToObject(info->root, "dev_cla", device_class_value);  //device_class=energy
-			cJSON_AddStringToObject(info->root, "unit_of_meas", "Wh");   //unit_of_measurement
+			JSONWriter_AddString(&info->writer, "dev_cla", device_class_value);  //device_class=energy
+			JSONWriter_AddString(&info->writer, "unit_of_meas", "Wh");   //unit_of_measurement
 
 			//state_class can be measurement, total or total_increasing. Energy values should be total_increasing.
-			cJSON_AddStringToObject(info->root, "stat_cla", "total_increasing");
+			JSONWriter_AddString(&info->writer, "stat_cla", "total_increasing");
 		}
 
 		sprintf(g_hassBuffer, "~/%s/get", counter_mqttNames[index - OBK_CONSUMPTION_TOTAL]);
-		cJSON_AddStringToObject(info->root, STATE_TOPIC_KEY, g_hassBuffer);
+		JSONWriter_AddString(&info->writer, STATE_TOPIC_KEY, g_hassBuffer);
 	}
 
 	return info;
@@ -382,51 +377,52 @@ HassDeviceInfo* hass_init_sensor_device_info(ENTITY_TYPE type, int channel) {
 	//https://developers.home-assistant.io/docs/core/entity/sensor/#available-device-classes
 	switch (type) {
 	case TEMPERATURE_SENSOR:
-		cJSON_AddStringToObject(info->root, "dev_cla", "temperature");
-		cJSON_AddStringToObject(info->root, "unit_of_meas", "°C");
+		JSONWriter_AddString(&info->writer, "dev_cla", "temperature");
+		JSONWriter_AddString(&info->writer, "unit_of_meas", "°C");
 
 		//https://www.home-assistant.io/integrations/sensor.mqtt/ refers to value_template (val_tpl)
 		//{{ float(value)*0.1 }} for value=12 give 1.2000000000000002, using round() to limit the decimal places
-		cJSON_AddStringToObject(info->root, "val_tpl", "{{ float(value)*0.1|round(2) }}");
+		JSONWriter_AddString(&info->writer, "val_tpl", "{{ float(value)*0.1|round(2) }}");
 		sprintf(g_hassBuffer, "~/%d/get", channel);
-		cJSON_AddStringToObject(info->root, STATE_TOPIC_KEY, g_hassBuffer);
+		JSONWriter_AddString(&info->writer, STATE_TOPIC_KEY, g_hassBuffer);
 		break;
 	case HUMIDITY_SENSOR:
-		cJSON_AddStringToObject(info->root, "dev_cla", "humidity");
-		cJSON_AddStringToObject(info->root, "unit_of_meas", "%");
+		JSONWriter_AddString(&info->writer, "dev_cla", "humidity");
+		JSONWriter_AddString(&info->writer, "unit_of_meas", "%");
 		sprintf(g_hassBuffer, "~/%d/get", channel);
-		cJSON_AddStringToObject(info->root, STATE_TOPIC_KEY, g_hassBuffer);
+		JSONWriter_AddString(&info->writer, STATE_TOPIC_KEY, g_hassBuffer);
 		break;
 	case CO2_SENSOR:
-		cJSON_AddStringToObject(info->root, "dev_cla", "carbon_dioxide");
-		cJSON_AddStringToObject(info->root, "unit_of_meas", "ppm");
+		JSONWriter_AddString(&info->writer, "dev_cla", "carbon_dioxide");
+		JSONWriter_AddString(&info->writer, "unit_of_meas", "ppm");
 		sprintf(g_hassBuffer, "~/%d/get", channel);
-		cJSON_AddStringToObject(info->root, STATE_TOPIC_KEY, g_hassBuffer);
+		JSONWriter_AddString(&info->writer, STATE_TOPIC_KEY, g_hassBuffer);
 		break;
 	case TVOC_SENSOR:
-		cJSON_AddStringToObject(info->root, "dev_cla", "volatile_organic_compounds");
-		cJSON_AddStringToObject(info->root, "unit_of_meas", "ppb");
+		JSONWriter_AddString(&info->writer, "dev_cla", "volatile_organic_compounds");
+		JSONWriter_AddString(&info->writer, "unit_of_meas", "ppb");
 		sprintf(g_hassBuffer, "~/%d/get", channel);
-		cJSON_AddStringToObject(info->root, STATE_TOPIC_KEY, g_hassBuffer);
+		JSONWriter_AddString(&info->writer, STATE_TOPIC_KEY, g_hassBuffer);
 		break;
 	case BATTERY_SENSOR:
-		cJSON_AddStringToObject(info->root, "dev_cla", "battery");
-		cJSON_AddStringToObject(info->root, "unit_of_meas", "%");
-		cJSON_AddStringToObject(info->root, STATE_TOPIC_KEY, "~/battery/get");
+		JSONWriter_AddString(&info->writer, "dev_cla", "battery");
+		JSONWriter_AddString(&info->writer, "unit_of_meas", "%");
+		JSONWriter_AddString(&info->writer, STATE_TOPIC_KEY, "~/battery/get");
 		break;
 	case BATTERY_VOLTAGE_SENSOR:
-		cJSON_AddStringToObject(info->root, "dev_cla", "voltage");
-		cJSON_AddStringToObject(info->root, "unit_of_meas", "mV");
-		cJSON_AddStringToObject(info->root, STATE_TOPIC_KEY, "~/voltage/get");
+		JSONWriter_AddString(&info->writer, "dev_cla", "voltage");
+		JSONWriter_AddString(&info->writer, "unit_of_meas", "mV");
+		JSONWriter_AddString(&info->writer, STATE_TOPIC_KEY, "~/voltage/get");
 		break;
 
 	default:
 		sprintf(g_hassBuffer, "~/%d/get", channel);
-		cJSON_AddStringToObject(info->root, STATE_TOPIC_KEY, g_hassBuffer);
+		JSONWriter_AddString(&info->writer, STATE_TOPIC_KEY, g_hassBuffer);
+		hass_free_device_info(info);
 		return NULL;
 	}
 
-	cJSON_AddStringToObject(info->root, "stat_cla", "measurement");
+	JSONWriter_AddString(&info->writer, "stat_cla", "measurement");
 	return info;
 }
 
@@ -438,7 +434,14 @@ const char* hass_build_discovery_json(HassDeviceInfo* info) {
 		addLogAdv(LOG_ERROR, LOG_FEATURE_HASS, "ERROR: someone passed NULL pointer to hass_build_discovery_json\r\n");
 		return "";
 	}
-	cJSON_PrintPreallocated(info->root, info->json, HASS_JSON_SIZE, 0);
+	// close root object, but only once, so it can be called again
+	if (info->writer.depth > 0) {
+		JSONWriter_EndObject(&info->writer);
+	}
+	if (JSONWriter_Finish(&info->writer) < 0) {
+		addLogAdv(LOG_ERROR, LOG_FEATURE_HASS, "Discovery JSON for %s does not fit in %i bytes\r\n", info->unique_id, HASS_JSON_SIZE);
+		return "";
+	}
 	return info->json;
 }
 
@@ -449,9 +452,353 @@ void hass_free_device_info(HassDeviceInfo* info) {
 		return;
 	//addLogAdv(LOG_DEBUG, LOG_FEATURE_HASS, "hass_free_device_info \r\n");
 
-	if (info->root != NULL) {
-		cJSON_Delete(info->root);
+	os_free(info);
+}
+
+/*
+Discovery is published one entity at a time. Every entity has a fixed place in the walk
+below (step + index), so a pass can stop when MQTT queue has no room or connection is lost,
+and go on later. Payload hash of every announced entity is kept, and entity is announced
+again only when its payload has changed. Hash is trusted only after the publish went through.
+*/
+
+typedef enum {
+	HASS_STEP_RELAYS,
+	HASS_STEP_INPUTS,
+	HASS_STEP_LIGHT,
+	HASS_STEP_POWER,
+	HASS_STEP_BATTERY,
+	HASS_STEP_PIN_SENSORS,
+	HASS_STEP_DONE
+} hassDiscoveryStep_t;
+
+// MQTT queue slots left for everything else
+#define HASS_DISCOVERY_QUEUE_RESERVE	2
+// how many times pass is restarted when some publishes were lost
+#define HASS_DISCOVERY_MAX_RETRIES		3
+
+typedef struct hassAnnounced_s {
+	unsigned int channelHash;
+	unsigned int payloadHash;
+	unsigned short pass;
+	bool bConfirmed;
+} hassAnnounced_t;
+
+static hassAnnounced_t* g_hassAnnounced = 0;
+static int g_numHassAnnounced = 0;
+static int g_maxHassAnnounced = 0;
+
+static struct {
+	char topic[HASS_DISCOVERY_PREFIX_SIZE];
+	int step;
+	int index;
+	unsigned short pass;
+	bool bRunning;
+	bool bForce;
+	int retries;
+	int queued;
+	int skipped;
+	// entities queued in current pass, but not published yet
+	int unconfirmed;
+} g_hassDiscovery;
+
+static int hass_discovery_step_size(int step) {
+	switch (step) {
+	case HASS_STEP_RELAYS:
+	case HASS_STEP_INPUTS:
+		return CHANNEL_MAX;
+	case HASS_STEP_LIGHT:
+		return 1;
+#ifndef OBK_DISABLE_ALL_DRIVERS
+	case HASS_STEP_POWER:
+		return OBK_NUM_SENSOR_COUNT;
+	case HASS_STEP_BATTERY:
+		return 2;
+#endif
+	case HASS_STEP_PIN_SENSORS:
+		return PLATFORM_GPIO_MAX * 2;
 	}
+	return 0;
+}
 
-	os_free(info);
+/// @brief Finds which entity is at given place of discovery walk.
+/// @param step 
+/// @param index 
+/// @param info If not NULL, entity is built there. The caller needs to free it.
+/// @return false if there is nothing at that place
+static bool hass_discovery_entity(int step, int index, HassDeviceInfo** info) {
+	ENTITY_TYPE type;
+	int arg = index;
+	int relayCount, pwmCount, dInputCount, role;
+
+	switch (step) {
+	case HASS_STEP_RELAYS:
+		if (!h_isChannelRelay(index))
+			return false;
+		type = CFG_HasFlag(OBK_FLAG_MQTT_HASS_ADD_RELAYS_AS_LIGHTS) ? LIGHT_ON_OFF : RELAY;
+		break;
+	case HASS_STEP_INPUTS:
+		if (!h_isChannelDigitalInput(index))
+			return false;
+		type = BINARY_SENSOR;
+		break;
+	case HASS_STEP_LIGHT:
+		PIN_get_Relay_PWM_Count(&relayCount, &pwmCount, &dInputCount);
+		if (pwmCount == 5 || LED_IsLedDriverChipRunning() || (pwmCount == 4 && CFG_HasFlag(OBK_FLAG_LED_EMULATE_COOL_WITH_RGB))) {
+			// Enable + RGB control + CW control
+			type = LIGHT_RGBCW;
+		}
+		else if (pwmCount == 3) {
+			// Enable + RGB control
+			type = LIGHT_RGB;
+		}
+		else if (pwmCount == 2) {
+			// PWM + Temperature (https://github.com/openshwprojects/OpenBK7231T_App/issues/279)
+			type = LIGHT_PWMCW;
+		}
+		else if (pwmCount == 1) {
+			type = LIGHT_PWM;
+		}
+		else {
+			if (pwmCount == 4 && info) {
+				addLogAdv(LOG_ERROR, LOG_FEATURE_HASS, "4 PWM device not yet handled\r\n");
+			}
+			return false;
+		}
+		break;
+#ifndef OBK_DISABLE_ALL_DRIVERS
+	case HASS_STEP_POWER:
+		if (!DRV_IsMeasuringPower())
+			return false;
+		type = POWER_SENSOR;
+		break;
+	case HASS_STEP_BATTERY:
+		if (!DRV_IsMeasuringBattery())
+			return false;
+		type = index == 0 ? BATTERY_SENSOR : BATTERY_VOLTAGE_SENSOR;
+		arg = 0;
+		break;
+#endif
+	case HASS_STEP_PIN_SENSORS:
+		// two entities per pin, first one uses first channel, second one uses second channel
+		role = g_cfg.pins.roles[index / 2];
+		if (IS_PIN_DHT_ROLE(role) || IS_PIN_TEMP_HUM_SENSOR_ROLE(role)) {
+			type = (index & 1) ? HUMIDITY_SENSOR : TEMPERATURE_SENSOR;
+		}
+		else if (IS_PIN_AIR_SENSOR_ROLE(role)) {
+			type = (index & 1) ? TVOC_SENSOR : CO2_SENSOR;
+		}
+		else {
+			return false;
+		}
+		arg = (index & 1) ? PIN_GetPinChannel2ForPinIndex(index / 2) : PIN_GetPinChannelForPinIndex(index / 2);
+		break;
+	default:
+		return false;
+	}
+	if (info == NULL)
+		return true;
+
+	switch (type) {
+	case RELAY:
+	case LIGHT_ON_OFF:
+		*info = hass_init_relay_device_info(arg, type);
+		break;
+	case BINARY_SENSOR:
+		*info = hass_init_binary_sensor_device_info(arg);
+		break;
+	case LIGHT_PWM:
+	case LIGHT_PWMCW:
+	case LIGHT_RGB:
+	case LIGHT_RGBCW:
+		*info = hass_init_light_device_info(type);
+		break;
+#ifndef OBK_DISABLE_ALL_DRIVERS
+	case POWER_SENSOR:
+		*info = hass_init_power_sensor_device_info(arg);
+		break;
+#endif
+	default:
+		*info = hass_init_sensor_device_info(type, arg);
+		break;
+	}
+	return *info != NULL;
+}
+
+/// @brief Moves discovery walk to the next place with an entity.
+/// @return false if walk is done
+static bool hass_discovery_advance(int* step, int* index) {
+	while (*step < HASS_STEP_DONE) {
+		if (*index >= hass_discovery_step_size(*step)) {
+			(*step)++;
+			*index = 0;
+			continue;
+		}
+		if (hass_discovery_entity(*step, *index, NULL))
+			return true;
+		(*index)++;
+	}
+	return false;
+}
+
+static hassAnnounced_t* hass_find_announced(unsigned int channelHash) {
+	int i;
+
+	for (i = 0; i < g_numHassAnnounced; i++) {
+		if (g_hassAnnounced[i].channelHash == channelHash)
+			return &g_hassAnnounced[i];
+	}
+	return NULL;
+}
+static hassAnnounced_t* hass_add_announced(unsigned int channelHash) {
+	hassAnnounced_t* n;
+
+	if (g_numHassAnnounced >= g_maxHassAnnounced) {
+		n = (hassAnnounced_t*)realloc(g_hassAnnounced, (g_maxHassAnnounced + 8) * sizeof(hassAnnounced_t));
+		if (n == NULL)
+			return NULL;
+		g_hassAnnounced = n;
+		g_maxHassAnnounced += 8;
+	}
+	n = &g_hassAnnounced[g_numHassAnnounced++];
+	n->channelHash = channelHash;
+	n->bConfirmed = false;
+	return n;
+}
+
+/// @brief Starts a new discovery pass. Entities are published later by hass_discovery_run.
+/// @param topic Discovery prefix, "homeassistant" if empty
+/// @param bForce Announce every entity, even if it has not changed
+/// @return false if there is nothing to announce or prefix is too long
+bool hass_discovery_start(const char* topic, bool bForce) {
+	int step = 0, index = 0;
+
+	if (topic == 0 || *topic == 0) {
+		topic = "homeassistant";
+	}
+	if (strlen(topic) >= sizeof(g_hassDiscovery.topic)) {
+		addLogAdv(LOG_ERROR, LOG_FEATURE_HASS, "HA discovery: prefix longer than %i characters\r\n", (int)sizeof(g_hassDiscovery.topic) - 1);
+		return false;
+	}
+	if (!hass_discovery_advance(&step, &index)) {
+		return false;
+	}
+	strcpy_safe(g_hassDiscovery.topic, topic, sizeof(g_hassDiscovery.topic));
+	g_hassDiscovery.step = 0;
+	g_hassDiscovery.index = 0;
+	g_hassDiscovery.pass++;
+	g_hassDiscovery.bRunning = true;
+	g_hassDiscovery.bForce = bForce;
+	g_hassDiscovery.retries = 0;
+	g_hassDiscovery.queued = 0;
+	g_hassDiscovery.skipped = 0;
+	g_hassDiscovery.unconfirmed = 0;
+	return true;
+}
+
+// All entities of the pass are out, now it's time for their states
+static void hass_discovery_finish() {
+	addLogAdv(LOG_INFO, LOG_FEATURE_HASS, "HA discovery done, %i announced, %i unchanged\r\n",
+		g_hassDiscovery.queued, g_hassDiscovery.skipped);
+	g_hassDiscovery.queued = 0;
+	MQTT_PublishOnlyDeviceChannelsIfPossible();
+}
+
+/// @brief Queues as many entities as MQTT queue has room for. Called every second.
+void hass_discovery_run() {
+	HassDeviceInfo* info;
+	hassAnnounced_t* a;
+	const char* json;
+	unsigned int channelHash, payloadHash;
+	int window;
+
+	if (!g_hassDiscovery.bRunning) {
+		return;
+	}
+	if (!MQTT_IsReady()) {
+		// what was queued may be lost, so walk again after reconnect,
+		// entities that were published for sure will be skipped
+		g_hassDiscovery.step = 0;
+		g_hassDiscovery.index = 0;
+		return;
+	}
+	window = MQTT_MAX_QUEUE_SIZE - HASS_DISCOVERY_QUEUE_RESERVE - MQTT_GetQueueDepth();
+	while (window > 0 && hass_discovery_advance(&g_hassDiscovery.step, &g_hassDiscovery.index)) {
+		info = NULL;
+		hass_discovery_entity(g_hassDiscovery.step, g_hassDiscovery.index, &info);
+		g_hassDiscovery.index++;
+		if (info == NULL)
+			continue;
+		json = hass_build_discovery_json(info);
+		if (*json) {
+			channelHash = MQTT_Dedup_HashTopic(info->channel);
+			payloadHash = MQTT_Dedup_HashTopic(json);
+			a = hass_find_announced(channelHash);
+			if (a && a->bConfirmed && a->payloadHash == payloadHash && (!g_hassDiscovery.bForce || a->pass == g_hassDiscovery.pass)) {
+				g_hassDiscovery.skipped++;
+			}
+			else {
+				if (a == NULL) {
+					a = hass_add_announced(channelHash);
+				}
+				if (a) {
+					// retried ones are already counted
+					if (a->pass != g_hassDiscovery.pass || a->bConfirmed)
+						g_hassDiscovery.unconfirmed++;
+					a->payloadHash = payloadHash;
+					a->pass = g_hassDiscovery.pass;
+					a->bConfirmed = false;
+				}
+				MQTT_QueuePublishWithCommand(g_hassDiscovery.topic, info->channel, json, OBK_PUBLISH_FLAG_RETAIN, HassDiscoveryPublished);
+				g_hassDiscovery.queued++;
+				window--;
+			}
+		}
+		hass_free_device_info(info);
+	}
+	if (g_hassDiscovery.step < HASS_STEP_DONE) {
+		return;
+	}
+	if (g_hassDiscovery.unconfirmed == 0) {
+		g_hassDiscovery.bRunning = false;
+		hass_discovery_finish();
+	}
+	else if (MQTT_GetQueueDepth() == 0) {
+		// queue is empty, but some publishes never went through
+		if (g_hassDiscovery.retries++ < HASS_DISCOVERY_MAX_RETRIES) {
+			g_hassDiscovery.step = 0;
+			g_hassDiscovery.index = 0;
+		}
+		else {
+			addLogAdv(LOG_ERROR, LOG_FEATURE_HASS, "HA discovery: %i entities could not be published\r\n", g_hassDiscovery.unconfirmed);
+			g_hassDiscovery.bRunning = false;
+		}
+	}
+}
+
+/// @brief Called by MQTT queue after discovery item was published.
+/// @param channel 
+void hass_discovery_on_published(const char* channel) {
+	hassAnnounced_t* a;
+
+	a = hass_find_announced(MQTT_Dedup_HashTopic(channel));
+	if (a == NULL)
+		return;
+	if (a->pass == g_hassDiscovery.pass && !a->bConfirmed)
+		g_hassDiscovery.unconfirmed--;
+	a->bConfirmed = true;
+	if (g_hassDiscovery.bRunning && g_hassDiscovery.step >= HASS_STEP_DONE && g_hassDiscovery.unconfirmed == 0) {
+		g_hassDiscovery.bRunning = false;
+		hass_discovery_finish();
+	}
+}
+
+/// @brief Forgets what was announced and stops current pass, so next pass announces everything.
+void hass_discovery_clear() {
+	free(g_hassAnnounced);
+	g_hassAnnounced = 0;
+	g_numHassAnnounced = 0;
+	g_maxHassAnnounced = 0;
+	g_hassDiscovery.bRunning = false;
+	g_hassDiscovery.unconfirmed = 0;
 }
@@ -1,6 +1,6 @@
 
 #include "new_http.h"
-#include "../cJSON/cJSON.h"
+#include "json_writer.h"
 #include "../new_pins.h"
 #include "../mqtt/new_mqtt.h"
 #include "../cmnds/cmd_public.h"
@@ -55,6 +55,9 @@ typedef enum {
 //channel is based on unique_id (see hass_populate_device_config_channel)
 #define HASS_CHANNEL_SIZE       (HASS_UNIQUE_ID_SIZE + 32)
 
+//Discovery prefix is queued as MQTT topic, so it has to fit there
+#define HASS_DISCOVERY_PREFIX_SIZE  MQTT_PUBLISH_ITEM_TOPIC_LENGTH
+
 //Size of JSON (1 less than MQTT queue holding)
 #define HASS_JSON_SIZE          (MQTT_PUBLISH_ITEM_VALUE_LENGTH - 1)
 
@@ -64,9 +67,7 @@ typedef struct HassDeviceInfo_s {
 	char channel[HASS_CHANNEL_SIZE];
 	char json[HASS_JSON_SIZE];
 
-	cJSON* root;
-	cJSON* device;
-	cJSON* ids;
+	jsonWriter_t writer;
 } HassDeviceInfo;
 
 void hass_print_unique_id(http_request_t* request, const char* fmt, ENTITY_TYPE type, int index);
@@ -77,3 +78,8 @@ HassDeviceInfo* hass_init_binary_sensor_device_info(int index);
 HassDeviceInfo* hass_init_sensor_device_info(ENTITY_TYPE type, int channel);
 const char* hass_build_discovery_json(HassDeviceInfo* info);
 void hass_free_device_info(HassDeviceInfo* info);
+
+bool hass_discovery_start(const char* topic, bool bForce);
+void hass_discovery_run();
+void hass_discovery_on_published(const char* channel);
+void hass_discovery_clear();
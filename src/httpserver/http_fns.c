@@ -14,7 +14,6 @@
 #include "../devicegroups/deviceGroups_public.h"
 #include "../mqtt/new_mqtt.h"
 #include "hass.h"
-#include "../cJSON/cJSON.h"
 #include <time.h>
 #include "../driver/drv_ntp.h"
 #include "../driver/drv_local.h"
@@ -848,8 +847,10 @@ int http_fn_index(http_request_t* request) {
 		hprintf255(request, "<h5>MQTT State: <span style=\"color:%s\">%s</span> RES: %d(%s)<br>", colorStr,
 			stateStr, MQTT_GetConnectResult(), get_error_name(MQTT_GetConnectResult()));
 		hprintf255(request, "MQTT ErrMsg: %s <br>", (MQTT_GetStatusMessage() != NULL) ? MQTT_GetStatusMessage() : "");
-		hprintf255(request, "MQTT Stats:CONN: %d PUB: %d RECV: %d ERR: %d </h5>", MQTT_GetConnectEvents(),
-			MQTT_GetPublishEventCounter(), MQTT_GetReceivedEventCounter(), MQTT_GetPublishErrorCounter());
+		hprintf255(request, "MQTT Stats:CONN: %d PUB: %d (%d/s, %u bytes) RECV: %d ERR: %d QUEUE: %d (%d drop, %d merged) </h5>", MQTT_GetConnectEvents(),
+			MQTT_GetPublishEventCounter(), MQTT_GetPublishRate(), MQTT_GetPublishedBytesCounter(),
+			MQTT_GetReceivedEventCounter(), MQTT_GetPublishErrorCounter(),
+			MQTT_GetQueueDepth(), MQTT_GetQueueDroppedCounter(), MQTT_GetQueueCoalescedCounter());
 	}
 	/* Format current PINS input state for all unused pins */
 	if (CFG_HasFlag(OBK_FLAG_HTTP_PINMONITOR))
@@ -1586,152 +1587,23 @@ int http_fn_uart_tool(http_request_t* request) {
 	return 0;
 }
 
+/// @brief Starts HomeAssistant discovery. Entities are published one by one from hass_discovery_run,
+/// as fast as MQTT queue allows, and only those that have changed since they were last announced.
+/// @param topic Discovery prefix
+/// @param request If not NULL, discovery was asked for over HTTP and everything is announced again.
 void doHomeAssistantDiscovery(const char* topic, http_request_t* request) {
-	int i;
-	int relayCount;
-	int pwmCount;
-	int dInputCount;
-	bool ledDriverChipRunning;
-	HassDeviceInfo* dev_info = NULL;
-	bool measuringPower = false;
-	bool measuringBattery = false;
-	struct cJSON_Hooks hooks;
-	bool discoveryQueued = false;
-
-	if (topic == 0 || *topic == 0) {
-		topic = "homeassistant";
-	}
-
-#ifndef OBK_DISABLE_ALL_DRIVERS
-	measuringPower = DRV_IsMeasuringPower();
-	measuringBattery = DRV_IsMeasuringBattery();
-#endif
-
-	PIN_get_Relay_PWM_Count(&relayCount, &pwmCount, &dInputCount);
-
-	ledDriverChipRunning = LED_IsLedDriverChipRunning();
-
-	hooks.malloc_fn = os_malloc;
-	hooks.free_fn = os_free;
-	cJSON_InitHooks(&hooks);
-
-	if (relayCount > 0) {
-		for (i = 0; i < CHANNEL_MAX; i++) {
-			if (h_isChannelRelay(i)) {
-				if (CFG_HasFlag(OBK_FLAG_MQTT_HASS_ADD_RELAYS_AS_LIGHTS)) {
-					dev_info = hass_init_relay_device_info(i, LIGHT_ON_OFF);
-				}
-				else {
-					dev_info = hass_init_relay_device_info(i, RELAY);
-				}
-				MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
-				hass_free_device_info(dev_info);
-				dev_info = NULL;
-				discoveryQueued = true;
-			}
-		}
-	}
+	const char* msg = NULL;
 
-	if (dInputCount > 0) {
-		for (i = 0; i < CHANNEL_MAX; i++) {
-			if (h_isChannelDigitalInput(i)) {
-				dev_info = hass_init_binary_sensor_device_info(i);
-				MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
-				hass_free_device_info(dev_info);
-				dev_info = NULL;
-				discoveryQueued = true;
-			}
-		}
+	if (topic && strlen(topic) >= HASS_DISCOVERY_PREFIX_SIZE) {
+		msg = "Discovery prefix is too long.";
 	}
-
-	if (pwmCount == 5 || ledDriverChipRunning || (pwmCount == 4 && CFG_HasFlag(OBK_FLAG_LED_EMULATE_COOL_WITH_RGB))) {
-		if (dev_info == NULL) {
-			dev_info = hass_init_light_device_info(LIGHT_RGBCW);
-		}
-		// Enable + RGB control + CW control
-		MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
-		hass_free_device_info(dev_info);
-		dev_info = NULL;
-		discoveryQueued = true;
-	}
-	else if (pwmCount > 0) {
-		if (pwmCount == 4) {
-			addLogAdv(LOG_ERROR, LOG_FEATURE_HTTP, "4 PWM device not yet handled\r\n");
-		}
-		else if (pwmCount == 3) {
-			// Enable + RGB control
-			dev_info = hass_init_light_device_info(LIGHT_RGB);
-		}
-		else if (pwmCount == 2) {
-			// PWM + Temperature (https://github.com/openshwprojects/OpenBK7231T_App/issues/279)
-			dev_info = hass_init_light_device_info(LIGHT_PWMCW);
-		}
-		else {
-			dev_info = hass_init_light_device_info(LIGHT_PWM);
-		}
-
-		if (dev_info != NULL) {
-			MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
-			hass_free_device_info(dev_info);
-			dev_info = NULL;
-			discoveryQueued = true;
-		}
-	}
-
-#ifndef OBK_DISABLE_ALL_DRIVERS
-	if (measuringPower == true) {
-		for (i = 0; i < OBK_NUM_SENSOR_COUNT; i++)
-		{
-			dev_info = hass_init_power_sensor_device_info(i);
-			MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
-			hass_free_device_info(dev_info);
-			discoveryQueued = true;
-		}
-	}
-#endif
-
-	if (measuringBattery == true) {
-		dev_info = hass_init_sensor_device_info(BATTERY_SENSOR, 0);
-		MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
-		hass_free_device_info(dev_info);
-
-		dev_info = hass_init_sensor_device_info(BATTERY_VOLTAGE_SENSOR, 0);
-		MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
-		hass_free_device_info(dev_info);
-
-		discoveryQueued = true;
-	}
-
-	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
-		if (IS_PIN_DHT_ROLE(g_cfg.pins.roles[i]) || IS_PIN_TEMP_HUM_SENSOR_ROLE(g_cfg.pins.roles[i])) {
-			dev_info = hass_init_sensor_device_info(TEMPERATURE_SENSOR, PIN_GetPinChannelForPinIndex(i));
-			MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
-			hass_free_device_info(dev_info);
-
-			dev_info = hass_init_sensor_device_info(HUMIDITY_SENSOR, PIN_GetPinChannel2ForPinIndex(i));
-			MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
-			hass_free_device_info(dev_info);
-
-			discoveryQueued = true;
-		}
-		else if (IS_PIN_AIR_SENSOR_ROLE(g_cfg.pins.roles[i])) {
-			dev_info = hass_init_sensor_device_info(CO2_SENSOR, PIN_GetPinChannelForPinIndex(i));
-			MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
-			hass_free_device_info(dev_info);
-
-			dev_info = hass_init_sensor_device_info(TVOC_SENSOR, PIN_GetPinChannel2ForPinIndex(i));
-			MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
-			hass_free_device_info(dev_info);
-
-			discoveryQueued = true;
-		}
-	}
-
-	if (discoveryQueued) {
-		MQTT_InvokeCommandAtEnd(PublishChannels);
+	else if (hass_discovery_start(topic, request != NULL)) {
+		hass_discovery_run();
 	}
 	else {
-		const char* msg = "No relay, PWM, sensor or power driver running.";
+		msg = "No relay, PWM, sensor or power driver running.";
+	}
+	if (msg) {
 		if (request) {
 			poststr(request, msg);
 			poststr(request, NULL);
@@ -1746,7 +1618,8 @@ void doHomeAssistantDiscovery(const char* topic, http_request_t* request) {
 /// @param request 
 /// @return 
 int http_fn_ha_discovery(http_request_t* request) {
-	char topic[32];
+	// one more, so too long prefix is not silently cut
+	char topic[HASS_DISCOVERY_PREFIX_SIZE + 1];
 
 	http_setup(request, httpMimeTypeText);
 
@@ -12,6 +12,56 @@
 
 int g_port = 80;
 
+// Event driven server - fixed pool of connection slots, served from HTTPServer_RunQuickTick.
+// Each slot collects data over as many recv calls as needed, so headers and
+// Content-Length bodies may arrive in pieces, and the connection is kept open
+// after reply (HTTP/1.1 keep-alive). Pipelined requests are processed in order.
+#ifndef HTTP_MAX_CLIENTS
+#define HTTP_MAX_CLIENTS 4
+#endif
+#define HTTP_CLIENT_BUFFER_SIZE 4096
+#define DEFAULT_BUFLEN 10000
+// idle keep-alive connection is closed after that time
+#define HTTP_KEEPALIVE_TIMEOUT_MS 5000
+#define HTTP_MAX_REQUESTS_PER_CONNECTION 100
+
+typedef struct httpClientSlot_s {
+	SOCKET sock;
+	// bytes in buffer
+	int used;
+	long lastActivity;
+	int requests;
+	char buffer[HTTP_CLIENT_BUFFER_SIZE + 1];
+} httpClientSlot_t;
+
+static httpClientSlot_t g_httpClients[HTTP_MAX_CLIENTS];
+static char g_httpReply[DEFAULT_BUFLEN + HTTP_KEEPALIVE_HEADER_EXTRA];
+static int g_httpClientsInitialized = 0;
+
+static void HTTPServer_CloseClient(httpClientSlot_t *c, bool bGraceful) {
+	if (c->sock == INVALID_SOCKET)
+		return;
+	if (bGraceful) {
+		shutdown(c->sock, SD_SEND);
+	}
+	closesocket(c->sock);
+	c->sock = INVALID_SOCKET;
+	c->used = 0;
+	c->requests = 0;
+}
+static void HTTPServer_InitClients() {
+	int i;
+
+	for (i = 0; i < HTTP_MAX_CLIENTS; i++) {
+		if (g_httpClientsInitialized) {
+			HTTPServer_CloseClient(&g_httpClients[i], false);
+		}
+		g_httpClients[i].sock = INVALID_SOCKET;
+		g_httpClients[i].used = 0;
+		g_httpClients[i].requests = 0;
+	}
+	g_httpClientsInitialized = 1;
+}
 int HTTPServer_Start() {
 
 	int iResult;
@@ -27,7 +77,9 @@ int HTTPServer_Start() {
 
 	if (ListenSocket != INVALID_SOCKET) {
 		closesocket(ListenSocket);
+		ListenSocket = INVALID_SOCKET;
 	}
+	HTTPServer_InitClients();
     // Resolve the server address and port
 	char service[6];
 	snprintf(service, sizeof(service), "%u", g_port);
@@ -54,6 +106,7 @@ int HTTPServer_Start() {
         printf("bind failed with error: %d\n", WSAGetLastError());
         freeaddrinfo(result);
         closesocket(ListenSocket);
+        ListenSocket = INVALID_SOCKET;
         WSACleanup();
         return 1;
     }
@@ -64,6 +117,7 @@ int HTTPServer_Start() {
 	if (iResult == SOCKET_ERROR) {
 		printf("listen failed with error: %d\n", WSAGetLastError());
 		closesocket(ListenSocket);
+		ListenSocket = INVALID_SOCKET;
 		WSACleanup();
 		return 1;
 	}
@@ -76,128 +130,192 @@ int HTTPServer_Start() {
         printf("ioctlsocket() error %d\n", WSAGetLastError());
         return 1;
     }
+	return 0;
 }
-#define DEFAULT_BUFLEN 10000
-void HTTPServer_RunQuickTick() {
-	int iResult;
-	int err;
-    char recvbuf[DEFAULT_BUFLEN];
-    char outbuf[DEFAULT_BUFLEN];
-    int recvbuflen = DEFAULT_BUFLEN;
-    SOCKET ClientSocket = INVALID_SOCKET;
-	int len, iSendResult;
-	int argp;
+// Returns header length (including final empty line) or 0 if headers are not complete yet.
+static int HTTPServer_ScanHeaders(const char *buf, int len, int *contentLength, int *keepAlive) {
+	const char *p, *end, *line;
+	int bHTTP11;
 
-	// Accept a client socket
-	ClientSocket = accept(ListenSocket, NULL, NULL);
-	if (ClientSocket == INVALID_SOCKET) {
-		iResult = WSAGetLastError();
-		if(iResult != WSAEWOULDBLOCK) {
-			printf("accept failed with error: %d\n", iResult);
+	p = strstr(buf, "\r\n\r\n");
+	if (p == 0) {
+		return 0;
+	}
+	end = p + 2;
+	*contentLength = 0;
+	// first line has protocol, HTTP/1.0 always closes (chunked replies need HTTP/1.1)
+	line = strstr(buf, "\r\n");
+	bHTTP11 = (line - buf > 8 && !strncmp(line - 8, "HTTP/1.1", 8));
+	*keepAlive = bHTTP11;
+	while (line < end) {
+		line += 2;
+		if (!wal_strnicmp(line, "Content-Length:", 15)) {
+			*contentLength = atoi(line + 15);
 		}
-		return;
+		else if (!wal_strnicmp(line, "Connection:", 11)) {
+			p = line + 11;
+			while (*p == ' ')
+				p++;
+			if (!wal_strnicmp(p, "close", 5)) {
+				*keepAlive = 0;
+			}
+			else if (bHTTP11 && !wal_strnicmp(p, "keep-alive", 10)) {
+				*keepAlive = 1;
+			}
+		}
+		line = strstr(line, "\r\n");
 	}
+	return (end + 2) - buf;
+}
+static void HTTPServer_SetBlocking(SOCKET s, int bBlocking) {
+	unsigned long argp = bBlocking ? 0 : 1;
+	ioctlsocket(s, FIONBIO, &argp);
+}
+// Process all complete requests in slot buffer. Returns false if connection was closed.
+static bool HTTPServer_ProcessClient(httpClientSlot_t *c) {
+	static const char httpTooLarge[] = "HTTP/1.1 431 Request Header Fields Too Large\r\nConnection: close\r\n\r\n";
+	int headerLen, contentLength, keepAlive, total;
+	char saved;
+	http_request_t request;
 
-	//argp = 0;
-	//if (ioctlsocket(ClientSocket,
-	//	FIONBIO,
-	//	&argp) == SOCKET_ERROR)
-	//{
-	//	printf("ioctlsocket() error %d\n", WSAGetLastError());
-	//	return 1;
-	//}
-		// Receive until the peer shuts down the connection
-		do {
-
-			iResult = recv(ClientSocket, recvbuf, recvbuflen, 0);
-			if (iResult > 0) {
-				http_request_t request;
-				memset(&request, 0, sizeof(request));
-
-				recvbuf[iResult] = 0;
-
-#if 1
-				// debug test code, you can disable it but dont remove it
-				if (1) {
-					FILE *f;
-
-					f = fopen("lastHTTPPacket.txt", "wb");
-					fwrite(recvbuf, 1, recvbuflen, f);
-					fclose(f);
-				}
-#endif
-
-				request.fd = ClientSocket;
-				request.received = recvbuf;
-				request.receivedLen = iResult;
-				outbuf[0] = '\0';
-				request.reply = outbuf;
-				request.replylen = 0;
-
-				request.replymaxlen = DEFAULT_BUFLEN;
-
-				//printf("HTTP Server for Windows: Bytes received: %d \n", iResult);
-				len = HTTP_ProcessPacket(&request);
-
-				if(len > 0) {
-					printf("Bytes rremaining tosend %d\n", len);
-					//printf("%s\n",outbuf);
-					// Echo the buffer back to the sender
-					//leen =  strlen(request.reply);
-					iSendResult = send( ClientSocket, outbuf,len, 0 );
-					if (iSendResult == SOCKET_ERROR) {
-						printf("send failed with error: %d\n", WSAGetLastError());
-						closesocket(ClientSocket);
-						return 1;
-					}
-					printf("HTTP Server for Windows: Bytes sent: %d\n", iSendResult);
-				}
-				break;
+	while (c->used > 0) {
+		c->buffer[c->used] = 0;
+		headerLen = HTTPServer_ScanHeaders(c->buffer, c->used, &contentLength, &keepAlive);
+		if (headerLen == 0) {
+			if (c->used >= HTTP_CLIENT_BUFFER_SIZE) {
+				ADDLOG_ERROR(LOG_FEATURE_HTTP, "HTTP headers too large");
+				send(c->sock, httpTooLarge, sizeof(httpTooLarge) - 1, 0);
+				HTTPServer_CloseClient(c, true);
+				return false;
 			}
-			else if (iResult == 0) {
-				printf("Connection closing...\n");
-				break;
+			// wait for more
+			return true;
+		}
+		if (contentLength < 0) {
+			contentLength = 0;
+		}
+		// compared before adding, so huge Content-Length can't overflow total
+		if (contentLength > HTTP_CLIENT_BUFFER_SIZE - headerLen) {
+			// body does not fit in slot buffer, so handler will recv the rest
+			// directly (like OTA or LFS upload) and connection is closed afterwards
+			total = c->used;
+			keepAlive = 0;
+		}
+		else {
+			total = headerLen + contentLength;
+			if (c->used < total) {
+				// wait for rest of body
+				return true;
 			}
-			else {
-				err = WSAGetLastError();
-				if (err != WSAEWOULDBLOCK) {
-					printf("recv failed with error: %d\n", err);
-					closesocket(ClientSocket);
-					break;
-				}
+		}
+		if (++c->requests >= HTTP_MAX_REQUESTS_PER_CONNECTION) {
+			keepAlive = 0;
+		}
+
+		memset(&request, 0, sizeof(request));
+		// terminate this request, but keep first byte of next pipelined one
+		saved = c->buffer[total];
+		c->buffer[total] = 0;
+#if 0
+		// debug test code, you can disable it but dont remove it
+		if (1) {
+			FILE *f;
+
+			f = fopen("lastHTTPPacket.txt", "wb");
+			fwrite(c->buffer, 1, total, f);
+			fclose(f);
+		}
+#endif
+		request.fd = c->sock;
+		request.received = c->buffer;
+		request.receivedLen = total;
+		request.receivedLenmax = HTTP_CLIENT_BUFFER_SIZE;
+		request.responseCode = HTTP_RESPONSE_OK;
+		g_httpReply[0] = '\0';
+		request.reply = g_httpReply;
+		request.replylen = 0;
+		request.replymaxlen = DEFAULT_BUFLEN;
+		request.keepAlive = keepAlive;
+
+		HTTPServer_SetBlocking(c->sock, 1);
+		HTTP_ProcessPacket(&request);
+		// send what's left in buffer
+		postany(&request, NULL, 0);
+		HTTPServer_SetBlocking(c->sock, 0);
+
+		if (request.keepAlive == 0) {
+			HTTPServer_CloseClient(c, true);
+			return false;
+		}
+		c->buffer[total] = saved;
+		c->used -= total;
+		memmove(c->buffer, c->buffer + total, c->used);
+	}
+	return true;
+}
+static void HTTPServer_AcceptClients() {
+	int i;
+	SOCKET s;
+	int one = 1;
+
+	for (i = 0; i < HTTP_MAX_CLIENTS; i++) {
+		if (g_httpClients[i].sock != INVALID_SOCKET)
+			continue;
+		s = accept(ListenSocket, NULL, NULL);
+		if (s == INVALID_SOCKET) {
+			int err = WSAGetLastError();
+			if (err != WSAEWOULDBLOCK) {
+				printf("accept failed with error: %d\n", err);
 			}
-			break;
-		} while (1);
-		//byte zero = 0;
-		//send(ClientSocket, &zero, 0, 0);
-		//Sleep(50);
-		// shutdown the connection since we're done
-		iResult = shutdown(ClientSocket, SD_SEND);
-		long firstAttempt = timeGetTime();
-		while (1) {
-			iResult = recv(ClientSocket, recvbuf, recvbuflen, 0);
-			if (iResult == 0)
-				break;
+			return;
+		}
+		HTTPServer_SetBlocking(s, 0);
+		// chunked replies end with a small write, don't let it wait for delayed ACK
+		setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&one, sizeof(one));
+		g_httpClients[i].sock = s;
+		g_httpClients[i].used = 0;
+		g_httpClients[i].requests = 0;
+		g_httpClients[i].lastActivity = timeGetTime();
+	}
+	// if all slots are busy, new clients wait in listen backlog
+}
+void HTTPServer_RunQuickTick() {
+	int i, len, err;
+	long now;
+	httpClientSlot_t *c;
+
+	if (ListenSocket == INVALID_SOCKET) {
+		return;
+	}
+	HTTPServer_AcceptClients();
+
+	now = timeGetTime();
+	for (i = 0; i < HTTP_MAX_CLIENTS; i++) {
+		c = &g_httpClients[i];
+		if (c->sock == INVALID_SOCKET)
+			continue;
+		len = recv(c->sock, c->buffer + c->used, HTTP_CLIENT_BUFFER_SIZE - c->used, 0);
+		if (len == 0) {
+			// peer closed
+			HTTPServer_CloseClient(c, false);
+			continue;
+		}
+		if (len < 0) {
 			err = WSAGetLastError();
 			if (err != WSAEWOULDBLOCK) {
-				break;
+				HTTPServer_CloseClient(c, false);
 			}
-			long delta = timeGetTime() - firstAttempt;
-			if (delta > 2) {
-				printf("HTTP server would freeze to long!\n");
-				break; // too long freeze!
-
+			else if (now - c->lastActivity > HTTP_KEEPALIVE_TIMEOUT_MS) {
+				HTTPServer_CloseClient(c, true);
 			}
+			continue;
 		}
-		//Sleep(50);
-		//iResult = closesocket(ClientSocket);
-		//if (iResult == SOCKET_ERROR) {
-		///	printf("shutdown failed with error: %d\n", WSAGetLastError());
-			closesocket(ClientSocket);
-			//WSACleanup();
-			//return 1;
-		//}
+		c->used += len;
+		c->lastActivity = now;
+		HTTPServer_ProcessClient(c);
+	}
+	// slots freed by closed connections can take waiting clients at once
+	HTTPServer_AcceptClients();
 }
 
 #endif
-
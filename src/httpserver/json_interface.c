@@ -15,29 +15,40 @@
 #include "../devicegroups/deviceGroups_public.h"
 #include "../mqtt/new_mqtt.h"
 #include "hass.h"
-#include "../cJSON/cJSON.h"
+#include "json_writer.h"
 #include <time.h>
 #include "../driver/drv_ntp.h"
 #include "../driver/drv_local.h"
 #include "../driver/drv_bl_shared.h"
 
-void JSON_PrintKeyValue_String(void* request, jsonCb_t printer, const char* key, const char* value, bool bComma) {
-	printer(request, "\"%s\":\"%s\"", key, value);
+// Helpers below print a single "key":value pair (or just value if key is NULL) through JSON writer,
+// so strings are escaped and NaN floats become null. Braces are up to the caller.
+static void JSON_FinishKeyValue(jsonWriter_t* w, bool bComma) {
+	JSONWriter_Finish(w);
 	if (bComma) {
-		printer(request, ",");
+		w->printer(w->userData, ",");
 	}
 }
+void JSON_PrintKeyValue_String(void* request, jsonCb_t printer, const char* key, const char* value, bool bComma) {
+	jsonWriter_t w;
+
+	JSONWriter_InitPrinter(&w, request, printer);
+	JSONWriter_AddString(&w, key, value);
+	JSON_FinishKeyValue(&w, bComma);
+}
 void JSON_PrintKeyValue_Int(void* request, jsonCb_t printer, const char* key, int value, bool bComma) {
-	printer(request, "\"%s\":%i", key, value);
-	if (bComma) {
-		printer(request, ",");
-	}
+	jsonWriter_t w;
+
+	JSONWriter_InitPrinter(&w, request, printer);
+	JSONWriter_AddInt(&w, key, value);
+	JSON_FinishKeyValue(&w, bComma);
 }
 void JSON_PrintKeyValue_Float(void* request, jsonCb_t printer, const char* key, float value, bool bComma) {
-	printer(request, "\"%s\":%f", key, value);
-	if (bComma) {
-		printer(request, ",");
-	}
+	jsonWriter_t w;
+
+	JSONWriter_InitPrinter(&w, request, printer);
+	JSONWriter_AddFloat(&w, key, value, 6);
+	JSON_FinishKeyValue(&w, bComma);
 }
 
 static int http_tasmota_json_Dimmer(void* request, jsonCb_t printer) {
@@ -225,14 +236,14 @@ static int http_tasmota_json_ENERGY(void* request, jsonCb_t printer) {
 		}
 
 		printer(request, "{");
-		printer(request, "\"Power\": %f,", power);
-		printer(request, "\"ApparentPower\": %f,", g_apparentPower);
-		printer(request, "\"ReactivePower\": %f,", g_reactivePower);
-		printer(request, "\"Factor\":%f,", g_powerFactor);
-		printer(request, "\"Voltage\":%f,", voltage);
-		printer(request, "\"Current\":%f,", current);
-		printer(request, "\"ConsumptionTotal\":%f,", energy);
-		printer(request, "\"ConsumptionLastHour\":%f", energy_hour);
+		JSON_PrintKeyValue_Float(request, printer, "Power", power, true);
+		JSON_PrintKeyValue_Float(request, printer, "ApparentPower", g_apparentPower, true);
+		JSON_PrintKeyValue_Float(request, printer, "ReactivePower", g_reactivePower, true);
+		JSON_PrintKeyValue_Float(request, printer, "Factor", g_powerFactor, true);
+		JSON_PrintKeyValue_Float(request, printer, "Voltage", voltage, true);
+		JSON_PrintKeyValue_Float(request, printer, "Current", current, true);
+		JSON_PrintKeyValue_Float(request, printer, "ConsumptionTotal", energy, true);
+		JSON_PrintKeyValue_Float(request, printer, "ConsumptionLastHour", energy_hour, false);
 		// close ENERGY block
 		printer(request, "}");
 	}
@@ -566,6 +577,7 @@ static int http_tasmota_json_status_generic(void* request, jsonCb_t printer) {
 	const char* deviceName;
 	const char* friendlyName;
 	const char* clientId;
+	char relayName[64];
 	int powerCode;
 	int relayCount, pwmCount, dInputCount, i;
 	bool bRelayIndexingStartsWithZero;
@@ -613,7 +625,7 @@ static int http_tasmota_json_status_generic(void* request, jsonCb_t printer) {
 	JSON_PrintKeyValue_String(request, printer, "DeviceName", deviceName, true);
 	printer(request, "\"FriendlyName\":[");
 	if (relayCount == 0) {
-		printer(request, "\"%s\"", deviceName);
+		JSON_PrintKeyValue_String(request, printer, NULL, deviceName, false);
 	}
 	else {
 		int c_printed = 0;
@@ -631,13 +643,16 @@ static int http_tasmota_json_status_generic(void* request, jsonCb_t printer) {
 				if (c_printed) {
 					printer(request, ",");
 				}
-				printer(request, "\"%s_%i\"", deviceName, useIdx);
+				snprintf(relayName, sizeof(relayName), "%s_%i", deviceName, useIdx);
+				JSON_PrintKeyValue_String(request, printer, NULL, relayName, false);
 				c_printed++;
 			}
 		}
 	}
 	printer(request, "]");
-	printer(request, ",\"Topic\":\"%s\",\"ButtonTopic\":\"0\"", clientId);
+	printer(request, ",");
+	JSON_PrintKeyValue_String(request, printer, "Topic", clientId, true);
+	printer(request, "\"ButtonTopic\":\"0\"");
 	printer(request, ",\"Power\":%i,\"PowerOnState\":3,\"LedState\":1", powerCode);
 	printer(request, ",\"LedMask\":\"FFFF\",\"SaveData\":1,\"SaveState\":1");
 	printer(request, ",\"SwitchTopic\":\"0\",\"SwitchMode\":[0,0,0,0,0,0,0,0]");
@@ -687,7 +702,7 @@ static int http_tasmota_json_status_generic(void* request, jsonCb_t printer) {
 	printer(request, "\"SysLog\":0,");
 	printer(request, "\"LogHost\":\"\",");
 	printer(request, "\"LogPort\":514,");
-	printer(request, "\"SSId1\":\"%s\",", CFG_GetWiFiSSID());
+	JSON_PrintKeyValue_String(request, printer, "SSId1", CFG_GetWiFiSSID(), true);
 	printer(request, "\"SSId2\":\"\",");
 	printer(request, "\"TelePeriod\":300,");
 	printer(request, "\"Resolution\":\"558180C0\",");
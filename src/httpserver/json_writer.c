@@ -0,0 +1,259 @@
+#include "../new_common.h"
+#include "json_writer.h"
+#include <math.h>
+#include <float.h>
+
+static const char g_jsonHex[] = "0123456789abcdef";
+
+static void JSONWriter_Flush(jsonWriter_t *w) {
+	if (w->stageLen == 0)
+		return;
+	w->stage[w->stageLen] = 0;
+	w->printer(w->userData, "%s", w->stage);
+	w->stageLen = 0;
+}
+static void JSONWriter_Raw(jsonWriter_t *w, const char *s, int len) {
+	int chunk;
+
+	if (w->bOverflow)
+		return;
+	if (w->printer) {
+		w->len += len;
+		while (len > 0) {
+			chunk = JSONWRITER_STAGE_SIZE - 1 - w->stageLen;
+			if (chunk > len)
+				chunk = len;
+			memcpy(w->stage + w->stageLen, s, chunk);
+			w->stageLen += chunk;
+			s += chunk;
+			len -= chunk;
+			if (w->stageLen >= JSONWRITER_STAGE_SIZE - 1)
+				JSONWriter_Flush(w);
+		}
+		return;
+	}
+	// always keep space for terminating zero
+	if (w->len + len >= w->size) {
+		w->bOverflow = true;
+		return;
+	}
+	memcpy(w->buffer + w->len, s, len);
+	w->len += len;
+	w->buffer[w->len] = 0;
+}
+static void JSONWriter_Char(jsonWriter_t *w, char c) {
+	JSONWriter_Raw(w, &c, 1);
+}
+static void JSONWriter_Escaped(jsonWriter_t *w, const char *s) {
+	const char *run;
+	char esc[6];
+	unsigned char c;
+
+	JSONWriter_Char(w, '"');
+	run = s;
+	while (*s) {
+		c = (unsigned char)*s;
+		if (c >= 0x20 && c != '"' && c != '\\') {
+			s++;
+			continue;
+		}
+		// write everything that didn't need escaping in one go
+		JSONWriter_Raw(w, run, s - run);
+		esc[0] = '\\';
+		switch (c) {
+		case '"': esc[1] = '"'; break;
+		case '\\': esc[1] = '\\'; break;
+		case '\b': esc[1] = 'b'; break;
+		case '\f': esc[1] = 'f'; break;
+		case '\n': esc[1] = 'n'; break;
+		case '\r': esc[1] = 'r'; break;
+		case '\t': esc[1] = 't'; break;
+		default:
+			esc[1] = 'u';
+			esc[2] = '0';
+			esc[3] = '0';
+			esc[4] = g_jsonHex[c >> 4];
+			esc[5] = g_jsonHex[c & 15];
+			JSONWriter_Raw(w, esc, 6);
+			s++;
+			run = s;
+			continue;
+		}
+		JSONWriter_Raw(w, esc, 2);
+		s++;
+		run = s;
+	}
+	JSONWriter_Raw(w, run, s - run);
+	JSONWriter_Char(w, '"');
+}
+// Comma before every item except the first one on given level, then the key if there is one
+static void JSONWriter_Item(jsonWriter_t *w, const char *key) {
+	if (w->depth > 0) {
+		if (w->firstItem & (1 << w->depth)) {
+			w->firstItem &= ~(1 << w->depth);
+		}
+		else {
+			JSONWriter_Char(w, ',');
+		}
+	}
+	if (key) {
+		JSONWriter_Escaped(w, key);
+		JSONWriter_Char(w, ':');
+	}
+}
+static void JSONWriter_Open(jsonWriter_t *w, const char *key, char c) {
+	JSONWriter_Item(w, key);
+	JSONWriter_Char(w, c);
+	if (w->depth >= JSONWRITER_MAX_DEPTH) {
+		w->bOverflow = true;
+		return;
+	}
+	w->depth++;
+	w->firstItem |= (1 << w->depth);
+}
+static void JSONWriter_Close(jsonWriter_t *w, char c) {
+	if (w->depth <= 0) {
+		w->bOverflow = true;
+		return;
+	}
+	w->firstItem &= ~(1 << w->depth);
+	w->depth--;
+	JSONWriter_Char(w, c);
+}
+static void JSONWriter_Reset(jsonWriter_t *w) {
+	w->len = 0;
+	w->depth = 0;
+	w->firstItem = 0;
+	w->stageLen = 0;
+	w->bOverflow = false;
+}
+void JSONWriter_InitBuffer(jsonWriter_t *w, char *buffer, int size) {
+	JSONWriter_Reset(w);
+	w->buffer = buffer;
+	w->size = size;
+	w->userData = 0;
+	w->printer = 0;
+	if (size > 0) {
+		buffer[0] = 0;
+	}
+	else {
+		w->bOverflow = true;
+	}
+}
+void JSONWriter_InitPrinter(jsonWriter_t *w, void *userData, jsonCb_t printer) {
+	JSONWriter_Reset(w);
+	w->buffer = 0;
+	w->size = 0;
+	w->userData = userData;
+	w->printer = printer;
+}
+void JSONWriter_BeginObject(jsonWriter_t *w, const char *key) {
+	JSONWriter_Open(w, key, '{');
+}
+void JSONWriter_EndObject(jsonWriter_t *w) {
+	JSONWriter_Close(w, '}');
+}
+void JSONWriter_BeginArray(jsonWriter_t *w, const char *key) {
+	JSONWriter_Open(w, key, '[');
+}
+void JSONWriter_EndArray(jsonWriter_t *w) {
+	JSONWriter_Close(w, ']');
+}
+void JSONWriter_AddString(jsonWriter_t *w, const char *key, const char *value) {
+	JSONWriter_Item(w, key);
+	if (value == 0) {
+		JSONWriter_Raw(w, "null", 4);
+		return;
+	}
+	JSONWriter_Escaped(w, value);
+}
+void JSONWriter_AddStringf(jsonWriter_t *w, const char *key, const char *fmt, ...) {
+	va_list argList;
+	char tmp[128];
+
+	va_start(argList, fmt);
+	vsnprintf(tmp, sizeof(tmp), fmt, argList);
+	va_end(argList);
+
+	JSONWriter_AddString(w, key, tmp);
+}
+void JSONWriter_AddInt(jsonWriter_t *w, const char *key, int value) {
+	char tmp[12];
+	char *p = tmp + sizeof(tmp);
+	unsigned int u = value < 0 ? 0u - (unsigned int)value : (unsigned int)value;
+
+	do {
+		*--p = '0' + u % 10;
+		u /= 10;
+	} while (u);
+	if (value < 0)
+		*--p = '-';
+	JSONWriter_Item(w, key);
+	JSONWriter_Raw(w, p, tmp + sizeof(tmp) - p);
+}
+void JSONWriter_AddBool(jsonWriter_t *w, const char *key, bool value) {
+	JSONWriter_Item(w, key);
+	if (value)
+		JSONWriter_Raw(w, "true", 4);
+	else
+		JSONWriter_Raw(w, "false", 5);
+}
+void JSONWriter_AddNumber(jsonWriter_t *w, const char *key, double value) {
+	char tmp[32];
+	double test;
+	int len;
+
+	// JSON has no NaN/Inf
+	if (isnan(value) || isinf(value)) {
+		JSONWriter_Item(w, key);
+		JSONWriter_Raw(w, "null", 4);
+		return;
+	}
+	if (fabs(value) < 2147483647.0 && value == (double)(int)value) {
+		JSONWriter_AddInt(w, key, (int)value);
+		return;
+	}
+	// 15 digits are enough for most values, use 17 when they don't round trip
+	len = snprintf(tmp, sizeof(tmp), "%1.15g", value);
+	test = strtod(tmp, 0);
+	if (fabs(test - value) > fmax(fabs(test), fabs(value)) * DBL_EPSILON) {
+		len = snprintf(tmp, sizeof(tmp), "%1.17g", value);
+	}
+	JSONWriter_Item(w, key);
+	JSONWriter_Raw(w, tmp, len);
+}
+void JSONWriter_AddFloat(jsonWriter_t *w, const char *key, double value, int decimals) {
+	char tmp[48];
+	int len;
+
+	if (isnan(value) || isinf(value) || fabs(value) > 1e15) {
+		JSONWriter_AddNumber(w, key, value);
+		return;
+	}
+	if (decimals < 0)
+		decimals = 0;
+	if (decimals > 9)
+		decimals = 9;
+	len = snprintf(tmp, sizeof(tmp), "%.*f", decimals, value);
+	if (decimals > 0) {
+		while (tmp[len - 1] == '0')
+			len--;
+		if (tmp[len - 1] == '.')
+			len--;
+	}
+	// don't print "-0" for tiny negative values
+	if (len == 2 && tmp[0] == '-' && tmp[1] == '0') {
+		tmp[0] = '0';
+		len = 1;
+	}
+	JSONWriter_Item(w, key);
+	JSONWriter_Raw(w, tmp, len);
+}
+int JSONWriter_Finish(jsonWriter_t *w) {
+	if (w->printer) {
+		JSONWriter_Flush(w);
+	}
+	if (w->bOverflow || w->depth != 0)
+		return -1;
+	return w->len;
+}
@@ -0,0 +1,51 @@
+#ifndef __JSON_WRITER_H__
+#define __JSON_WRITER_H__
+
+#include "../new_common.h"
+
+// Streaming JSON emitter. It doesn't build a tree and doesn't allocate;
+// output goes straight into caller buffer (for example MQTT publish item value)
+// or through jsonCb_t printer (HTTP reply, MQTT reply builder).
+// Commas are inserted automatically, strings are escaped.
+// Overflow is sticky: once buffer is full, everything else is dropped and Finish reports it.
+
+#define JSONWRITER_MAX_DEPTH		16
+#define JSONWRITER_STAGE_SIZE		64
+
+typedef struct jsonWriter_s {
+	// buffer mode
+	char *buffer;
+	int size;
+	// printer mode
+	void *userData;
+	jsonCb_t printer;
+	char stage[JSONWRITER_STAGE_SIZE];
+	int stageLen;
+
+	int len;
+	int depth;
+	// bit set for every open level that has no items yet
+	unsigned int firstItem;
+	bool bOverflow;
+} jsonWriter_t;
+
+void JSONWriter_InitBuffer(jsonWriter_t *w, char *buffer, int size);
+void JSONWriter_InitPrinter(jsonWriter_t *w, void *userData, jsonCb_t printer);
+// key can be NULL for array items and top level values
+void JSONWriter_BeginObject(jsonWriter_t *w, const char *key);
+void JSONWriter_EndObject(jsonWriter_t *w);
+void JSONWriter_BeginArray(jsonWriter_t *w, const char *key);
+void JSONWriter_EndArray(jsonWriter_t *w);
+void JSONWriter_AddString(jsonWriter_t *w, const char *key, const char *value);
+void JSONWriter_AddStringf(jsonWriter_t *w, const char *key, const char *fmt, ...);
+void JSONWriter_AddInt(jsonWriter_t *w, const char *key, int value);
+void JSONWriter_AddBool(jsonWriter_t *w, const char *key, bool value);
+// shortest form that reads back as the same double, like cJSON does
+void JSONWriter_AddNumber(jsonWriter_t *w, const char *key, double value);
+// fixed number of decimals, trailing zeros are stripped
+void JSONWriter_AddFloat(jsonWriter_t *w, const char *key, double value, int decimals);
+// Returns output length, or -1 if buffer overflowed or nesting is not closed.
+// In printer mode it also flushes staged output.
+int JSONWriter_Finish(jsonWriter_t *w);
+
+#endif
@@ -73,50 +73,225 @@ const char* methodNames[] = {
 void misc_formatUpTimeString(int totalSeconds, char* o);
 int Time_getUpTimeSeconds();
 
-typedef struct http_callback_tag {
-	char* url;
-	int method;
-	http_callback_fn callback;
-} http_callback_t;
+#if WINDOWS
+#include <timeapi.h>
+#define HTTP_GetTimeMS() timeGetTime()
+#else
+#define HTTP_GetTimeMS() (xTaskGetTickCount() * portTICK_RATE_MS)
+#endif
 
-#define MAX_HTTP_CALLBACKS 32
-static http_callback_t* callbacks[MAX_HTTP_CALLBACKS];
-static int numCallbacks = 0;
+#define HTTP_METHODS_COUNT 4
 
-int HTTP_RegisterCallback(const char* url, int method, http_callback_fn callback) {
+// Routes are kept in a trie keyed on path segments, built as routes are registered.
+// Callbacks from HTTP_RegisterCallback are prefix routes - they also match all deeper paths,
+// builtin pages are exact routes. The deepest matching route wins, on the same node
+// a registered callback wins over builtin page.
+typedef struct httpRoute_s {
+	char* url;
+	http_callback_fn callback;
+	// HTTP_ANY or method
+	int method;
+	bool bPrefix;
+	unsigned int hits;
+	unsigned int timeMS;
+} httpRoute_t;
+
+typedef struct httpRouteNode_s {
+	char* segment;
+	struct httpRouteNode_s* child;
+	struct httpRouteNode_s* next;
+	// route index + 1 for each method, 0 if none
+	byte exact[HTTP_METHODS_COUNT];
+	byte prefix[HTTP_METHODS_COUNT];
+} httpRouteNode_t;
+
+#define MAX_HTTP_ROUTES 96
+static httpRoute_t g_httpRoutes[MAX_HTTP_ROUTES];
+static int g_numHttpRoutes = 0;
+static httpRouteNode_t g_httpRouteRoot;
+static bool g_httpRoutesInitialized = false;
+
+static httpRouteNode_t* HTTP_GetRouteChild(httpRouteNode_t* node, const char* seg, int len, bool bCreate) {
+	httpRouteNode_t* n;
+
+	for (n = node->child; n; n = n->next) {
+		if (!strncmp(n->segment, seg, len) && n->segment[len] == 0) {
+			return n;
+		}
+	}
+	if (bCreate == false) {
+		return 0;
+	}
+	n = (httpRouteNode_t*)os_malloc(sizeof(httpRouteNode_t) + len + 1);
+	if (n == 0) {
+		return 0;
+	}
+	memset(n, 0, sizeof(httpRouteNode_t));
+	n->segment = (char*)(n + 1);
+	memcpy(n->segment, seg, len);
+	n->segment[len] = 0;
+	n->next = node->child;
+	node->child = n;
+	return n;
+}
+static int HTTP_AddRoute(const char* url, int method, http_callback_fn callback, bool bPrefix) {
+	httpRouteNode_t* node;
+	httpRoute_t* r;
+	const char* p, *e;
+	byte* slots;
 	int i;
 
-	if (!url || !callback) {
+	if (!url || !callback || url[0] != '/') {
 		return -1;
 	}
-	if (numCallbacks >= MAX_HTTP_CALLBACKS) {
+	for (i = 0; i < g_numHttpRoutes; i++) {
+		r = &g_httpRoutes[i];
+		if (r->callback == callback && r->method == method && r->bPrefix == bPrefix && !strcmp(r->url, url)) {
+			return i;
+		}
+	}
+	if (g_numHttpRoutes >= MAX_HTTP_ROUTES) {
 		return -4;
 	}
-	for (i = 0; i < MAX_HTTP_CALLBACKS; i++) {
-		if (callbacks[i]) {
-			if (callbacks[i]->callback == callback && !strcmp(callbacks[i]->url, url)
-				&& callbacks[i]->method == method) {
-				return i;
+	node = &g_httpRouteRoot;
+	p = url + 1;
+	while (*p) {
+		e = p;
+		while (*e && *e != '/') {
+			e++;
+		}
+		if (e != p) {
+			node = HTTP_GetRouteChild(node, p, e - p, true);
+			if (node == 0) {
+				return -2;
 			}
 		}
+		p = *e ? e + 1 : e;
 	}
-	callbacks[numCallbacks] = (http_callback_t*)os_malloc(sizeof(http_callback_t));
-	if (!callbacks[numCallbacks]) {
-		return -2;
-	}
-	callbacks[numCallbacks]->url = (char*)os_malloc(strlen(url) + 1);
-	if (!callbacks[numCallbacks]->url) {
-		os_free(callbacks[numCallbacks]);
+	r = &g_httpRoutes[g_numHttpRoutes];
+	r->url = (char*)os_malloc(strlen(url) + 1);
+	if (r->url == 0) {
 		return -3;
 	}
-	strcpy(callbacks[numCallbacks]->url, url);
-	callbacks[numCallbacks]->callback = callback;
-	callbacks[numCallbacks]->method = method;
+	strcpy(r->url, url);
+	r->callback = callback;
+	r->method = method;
+	r->bPrefix = bPrefix;
+	r->hits = 0;
+	r->timeMS = 0;
+	g_numHttpRoutes++;
+	slots = bPrefix ? node->prefix : node->exact;
+	for (i = 0; i < HTTP_METHODS_COUNT; i++) {
+		if (method == HTTP_ANY || method == i) {
+			slots[i] = g_numHttpRoutes;
+		}
+	}
+	return 0;
+}
+static int http_fn_style_css(http_request_t* request);
+static int http_fn_script_js(http_request_t* request);
 
-	numCallbacks++;
+typedef struct httpBuiltinPage_s {
+	const char* url;
+	http_callback_fn callback;
+} httpBuiltinPage_t;
+
+static const httpBuiltinPage_t g_httpBuiltinPages[] = {
+	{ "/", http_fn_empty_url },
+	{ "/testmsg", http_fn_testmsg },
+	{ "/index", http_fn_index },
+	{ "/about", http_fn_about },
+	{ "/cfg_mqtt", http_fn_cfg_mqtt },
+	{ "/cfg_ip", http_fn_cfg_ip },
+	{ "/cfg_mqtt_set", http_fn_cfg_mqtt_set },
+	{ "/cfg_webapp", http_fn_cfg_webapp },
+	{ "/cfg_webapp_set", http_fn_cfg_webapp_set },
+	{ "/cfg_wifi", http_fn_cfg_wifi },
+	{ "/cfg_name", http_fn_cfg_name },
+	{ "/cfg_wifi_set", http_fn_cfg_wifi_set },
+	{ "/cfg_loglevel_set", http_fn_cfg_loglevel_set },
+	{ "/cfg_mac", http_fn_cfg_mac },
+	{ "/flash_read_tool", http_fn_flash_read_tool },
+	{ "/uart_tool", http_fn_uart_tool },
+	{ "/cmd_tool", http_fn_cmd_tool },
+	{ "/startup_command", http_fn_startup_command },
+	{ "/cfg_generic", http_fn_cfg_generic },
+	{ "/cfg_startup", http_fn_cfg_startup },
+	{ "/cfg_dgr", http_fn_cfg_dgr },
+	{ "/ha_cfg", http_fn_ha_cfg },
+	{ "/ha_discovery", http_fn_ha_discovery },
+	{ "/cfg", http_fn_cfg },
+	{ "/cfg_pins", http_fn_cfg_pins },
+	{ "/cfg_ping", http_fn_cfg_ping },
+	{ "/ota", http_fn_ota },
+	{ "/ota_exec", http_fn_ota_exec },
+	{ "/cm", http_fn_cm },
+	{ "/style.css", http_fn_style_css },
+	{ "/script.js", http_fn_script_js },
+};
 
-	// success
-	return 0;
+static void HTTP_InitRoutes() {
+	int i;
+
+	if (g_httpRoutesInitialized) {
+		return;
+	}
+	g_httpRoutesInitialized = true;
+	for (i = 0; i < sizeof(g_httpBuiltinPages) / sizeof(g_httpBuiltinPages[0]); i++) {
+		HTTP_AddRoute(g_httpBuiltinPages[i].url, HTTP_ANY, g_httpBuiltinPages[i].callback, false);
+	}
+}
+// url is without leading slash, ends at '?', ' ' or 0
+static httpRoute_t* HTTP_FindRoute(const char* url, int method) {
+	httpRouteNode_t* node = &g_httpRouteRoot;
+	const char* p = url, *e;
+	int best;
+
+	if (method < 0 || method >= HTTP_METHODS_COUNT) {
+		return 0;
+	}
+	best = node->prefix[method];
+	while (*p && *p != '?' && *p != ' ') {
+		e = p;
+		while (*e && *e != '/' && *e != '?' && *e != ' ') {
+			e++;
+		}
+		node = HTTP_GetRouteChild(node, p, e - p, false);
+		if (node == 0) {
+			// no exact match possible, use the longest prefix found
+			return best ? &g_httpRoutes[best - 1] : 0;
+		}
+		if (node->prefix[method]) {
+			best = node->prefix[method];
+		}
+		p = (*e == '/') ? e + 1 : e;
+	}
+	if (node->prefix[method]) {
+		return &g_httpRoutes[node->prefix[method] - 1];
+	}
+	if (node->exact[method]) {
+		return &g_httpRoutes[node->exact[method] - 1];
+	}
+	return best ? &g_httpRoutes[best - 1] : 0;
+}
+// returns 0 when index is past the last route
+int HTTP_GetRouteStats(int index, const char** url, int* method, int* hits, int* timeMS) {
+	httpRoute_t* r;
+
+	if (index < 0 || index >= g_numHttpRoutes) {
+		return 0;
+	}
+	r = &g_httpRoutes[index];
+	*url = r->url;
+	*method = r->method;
+	*hits = r->hits;
+	*timeMS = r->timeMS;
+	return 1;
+}
+
+int HTTP_RegisterCallback(const char* url, int method, http_callback_fn callback) {
+	HTTP_InitRoutes();
+	return HTTP_AddRoute(url, method, callback, true);
 }
 
 int my_strnicmp(const char* a, const char* b, int len) {
@@ -249,7 +424,7 @@ void http_html_start(http_request_t* request, const char* pagename) {
 	poststr(request, "</title>");
 	poststr(request, htmlShortcutIcon);
 	poststr(request, htmlHeadMeta);
-	poststr(request, htmlHeadStyle);
+	poststr(request, "<link rel=\"stylesheet\" href=\"/style.css\">");
 	poststr(request, "</head>");
 	poststr(request, htmlBodyStart);
 	poststr(request, CFG_GetDeviceName());
@@ -275,7 +450,73 @@ void http_html_end(http_request_t* request) {
 	poststr(request, upTimeStr);
 
 	poststr(request, htmlBodyEnd);
-	poststr(request, pageScript);
+	poststr(request, "<script type='text/javascript' src='/script.js'></script>");
+}
+
+// Returns value of given request header (after "Name:" and spaces), or 0
+const char* http_getHeader(http_request_t* request, const char* name) {
+	int i;
+	int len = strlen(name);
+	const char* p;
+
+	for (i = 0; i < request->numheaders; i++) {
+		p = request->headers[i];
+		if (!my_strnicmp(p, name, len) && p[len] == ':') {
+			p += len + 1;
+			while (*p == ' ')
+				p++;
+			return p;
+		}
+	}
+	return 0;
+}
+
+// CSS and JS for pages are served as separate, cacheable files.
+// Content is taken from inside the htmlHeadStyle/pageScript tags, so there is only one copy in flash
+typedef struct httpStaticAsset_s {
+	const char* blob;
+	const char* type;
+	const char* data;
+	int len;
+	char etag[12];
+} httpStaticAsset_t;
+
+static httpStaticAsset_t g_httpStaticAssets[] = {
+	{ htmlHeadStyle, "text/css" },
+	{ pageScript, "application/javascript" },
+};
+
+static int http_sendStaticAsset(http_request_t* request, httpStaticAsset_t* a) {
+	const char* p;
+	const char* ifNoneMatch;
+	unsigned int hash;
+
+	if (a->data == 0) {
+		a->data = strchr(a->blob, '>') + 1;
+		a->len = strrchr(a->blob, '<') - a->data;
+		// FNV-1a
+		hash = 2166136261u;
+		for (p = a->data; p < a->data + a->len; p++) {
+			hash ^= (byte)*p;
+			hash *= 16777619u;
+		}
+		sprintf(a->etag, "\"%08x\"", hash);
+	}
+	ifNoneMatch = http_getHeader(request, "If-None-Match");
+	request->responseCode = (ifNoneMatch && strstr(ifNoneMatch, a->etag)) ? 304 : HTTP_RESPONSE_OK;
+	hprintf255(request, "HTTP/1.1 %i %s\r\nContent-type: %s\r\nETag: %s\r\nCache-Control: no-cache\r\nConnection: close\r\n\r\n",
+		request->responseCode, request->responseCode == 304 ? "Not Modified" : "OK", a->type, a->etag);
+	if (request->responseCode != 304) {
+		postany(request, a->data, a->len);
+	}
+	poststr(request, NULL);
+	return 0;
+}
+static int http_fn_style_css(http_request_t* request) {
+	return http_sendStaticAsset(request, &g_httpStaticAssets[0]);
+}
+static int http_fn_script_js(http_request_t* request) {
+	return http_sendStaticAsset(request, &g_httpStaticAssets[1]);
 }
 
 const char* http_checkArg(const char* p, const char* n) {
@@ -496,6 +737,120 @@ void setupAllWB2SPinsAsButtons() {
 	PIN_SetPinChannelForPinIndex(27, 1);
 }
 
+static void http_sendReply(http_request_t* request, const char* data, int len) {
+	send(request->fd, data, len, 0);
+	request->replySent += len;
+}
+static const char httpConnectionClose[] = "Connection: close\r\n";
+
+// Returns offset of body in reply buffer, or -1 if headers have no "Connection: close" (custom headers)
+static int http_findBodyOffset(http_request_t* request) {
+	char* conn;
+	char* hdrEnd;
+
+	request->reply[request->replylen] = 0;
+	hdrEnd = strstr(request->reply, "\r\n\r\n");
+	conn = strstr(request->reply, httpConnectionClose);
+	if (hdrEnd == 0 || conn == 0 || conn > hdrEnd) {
+		return -1;
+	}
+	return hdrEnd + 4 - request->reply;
+}
+// Replaces "Connection: close" header in reply buffer with given text.
+// Returns new offset of body in buffer, or -1 if there is no such header.
+// Reply buffer must have HTTP_KEEPALIVE_HEADER_EXTRA spare bytes.
+static int http_replaceConnectionHeader(http_request_t* request, const char* with) {
+	char* conn;
+	int bodyOfs, withLen, connLen, tailLen;
+
+	bodyOfs = http_findBodyOffset(request);
+	if (bodyOfs < 0) {
+		return -1;
+	}
+	conn = strstr(request->reply, httpConnectionClose);
+	withLen = strlen(with);
+	connLen = sizeof(httpConnectionClose) - 1;
+	tailLen = request->replylen - (conn + connLen - request->reply);
+	memmove(conn + withLen, conn + connLen, tailLen);
+	memcpy(conn, with, withLen);
+	request->replylen += withLen - connLen;
+	return bodyOfs + withLen - connLen;
+}
+// Sends what is in reply buffer. While headers are still in the buffer, picks the framing:
+// Content-Length if this is the whole reply, chunked if more follows, and for servers
+// that don't keep connection alive, the reply just ends with close.
+// nextChunkLen > 0 means that many bytes will be sent directly right after.
+static void http_flushReply(http_request_t* request, bool bFinal, int nextChunkLen) {
+	char tmp[64];
+	int bodyOfs = 0;
+	int dataLen, tmpLen;
+
+	if (request->chunked == HTTP_CHUNKED_DONE) {
+		// something posted after end of reply, only close can end it now
+		request->keepAlive = 0;
+	}
+	else if (request->replySent == 0 && request->keepAlive) {
+		bodyOfs = http_findBodyOffset(request);
+		if (bodyOfs < 0) {
+			// custom headers, only close can end the reply
+			request->keepAlive = 0;
+			bodyOfs = 0;
+		}
+		else if (bFinal && nextChunkLen == 0) {
+			// whole reply is in buffer
+			sprintf(tmp, "Connection: keep-alive\r\nContent-Length: %i\r\n", request->replylen - bodyOfs);
+			http_replaceConnectionHeader(request, tmp);
+			bodyOfs = 0;
+		}
+		else {
+			bodyOfs = http_replaceConnectionHeader(request, "Connection: keep-alive\r\nTransfer-Encoding: chunked\r\n");
+			request->chunked = HTTP_CHUNKED_ACTIVE;
+		}
+	}
+	else if (request->chunked == HTTP_CHUNKED_NONE) {
+		// reply is already partially sent without framing
+		request->keepAlive = 0;
+	}
+
+	if (request->chunked == HTTP_CHUNKED_ACTIVE) {
+		// chunk size line before data, and CRLF closing previous chunk
+		dataLen = request->replylen - bodyOfs;
+		tmpLen = 0;
+		if (request->chunkOpen) {
+			tmpLen += sprintf(tmp + tmpLen, "\r\n");
+			request->chunkOpen = 0;
+		}
+		if (dataLen > 0) {
+			tmpLen += sprintf(tmp + tmpLen, "%x\r\n", dataLen);
+			request->chunkOpen = 1;
+		}
+		memmove(request->reply + bodyOfs + tmpLen, request->reply + bodyOfs, dataLen);
+		memcpy(request->reply + bodyOfs, tmp, tmpLen);
+		request->replylen += tmpLen;
+		tmpLen = 0;
+		if (request->chunkOpen && (nextChunkLen > 0 || bFinal)) {
+			tmpLen += sprintf(tmp + tmpLen, "\r\n");
+			request->chunkOpen = 0;
+		}
+		if (nextChunkLen > 0) {
+			tmpLen += sprintf(tmp + tmpLen, "%x\r\n", nextChunkLen);
+			// closed by next flush
+			request->chunkOpen = 1;
+		}
+		else if (bFinal) {
+			tmpLen += sprintf(tmp + tmpLen, "0\r\n\r\n");
+			request->chunked = HTTP_CHUNKED_DONE;
+		}
+		memcpy(request->reply + request->replylen, tmp, tmpLen);
+		request->replylen += tmpLen;
+	}
+	if (request->replylen > 0) {
+		http_sendReply(request, request->reply, request->replylen);
+	}
+	request->reply[0] = 0;
+	request->replylen = 0;
+}
+
 // add some more output safely, sending if necessary.
 // call with str == NULL to force send. - can be binary.
 // supply length
@@ -512,32 +867,25 @@ int postany(http_request_t* request, const char* str, int len) {
 		if (request->fd == 0) {
 			return request->replylen;
 		}
-		if (request->replylen > 0) {
-			send(request->fd, request->reply, request->replylen, 0);
+		if (request->replylen > 0 || request->chunked == HTTP_CHUNKED_ACTIVE) {
+			http_flushReply(request, true, 0);
 		}
-		request->reply[0] = 0;
-		request->replylen = 0;
+		return 0;
+	}
+
+	// large strings (mostly constants in flash) are sent directly from where they are,
+	// without copying them through reply buffer
+	if (addlen >= request->replymaxlen || (request->fd && addlen >= HTTP_DIRECT_SEND_MIN)) {
+		http_flushReply(request, false, addlen);
+		http_sendReply(request, str, addlen);
 		return 0;
 	}
 
 	currentlen = request->replylen;
 	if (currentlen + addlen >= request->replymaxlen) {
-		send(request->fd, request->reply, request->replylen, 0);
-		request->reply[0] = 0;
-		request->replylen = 0;
+		http_flushReply(request, false, 0);
 		currentlen = 0;
 	}
-	while (addlen >= request->replymaxlen) {
-		if (request->replylen > 0) {
-			send(request->fd, request->reply, request->replylen, 0);
-			request->replylen = 0;
-		}
-		send(request->fd, str, (request->replymaxlen - 1), 0);
-		addlen -= (request->replymaxlen - 1);
-		str += (request->replymaxlen - 1);
-
-		rtos_delay_milliseconds(1);
-	}
 
 	memcpy(request->reply + request->replylen, str, addlen);
 	request->replylen += addlen;
@@ -569,6 +917,8 @@ int hprintf255(http_request_t* request, const char* fmt, ...) {
 
 int HTTP_ProcessPacket(http_request_t* request) {
 	int i;
+	unsigned int startTime;
+	httpRoute_t* route;
 	char* p;
 	char* headers;
 	char* protocol;
@@ -580,6 +930,7 @@ int HTTP_ProcessPacket(http_request_t* request) {
 		ADDLOGF_ERROR("You gave request with NULL input");
 		return 0;
 	}
+	HTTP_InitRoutes();
 	recvbuf = request->received;
 	for (i = 0; i < sizeof(methodNames) / sizeof(*methodNames); i++) {
 		if (http_startsWith(recvbuf, methodNames[i])) {
@@ -691,55 +1042,14 @@ int HTTP_ProcessPacket(http_request_t* request) {
 	return http_fn_empty_url(request);
 #endif
 
-	// look for a callback with this URL and method, or HTTP_ANY
-	for (i = 0; i < numCallbacks; i++) {
-		char* url = callbacks[i]->url;
-		if (http_startsWith(urlStr, &url[1])) {
-			int method = callbacks[i]->method;
-			if (method == HTTP_ANY || method == request->method) {
-				return callbacks[i]->callback(request);
-			}
-		}
+	route = HTTP_FindRoute(urlStr, request->method);
+	if (route) {
+		startTime = HTTP_GetTimeMS();
+		i = route->callback(request);
+		route->hits++;
+		route->timeMS += HTTP_GetTimeMS() - startTime;
+		return i;
 	}
-	if (http_checkUrlBase(urlStr, "")) return http_fn_empty_url(request);
-
-	if (http_checkUrlBase(urlStr, "testmsg")) return http_fn_testmsg(request);
-	if (http_checkUrlBase(urlStr, "index")) return http_fn_index(request);
-
-	if (http_checkUrlBase(urlStr, "about")) return http_fn_about(request);
-
-	if (http_checkUrlBase(urlStr, "cfg_mqtt")) return http_fn_cfg_mqtt(request);
-	if (http_checkUrlBase(urlStr, "cfg_ip")) return http_fn_cfg_ip(request);
-	if (http_checkUrlBase(urlStr, "cfg_mqtt_set")) return http_fn_cfg_mqtt_set(request);
-
-	if (http_checkUrlBase(urlStr, "cfg_webapp")) return http_fn_cfg_webapp(request);
-	if (http_checkUrlBase(urlStr, "cfg_webapp_set")) return http_fn_cfg_webapp_set(request);
-
-	if (http_checkUrlBase(urlStr, "cfg_wifi")) return http_fn_cfg_wifi(request);
-	if (http_checkUrlBase(urlStr, "cfg_name")) return http_fn_cfg_name(request);
-	if (http_checkUrlBase(urlStr, "cfg_wifi_set")) return http_fn_cfg_wifi_set(request);
-
-	if (http_checkUrlBase(urlStr, "cfg_loglevel_set")) return http_fn_cfg_loglevel_set(request);
-	if (http_checkUrlBase(urlStr, "cfg_mac")) return http_fn_cfg_mac(request);
-
-	if (http_checkUrlBase(urlStr, "flash_read_tool")) return http_fn_flash_read_tool(request);
-	if (http_checkUrlBase(urlStr, "uart_tool")) return http_fn_uart_tool(request);
-	if (http_checkUrlBase(urlStr, "cmd_tool")) return http_fn_cmd_tool(request);
-	if (http_checkUrlBase(urlStr, "startup_command")) return http_fn_startup_command(request);
-	if (http_checkUrlBase(urlStr, "cfg_generic")) return http_fn_cfg_generic(request);
-	if (http_checkUrlBase(urlStr, "cfg_startup")) return http_fn_cfg_startup(request);
-	if (http_checkUrlBase(urlStr, "cfg_dgr")) return http_fn_cfg_dgr(request);
-
-	if (http_checkUrlBase(urlStr, "ha_cfg")) return http_fn_ha_cfg(request);
-	if (http_checkUrlBase(urlStr, "ha_discovery")) return http_fn_ha_discovery(request);
-	if (http_checkUrlBase(urlStr, "cfg")) return http_fn_cfg(request);
-
-	if (http_checkUrlBase(urlStr, "cfg_pins")) return http_fn_cfg_pins(request);
-	if (http_checkUrlBase(urlStr, "cfg_ping")) return http_fn_cfg_ping(request);
-
-	if (http_checkUrlBase(urlStr, "ota")) return http_fn_ota(request);
-	if (http_checkUrlBase(urlStr, "ota_exec")) return http_fn_ota_exec(request);
-	if (http_checkUrlBase(urlStr, "cm")) return http_fn_cm(request);
 
 	return http_fn_other(request);
 }
@@ -18,6 +18,7 @@ extern const char htmlFooterRefreshLink[];
 extern const char htmlFooterReturnToCfgLink[];
 
 extern const char* htmlPinRoleNames[];
+extern const char* methodNames[];
 
 extern const char* g_build_str;
 
@@ -30,7 +31,7 @@ extern const char ha_discovery_script[];
 #define HTTP_RESPONSE_SERVER_ERROR 500
 
 #define MAX_QUERY 16
-#define MAX_HEADERS 16
+#define MAX_HEADERS 24
 typedef struct http_request_tag {
 	char* received; // partial or whole received data, up to 1024
 	int receivedLen;
@@ -54,11 +55,29 @@ typedef struct http_request_tag {
 	int replylen;
 	int replymaxlen;
 	int fd;
+
+	// set by server when connection may be reused after this reply (HTTP/1.1),
+	// reply is then sent with Content-Length or chunked
+	int keepAlive;
+	int replySent; // bytes of reply already sent to fd
+	int chunked; // HTTP_CHUNKED_*
+	int chunkOpen; // last chunk still needs CRLF
 } http_request_t;
 
+#define HTTP_CHUNKED_NONE 0
+#define HTTP_CHUNKED_ACTIVE 1
+#define HTTP_CHUNKED_DONE 2
+
+// server must allocate reply buffer with this many extra bytes past replymaxlen
+// if it sets keepAlive, room for keep-alive headers and chunk framing
+#define HTTP_KEEPALIVE_HEADER_EXTRA 64
+// strings at least that long are sent directly, not copied into reply buffer
+#define HTTP_DIRECT_SEND_MIN 512
+
 
 int HTTP_ProcessPacket(http_request_t* request);
 void http_setup(http_request_t* request, const char* type);
+const char* http_getHeader(http_request_t* request, const char* name);
 void http_html_start(http_request_t* request, const char* pagename);
 void http_html_end(http_request_t* request);
 int poststr(http_request_t* request, const char* str);
@@ -84,8 +103,11 @@ typedef enum {
 // callback function for http
 typedef int (*http_callback_fn)(http_request_t* request);
 // url MUST start with '/'
-// urls must be unique (i.e. you can't have /about and /aboutme or /about/me)
+// url is a prefix matched on path segments, so /about also gets /about/me,
+// unless /about/me is registered too - the longest match wins
 int HTTP_RegisterCallback(const char* url, int method, http_callback_fn callback);
+// route hit counter and total handler time, returns 0 when index is past the last route
+int HTTP_GetRouteStats(int index, const char** url, int* method, int* hits, int* timeMS);
 
 #endif
 
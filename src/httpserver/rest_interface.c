@@ -59,6 +59,8 @@ extern UINT32 flash_read(char* user_buf, UINT32 count, UINT32 address);
 
 #ifndef OBK_DISABLE_ALL_DRIVERS
 #include "../driver/drv_local.h"
+#include "../driver/drv_public.h"
+#include "../driver/drv_bl_shared.h"
 #endif
 
 #define MAX_JSON_VALUE_LENGTH   128
@@ -100,6 +102,7 @@ static int http_rest_get_testconfig(http_request_t* request);
 
 static int http_rest_post_channels(http_request_t* request);
 static int http_rest_get_channels(http_request_t* request);
+static int http_rest_get_energy(http_request_t* request);
 
 static int http_rest_get_flash_vars_test(http_request_t* request);
 
@@ -186,6 +189,10 @@ static int http_rest_get(http_request_t* request) {
 		return http_rest_get_info(request);
 	}
 
+	if (!strcmp(request->url, "api/energy")) {
+		return http_rest_get_energy(request);
+	}
+
 	if (!strncmp(request->url, "api/flash/", 10)) {
 		return http_rest_get_flash_advanced(request);
 	}
@@ -736,6 +743,14 @@ static int http_rest_get_logconfig(http_request_t* request) {
 			hprintf255(request, "\"%s\"", logfeaturenames[i]);
 		}
 	}
+	poststr(request, "],\"emitted\":[");
+	for (i = 0; i < LOG_FEATURE_MAX; i++) {
+		hprintf255(request, i ? ",%u" : "%u", g_logEmitted[i]);
+	}
+	poststr(request, "],\"suppressed\":[");
+	for (i = 0; i < LOG_FEATURE_MAX; i++) {
+		hprintf255(request, i ? ",%u" : "%u", g_logSuppressed[i]);
+	}
 	poststr(request, "]}");
 	poststr(request, NULL);
 	return 0;
@@ -818,6 +833,9 @@ static int http_rest_post_logconfig(http_request_t* request) {
 
 static int http_rest_get_info(http_request_t* request) {
 	char macstr[3 * 6 + 1];
+	const char* url;
+	int i, method, hits, timeMS;
+
 	http_setup(request, httpMimeTypeJson);
 	hprintf255(request, "{\"uptime_s\":%d,", Time_getUpTimeSeconds());
 	hprintf255(request, "\"build\":\"%s\",", g_build_str);
@@ -836,7 +854,15 @@ static int http_rest_get_info(http_request_t* request) {
 	hprintf255(request, "\"supportsSSDP\":0,");
 #endif
 
-	hprintf255(request, "\"supportsClientDeviceDB\":true}");
+	hprintf255(request, "\"supportsClientDeviceDB\":true,");
+
+	// per-route hit counters and total handler time
+	poststr(request, "\"routes\":[");
+	for (i = 0; HTTP_GetRouteStats(i, &url, &method, &hits, &timeMS); i++) {
+		hprintf255(request, "%s{\"url\":\"%s\",\"method\":\"%s\",\"hits\":%i,\"time_ms\":%i}",
+			i ? "," : "", url, method == HTTP_ANY ? "ANY" : methodNames[method], hits, timeMS);
+	}
+	poststr(request, "]}");
 
 	poststr(request, NULL);
 	return 0;
@@ -1596,6 +1622,18 @@ static int http_rest_get_flash_vars_test(http_request_t* request) {
 }
 
 
+static int http_rest_get_energy(http_request_t* request) {
+#ifndef OBK_DISABLE_ALL_DRIVERS
+	if (DRV_IsMeasuringPower()) {
+		http_setup(request, httpMimeTypeJson);
+		BL09XX_AppendEnergyJSON(request);
+		poststr(request, NULL);
+		return 0;
+	}
+#endif
+	return http_rest_error(request, 404, "no energy meter running");
+}
+
 static int http_rest_get_channels(http_request_t* request) {
 	int i;
 	int addcomma = 0;
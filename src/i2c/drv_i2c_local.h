@@ -21,6 +21,9 @@ typedef struct i2cDevice_s {
 	int busType;
 	int addr;
 	int type;
+	// registers changed in shadow, but not written yet; bits are device specific,
+	// changed only under DRV_I2C_Mutex_Take
+	byte dirty;
 	struct i2cDevice_s *next;
 } i2cDevice_t;
 
@@ -53,6 +56,10 @@ typedef struct i2cDevice_MCP23017_s {
 	byte pinMapping[16];
 	// is pin an output or input?
 	//int pinDirections;
+	// Shadow of OLATA/OLATB, so bits are changed without reading them back
+	byte olat[2];
+	// IODIR was written already
+	bool bDirectionSent;
 } i2cDevice_MCP23017_t;
 
 typedef struct i2cDevice_PCF8574_s {
@@ -76,6 +83,14 @@ void DRV_I2C_Read(byte addr, byte *data);
 int DRV_I2C_Begin(int dev_adr, int busID);
 void DRV_I2C_Close();
 
+// Devices keep shadow copies of their registers. Callers (like channel change) only change
+// the shadow and mark registers dirty, under the lock, so they don't wait for the bus.
+// Quick tick writes dirty registers of each device from the shadow in bursts.
+// Nothing is queued, so nothing can be dropped; many changes in one tick become one write.
+bool DRV_I2C_Mutex_Take(int del);
+void DRV_I2C_Mutex_Free();
+void DRV_I2C_FlushDevices(int busType);
+
 i2cBusType_t DRV_I2C_ParseBusType(const char *s);
 i2cDevice_t *DRV_I2C_FindDevice(int busType,int address);
 i2cDevice_t *DRV_I2C_FindDeviceExt(int busType,int address, int devType);
@@ -85,6 +100,7 @@ i2cDevice_t *DRV_I2C_FindDeviceExt(int busType,int address, int devType);
 void DRV_I2C_MCP23017_RunDevice(i2cDevice_t *dev);
 commandResult_t DRV_I2C_MCP23017_MapPinToChannel(const void *context, const char *cmd, const char *args, int cmdFlags);
 void DRV_I2C_MCP23017_OnChannelChanged(i2cDevice_t *dev, int channel, int iVal);
+void DRV_I2C_MCP23017_Flush(i2cDevice_t *dev);
 
 // drv_i2c_tc74.c
 void DRV_I2C_TC74_RunDevice(i2cDevice_t *dev);
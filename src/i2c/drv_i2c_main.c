@@ -24,28 +24,66 @@ static int current_bus;
 static int tg_addr;
 static softI2C_t g_softI2C;
 
+#if WINDOWS
+// Fake hardware bus for selftests, remembers written registers and counts traffic.
+// Both hardware buses share it.
+#define I2C_MOCK_REGS	32
+static byte g_mockRegs[128][I2C_MOCK_REGS];
+static int g_mockTransactions;
+static int g_mockBytes;
+
+static void I2C_Mock_Write(byte reg, const byte *data, int len) {
+	int i;
+
+	g_mockTransactions++;
+	g_mockBytes += 1 + len;
+	for (i = 0; i < len; i++) {
+		if (reg + i < I2C_MOCK_REGS) {
+			g_mockRegs[tg_addr & 0x7F][reg + i] = data[i];
+		}
+	}
+}
+static void I2C_Mock_Read(byte reg, byte *data) {
+	g_mockTransactions++;
+	g_mockBytes += 2;
+	*data = reg < I2C_MOCK_REGS ? g_mockRegs[tg_addr & 0x7F][reg] : 0;
+}
+void SIM_I2C_GetStats(int *transactions, int *bytes) {
+	*transactions = g_mockTransactions;
+	*bytes = g_mockBytes;
+}
+int SIM_I2C_GetRegister(int addr, int reg) {
+	return g_mockRegs[addr & 0x7F][reg % I2C_MOCK_REGS];
+}
+void SIM_I2C_Reset() {
+	memset(g_mockRegs, 0, sizeof(g_mockRegs));
+	g_mockTransactions = 0;
+	g_mockBytes = 0;
+}
+#endif
+
 void DRV_I2C_Write(byte addr, byte data)
 {
 	if (current_bus == I2C_BUS_SOFT) {
-		Soft_I2C_Start(&g_softI2C, (tg_addr << 1) + 0);
-		Soft_I2C_WriteByte(&g_softI2C, addr);
-		Soft_I2C_Stop(&g_softI2C);
-		Soft_I2C_Start(&g_softI2C, (tg_addr << 1) + 0);
-		Soft_I2C_WriteByte(&g_softI2C, data);
-		Soft_I2C_Stop(&g_softI2C);
+		byte buf[2];
+
+		buf[0] = addr;
+		buf[1] = data;
+		// register and value in one transaction, same as hardware bus does
+		Soft_I2C_Transfer(&g_softI2C, tg_addr << 1, buf, 2, 0, 0);
 		return;
 	}
 #if PLATFORM_BK7231T
     i2c_operater.op_addr = addr;
     ddev_write(i2c_hdl, (char*)&data, 1, (UINT32)&i2c_operater);
+#elif WINDOWS
+	I2C_Mock_Write(addr, &data, 1);
 #endif
 }
 void DRV_I2C_WriteBytes(byte addr, byte *data, int len) {
 	if (current_bus == I2C_BUS_SOFT) {
-		Soft_I2C_Start(&g_softI2C, (tg_addr << 1) +0);
-		Soft_I2C_WriteByte(&g_softI2C, addr);
-		Soft_I2C_Stop(&g_softI2C);
 		Soft_I2C_Start(&g_softI2C, (tg_addr << 1) + 0);
+		Soft_I2C_WriteByte(&g_softI2C, addr);
 		for (int i = 0; i < len; i++) {
 			Soft_I2C_WriteByte(&g_softI2C, data[i]);
 		}
@@ -55,22 +93,21 @@ void DRV_I2C_WriteBytes(byte addr, byte *data, int len) {
 #if PLATFORM_BK7231T
     i2c_operater.op_addr = addr;
     ddev_write(i2c_hdl, (char*)data, len, (UINT32)&i2c_operater);
+#elif WINDOWS
+	I2C_Mock_Write(addr, data, len);
 #endif
 }
 void DRV_I2C_Read(byte addr, byte *data)
 {
 	if (current_bus == I2C_BUS_SOFT) {
-		Soft_I2C_Start(&g_softI2C, (tg_addr << 1) + 0);
-		Soft_I2C_WriteByte(&g_softI2C, addr);
-		Soft_I2C_Stop(&g_softI2C);
-		Soft_I2C_Start(&g_softI2C, (tg_addr << 1) + 1);
-		*data = Soft_I2C_ReadByte(&g_softI2C, false);
-		Soft_I2C_Stop(&g_softI2C);
+		Soft_I2C_Transfer(&g_softI2C, tg_addr << 1, &addr, 1, data, 1);
 		return;
 	}
 #if PLATFORM_BK7231T
     i2c_operater.op_addr = addr;
     ddev_read(i2c_hdl, (char*)data, 1, (UINT32)&i2c_operater);
+#elif WINDOWS
+	I2C_Mock_Read(addr, data);
 #endif
 }
 int DRV_I2C_Begin(int dev_adr, int busID) {
@@ -109,6 +146,11 @@ int DRV_I2C_Begin(int dev_adr, int busID) {
     i2c_operater.salve_id = dev_adr;
 
 	return 0;
+#elif WINDOWS
+	if (busID == I2C_BUS_I2C1 || busID == I2C_BUS_I2C2) {
+		return 0;
+	}
+	return 1;
 #else
 	return 1;
 #endif
@@ -125,6 +167,48 @@ void DRV_I2C_Close() {
 
 i2cDevice_t *g_i2c_devices = 0;
 
+// shadow registers and dirty bits are changed from any thread (channel change),
+// while quick tick writes them to the bus
+static SemaphoreHandle_t g_i2c_mutex = 0;
+
+bool DRV_I2C_Mutex_Take(int del) {
+	int taken;
+
+	if (g_i2c_mutex == 0)
+	{
+		g_i2c_mutex = xSemaphoreCreateMutex();
+	}
+	taken = xSemaphoreTake(g_i2c_mutex, del);
+	if (taken == pdTRUE) {
+		return true;
+	}
+	return false;
+}
+void DRV_I2C_Mutex_Free() {
+	xSemaphoreGive(g_i2c_mutex);
+}
+void DRV_I2C_FlushDevices(int busType) {
+	i2cDevice_t *dev;
+
+	for (dev = g_i2c_devices; dev; dev = dev->next) {
+		// only a hint, device takes dirty bits under lock
+		if (dev->busType != busType || dev->dirty == 0)
+			continue;
+		switch (dev->type) {
+		case I2CDEV_MCP23017:
+			DRV_I2C_MCP23017_Flush(dev);
+			break;
+		}
+	}
+}
+void DRV_I2C_RunQuickTick() {
+	int i;
+
+	for (i = I2C_BUS_I2C1; i <= I2C_BUS_SOFT; i++) {
+		DRV_I2C_FlushDevices(i);
+	}
+}
+
 i2cBusType_t DRV_I2C_ParseBusType(const char *s) {
 	if(!stricmp(s,"I2C1"))
 		return I2C_BUS_I2C1;
@@ -146,6 +230,7 @@ void DRV_I2C_AddDevice_PCF8574_Internal(int busType,int address, byte lcd_cols,
 	dev->base.addr = address;
 	dev->base.busType = busType;
 	dev->base.type = I2CDEV_LCD_PCF8574;
+	dev->base.dirty = 0;
 	dev->base.next = 0;
 	dev->lcd_cols = lcd_cols;
 	dev->lcd_rows = lcd_rows;
@@ -158,6 +243,7 @@ void DRV_I2C_AddDevice_MCP23017_Internal(int busType,int address) {
 	i2cDevice_MCP23017_t *dev;
 
 	dev = malloc(sizeof(i2cDevice_MCP23017_t));
+	memset(dev, 0, sizeof(i2cDevice_MCP23017_t));
 
 	dev->base.addr = address;
 	dev->base.busType = busType;
@@ -197,6 +283,7 @@ void DRV_I2C_AddDevice_TC74_Internal(int busType,int address, int targetChannel)
 	dev->base.addr = address;
 	dev->base.busType = busType;
 	dev->base.type = I2CDEV_TC74;
+	dev->base.dirty = 0;
 	dev->base.next = 0;
 	dev->targetChannel = targetChannel;
 
@@ -360,6 +447,20 @@ void DRV_I2C_Init()
 	//cmddetail:"examples":""}
 	CMD_RegisterCommand("scanI2C", DRV_I2C_Scan, NULL);
 }
+void DRV_I2C_Shutdown()
+{
+	i2cDevice_t *cur, *next;
+
+	// don't drop what was already requested
+	DRV_I2C_RunQuickTick();
+	cur = g_i2c_devices;
+	while (cur) {
+		next = cur->next;
+		free(cur);
+		cur = next;
+	}
+	g_i2c_devices = 0;
+}
 void DRC_I2C_RunDevice(i2cDevice_t *dev)
 {
 	switch(dev->type)
@@ -24,26 +24,6 @@ static void MCP23017_writeByte( i2cDevice_MCP23017_t *mcp, byte tgRegAddr, byte
     DRV_I2C_Write( tgRegAddr, toWrite );
 	DRV_I2C_Close();
 }
-static void MCP23017_setBits( i2cDevice_MCP23017_t *mcp, byte tgRegAddr, byte bitMask )
-{
-    byte temp;
-
-    temp = MCP23017_readByte( mcp, tgRegAddr );
-
-    temp |= bitMask;
-
-    MCP23017_writeByte( mcp, tgRegAddr, temp );
-}
-static void MCP23017_clearBits( i2cDevice_MCP23017_t *mcp, byte tgRegAddr, byte bitMask )
-{
-    byte temp;
-
-    temp = MCP23017_readByte( mcp, tgRegAddr );
-
-    temp &= ~bitMask;
-
-    MCP23017_writeByte( mcp, tgRegAddr, temp );
-}
 static void MCP23017_toggleBits( i2cDevice_MCP23017_t *mcp, byte tgRegAddr, byte bitMask )
 {
     byte temp;
@@ -73,44 +53,85 @@ static void MCP23017_toggleBitPortA(  i2cDevice_MCP23017_t *mcp, byte bitMask )
 }
 
 
+// Outputs are kept in shadow registers and only marked dirty here, so there are
+// no reads and all changes done before next quick tick go in one burst
+#define MCP23017_DIRTY_OLATA	1
+#define MCP23017_DIRTY_OLATB	2
+#define MCP23017_DIRTY_IODIR	4
+
+void DRV_I2C_MCP23017_Flush(i2cDevice_t *dev)
+{
+	i2cDevice_MCP23017_t *mcp;
+	byte dirty;
+	byte olat[2];
+	byte dirs[2];
+
+	mcp = (i2cDevice_MCP23017_t*)dev;
+
+	// take changes out under lock, so new ones can be done while these are sent
+	if (DRV_I2C_Mutex_Take(10) == false)
+		return;
+	dirty = mcp->base.dirty;
+	olat[0] = mcp->olat[0];
+	olat[1] = mcp->olat[1];
+	mcp->base.dirty = 0;
+	DRV_I2C_Mutex_Free();
+	if (dirty == 0)
+		return;
+
+	DRV_I2C_Begin(mcp->base.addr, mcp->base.busType);
+	// latches go first so outputs don't glitch when they are enabled
+	if ((dirty & MCP23017_DIRTY_OLATA) && (dirty & MCP23017_DIRTY_OLATB)) {
+		DRV_I2C_WriteBytes(_MCP23017_OLATA_BANK0, olat, 2);
+	}
+	else if (dirty & MCP23017_DIRTY_OLATA) {
+		DRV_I2C_WriteBytes(_MCP23017_OLATA_BANK0, &olat[0], 1);
+	}
+	else if (dirty & MCP23017_DIRTY_OLATB) {
+		DRV_I2C_WriteBytes(_MCP23017_OLATB_BANK0, &olat[1], 1);
+	}
+	if (dirty & MCP23017_DIRTY_IODIR) {
+		dirs[0] = _MCP23017_PORT_DIRECTION_OUTPUT;
+		dirs[1] = _MCP23017_PORT_DIRECTION_OUTPUT;
+		DRV_I2C_WriteBytes(_MCP23017_IODIRA_BANK0, dirs, 2);
+		mcp->bDirectionSent = true;
+	}
+	DRV_I2C_Close();
+}
+
 void DRV_I2C_MCP23017_OnChannelChanged(i2cDevice_t *dev, int channel, int iVal)
 {
 	i2cDevice_MCP23017_t *mcp;
 	int i;
-	int bank;
+	int port;
 	int localBitIndex;
-	int mask;
+	byte prev;
 
 	mcp = (i2cDevice_MCP23017_t*)dev;
 
-	MCP23017_setDirectionPortA(mcp, _MCP23017_PORT_DIRECTION_OUTPUT);
-	MCP23017_setDirectionPortB(mcp, _MCP23017_PORT_DIRECTION_OUTPUT);
-
-	// test only
-	//MCP23017_toggleBitPortA(mcp, 0xFF);
-
+	// lock is held by flush only while it copies shadow, so this is never given up in practice
+	if (DRV_I2C_Mutex_Take(100) == false) {
+		addLogAdv(LOG_ERROR, LOG_FEATURE_I2C, "DRV_I2C_MCP23017_OnChannelChanged: bus lock busy, ch %i not applied\n", channel);
+		return;
+	}
 	for(i = 0; i < 16; i++) {
 		if(mcp->pinMapping[i] == channel) {
-			addLogAdv(LOG_INFO, LOG_FEATURE_I2C,"DRV_I2C_MCP23017_OnChannelChanged: will set pin %i to %i for ch %i\n", i, iVal, channel);
-
 			// split 0-16 indices into two 8 bit ports - port A and port B
-			if(i>=8) {
-				localBitIndex = i - 8;
-				bank = _MCP23017_OLATB_BANK0;
-			} else {
-				localBitIndex = i;
-				bank = _MCP23017_OLATA_BANK0;
-			}
-			mask = 1 << localBitIndex;
+			port = i >> 3;
+			localBitIndex = i & 7;
+			prev = mcp->olat[port];
 			if(iVal) {
-				//addLogAdv(LOG_INFO, LOG_FEATURE_I2C,"DRV_I2C_MCP23017_OnChannelChanged: calling MCP23017_setBits mask %i\n", mask);
-				MCP23017_setBits(mcp, bank, mask);
+				mcp->olat[port] |= 1 << localBitIndex;
 			} else {
-				//addLogAdv(LOG_INFO, LOG_FEATURE_I2C,"DRV_I2C_MCP23017_OnChannelChanged: calling MCP23017_clearBits mask %i\n", mask);
-				MCP23017_clearBits(mcp, bank, mask);
+				mcp->olat[port] &= ~(1 << localBitIndex);
+			}
+			if(mcp->olat[port] != prev) {
+				addLogAdv(LOG_INFO, LOG_FEATURE_I2C,"DRV_I2C_MCP23017_OnChannelChanged: will set pin %i to %i for ch %i\n", i, iVal, channel);
+				mcp->base.dirty |= port ? MCP23017_DIRTY_OLATB : MCP23017_DIRTY_OLATA;
 			}
 		}
 	}
+	DRV_I2C_Mutex_Free();
 }
 commandResult_t DRV_I2C_MCP23017_MapPinToChannel(const void *context, const char *cmd, const char *args, int cmdFlags) {
 	const char *i2cModuleStr;
@@ -136,10 +157,19 @@ commandResult_t DRV_I2C_MCP23017_MapPinToChannel(const void *context, const char
 		return CMD_RES_BAD_ARGUMENT;
 	}
 
+	if(targetPin < 0 || targetPin >= 16) {
+		addLogAdv(LOG_INFO, LOG_FEATURE_I2C,"DRV_I2C_MCP23017_MapPinToChannel: pin %i out of range\n", targetPin );
+		return CMD_RES_BAD_ARGUMENT;
+	}
+
 	mcp->pinMapping[targetPin] = targetChannel;
 
-	// send refresh
+	// send refresh, new device gets both latches and directions
 	DRV_I2C_MCP23017_OnChannelChanged((i2cDevice_t*)mcp, targetChannel, CHANNEL_Get(targetChannel));
+	if (mcp->bDirectionSent == false && DRV_I2C_Mutex_Take(100)) {
+		mcp->base.dirty |= MCP23017_DIRTY_OLATA | MCP23017_DIRTY_OLATB | MCP23017_DIRTY_IODIR;
+		DRV_I2C_Mutex_Free();
+	}
 
 	return CMD_RES_OK;
 }
@@ -3,6 +3,14 @@
 
 void DRV_I2C_Init();
 void DRV_I2C_EverySecond();
+void DRV_I2C_RunQuickTick();
+void DRV_I2C_Shutdown();
 void I2C_OnChannelChanged(int channel,int iVal);
+#ifdef WINDOWS
+// fake I2C1/I2C2 bus of simulator
+void SIM_I2C_GetStats(int *transactions, int *bytes);
+int SIM_I2C_GetRegister(int addr, int reg);
+void SIM_I2C_Reset();
+#endif
 
 
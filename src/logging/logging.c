@@ -40,6 +40,9 @@ unsigned int logfeatures = (
 	);
 static int log_delay = 0;
 
+unsigned int g_logEmitted[LOG_FEATURE_MAX];
+unsigned int g_logSuppressed[LOG_FEATURE_MAX];
+
 // must match header definitions in logging.h
 char* loglevelnames[] = {
 	"NONE:",
@@ -115,15 +118,53 @@ static void startLogServer();
 
 int logTcpPort = LOGPORT;
 
+// every log consumer has its own read cursor
+enum {
+	LOG_READER_SERIAL,
+	LOG_READER_TCP,
+	LOG_READER_HTTP,
+	LOG_READERS_COUNT
+};
+
+typedef struct logReader_s {
+	int tail;
+	// set when the writer had to skip over unread data,
+	// the reader will then mark the gap with '^'
+	byte overflow;
+} logReader_t;
+
 static struct tag_logMemory {
 	char log[LOGSIZE];
 	int head;
-	int tailserial;
-	int tailtcp;
-	int tailhttp;
+	logReader_t readers[LOG_READERS_COUNT];
 	SemaphoreHandle_t mutex;
 } logMemory;
 
+// Deferred mode (see 'logdeferred' command). Logs with numeric arguments only
+// are stored as format pointer plus raw arguments and they are formatted
+// later, when a reader drains the log (or before next non-deferred log, to keep order).
+// Format string must outlive the call, which is the case for string literals.
+#define LOG_DEFERRED_MAX_ARGS	6
+#define LOG_DEFERRED_QUEUE		8
+
+typedef union logArg_u {
+	int i;
+	long l;
+	double d;
+	void *p;
+} logArg_t;
+
+typedef struct logDeferred_s {
+	const char *fmt;
+	byte level;
+	byte feature;
+	logArg_t args[LOG_DEFERRED_MAX_ARGS];
+} logDeferred_t;
+
+// allocated only when deferred mode is enabled
+static logDeferred_t *g_logDeferred = 0;
+static int g_logDeferredCount = 0;
+
 
 static int initialised = 0;
 static int tcpLogStarted = 0;
@@ -142,7 +183,8 @@ commandResult_t log_command(const void* context, const char* cmd, const char* ar
 static void initLog(void)
 {
 	bk_printf("Entering initLog()...\r\n");
-	logMemory.head = logMemory.tailserial = logMemory.tailtcp = logMemory.tailhttp = 0;
+	memset(&logMemory.readers, 0, sizeof(logMemory.readers));
+	logMemory.head = 0;
 	logMemory.mutex = xSemaphoreCreateMutex();
 	initialised = 1;
 	startSerialLog();
@@ -150,7 +192,7 @@ static void initLog(void)
 	HTTP_RegisterCallback("/lograw", HTTP_GET, http_getlograw);
 
 	//cmddetail:{"name":"loglevel","args":"[Value]",
-	//cmddetail:"descr":"Correct values are 0 to 7. Default is 3. Higher value includes more logs. Log levels are: ERROR = 1, WARN = 2, INFO = 3, DEBUG = 4, EXTRADEBUG = 5. WARNING: you also must separately select logging level filter on web panel in order for more logs to show up there",
+	//cmddetail:"descr":"Correct values are 0 to 7. Default is 3. Higher value includes more logs. Log levels are: ERROR = 1, WARN = 2, INFO = 3, DEBUG = 4, EXTRADEBUG = 5. WARNING: you also must separately select logging level filter on web panel in order for more logs to show up there. Without argument, prints current level and per-feature counts of printed and suppressed logs",
 	//cmddetail:"fn":"log_command","file":"logging/logging.c","requires":"",
 	//cmddetail:"examples":""}
 	CMD_RegisterCommand("loglevel", log_command, NULL);
@@ -169,6 +211,11 @@ static void initLog(void)
 	//cmddetail:"fn":"log_command","file":"logging/logging.c","requires":"",
 	//cmddetail:"examples":""}
 	CMD_RegisterCommand("logdelay", log_command, NULL);
+	//cmddetail:{"name":"logdeferred","args":"[1or0]",
+	//cmddetail:"descr":"Enables deferred log formatting. Logs with only numeric arguments are queued as raw arguments and formatted when the log is read by serial, TCP or HTTP",
+	//cmddetail:"fn":"log_command","file":"logging/logging.c","requires":"",
+	//cmddetail:"examples":""}
+	CMD_RegisterCommand("logdeferred", log_command, NULL);
 
 	bk_printf("Commands registered!\r\n");
 	bk_printf("initLog() done!\r\n");
@@ -227,73 +274,223 @@ void LOG_SetCommandHTTPRedirectReply(http_request_t* request) {
 	}
 #endif
 
-// adds a log to the log memory
-// if head collides with either tail, move the tails on.
-void addLogAdv(int level, int feature, const char* fmt, ...)
-{
-	char* tmp;
-	char* t;
-	int len;
-	va_list argList;
-	BaseType_t taken;
-	int i;
+// parses a single printf conversion, fmt points just after '%'.
+// Sets type to 'i' (int), 'l' (long), 'd' (double), 'p' (pointer), '%' (literal %)
+// or 0 if conversion can't be deferred (strings, '*' width, etc).
+static const char *LOG_ParseConversion(const char *fmt, char *type) {
+	int longs = 0;
 
-	if (fmt == 0)
-	{
-		return;
+	while (*fmt && strchr("-+ #0123456789.", *fmt)) {
+		fmt++;
 	}
-	if (!((1 << feature) & logfeatures)) {
-		return;
+	while (*fmt == 'l' || *fmt == 'h') {
+		if (*fmt == 'l')
+			longs++;
+		fmt++;
 	}
-	if (level > loglevel) {
-		return;
+	switch (*fmt) {
+	case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+		if (longs == 0)
+			*type = 'i';
+		else if (longs == 1)
+			*type = 'l';
+		else
+			*type = 0;
+		break;
+	case 'f': case 'F': case 'e': case 'E': case 'g': case 'G':
+		*type = 'd';
+		break;
+	case 'p':
+		*type = 'p';
+		break;
+	case '%':
+		*type = '%';
+		break;
+	default:
+		*type = 0;
+		return fmt;
 	}
-
-	// if not initialised, direct output
-	if (!initialised) {
-		initLog();
+	return fmt + 1;
+}
+// returns number of arguments if format can be deferred, or -1 if not
+static int LOG_CountDeferrableArgs(const char *fmt) {
+	char type;
+	int n = 0;
+
+	while (*fmt) {
+		if (*fmt != '%') {
+			fmt++;
+			continue;
+		}
+		fmt = LOG_ParseConversion(fmt + 1, &type);
+		if (type == 0)
+			return -1;
+		if (type != '%')
+			n++;
 	}
-	if (g_StartupDelayOver && !tcpLogStarted){
-		inittcplog();
+	return n;
+}
+static bool LOG_TryDefer(int level, int feature, const char *fmt, va_list argList) {
+	logDeferred_t *d;
+	const char *p;
+	char type;
+	int n;
+
+	if (g_logDeferredCount >= LOG_DEFERRED_QUEUE)
+		return false;
+	n = LOG_CountDeferrableArgs(fmt);
+	// without arguments there is nothing to save, and fmt might be a temporary buffer
+	if (n <= 0 || n > LOG_DEFERRED_MAX_ARGS)
+		return false;
+	d = &g_logDeferred[g_logDeferredCount];
+	d->fmt = fmt;
+	d->level = level;
+	d->feature = feature;
+	n = 0;
+	for (p = fmt; *p; ) {
+		if (*p != '%') {
+			p++;
+			continue;
+		}
+		p = LOG_ParseConversion(p + 1, &type);
+		switch (type) {
+		case 'i':
+			d->args[n++].i = va_arg(argList, int);
+			break;
+		case 'l':
+			d->args[n++].l = va_arg(argList, long);
+			break;
+		case 'd':
+			d->args[n++].d = va_arg(argList, double);
+			break;
+		case 'p':
+			d->args[n++].p = va_arg(argList, void*);
+			break;
+		}
 	}
+	g_logDeferredCount++;
+	return true;
+}
+// formats deferred log one conversion at a time
+static int LOG_FormatDeferred(char *out, int outLen, const logDeferred_t *d) {
+	const char *p, *start;
+	char spec[16];
+	char type;
+	int len, a, n;
+
+	len = 0;
+	a = 0;
+	p = d->fmt;
+	while (*p && len < outLen - 1) {
+		if (*p != '%') {
+			out[len++] = *p++;
+			continue;
+		}
+		start = p;
+		p = LOG_ParseConversion(p + 1, &type);
+		if (type == '%') {
+			out[len++] = '%';
+			continue;
+		}
+		n = p - start;
+		if (n >= sizeof(spec))
+			n = sizeof(spec) - 1;
+		memcpy(spec, start, n);
+		spec[n] = 0;
+		switch (type) {
+		case 'i':
+			n = snprintf(out + len, outLen - len, spec, d->args[a].i);
+			break;
+		case 'l':
+			n = snprintf(out + len, outLen - len, spec, d->args[a].l);
+			break;
+		case 'd':
+			n = snprintf(out + len, outLen - len, spec, d->args[a].d);
+			break;
+		default:
+			n = snprintf(out + len, outLen - len, spec, d->args[a].p);
+			break;
+		}
+		a++;
+		if (n > 0) {
+			len += n;
+		}
+		if (len > outLen - 1) {
+			len = outLen - 1;
+		}
+	}
+	out[len] = 0;
+	return len;
+}
 
+// writes "Level:Feature:" prefix, returns its length
+static int LOG_WritePrefix(char *t, int level, int feature) {
+	int len;
+	const char *s;
 
-	taken = xSemaphoreTake(logMemory.mutex, 100);
-	tmp = g_loggingBuffer;
-	memset(tmp, 0, LOGGING_BUFFER_SIZE);
-	t = tmp;
-
+	// raw means no prefixes
 	if (feature == LOG_FEATURE_RAW)
-	{
-		// raw means no prefixes
+		return 0;
+	len = 0;
+	for (s = loglevelnames[level]; *s; s++) {
+		t[len++] = *s;
 	}
-	else {
-		strncpy(t, loglevelnames[level], (LOGGING_BUFFER_SIZE - (3 + t - tmp)));
-		t += strlen(t);
-		if (feature < sizeof(logfeaturenames) / sizeof(*logfeaturenames))
-		{
-			strncpy(t, logfeaturenames[feature], (LOGGING_BUFFER_SIZE - (3 + t - tmp)));
-			t += strlen(t);
+	if (feature < sizeof(logfeaturenames) / sizeof(*logfeaturenames)) {
+		for (s = logfeaturenames[feature]; *s; s++) {
+			t[len++] = *s;
 		}
 	}
-
-	va_start(argList, fmt);
-	//vsnprintf3(t, (LOGGING_BUFFER_SIZE - (3 + t - tmp)), fmt, argList);
-	//vsnprintf2(t, (LOGGING_BUFFER_SIZE - (3 + t - tmp)), fmt, argList);
-	vsnprintf(t, (LOGGING_BUFFER_SIZE - (3 + t - tmp)), fmt, argList);
-	va_end(argList);
-	if (tmp[strlen(tmp) - 1] == '\n') tmp[strlen(tmp) - 1] = '\0';
-	if (tmp[strlen(tmp) - 1] == '\r') tmp[strlen(tmp) - 1] = '\0';
-
-	len = strlen(tmp); // save 3 bytes at end for /r/n/0
+	return len;
+}
+// strips trailing newline and adds \r\n, 'len' may be larger than what was
+// really printed if the text has been truncated
+static int LOG_FinishLine(char *tmp, int len) {
+	// save 3 bytes at end for /r/n/0
+	if (len > LOGGING_BUFFER_SIZE - 4)
+		len = LOGGING_BUFFER_SIZE - 4;
+	if (len > 0 && tmp[len - 1] == '\n') len--;
+	if (len > 0 && tmp[len - 1] == '\r') len--;
 	tmp[len++] = '\r';
 	tmp[len++] = '\n';
 	tmp[len] = '\0';
+	return len;
+}
+
+// copies data to log memory with at most two memcpy calls.
+// Readers that would be overwritten are moved to the oldest kept byte.
+static void LOG_RingWrite(const char *data, int len) {
+	logReader_t *r;
+	int used, first, i;
+
+	// keep only what fits
+	if (len > LOGSIZE - 1) {
+		data += len - (LOGSIZE - 1);
+		len = LOGSIZE - 1;
+	}
+	for (i = 0; i < LOG_READERS_COUNT; i++) {
+		r = &logMemory.readers[i];
+		used = (logMemory.head - r->tail + LOGSIZE) % LOGSIZE;
+		if (used + len > LOGSIZE - 1) {
+			r->tail = (logMemory.head + len + 1) % LOGSIZE;
+			r->overflow = 1;
+		}
+	}
+	first = LOGSIZE - logMemory.head;
+	if (first > len)
+		first = len;
+	memcpy(logMemory.log + logMemory.head, data, first);
+	if (len > first) {
+		memcpy(logMemory.log, data + first, len - first);
+	}
+	logMemory.head = (logMemory.head + len) % LOGSIZE;
+}
+// sends ready line everywhere, returns true if it was printed directly
+static bool LOG_EmitLine(char *tmp, int len) {
 #if WINDOWS
-	printf(tmp);
+	printf("%s", tmp);
 #endif
 #if PLATFORM_XR809
-	printf(tmp);
+	printf("%s", tmp);
 #endif
 #if PLATFORM_W600 || PLATFORM_W800
 	//printf(tmp);
@@ -313,14 +510,118 @@ void addLogAdv(int level, int feature, const char* fmt, ...)
 	}
 	if (g_extraSocketToSendLOG)
 	{
-		send(g_extraSocketToSendLOG, tmp, strlen(tmp), 0);
+		send(g_extraSocketToSendLOG, tmp, len, 0);
 	}
 
 	if (direct_serial_log == LOGTYPE_DIRECT) {
 		bk_printf("%s", tmp);
-		if (taken == pdTRUE) {
-			xSemaphoreGive(logMemory.mutex);
+		return true;
+	}
+	LOG_RingWrite(tmp, len);
+	return false;
+}
+// must be called with mutex taken
+static void LOG_FlushDeferred() {
+	logDeferred_t *d;
+	char *tmp;
+	int i, len;
+
+	tmp = g_loggingBuffer;
+	for (i = 0; i < g_logDeferredCount; i++) {
+		d = &g_logDeferred[i];
+		len = LOG_WritePrefix(tmp, d->level, d->feature);
+		len += LOG_FormatDeferred(tmp + len, LOGGING_BUFFER_SIZE - 3 - len, d);
+		len = LOG_FinishLine(tmp, len);
+		LOG_EmitLine(tmp, len);
+	}
+	g_logDeferredCount = 0;
+}
+
+void LOG_CountSuppressed(int feature) {
+	if (feature >= 0 && feature < LOG_FEATURE_MAX) {
+		g_logSuppressed[feature]++;
+	}
+}
+
+// adds a log to the log memory
+// if head collides with either tail, move the tails on.
+// Name is in brackets, because addLogAdv is also a macro doing the early checks.
+void (addLogAdv)(int level, int feature, const char* fmt, ...)
+{
+	char* tmp;
+	int len;
+	int printed;
+	va_list argList;
+	BaseType_t taken;
+	bool bDirect;
+
+	if (fmt == 0)
+	{
+		return;
+	}
+	if (!((1 << feature) & logfeatures)) {
+		LOG_CountSuppressed(feature);
+		return;
+	}
+	if (level > loglevel) {
+		LOG_CountSuppressed(feature);
+		return;
+	}
+	if (feature < LOG_FEATURE_MAX) {
+		g_logEmitted[feature]++;
+	}
+
+	// if not initialised, direct output
+	if (!initialised) {
+		initLog();
+	}
+	if (g_StartupDelayOver && !tcpLogStarted){
+		inittcplog();
+	}
+
+
+	taken = xSemaphoreTake(logMemory.mutex, 100);
+
+	// deferred mode only makes sense when nobody needs the text right now
+	if (g_logDeferred && direct_serial_log != LOGTYPE_DIRECT
+		&& g_log_alsoPrintToHTTP == 0 && g_extraSocketToSendLOG == 0) {
+		bool bDeferred;
+
+		va_start(argList, fmt);
+		bDeferred = LOG_TryDefer(level, feature, fmt, argList);
+		va_end(argList);
+		if (bDeferred) {
+			if (taken == pdTRUE) {
+				xSemaphoreGive(logMemory.mutex);
+			}
+#ifdef PLATFORM_BEKEN
+			trigger_log_send();
+#endif
+			return;
 		}
+	}
+	// keep order, earlier deferred logs go first
+	if (g_logDeferredCount) {
+		LOG_FlushDeferred();
+	}
+
+	tmp = g_loggingBuffer;
+	len = LOG_WritePrefix(tmp, level, feature);
+
+	va_start(argList, fmt);
+	printed = vsnprintf(tmp + len, (LOGGING_BUFFER_SIZE - (3 + len)), fmt, argList);
+	va_end(argList);
+	// vsnprintf returns the length it wanted to print, not what fit
+	if (printed < 0)
+		printed = 0;
+	len = LOG_FinishLine(tmp, len + printed);
+
+	bDirect = LOG_EmitLine(tmp, len);
+
+	if (taken == pdTRUE) {
+		xSemaphoreGive(logMemory.mutex);
+	}
+	if (bDirect) {
 		/* no need to delay becasue bk_printf currently delays
 		if (log_delay){
 			if (log_delay < 0){
@@ -332,28 +633,6 @@ void addLogAdv(int level, int feature, const char* fmt, ...)
 		*/
 		return;
 	}
-
-	for ( i = 0; i < len; i++)
-	{
-		logMemory.log[logMemory.head] = tmp[i];
-		logMemory.head = (logMemory.head + 1) % LOGSIZE;
-		if (logMemory.tailserial == logMemory.head)
-		{
-			logMemory.tailserial = (logMemory.tailserial + 1) % LOGSIZE;
-		}
-		if (logMemory.tailtcp == logMemory.head)
-		{
-			logMemory.tailtcp = (logMemory.tailtcp + 1) % LOGSIZE;
-		}
-		if (logMemory.tailhttp == logMemory.head)
-		{
-			logMemory.tailhttp = (logMemory.tailhttp + 1) % LOGSIZE;
-		}
-	}
-
-	if (taken == pdTRUE) {
-		xSemaphoreGive(logMemory.mutex);
-	}
 #ifdef PLATFORM_BEKEN
 	trigger_log_send();
 #endif	
@@ -375,27 +654,34 @@ void addLogAdv(int level, int feature, const char* fmt, ...)
 }
 
 
-static int getData(char* buff, int buffsize, int* tail) {
+static int getData(char* buff, int buffsize, logReader_t *reader) {
 	BaseType_t taken;
-	int count;
-	char* p;
+	int count, first;
 	if (!initialised)
 		return 0;
 	taken = xSemaphoreTake(logMemory.mutex, 100);
 
-	count = 0;
-	p = buff;
-	while (buffsize > 1) {
-		if (*tail == logMemory.head) {
-			break;
-		}
-		*p = logMemory.log[*tail];
-		p++;
-		(*tail) = ((*tail) + 1) % LOGSIZE;
-		buffsize--;
-		count++;
+	if (g_logDeferredCount) {
+		LOG_FlushDeferred();
+	}
+
+	count = (logMemory.head - reader->tail + LOGSIZE) % LOGSIZE;
+	if (count > buffsize - 1)
+		count = buffsize - 1;
+	first = LOGSIZE - reader->tail;
+	if (first > count)
+		first = count;
+	memcpy(buff, logMemory.log + reader->tail, first);
+	if (count > first) {
+		memcpy(buff + first, logMemory.log, count - first);
+	}
+	reader->tail = (reader->tail + count) % LOGSIZE;
+	buff[count] = 0;
+	if (reader->overflow && count) {
+		// replace the first char with ^ if we overflowed....
+		buff[0] = '^';
+		reader->overflow = 0;
 	}
-	*p = 0;
 
 	if (taken == pdTRUE) {
 		xSemaphoreGive(logMemory.mutex);
@@ -411,31 +697,29 @@ static int getData(char* buff, int buffsize, int* tail) {
 // H/W TX fifo seems to be 256 bytes!!!
 static int getSerial2() {
 	if (!initialised) return 0;
-	int* tail = &logMemory.tailserial;
+	logReader_t* reader = &logMemory.readers[LOG_READER_SERIAL];
 	char c;
 	BaseType_t taken = xSemaphoreTake(logMemory.mutex, 100);
-	char overflow = 0;
 
-	// if we hit overflow
-	if (logMemory.tailserial == (logMemory.head + 1) % LOGSIZE) {
-		overflow = 1;
+	if (g_logDeferredCount) {
+		LOG_FlushDeferred();
 	}
 
-	while ((*tail != logMemory.head) && !uart_is_tx_fifo_full(UART_PORT)) {
-		c = logMemory.log[*tail];
-		if (overflow) {
+	while ((reader->tail != logMemory.head) && !uart_is_tx_fifo_full(UART_PORT)) {
+		c = logMemory.log[reader->tail];
+		if (reader->overflow) {
 			c = '^'; // replace the first char with ^ if we overflowed....
-			overflow = 0;
+			reader->overflow = 0;
 		}
 
-		(*tail) = ((*tail) + 1) % LOGSIZE;
+		reader->tail = (reader->tail + 1) % LOGSIZE;
 
 		if (direct_serial_log == LOGTYPE_THREAD) {
 			UART_WRITE_BYTE(UART_PORT_INDEX, c);
 		}
 	}
 
-	int remains = (*tail != logMemory.head);
+	int remains = (reader->tail != logMemory.head);
 
 	if (taken == pdTRUE) {
 		xSemaphoreGive(logMemory.mutex);
@@ -446,7 +730,7 @@ static int getSerial2() {
 #else
 
 static int getSerial(char* buff, int buffsize) {
-	int len = getData(buff, buffsize, &logMemory.tailserial);
+	int len = getData(buff, buffsize, &logMemory.readers[LOG_READER_SERIAL]);
 	//bk_printf("got serial: %d:%s\r\n", len, buff);
 	return len;
 }
@@ -455,13 +739,13 @@ static int getSerial(char* buff, int buffsize) {
 
 
 static int getTcp(char* buff, int buffsize) {
-	int len = getData(buff, buffsize, &logMemory.tailtcp);
+	int len = getData(buff, buffsize, &logMemory.readers[LOG_READER_TCP]);
 	//bk_printf("got tcp: %d:%s\r\n", len,buff);
 	return len;
 }
 
 static int getHttp(char* buff, int buffsize) {
-	int len = getData(buff, buffsize, &logMemory.tailhttp);
+	int len = getData(buff, buffsize, &logMemory.readers[LOG_READER_HTTP]);
 	//printf("got tcp: %d:%s\r\n", len,buff);
 	return len;
 }
@@ -701,6 +985,17 @@ commandResult_t log_command(const void* context, const char* cmd, const char* ar
 	do {
 		if (!stricmp(cmd, "loglevel")) {
 			int res, level;
+			if (*args == 0) {
+				int i;
+				// no argument - print current level and per-feature counters
+				ADDLOG_INFO(LOG_FEATURE_CMD, "loglevel is %i", loglevel);
+				for (i = 0; i < LOG_FEATURE_MAX; i++) {
+					ADDLOG_INFO(LOG_FEATURE_CMD, "%s printed %u, suppressed %u",
+						logfeaturenames[i], g_logEmitted[i], g_logSuppressed[i]);
+				}
+				result = CMD_RES_OK;
+				break;
+			}
 			res = sscanf(args, "%d", &level);
 			if (res == 1) {
 				if ((level >= 0) && (level <= 9)) {
@@ -757,6 +1052,27 @@ commandResult_t log_command(const void* context, const char* cmd, const char* ar
 			result = CMD_RES_OK;
 			break;
 		}
+		if (!stricmp(cmd, "logdeferred")) {
+			int enable = 0;
+			BaseType_t taken;
+
+			sscanf(args, "%d", &enable);
+			taken = xSemaphoreTake(logMemory.mutex, 100);
+			if (enable && g_logDeferred == 0) {
+				g_logDeferred = malloc(sizeof(logDeferred_t) * LOG_DEFERRED_QUEUE);
+				g_logDeferredCount = 0;
+			}
+			else if (enable == 0 && g_logDeferred) {
+				LOG_FlushDeferred();
+				free(g_logDeferred);
+				g_logDeferred = 0;
+			}
+			if (taken == pdTRUE) {
+				xSemaphoreGive(logMemory.mutex);
+			}
+			result = CMD_RES_OK;
+			break;
+		}
 		if (!stricmp(cmd, "logdelay")) {
 			int res, delay;
 			res = sscanf(args, "%d", &delay);
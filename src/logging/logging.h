@@ -16,18 +16,55 @@
 
 void addLogAdv(int level, int feature, const char *fmt, ...);
 void LOG_SetRawSocketCallback(int newFD);
+void LOG_CountSuppressed(int feature);
+
+// Logs above this level are removed at build time, so for example
+// -DOBK_LOG_MIN_LEVEL=3 drops all DEBUG and EXTRADEBUG calls.
+// Values must match log_levels below.
+#ifndef OBK_LOG_MIN_LEVEL
+#define OBK_LOG_MIN_LEVEL 6
+#endif
+
+#define LOG_IsEnabled(level, feature) ((level) <= loglevel && ((1 << (feature)) & logfeatures))
+
+// Level and feature are checked before the arguments are evaluated,
+// so disabled logs don't cost anything more than a compare.
+#define addLogAdv(level, feature, ...) do { \
+		if ((level) <= OBK_LOG_MIN_LEVEL) { \
+			if (LOG_IsEnabled(level, feature)) \
+				addLogAdv(level, feature, __VA_ARGS__); \
+			else \
+				LOG_CountSuppressed(feature); \
+		} \
+	} while (0)
 
 #define ADDLOG_ERROR(x, fmt, ...) addLogAdv(LOG_ERROR, x, fmt, ##__VA_ARGS__)
 #define ADDLOG_WARN(x, fmt, ...)  addLogAdv(LOG_WARN, x, fmt, ##__VA_ARGS__)
 #define ADDLOG_INFO(x, fmt, ...)  addLogAdv(LOG_INFO, x, fmt, ##__VA_ARGS__)
+#if OBK_LOG_MIN_LEVEL >= 4
 #define ADDLOG_DEBUG(x, fmt, ...) addLogAdv(LOG_DEBUG, x, fmt, ##__VA_ARGS__)
+#else
+#define ADDLOG_DEBUG(x, fmt, ...) do { } while (0)
+#endif
+#if OBK_LOG_MIN_LEVEL >= 5
 #define ADDLOG_EXTRADEBUG(x, fmt, ...) addLogAdv(LOG_EXTRADEBUG, x, fmt, ##__VA_ARGS__)
+#else
+#define ADDLOG_EXTRADEBUG(x, fmt, ...) do { } while (0)
+#endif
 
 #define ADDLOGF_ERROR(fmt, ...) addLogAdv(LOG_ERROR, LOG_FEATURE, fmt, ##__VA_ARGS__)
 #define ADDLOGF_WARN(fmt, ...)  addLogAdv(LOG_WARN, LOG_FEATURE, fmt, ##__VA_ARGS__)
 #define ADDLOGF_INFO(fmt, ...)  addLogAdv(LOG_INFO, LOG_FEATURE, fmt, ##__VA_ARGS__)
+#if OBK_LOG_MIN_LEVEL >= 4
 #define ADDLOGF_DEBUG(fmt, ...) addLogAdv(LOG_DEBUG, LOG_FEATURE, fmt, ##__VA_ARGS__)
+#else
+#define ADDLOGF_DEBUG(fmt, ...) do { } while (0)
+#endif
+#if OBK_LOG_MIN_LEVEL >= 5
 #define ADDLOGF_EXTRADEBUG(fmt, ...) addLogAdv(LOG_EXTRADEBUG, LOG_FEATURE, fmt, ##__VA_ARGS__)
+#else
+#define ADDLOGF_EXTRADEBUG(fmt, ...) do { } while (0)
+#endif
 
 
 extern int loglevel;
@@ -88,4 +125,8 @@ typedef enum {
     LOG_FEATURE_MAX             = 23,
 } log_features;
 
+// per-feature counters of printed and filtered out logs
+extern unsigned int g_logEmitted[LOG_FEATURE_MAX];
+extern unsigned int g_logSuppressed[LOG_FEATURE_MAX];
+
 #endif
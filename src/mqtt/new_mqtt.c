@@ -10,6 +10,7 @@
 #include "../driver/drv_public.h"
 #include "../driver/drv_ntp.h"
 #include "../driver/drv_tuyaMCU.h"
+#include "../httpserver/hass.h"
 #include "../ota/ota.h"
 
 #ifndef LWIP_MQTT_EXAMPLE_IPADDR_INIT
@@ -171,11 +172,13 @@ int get_received(char **topic, int *topiclen, unsigned char **data, int *datalen
 //
 //////////////////////////////////////////////////////////////////////
 
-#define MQTT_QUEUE_ITEM_IS_REUSABLE(x)  (x->topic[0] == 0)
-#define MQTT_QUEUE_ITEM_SET_REUSABLE(x) (x->topic[0] = 0)
-
-MqttPublishItem_t* g_MqttPublishQueueHead = NULL;
-int g_MqttPublishItemsQueued = 0;   //Items in the queue waiting to be published. This is not the queue length.
+// Publish queue is a fixed ring of MQTT_MAX_QUEUE_SIZE slots, allocated once on first use.
+// Enqueue writes at tail, dequeue reads at head, both O(1); no per-item allocation.
+static MqttPublishItem_t* g_MqttPublishQueue = NULL;
+static int g_MqttPublishQueueHead = 0;
+int g_MqttPublishItemsQueued = 0;   //Items in the queue waiting to be published (queue depth).
+static int g_MqttPublishQueueDropped = 0;
+static int g_MqttPublishQueueCoalesced = 0;
 
 // from mqtt.c
 extern void mqtt_disconnect(mqtt_client_t* client);
@@ -191,6 +194,28 @@ static char mqtt_status_message[256];
 static int mqtt_published_events = 0;
 static int mqtt_publish_errors = 0;
 static int mqtt_received_events = 0;
+static unsigned int mqtt_published_bytes = 0;
+static int mqtt_published_events_lastSecond = 0;
+static int mqtt_publish_rate = 0;
+
+// Topic and numeric value of a publish are assembled here, always with MQTT mutex taken,
+// so publishing doesn't need any allocation.
+#define MQTT_TOPIC_BUFFER_SIZE 192
+#define MQTT_VALUE_BUFFER_SIZE 32
+static char g_mqttTopicBuffer[MQTT_TOPIC_BUFFER_SIZE];
+static char g_mqttValueBuffer[MQTT_VALUE_BUFFER_SIZE];
+
+// "clientId", "tele/clientId" and "stat/clientId", rebuilt when base topic changes
+static char g_mqttMainPrefix[CGF_MQTT_CLIENT_ID_SIZE];
+static char g_mqttTelePrefix[CGF_MQTT_CLIENT_ID_SIZE + 8];
+static char g_mqttStatPrefix[CGF_MQTT_CLIENT_ID_SIZE + 8];
+static bool g_mqttPrefixesValid = false;
+
+typedef enum mqttValueType_e {
+	MQTT_VALUE_STRING,
+	MQTT_VALUE_INT,
+	MQTT_VALUE_FLOAT,
+} mqttValueType_t;
 
 static int g_just_connected = 0;
 
@@ -278,6 +303,16 @@ int MQTT_GetPublishEventCounter(void)
 	return mqtt_published_events;
 }
 
+unsigned int MQTT_GetPublishedBytesCounter(void)
+{
+	return mqtt_published_bytes;
+}
+
+int MQTT_GetPublishRate(void)
+{
+	return mqtt_publish_rate;
+}
+
 int MQTT_GetPublishErrorCounter(void)
 {
 	return mqtt_publish_errors;
@@ -790,14 +825,46 @@ static void mqtt_pub_request_cb(void* arg, err_t result)
 	}
 }
 
+static void MQTT_RefreshTopicPrefixes() {
+	const char *clientId;
+
+	clientId = CFG_GetMQTTClientId();
+	strcpy_safe(g_mqttMainPrefix, clientId, sizeof(g_mqttMainPrefix));
+	snprintf(g_mqttTelePrefix, sizeof(g_mqttTelePrefix), "tele/%s", clientId);
+	snprintf(g_mqttStatPrefix, sizeof(g_mqttStatPrefix), "stat/%s", clientId);
+	g_mqttPrefixesValid = true;
+}
+// base topic can be changed at any time, and it's rebuilt once per second,
+// so we also check dirty flag to never publish with an old client ID.
+// Prefixes are shared by all publishers, so call this only with MQTT mutex taken.
+static void MQTT_CheckTopicPrefixes() {
+	if (g_mqttPrefixesValid == false || g_mqtt_bBaseTopicDirty) {
+		MQTT_RefreshTopicPrefixes();
+	}
+}
+// appends src to topic buffer, returns new length or -1 if it does not fit
+static int MQTT_AppendToTopic(char *out, int len, const char *src) {
+	while (*src) {
+		if (len >= MQTT_TOPIC_BUFFER_SIZE - 1)
+			return -1;
+		out[len++] = *src++;
+	}
+	out[len] = 0;
+	return len;
+}
+
 // This publishes value to the specified topic/channel.
-static OBK_Publish_Result MQTT_PublishTopicToClient(mqtt_client_t* client, const char* sTopic, const char* sChannel, const char* sVal, int flags, bool appendGet)
+// Value is either a string (sVal) or a number formatted directly into g_mqttValueBuffer.
+static OBK_Publish_Result MQTT_PublishTopicToClient_Internal(mqtt_client_t* client, const char* sTopic, const char* sChannel,
+	const char* sVal, mqttValueType_t valueType, int iVal, float fVal, int flags, bool appendGet)
 {
 	err_t err;
 	u8_t qos = 2; /* 0 1 or 2, see MQTT specification */
 	u8_t retain = 0; /* No don't retain such crappy payload... */
 	size_t sVal_len;
+	int topicLen;
 	char* pub_topic;
+	char* allocated_topic;
 
 	if (client == 0)
 		return OBK_PUBLISH_WAS_DISCONNECTED;
@@ -812,10 +879,12 @@ static OBK_Publish_Result MQTT_PublishTopicToClient(mqtt_client_t* client, const
 	else {
 		if (MQTT_Mutex_Take(500) == 0)
 		{
-			addLogAdv(LOG_ERROR, LOG_FEATURE_MQTT, "MQTT_PublishTopicToClient: mutex failed for %s=%s\r\n", sChannel, sVal);
+			addLogAdv(LOG_ERROR, LOG_FEATURE_MQTT, "MQTT_PublishTopicToClient: mutex failed for %s=%s\r\n", sChannel, sVal ? sVal : "(number)");
 			return OBK_PUBLISH_MUTEX_FAIL;
 		}
 	}
+	// sTopic may point to one of the prefix buffers, so refresh them before it's read
+	MQTT_CheckTopicPrefixes();
 	if (flags & OBK_PUBLISH_FLAG_RETAIN)
 	{
 		retain = 1;
@@ -844,11 +913,38 @@ static OBK_Publish_Result MQTT_PublishTopicToClient(mqtt_client_t* client, const
 
 	g_timeSinceLastMQTTPublish = 0;
 
-	pub_topic = (char*)os_malloc(strlen(sTopic) + 1 + strlen(sChannel) + 5 + 1); //5 for /get
+	// format number values straight into static buffer
+	if (valueType == MQTT_VALUE_INT) {
+		snprintf(g_mqttValueBuffer, sizeof(g_mqttValueBuffer), "%i", iVal);
+		sVal = g_mqttValueBuffer;
+	}
+	else if (valueType == MQTT_VALUE_FLOAT) {
+		snprintf(g_mqttValueBuffer, sizeof(g_mqttValueBuffer), "%f", fVal);
+		sVal = g_mqttValueBuffer;
+	}
+
+	// build "topic/channel/get" in static buffer,
+	// allocate only if someone passes a really long topic
+	allocated_topic = 0;
+	pub_topic = g_mqttTopicBuffer;
+	topicLen = MQTT_AppendToTopic(pub_topic, 0, sTopic);
+	if (topicLen >= 0)
+		topicLen = MQTT_AppendToTopic(pub_topic, topicLen, "/");
+	if (topicLen >= 0)
+		topicLen = MQTT_AppendToTopic(pub_topic, topicLen, sChannel);
+	if (topicLen >= 0 && appendGet)
+		topicLen = MQTT_AppendToTopic(pub_topic, topicLen, "/get");
+	if (topicLen < 0) {
+		allocated_topic = (char*)os_malloc(strlen(sTopic) + 1 + strlen(sChannel) + 5 + 1); //5 for /get
+		pub_topic = allocated_topic;
+		if (pub_topic != NULL) {
+			sprintf(pub_topic, "%s/%s%s", sTopic, sChannel, (appendGet == true ? "/get" : ""));
+			topicLen = strlen(pub_topic);
+		}
+	}
 	if ((pub_topic != NULL) && (sVal != NULL))
 	{
 		sVal_len = strlen(sVal);
-		sprintf(pub_topic, "%s/%s%s", sTopic, sChannel, (appendGet == true ? "/get" : ""));
 		if (sVal_len < 128)
 		{
 			addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "Publishing val %s to %s retain=%i\n", sVal, pub_topic, retain);
@@ -859,9 +955,11 @@ static OBK_Publish_Result MQTT_PublishTopicToClient(mqtt_client_t* client, const
 
 
 		LOCK_TCPIP_CORE();
-		err = mqtt_publish(client, pub_topic, sVal, strlen(sVal), qos, retain, mqtt_pub_request_cb, 0);
+		err = mqtt_publish(client, pub_topic, sVal, sVal_len, qos, retain, mqtt_pub_request_cb, 0);
 		UNLOCK_TCPIP_CORE();
-		os_free(pub_topic);
+		if (allocated_topic) {
+			os_free(allocated_topic);
+		}
 
 		if (err != ERR_OK)
 		{
@@ -881,33 +979,46 @@ static OBK_Publish_Result MQTT_PublishTopicToClient(mqtt_client_t* client, const
 			return OBK_PUBLISH_MEM_FAIL;
 		}
 		mqtt_published_events++;
+		mqtt_published_bytes += topicLen + sVal_len;
 		MQTT_Mutex_Free();
 		return OBK_PUBLISH_OK;
 	}
 	else {
+		if (allocated_topic) {
+			os_free(allocated_topic);
+		}
 		MQTT_Mutex_Free();
 		return OBK_PUBLISH_MEM_FAIL;
 	}
 }
+static OBK_Publish_Result MQTT_PublishTopicToClient(mqtt_client_t* client, const char* sTopic, const char* sChannel, const char* sVal, int flags, bool appendGet)
+{
+	return MQTT_PublishTopicToClient_Internal(client, sTopic, sChannel, sVal, MQTT_VALUE_STRING, 0, 0, flags, appendGet);
+}
 
 // This is used to publish channel values in "obk0696FB33/1/get" format with numerical value,
 // This is also used to publish custom information with string name,
 // for example, "obk0696FB33/voltage/get" is used to publish voltage from the sensor
 static OBK_Publish_Result MQTT_PublishMain(mqtt_client_t* client, const char* sChannel, const char* sVal, int flags, bool appendGet)
 {
-	return MQTT_PublishTopicToClient(mqtt_client, CFG_GetMQTTClientId(), sChannel, sVal, flags, appendGet);
+	return MQTT_PublishTopicToClient(mqtt_client, g_mqttMainPrefix, sChannel, sVal, flags, appendGet);
+}
+// as above, but value is formatted directly into the publish buffer
+OBK_Publish_Result MQTT_PublishMain_Int(const char* sChannel, int iVal, int flags, bool appendGet)
+{
+	return MQTT_PublishTopicToClient_Internal(mqtt_client, g_mqttMainPrefix, sChannel, 0, MQTT_VALUE_INT, iVal, 0, flags, appendGet);
+}
+OBK_Publish_Result MQTT_PublishMain_Float(const char* sChannel, float fVal, int flags, bool appendGet)
+{
+	return MQTT_PublishTopicToClient_Internal(mqtt_client, g_mqttMainPrefix, sChannel, 0, MQTT_VALUE_FLOAT, 0, fVal, flags, appendGet);
 }
 OBK_Publish_Result MQTT_PublishTele(const char* teleName, const char* teleValue)
 {
-	char topic[64];
-	snprintf(topic, sizeof(topic), "tele/%s", CFG_GetMQTTClientId());
-	return MQTT_PublishTopicToClient(mqtt_client, topic, teleName, teleValue, 0, false);
+	return MQTT_PublishTopicToClient(mqtt_client, g_mqttTelePrefix, teleName, teleValue, 0, false);
 }
 OBK_Publish_Result MQTT_PublishStat(const char* statName, const char* statValue)
 {
-	char topic[64];
-	snprintf(topic,sizeof(topic),"stat/%s", CFG_GetMQTTClientId());
-	return MQTT_PublishTopicToClient(mqtt_client, topic, statName, statValue, 0, false);
+	return MQTT_PublishTopicToClient(mqtt_client, g_mqttStatPrefix, statName, statValue, 0, false);
 }
 /// @brief Publish a MQTT message immediately.
 /// @param sTopic 
@@ -1213,21 +1324,11 @@ static int MQTT_do_connect(mqtt_client_t* client)
 
 OBK_Publish_Result MQTT_PublishMain_StringInt(const char* sChannel, int iv)
 {
-	char valueStr[16];
-
-	sprintf(valueStr, "%i", iv);
-
-	return MQTT_PublishMain(mqtt_client, sChannel, valueStr, 0, true);
-
+	return MQTT_PublishMain_Int(sChannel, iv, 0, true);
 }
 OBK_Publish_Result MQTT_PublishMain_StringFloat(const char* sChannel, float f)
 {
-	char valueStr[16];
-
-	sprintf(valueStr, "%f", f);
-
-	return MQTT_PublishMain(mqtt_client, sChannel, valueStr, 0, true);
-
+	return MQTT_PublishMain_Float(sChannel, f, 0, true);
 }
 OBK_Publish_Result MQTT_PublishMain_StringString(const char* sChannel, const char* valueStr, int flags)
 {
@@ -1239,19 +1340,20 @@ OBK_Publish_Result MQTT_PublishMain_StringString(const char* sChannel, const cha
 OBK_Publish_Result MQTT_ChannelPublish(int channel, int flags)
 {
 	char channelNameStr[8];
-	char valueStr[16];
+	float dVal;
+	int iVal;
+	bool bFloat;
 
-	if (CFG_HasFlag(OBK_FLAG_PUBLISH_MULTIPLIED_VALUES)) {
-		float dVal = CHANNEL_GetFinalValue(channel);
+	bFloat = CFG_HasFlag(OBK_FLAG_PUBLISH_MULTIPLIED_VALUES);
+	if (bFloat) {
+		dVal = CHANNEL_GetFinalValue(channel);
 		// Float value
 		addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "Channel has changed! Publishing %f to channel %i \n", dVal, channel);
-		sprintf(valueStr, "%f", dVal);
 	}
 	else {
-		int iVal = CHANNEL_Get(channel);
+		iVal = CHANNEL_Get(channel);
 		// Integer value
 		addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "Channel has changed! Publishing %i to channel %i \n", iVal, channel);
-		sprintf(valueStr, "%i", iVal);
 	}
 
 	MQTT_BroadcastTasmotaTeleSTATE();
@@ -1266,7 +1368,10 @@ OBK_Publish_Result MQTT_ChannelPublish(int channel, int flags)
 		}
 	}
 
-	return MQTT_PublishMain(mqtt_client, channelNameStr, valueStr, flags, true);
+	if (bFloat) {
+		return MQTT_PublishMain_StringFloat_Filtered(MQTT_DEDUP_HASH_LATER, channelNameStr, dVal, flags);
+	}
+	return MQTT_PublishMain_StringInt_Filtered(MQTT_DEDUP_HASH_LATER, channelNameStr, iVal, flags);
 }
 // This console command will trigger a publish of all used variables (channels and extra stuff)
 commandResult_t MQTT_PublishAll(const void* context, const char* cmd, const char* args, int cmdFlags) {
@@ -1288,7 +1393,8 @@ commandResult_t MQTT_PublishChannel(const void* context, const char* cmd, const
 	}
 	channelIndex = Tokenizer_GetArgInteger(0);
 
-	MQTT_ChannelPublish(channelIndex,0);
+	// explicit request, so deduper must not hold it back
+	MQTT_ChannelPublish(channelIndex, OBK_PUBLISH_FLAG_FORCE);
 
 	return CMD_RES_OK;
 }
@@ -1325,7 +1431,7 @@ commandResult_t MQTT_PublishCommandInteger(const void* context, const char* cmd,
 	topic = Tokenizer_GetArg(0);
 	value = Tokenizer_GetArgInteger(1);
 
-	ret = MQTT_PublishMain_StringInt(topic, value);
+	ret = MQTT_PublishMain_StringInt_Filtered(MQTT_DEDUP_HASH_LATER, topic, value, 0);
 
 	return CMD_RES_OK;
 }
@@ -1346,7 +1452,7 @@ commandResult_t MQTT_PublishCommandFloat(const void* context, const char* cmd, c
 	topic = Tokenizer_GetArg(0);
 	value = Tokenizer_GetArgFloat(1);
 
-	ret = MQTT_PublishMain_StringFloat(topic, value);
+	ret = MQTT_PublishMain_StringFloat_Filtered(MQTT_DEDUP_HASH_LATER, topic, value, 0);
 
 	return CMD_RES_OK;
 }
@@ -1553,6 +1659,8 @@ void MQTT_InitCallbacks() {
 
 	MQTT_ClearCallbacks();
 	g_mqtt_bBaseTopicDirty = 0;
+	// prefixes are rebuilt by next publish, under MQTT mutex
+	g_mqttPrefixesValid = false;
 
 	clientId = CFG_GetMQTTClientId();
 	groupId = CFG_GetMQTTGroupTopic();
@@ -1639,6 +1747,7 @@ void MQTT_init()
 	//cmddetail:"fn":"MQTT_PublishCommand","file":"mqtt/new_mqtt.c","requires":"",
 	//cmddetail:"examples":""}
 	CMD_RegisterCommand("publishFloat", MQTT_PublishCommandFloat, NULL);
+	MQTT_Dedup_InitCommands();
 	//cmddetail:{"name":"publishAll","args":"",
 	//cmddetail:"descr":"Starts the step by step publish of all available values",
 	//cmddetail:"fn":"MQTT_PublishAll","file":"mqtt/new_mqtt.c","requires":"",
@@ -1725,8 +1834,7 @@ OBK_Publish_Result MQTT_DoItemPublish(int idx)
 		//Drivers are only built on BK7231 chips
 #ifndef OBK_DISABLE_ALL_DRIVERS
 		if (DRV_IsRunning("NTP")) {
-			sprintf(dataStr, "%d", NTP_GetCurrentTime());
-			return MQTT_DoItemPublishString("datetime", dataStr);
+			return MQTT_PublishMain_Int("datetime", NTP_GetCurrentTime(), OBK_PUBLISH_FLAG_MUTEX_SILENT, false);
 		}
 		else {
 			return OBK_PUBLISH_WAS_NOT_REQUIRED;
@@ -1736,20 +1844,16 @@ OBK_Publish_Result MQTT_DoItemPublish(int idx)
 #endif
 
 	case PUBLISHITEM_SELF_SOCKETS:
-		sprintf(dataStr, "%d", LWIP_GetActiveSockets());
-		return MQTT_DoItemPublishString("sockets", dataStr);
+		return MQTT_PublishMain_Int("sockets", LWIP_GetActiveSockets(), OBK_PUBLISH_FLAG_MUTEX_SILENT, false);
 
 	case PUBLISHITEM_SELF_RSSI:
-		sprintf(dataStr, "%d", HAL_GetWifiStrength());
-		return MQTT_DoItemPublishString("rssi", dataStr);
+		return MQTT_PublishMain_Int("rssi", HAL_GetWifiStrength(), OBK_PUBLISH_FLAG_MUTEX_SILENT, false);
 
 	case PUBLISHITEM_SELF_UPTIME:
-		sprintf(dataStr, "%d", Time_getUpTimeSeconds());
-		return MQTT_DoItemPublishString("uptime", dataStr);
+		return MQTT_PublishMain_Int("uptime", Time_getUpTimeSeconds(), OBK_PUBLISH_FLAG_MUTEX_SILENT, false);
 
 	case PUBLISHITEM_SELF_FREEHEAP:
-		sprintf(dataStr, "%d", xPortGetFreeHeapSize());
-		return MQTT_DoItemPublishString("freeheap", dataStr);
+		return MQTT_PublishMain_Int("freeheap", xPortGetFreeHeapSize(), OBK_PUBLISH_FLAG_MUTEX_SILENT, false);
 
 	case PUBLISHITEM_SELF_IP:
 		g_firstFullBroadcast = false; //We published the last status item, disable full broadcast
@@ -1770,7 +1874,7 @@ OBK_Publish_Result MQTT_DoItemPublish(int idx)
 	// TODO
 	//type = CHANNEL_GetType(idx);
 	if (bWantsToPublish) {
-		return MQTT_ChannelPublish(g_publishItemIndex, OBK_PUBLISH_FLAG_MUTEX_SILENT);
+		return MQTT_ChannelPublish(g_publishItemIndex, OBK_PUBLISH_FLAG_MUTEX_SILENT | OBK_PUBLISH_FLAG_FORCE);
 	}
 
 	return OBK_PUBLISH_WAS_NOT_REQUIRED; // didnt publish
@@ -1816,6 +1920,9 @@ int MQTT_RunEverySecondUpdate()
 	if (!mqtt_initialised)
 		return 0;
 
+	mqtt_publish_rate = mqtt_published_events - mqtt_published_events_lastSecond;
+	mqtt_published_events_lastSecond = mqtt_published_events;
+
 	if (Main_HasWiFiConnected() == 0)
 	{
 		mqtt_reconnect = 0;
@@ -2036,26 +2143,42 @@ int MQTT_RunEverySecondUpdate()
 	return 1;
 }
 
-MqttPublishItem_t* get_queue_tail(MqttPublishItem_t* head) {
-	if (head == NULL) { return NULL; }
+#define MQTT_QUEUE_SLOT(i) (&g_MqttPublishQueue[(i) % MQTT_MAX_QUEUE_SIZE])
 
-	while (head->next != NULL) {
-		head = head->next;
-	}
-	return head;
+int MQTT_GetQueueDepth(void)
+{
+	return g_MqttPublishItemsQueued;
 }
 
-MqttPublishItem_t* find_queue_reusable_item(MqttPublishItem_t* head) {
-	while (head != NULL) {
-		if (MQTT_QUEUE_ITEM_IS_REUSABLE(head)) {
-			return head;
+int MQTT_GetQueueDroppedCounter(void)
+{
+	return g_MqttPublishQueueDropped;
+}
+
+int MQTT_GetQueueCoalescedCounter(void)
+{
+	return g_MqttPublishQueueCoalesced;
+}
+
+/// @brief Find a pending item with the same topic and channel. Queue is small, so scan is bounded.
+/// @param topic 
+/// @param channel 
+/// @return Slot index or -1
+static int MQTT_FindQueuedItem(const char* topic, const char* channel) {
+	int i;
+	MqttPublishItem_t* item;
+
+	for (i = 0; i < g_MqttPublishItemsQueued; i++) {
+		item = MQTT_QUEUE_SLOT(g_MqttPublishQueueHead + i);
+		if (!strcmp(item->channel, channel) && !strcmp(item->topic, topic)) {
+			return (g_MqttPublishQueueHead + i) % MQTT_MAX_QUEUE_SIZE;
 		}
-		head = head->next;
 	}
-	return head;
+	return -1;
 }
 
 /// @brief Queue an entry for publish and execute a command after the publish.
+/// If the same topic/channel is already pending, its value is replaced instead of queuing a stale duplicate.
 /// @param topic 
 /// @param channel 
 /// @param value 
@@ -2063,36 +2186,51 @@ MqttPublishItem_t* find_queue_reusable_item(MqttPublishItem_t* head) {
 /// @param command Command to execute after the publish
 void MQTT_QueuePublishWithCommand(const char* topic, const char* channel, const char* value, int flags, PostPublishCommands command) {
 	MqttPublishItem_t* newItem;
-	if (g_MqttPublishItemsQueued >= MQTT_MAX_QUEUE_SIZE) {
-		addLogAdv(LOG_ERROR, LOG_FEATURE_MQTT, "Unable to queue! %i items already present\r\n", g_MqttPublishItemsQueued);
-		return;
-	}
+	int index;
 
-	if ((strlen(topic) > MQTT_PUBLISH_ITEM_TOPIC_LENGTH) ||
-		(strlen(channel) > MQTT_PUBLISH_ITEM_CHANNEL_LENGTH) ||
-		(strlen(value) > MQTT_PUBLISH_ITEM_VALUE_LENGTH)) {
+	if ((strlen(topic) >= MQTT_PUBLISH_ITEM_TOPIC_LENGTH) ||
+		(strlen(channel) >= MQTT_PUBLISH_ITEM_CHANNEL_LENGTH) ||
+		(strlen(value) >= MQTT_PUBLISH_ITEM_VALUE_LENGTH)) {
 		addLogAdv(LOG_ERROR, LOG_FEATURE_MQTT, "Unable to queue! Topic (%i), channel (%i) or value (%i) exceeds size limit\r\n",
 			strlen(topic), strlen(channel), strlen(value));
+		g_MqttPublishQueueDropped++;
 		return;
 	}
 
-	//Queue data for publish. This might be a new item in the queue or an existing item. This is done to prevent
-	//memory fragmentation. The total queue length is limited to MQTT_MAX_QUEUE_SIZE.
-
-	if (g_MqttPublishQueueHead == NULL) {
-		g_MqttPublishQueueHead = newItem = os_malloc(sizeof(MqttPublishItem_t));
-		newItem->next = NULL;
+	if (g_MqttPublishQueue == NULL) {
+		g_MqttPublishQueue = (MqttPublishItem_t*)os_malloc(sizeof(MqttPublishItem_t) * MQTT_MAX_QUEUE_SIZE);
+		if (g_MqttPublishQueue == NULL) {
+			addLogAdv(LOG_ERROR, LOG_FEATURE_MQTT, "Unable to allocate publish queue\r\n");
+			g_MqttPublishQueueDropped++;
+			return;
+		}
+		g_MqttPublishQueueHead = 0;
+		g_MqttPublishItemsQueued = 0;
+	}
+
+	index = MQTT_FindQueuedItem(topic, channel);
+	if (index >= 0) {
+		newItem = &g_MqttPublishQueue[index];
+		os_strcpy(newItem->value, value);
+		newItem->flags = flags;
+		// never lose a pending post-publish command
+		if (command != None) {
+			newItem->command = command;
+		}
+		g_MqttPublishQueueCoalesced++;
+		addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "Coalesced topic=%s/%s, %i items in queue", newItem->topic, newItem->channel, g_MqttPublishItemsQueued);
+		return;
 	}
-	else {
-		newItem = find_queue_reusable_item(g_MqttPublishQueueHead);
 
-		if (newItem == NULL) {
-			newItem = os_malloc(sizeof(MqttPublishItem_t));
-			newItem->next = NULL;
-			get_queue_tail(g_MqttPublishQueueHead)->next = newItem; //Append new item
-		}
+	if (g_MqttPublishItemsQueued >= MQTT_MAX_QUEUE_SIZE) {
+		g_MqttPublishQueueDropped++;
+		addLogAdv(LOG_ERROR, LOG_FEATURE_MQTT, "Unable to queue! %i items already present\r\n", g_MqttPublishItemsQueued);
+		return;
 	}
 
+	index = (g_MqttPublishQueueHead + g_MqttPublishItemsQueued) % MQTT_MAX_QUEUE_SIZE;
+	newItem = &g_MqttPublishQueue[index];
+
 	//os_strcpy does copy ending null character.
 	os_strcpy(newItem->topic, topic);
 	os_strcpy(newItem->channel, channel);
@@ -2107,13 +2245,15 @@ void MQTT_QueuePublishWithCommand(const char* topic, const char* channel, const
 /// @brief Add the specified command to the last entry in the queue.
 /// @param command 
 void MQTT_InvokeCommandAtEnd(PostPublishCommands command) {
-	MqttPublishItem_t* tail = get_queue_tail(g_MqttPublishQueueHead);
-	if (tail == NULL){
+	int tail;
+
+	if (g_MqttPublishItemsQueued == 0) {
 		addLogAdv(LOG_ERROR, LOG_FEATURE_MQTT, "InvokeCommandAtEnd invoked but queue is empty");
+		return;
 	}
-	else {
-		tail->command = command;
-	}
+	// the command must run after everything that is pending, so it goes on the ring tail
+	tail = (g_MqttPublishQueueHead + g_MqttPublishItemsQueued - 1) % MQTT_MAX_QUEUE_SIZE;
+	g_MqttPublishQueue[tail].command = command;
 }
 
 /// @brief Queue an entry for publish.
@@ -2130,39 +2270,36 @@ void MQTT_QueuePublish(const char* topic, const char* channel, const char* value
 /// @return 
 OBK_Publish_Result PublishQueuedItems() {
 	OBK_Publish_Result result = OBK_PUBLISH_WAS_NOT_REQUIRED;
-
+	MqttPublishItem_t* head;
+	PostPublishCommands command;
 	int count = 0;
-	MqttPublishItem_t* head = g_MqttPublishQueueHead;
 
-	//The next actionable item might not be at the front. The queue size is limited to MQTT_QUEUED_ITEMS_PUBLISHED_AT_ONCE
-	//so this traversal is fast.
 	//addLogAdv(LOG_INFO,LOG_FEATURE_MQTT,"PublishQueuedItems g_MqttPublishItemsQueued=%i",g_MqttPublishItemsQueued );
-	while ((head != NULL) && (count < MQTT_QUEUED_ITEMS_PUBLISHED_AT_ONCE) && (g_MqttPublishItemsQueued > 0)) {
-		if (!MQTT_QUEUE_ITEM_IS_REUSABLE(head)) {  //Skip reusable entries
-			count++;
-			result = MQTT_PublishTopicToClient(mqtt_client, head->topic, head->channel, head->value, head->flags, false);
-			MQTT_QUEUE_ITEM_SET_REUSABLE(head); //Flag item as reusable
-			g_MqttPublishItemsQueued--;   //decrement queued count
-
-			//Stop if last publish failed
-			if (result != OBK_PUBLISH_OK) break;
-
-			switch (head->command) {
-			case None:
-				break;
-			case PublishAll:
-				MQTT_PublishWholeDeviceState_Internal(true);
-				break;
-			case PublishChannels:
-				MQTT_PublishOnlyDeviceChannelsIfPossible();
-				break;
-			}
-		}
-		else {
-			//addLogAdv(LOG_INFO,LOG_FEATURE_MQTT,"PublishQueuedItems item skipped reusable");
+	while ((count < MQTT_QUEUED_ITEMS_PUBLISHED_AT_ONCE) && (g_MqttPublishItemsQueued > 0)) {
+		head = &g_MqttPublishQueue[g_MqttPublishQueueHead];
+		count++;
+		result = MQTT_PublishTopicToClient(mqtt_client, head->topic, head->channel, head->value, head->flags, false);
+		command = head->command;
+		// dequeue before running the command, it may queue more items
+		g_MqttPublishQueueHead = (g_MqttPublishQueueHead + 1) % MQTT_MAX_QUEUE_SIZE;
+		g_MqttPublishItemsQueued--;
+
+		//Stop if last publish failed
+		if (result != OBK_PUBLISH_OK) break;
+
+		switch (command) {
+		case None:
+			break;
+		case PublishAll:
+			MQTT_PublishWholeDeviceState_Internal(true);
+			break;
+		case PublishChannels:
+			MQTT_PublishOnlyDeviceChannelsIfPossible();
+			break;
+		case HassDiscoveryPublished:
+			hass_discovery_on_published(head->channel);
+			break;
 		}
-
-		head = head->next;
 	}
 
 	return result;
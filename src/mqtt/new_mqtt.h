@@ -60,6 +60,8 @@ enum OBK_Publish_Result_e {
 #define OBK_PUBLISH_FLAG_MUTEX_SILENT			1
 #define OBK_PUBLISH_FLAG_RETAIN					2
 #define OBK_PUBLISH_FLAG_FORCE_REMOVE_GET		4
+// state broadcast (publishAll, connect, periodic), not filtered by generic deduper
+#define OBK_PUBLISH_FLAG_FORCE					8
 
 #include "new_mqtt_deduper.h"
 
@@ -78,7 +80,9 @@ typedef struct obk_mqtt_request_tag {
 typedef enum PostPublishCommands_e {
 	None,
 	PublishAll,
-	PublishChannels
+	PublishChannels,
+	// tells HA discovery that its entity went out
+	HassDiscoveryPublished
 } PostPublishCommands;
 
 
@@ -89,7 +93,6 @@ typedef struct MqttPublishItem
 	char channel[MQTT_PUBLISH_ITEM_CHANNEL_LENGTH];
 	char value[MQTT_PUBLISH_ITEM_VALUE_LENGTH];
 	int flags;
-	struct MqttPublishItem* next;
 	PostPublishCommands command;
 } MqttPublishItem_t;
 
@@ -99,7 +102,10 @@ typedef struct MqttPublishItem
 
 // Count of queued items published at once.
 #define MQTT_QUEUED_ITEMS_PUBLISHED_AT_ONCE	3
+// Capacity of the publish ring; pending items with the same topic/channel are coalesced.
+#ifndef MQTT_MAX_QUEUE_SIZE
 #define MQTT_MAX_QUEUE_SIZE	                7
+#endif
 
 // callback function for mqtt.
 // return 0 to allow the incoming topic/data to be processed by others/channel set.
@@ -114,7 +120,12 @@ const char* get_error_name(int err);
 int MQTT_GetConnectResult(void);
 char* MQTT_GetStatusMessage(void);
 int MQTT_GetPublishEventCounter(void);
+unsigned int MQTT_GetPublishedBytesCounter(void);
+int MQTT_GetPublishRate(void);
 int MQTT_GetPublishErrorCounter(void);
+int MQTT_GetQueueDepth(void);
+int MQTT_GetQueueDroppedCounter(void);
+int MQTT_GetQueueCoalescedCounter(void);
 int MQTT_GetReceivedEventCounter(void);
 
 OBK_Publish_Result PublishQueuedItems();
@@ -138,6 +149,8 @@ OBK_Publish_Result MQTT_DoItemPublish(int idx);
 OBK_Publish_Result MQTT_PublishMain_StringFloat(const char* sChannel, float f);
 OBK_Publish_Result MQTT_PublishMain_StringInt(const char* sChannel, int val);
 OBK_Publish_Result MQTT_PublishMain_StringString(const char* sChannel, const char* valueStr, int flags);
+OBK_Publish_Result MQTT_PublishMain_Int(const char* sChannel, int iVal, int flags, bool appendGet);
+OBK_Publish_Result MQTT_PublishMain_Float(const char* sChannel, float fVal, int flags, bool appendGet);
 void MQTT_PublishOnlyDeviceChannelsIfPossible();
 void MQTT_QueuePublish(const char* topic, const char* channel, const char* value, int flags);
 void MQTT_QueuePublishWithCommand(const char* topic, const char* channel, const char* value, int flags, PostPublishCommands command);
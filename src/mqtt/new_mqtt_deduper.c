@@ -35,9 +35,13 @@ static mqtt_dedup_slot_t *mqtt_dedups[DEDUP_MAX];
 static int stat_deduper_send = 0;
 static int stat_deduper_culled_duplicates = 0;
 static int stat_deduper_culled_tooFast = 0;
+static int stat_topicDedup_culled = 0;
+static int stat_topicDedup_delayed = 0;
 
 static SemaphoreHandle_t g_mutex = 0;
 
+static void MQTT_Dedup_TickTopics();
+
 
 static bool DD_Mutex_Take(int del) {
     int taken;
@@ -79,9 +83,11 @@ void MQTT_Dedup_Tick() {
 		}
 	}
 //	DD_Mutex_Free();
+	MQTT_Dedup_TickTopics();
 	if (CFG_HasLoggerFlag(LOGGER_FLAG_MQTT_DEDUPER)) {
-		ADDLOG_DEBUG(LOG_FEATURE_MQTT, "MQTT deduper sent %i, culled duplicates %i, culled too fast %i",
-			stat_deduper_send, stat_deduper_culled_duplicates, stat_deduper_culled_tooFast);
+		ADDLOG_DEBUG(LOG_FEATURE_MQTT, "MQTT deduper sent %i, culled duplicates %i, culled too fast %i, topics culled %i, topics delayed %i",
+			stat_deduper_send, stat_deduper_culled_duplicates, stat_deduper_culled_tooFast,
+			stat_topicDedup_culled, stat_topicDedup_delayed);
 	}
 
 }
@@ -151,3 +157,235 @@ OBK_Publish_Result MQTT_PublishMain_StringString_DeDuped(int slotCode, int expir
 	stat_deduper_send++;
 	return res;
 }
+
+// Generic deduper, open addressing table keyed by topic hash.
+// Size must be a power of two.
+#define DEDUP_TOPIC_TABLE_SIZE 32
+
+typedef struct mqtt_topicDedup_s {
+	unsigned int hash;
+	char name[DEDUPER_MAX_STRING_LEN];
+	// do not send this topic more often than that, in seconds; newest value is sent later
+	short minInterval;
+	byte bUsed;
+	byte bHasLastValue;
+	byte bPending;
+	byte bPendingFloat;
+	// value change smaller or equal to that is not published
+	float deadbandAbs;
+	// same as above, but in percent of last sent value
+	float deadbandPct;
+	float lastValue;
+	float pendingValue;
+	int pendingFlags;
+	int timeSinceLastSend;
+} mqtt_topicDedup_t;
+
+static mqtt_topicDedup_t *g_topicDedups = 0;
+static int g_topicDedupsUsed = 0;
+static byte g_topicDedupHasDefault = 0;
+static mqtt_topicDedup_t g_topicDedupDefault;
+
+unsigned int MQTT_Dedup_HashTopic(const char* name) {
+	// FNV-1a
+	unsigned int h = 2166136261u;
+	while (*name) {
+		h ^= (byte)*name;
+		h *= 16777619u;
+		name++;
+	}
+	return h;
+}
+bool MQTT_Dedup_IsActive() {
+	return g_topicDedupsUsed > 0 || g_topicDedupHasDefault;
+}
+int MQTT_Dedup_GetCulledCounter() {
+	return stat_topicDedup_culled;
+}
+void MQTT_Dedup_ClearRules() {
+	if (g_topicDedups) {
+		free(g_topicDedups);
+		g_topicDedups = 0;
+	}
+	g_topicDedupsUsed = 0;
+	g_topicDedupHasDefault = 0;
+}
+// returns matching entry or, if bCreate is set, a fresh one
+static mqtt_topicDedup_t* MQTT_Dedup_FindTopic(unsigned int hash, const char* name, bool bCreate) {
+	int i, idx;
+	mqtt_topicDedup_t* e;
+
+	if (g_topicDedups == 0) {
+		if (bCreate == false) {
+			return 0;
+		}
+		g_topicDedups = malloc(sizeof(mqtt_topicDedup_t) * DEDUP_TOPIC_TABLE_SIZE);
+		if (g_topicDedups == 0) {
+			return 0;
+		}
+		memset(g_topicDedups, 0, sizeof(mqtt_topicDedup_t) * DEDUP_TOPIC_TABLE_SIZE);
+	}
+	for (i = 0; i < DEDUP_TOPIC_TABLE_SIZE; i++) {
+		idx = (hash + i) & (DEDUP_TOPIC_TABLE_SIZE - 1);
+		e = &g_topicDedups[idx];
+		if (e->bUsed == 0) {
+			// entries are never removed one by one, so first free slot ends the probe
+			if (bCreate == false) {
+				return 0;
+			}
+			// keep at least one slot free so that failed lookups terminate early
+			if (g_topicDedupsUsed >= DEDUP_TOPIC_TABLE_SIZE - 1) {
+				return 0;
+			}
+			e->bUsed = 1;
+			e->hash = hash;
+			strcpy_safe(e->name, name, DEDUPER_MAX_STRING_LEN);
+			e->timeSinceLastSend = 999;
+			g_topicDedupsUsed++;
+			return e;
+		}
+		if (e->hash == hash && !strcmp(e->name, name)) {
+			return e;
+		}
+	}
+	return 0;
+}
+bool MQTT_Dedup_Filter(unsigned int hash, const char* name, float value, bool bFloat, int flags) {
+	mqtt_topicDedup_t* e;
+	float diff;
+
+	e = MQTT_Dedup_FindTopic(hash, name, false);
+	if (flags & OBK_PUBLISH_FLAG_FORCE) {
+		if (e) {
+			e->bPending = 0;
+			e->bHasLastValue = 1;
+			e->lastValue = value;
+			e->timeSinceLastSend = 0;
+		}
+		return true;
+	}
+	if (e == 0) {
+		if (g_topicDedupHasDefault == 0) {
+			return true;
+		}
+		e = MQTT_Dedup_FindTopic(hash, name, true);
+		if (e == 0) {
+			// table full, do not filter
+			return true;
+		}
+		e->minInterval = g_topicDedupDefault.minInterval;
+		e->deadbandAbs = g_topicDedupDefault.deadbandAbs;
+		e->deadbandPct = g_topicDedupDefault.deadbandPct;
+	}
+	if (e->bHasLastValue) {
+		diff = value - e->lastValue;
+		if (diff < 0)
+			diff = -diff;
+		if ((e->deadbandAbs > 0 && diff <= e->deadbandAbs) ||
+			(e->deadbandPct > 0 && diff * 100.0f <= e->deadbandPct * (e->lastValue < 0 ? -e->lastValue : e->lastValue))) {
+			// back within deadband of the last sent value, so there is nothing worth sending later
+			e->bPending = 0;
+			stat_topicDedup_culled++;
+			return false;
+		}
+	}
+	if (e->minInterval > e->timeSinceLastSend) {
+		e->pendingValue = value;
+		e->bPendingFloat = bFloat;
+		e->pendingFlags = flags;
+		e->bPending = 1;
+		stat_topicDedup_delayed++;
+		return false;
+	}
+	e->bPending = 0;
+	e->bHasLastValue = 1;
+	e->lastValue = value;
+	e->timeSinceLastSend = 0;
+	return true;
+}
+OBK_Publish_Result MQTT_PublishMain_StringFloat_Filtered(unsigned int hash, const char* sChannel, float val, int flags) {
+	if (MQTT_Dedup_IsActive()) {
+		if (hash == MQTT_DEDUP_HASH_LATER)
+			hash = MQTT_Dedup_HashTopic(sChannel);
+		if (MQTT_Dedup_Filter(hash, sChannel, val, true, flags) == false)
+			return OBK_PUBLISH_WAS_NOT_REQUIRED;
+	}
+	return MQTT_PublishMain_Float(sChannel, val, flags & ~OBK_PUBLISH_FLAG_FORCE, true);
+}
+OBK_Publish_Result MQTT_PublishMain_StringInt_Filtered(unsigned int hash, const char* sChannel, int val, int flags) {
+	if (MQTT_Dedup_IsActive()) {
+		if (hash == MQTT_DEDUP_HASH_LATER)
+			hash = MQTT_Dedup_HashTopic(sChannel);
+		if (MQTT_Dedup_Filter(hash, sChannel, val, false, flags) == false)
+			return OBK_PUBLISH_WAS_NOT_REQUIRED;
+	}
+	return MQTT_PublishMain_Int(sChannel, val, flags & ~OBK_PUBLISH_FLAG_FORCE, true);
+}
+static void MQTT_Dedup_TickTopics() {
+	int i;
+	mqtt_topicDedup_t* e;
+
+	if (g_topicDedups == 0)
+		return;
+	for (i = 0; i < DEDUP_TOPIC_TABLE_SIZE; i++) {
+		e = &g_topicDedups[i];
+		if (e->bUsed == 0)
+			continue;
+		e->timeSinceLastSend++;
+		if (e->bPending && e->timeSinceLastSend >= e->minInterval) {
+			// send the newest value that was held back by minimal interval
+			e->bPending = 0;
+			e->bHasLastValue = 1;
+			e->lastValue = e->pendingValue;
+			e->timeSinceLastSend = 0;
+			if (e->bPendingFloat) {
+				MQTT_PublishMain_Float(e->name, e->pendingValue, e->pendingFlags, true);
+			}
+			else {
+				MQTT_PublishMain_Int(e->name, (int)e->pendingValue, e->pendingFlags, true);
+			}
+		}
+	}
+}
+// mqttDedup [TopicName or *] [MinIntervalSeconds] [DeadbandAbsolute] [DeadbandPercent]
+static commandResult_t MQTT_Dedup_RuleCommand(const void* context, const char* cmd, const char* args, int cmdFlags) {
+	const char* name;
+	mqtt_topicDedup_t* e;
+
+	Tokenizer_TokenizeString(args, 0);
+	// following check must be done after 'Tokenizer_TokenizeString',
+	// so we know arguments count in Tokenizer. 'cmd' argument is
+	// only for warning display
+	if (Tokenizer_CheckArgsCountAndPrintWarning(cmd, 2)) {
+		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
+	}
+	name = Tokenizer_GetArg(0);
+	if (!strcmp(name, "*")) {
+		e = &g_topicDedupDefault;
+		g_topicDedupHasDefault = 1;
+	}
+	else {
+		e = MQTT_Dedup_FindTopic(MQTT_Dedup_HashTopic(name), name, true);
+		if (e == 0) {
+			ADDLOG_ERROR(LOG_FEATURE_MQTT, "mqttDedup: no free slot for %s", name);
+			return CMD_RES_ERROR;
+		}
+	}
+	e->minInterval = Tokenizer_GetArgInteger(1);
+	e->deadbandAbs = 0;
+	e->deadbandPct = 0;
+	if (Tokenizer_GetArgsCount() > 2) {
+		e->deadbandAbs = Tokenizer_GetArgFloat(2);
+	}
+	if (Tokenizer_GetArgsCount() > 3) {
+		e->deadbandPct = Tokenizer_GetArgFloat(3);
+	}
+	return CMD_RES_OK;
+}
+void MQTT_Dedup_InitCommands() {
+	//cmddetail:{"name":"mqttDedup","args":"[TopicName][MinIntervalSeconds][DeadbandAbsolute][DeadbandPercent]",
+	//cmddetail:"descr":"Sets publish filter for given topic name (channel index, sensor name or publishInt/publishFloat topic). Numeric value is not published if it changed by no more than absolute or percentage deadband since last publish. Values coming faster than MinIntervalSeconds are held and only the newest one is sent later. Use * as TopicName to set the default for all filtered topics.",
+	//cmddetail:"fn":"MQTT_Dedup_RuleCommand","file":"mqtt/new_mqtt_deduper.c","requires":"",
+	//cmddetail:"examples":"mqttDedup voltage 5 0.5"}
+	CMD_RegisterCommand("mqttDedup", MQTT_Dedup_RuleCommand, NULL);
+}
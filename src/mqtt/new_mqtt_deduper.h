@@ -1,7 +1,7 @@
 
 
-// i didn't choose the "automatic, per string name" approach because it would be slower
-// I think we only need to dedup the built-in MQTT publishes, which can be listed here and defined as constants
+// Built-in LED publishes use fixed slots below.
+// Arbitrary topics (channels, sensors, scripts) use the generic, hash keyed table, see MQTT_Dedup_Filter.
 typedef enum MQTT_Dedup_Slot_e {
 	DEDUP_LED_BASECOLOR_RGB,
 	DEDUP_LED_FINALCOLOR_RGB,
@@ -19,3 +19,20 @@ typedef enum MQTT_Dedup_Slot_e {
 OBK_Publish_Result MQTT_PublishMain_StringString_DeDuped(int slotCode, int expireTime, const char* sChannel, const char* valueStr, int flags);
 OBK_Publish_Result MQTT_PublishMain_StringInt_DeDuped(int slotCode, int expireTime, const char* sChannel, int val, int flags);
 void MQTT_Dedup_Tick();
+
+// Generic deduper for arbitrary topics.
+// Topics are keyed by MQTT_Dedup_HashTopic(name); callers publishing often should compute it once.
+// A topic is filtered only if it has a rule (or a default rule '*' exists), see mqttDedup command.
+unsigned int MQTT_Dedup_HashTopic(const char* name);
+// returns true if at least one rule is configured - cheap check before hashing
+bool MQTT_Dedup_IsActive();
+// returns true if value should be published now, false if it was culled or delayed (delayed values are sent by MQTT_Dedup_Tick).
+// With OBK_PUBLISH_FLAG_FORCE value always goes out and becomes the new reference value.
+bool MQTT_Dedup_Filter(unsigned int hash, const char* name, float value, bool bFloat, int flags);
+// hash may be MQTT_DEDUP_HASH_LATER, then it's computed only if deduper is active
+#define MQTT_DEDUP_HASH_LATER	0
+OBK_Publish_Result MQTT_PublishMain_StringFloat_Filtered(unsigned int hash, const char* sChannel, float val, int flags);
+OBK_Publish_Result MQTT_PublishMain_StringInt_Filtered(unsigned int hash, const char* sChannel, int val, int flags);
+void MQTT_Dedup_ClearRules();
+int MQTT_Dedup_GetCulledCounter();
+void MQTT_Dedup_InitCommands();
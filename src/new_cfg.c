@@ -75,6 +75,7 @@ void CFG_MarkAsDirty() {
 }
 void CFG_ClearIO() {
 	memset(&g_cfg.pins, 0, sizeof(g_cfg.pins));
+	PIN_MarkTickListsDirty();
 	g_cfg_pendingChanges++;
 }
 void CFG_SetDefaultConfig() {
@@ -90,6 +91,7 @@ void CFG_SetDefaultConfig() {
 	g_configInitialized = 1;
 
 	memset(&g_cfg,0,sizeof(mainConfig_t));
+	PIN_MarkTickListsDirty();
 	g_cfg.version = MAIN_CFG_VERSION;
 	g_cfg.mqtt_port = 1883;
 	g_cfg.ident0 = CFG_IDENT_0;
@@ -371,6 +373,7 @@ void CFG_SetMQTTPass(const char *s) {
 }
 void CFG_ClearPins() {
 	memset(&g_cfg.pins,0,sizeof(g_cfg.pins));
+	PIN_MarkTickListsDirty();
 	g_cfg_pendingChanges++;
 }
 void CFG_IncrementOTACount() {
@@ -606,6 +609,7 @@ void CFG_InitAndLoad() {
 	byte chkSum;
 
 	HAL_Configuration_ReadConfigMemory(&g_cfg,sizeof(g_cfg));
+	PIN_MarkTickListsDirty();
 	chkSum = CFG_CalcChecksum(&g_cfg);
 	if(g_cfg.ident0 != CFG_IDENT_0 || g_cfg.ident1 != CFG_IDENT_1 || g_cfg.ident2 != CFG_IDENT_2
 		|| chkSum != g_cfg.crc) {
@@ -696,6 +696,7 @@ void PIN_SetPinRoleForPinIndex(int index, int role) {
 		}
 		g_cfg.pins.roles[index] = role;
 		g_cfg_pendingChanges++;
+		PIN_MarkTickListsDirty();
 	}
 
 	if (g_enable_pins) {
@@ -1535,9 +1536,75 @@ static uint32_t g_last_time = 0;
 static int activepoll_time = 0; // time to keep polling active until
 
 //  background ticks, timer repeat invoking interval defined by PIN_TMR_DURATION.
+// Pins grouped by what PIN_ticks has to do with them, so the tick does not
+// have to test every pin against every role. Rebuilt lazily after role changes.
+enum {
+	PIN_TICK_PWM,
+	PIN_TICK_BUTTON,
+	PIN_TICK_DIGITAL_INPUT,
+	PIN_TICK_TOGGLE,
+	PIN_TICK_CLASSES,
+};
+static byte g_tickPins[PIN_TICK_CLASSES][PLATFORM_GPIO_MAX];
+static byte g_tickPinsCount[PIN_TICK_CLASSES];
+static byte g_tickPinsDirty = 1;
+// last value sent to HAL_PIN_PWM_Update
+static float g_tickPWMValues[PLATFORM_GPIO_MAX];
+
+static int PIN_GetTickClassForRole(int role) {
+	switch (role) {
+	case IOR_PWM:
+	case IOR_PWM_n:
+		return PIN_TICK_PWM;
+	case IOR_Button:
+	case IOR_Button_n:
+	case IOR_Button_ToggleAll:
+	case IOR_Button_ToggleAll_n:
+	case IOR_Button_NextColor:
+	case IOR_Button_NextColor_n:
+	case IOR_Button_NextDimmer:
+	case IOR_Button_NextDimmer_n:
+	case IOR_Button_NextTemperature:
+	case IOR_Button_NextTemperature_n:
+	case IOR_Button_ScriptOnly:
+	case IOR_Button_ScriptOnly_n:
+	case IOR_SmartButtonForLEDs:
+	case IOR_SmartButtonForLEDs_n:
+		return PIN_TICK_BUTTON;
+	case IOR_DigitalInput:
+	case IOR_DigitalInput_n:
+	case IOR_DigitalInput_NoPup:
+	case IOR_DigitalInput_NoPup_n:
+	case IOR_DoorSensorWithDeepSleep:
+	case IOR_DoorSensorWithDeepSleep_NoPup:
+	case IOR_DoorSensorWithDeepSleep_pd:
+		return PIN_TICK_DIGITAL_INPUT;
+	case IOR_ToggleChannelOnToggle:
+		return PIN_TICK_TOGGLE;
+	}
+	return -1;
+}
+// call after roles were changed without PIN_SetPinRoleForPinIndex (config cleared, loaded, etc)
+void PIN_MarkTickListsDirty() {
+	g_tickPinsDirty = 1;
+}
+static void PIN_RebuildTickLists() {
+	int i, c;
+
+	memset(g_tickPinsCount, 0, sizeof(g_tickPinsCount));
+	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
+		// force PWM refresh on next tick
+		g_tickPWMValues[i] = -1;
+		c = PIN_GetTickClassForRole(g_cfg.pins.roles[i]);
+		if (c >= 0) {
+			g_tickPins[c][g_tickPinsCount[c]++] = i;
+		}
+	}
+	g_tickPinsDirty = 0;
+}
 void PIN_ticks(void* param)
 {
-	int i;
+	int i, j;
 	int value;
 
 #if defined(PLATFORM_BEKEN) || defined(WINDOWS)
@@ -1567,137 +1634,113 @@ void PIN_ticks(void* param)
 	int activepins = 0;
 	uint32_t pinvalues[2] = { 0, 0 };
 
-	for (i = 0; i < PLATFORM_GPIO_MAX; i++)
-	{
-		// note pins which are active - i.e. would not trigger an edge interrupt on change.
-		// if we have any, then we must poll until none
-		// TODO: this will only be used when GPI interrupt triggeringis used.
-		// but it's useful info anyway...
+	if (g_tickPinsDirty) {
+		PIN_RebuildTickLists();
+	}
 
-		if (i >= 32)
+	// note pins which are active - i.e. would not trigger an edge interrupt on change.
+	// if we have any, then we must poll until none
+	// TODO: this will only be used when GPI interrupt triggeringis used.
+	// but it's useful info anyway...
+	if (g_gpio_index_map[0] | g_gpio_index_map[1]) {
+		for (i = 0; i < PLATFORM_GPIO_MAX; i++)
 		{
-			if (g_gpio_index_map[1] & (1 << (i - 32)))
-			{
-				uint32_t level = 1;
-				if (g_gpio_edge_map[1] & (1 << (i - 32))) {
-					level = 0;
-				}
-				int rawval = HAL_PIN_ReadDigitalInput(i);
-				if (rawval && level == 1) {
-					activepins++;
-					pinvalues[1] |= (1 << (i - 32));
-				}
-				if (!rawval && level == 0) {
-					activepins++;
-					pinvalues[1] |= (1 << (i - 32));
-				}
-			}
-		}
-		else {
-			if (g_gpio_index_map[0] & (1 << i))
+			uint32_t bit = 1 << (i % 32);
+			int word = i / 32;
+			if (g_gpio_index_map[word] & bit)
 			{
 				uint32_t level = 1;
-				if (g_gpio_edge_map[0] & (1 << i)) {
+				if (g_gpio_edge_map[word] & bit) {
 					level = 0;
 				}
 				int rawval = HAL_PIN_ReadDigitalInput(i);
 				if (rawval && level == 1) {
 					activepins++;
-					pinvalues[0] |= (1 << i);
+					pinvalues[word] |= bit;
 				}
 				if (!rawval && level == 0) {
 					activepins++;
-					pinvalues[0] |= (1 << i);
+					pinvalues[word] |= bit;
 				}
 			}
 		}
-
 		// activepins is count of pins which are 'active', i.e. match thier expected active level
 		if (activepins) {
 			activepoll_time = 1000; //20 x 50ms = 1s of polls after button release
 		}
+	}
 
-#if 1
-		if (g_cfg.pins.roles[i] == IOR_PWM) {
-			HAL_PIN_PWM_Update(i, g_channelValuesFloats[g_cfg.pins.channels[i]]);
-		}
-		else if (g_cfg.pins.roles[i] == IOR_PWM_n) {
+	// PWM - only touch hardware when value has changed
+	for (j = 0; j < g_tickPinsCount[PIN_TICK_PWM]; j++) {
+		float f;
+		i = g_tickPins[PIN_TICK_PWM][j];
+		f = g_channelValuesFloats[g_cfg.pins.channels[i]];
+		if (g_cfg.pins.roles[i] == IOR_PWM_n) {
 			// invert PWM value
-			HAL_PIN_PWM_Update(i, 100 - g_channelValuesFloats[g_cfg.pins.channels[i]]);
+			f = 100 - f;
 		}
-		else
-#endif
-			if (g_cfg.pins.roles[i] == IOR_Button || g_cfg.pins.roles[i] == IOR_Button_n
-				|| g_cfg.pins.roles[i] == IOR_Button_ToggleAll || g_cfg.pins.roles[i] == IOR_Button_ToggleAll_n
-				|| g_cfg.pins.roles[i] == IOR_Button_NextColor || g_cfg.pins.roles[i] == IOR_Button_NextColor_n
-				|| g_cfg.pins.roles[i] == IOR_Button_NextDimmer || g_cfg.pins.roles[i] == IOR_Button_NextDimmer_n
-				|| g_cfg.pins.roles[i] == IOR_Button_NextTemperature || g_cfg.pins.roles[i] == IOR_Button_NextTemperature_n
-				|| g_cfg.pins.roles[i] == IOR_Button_ScriptOnly || g_cfg.pins.roles[i] == IOR_Button_ScriptOnly_n
-				|| g_cfg.pins.roles[i] == IOR_SmartButtonForLEDs || g_cfg.pins.roles[i] == IOR_SmartButtonForLEDs_n) {
-				//addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL,"Test hold %i\r\n",i);
-				PIN_Input_Handler(i, t_diff);
-			}
-			else if (g_cfg.pins.roles[i] == IOR_DigitalInput || g_cfg.pins.roles[i] == IOR_DigitalInput_n
-				||
-				g_cfg.pins.roles[i] == IOR_DigitalInput_NoPup || g_cfg.pins.roles[i] == IOR_DigitalInput_NoPup_n
-				|| g_cfg.pins.roles[i] == IOR_DoorSensorWithDeepSleep || g_cfg.pins.roles[i] == IOR_DoorSensorWithDeepSleep_NoPup
-				|| g_cfg.pins.roles[i] == IOR_DoorSensorWithDeepSleep_pd) {
-				// read pin digital value (and already invert it if needed)
-				value = PIN_ReadDigitalInputValue_WithInversionIncluded(i);
+		if (f != g_tickPWMValues[i]) {
+			g_tickPWMValues[i] = f;
+			HAL_PIN_PWM_Update(i, f);
+		}
+	}
+	for (j = 0; j < g_tickPinsCount[PIN_TICK_BUTTON]; j++) {
+		//addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL,"Test hold %i\r\n",i);
+		PIN_Input_Handler(g_tickPins[PIN_TICK_BUTTON][j], t_diff);
+	}
+	for (j = 0; j < g_tickPinsCount[PIN_TICK_DIGITAL_INPUT]; j++) {
+		i = g_tickPins[PIN_TICK_DIGITAL_INPUT][j];
+		// read pin digital value (and already invert it if needed)
+		value = PIN_ReadDigitalInputValue_WithInversionIncluded(i);
 
-#if 0
-				CHANNEL_Set(g_cfg.pins.channels[i], value, 0);
-#else
-				// debouncing
-				if (value) {
-					if (g_times[i] > debounceMS) {
-						if (g_lastValidState[i] != value) {
-							// became up
-							g_lastValidState[i] = value;
-							CHANNEL_Set(g_cfg.pins.channels[i], value, 0);
-						}
-					}
-					else {
-						g_times[i] += t_diff;
-					}
-					g_times2[i] = 0;
-				}
-				else {
-					if (g_times2[i] > debounceMS) {
-						if (g_lastValidState[i] != value) {
-							// became down
-							g_lastValidState[i] = value;
-							CHANNEL_Set(g_cfg.pins.channels[i], value, 0);
-						}
-					}
-					else {
-						g_times2[i] += t_diff;
-					}
-					g_times[i] = 0;
+		// debouncing
+		if (value) {
+			if (g_times[i] > debounceMS) {
+				if (g_lastValidState[i] != value) {
+					// became up
+					g_lastValidState[i] = value;
+					CHANNEL_Set(g_cfg.pins.channels[i], value, 0);
 				}
-
-#endif
 			}
-			else if (g_cfg.pins.roles[i] == IOR_ToggleChannelOnToggle) {
-				// we must detect a toggle, but with debouncing
-				value = PIN_ReadDigitalInputValue_WithInversionIncluded(i);
-				// debouncing
-				if (g_times[i] <= 0) {
-					if (g_lastValidState[i] != value) {
-						// became up
-						g_lastValidState[i] = value;
-						CHANNEL_Toggle(g_cfg.pins.channels[i]);
-						// fire event - IOR_ToggleChannelOnToggle has been toggle
-						// Argument is a pin number (NOT channel)
-						EventHandlers_FireEvent(CMD_EVENT_PIN_ONTOGGLE, i);
-						// lock for given time
-						g_times[i] = debounceMS;
-					}
-				}
-				else {
-					g_times[i] -= t_diff;
+			else {
+				g_times[i] += t_diff;
+			}
+			g_times2[i] = 0;
+		}
+		else {
+			if (g_times2[i] > debounceMS) {
+				if (g_lastValidState[i] != value) {
+					// became down
+					g_lastValidState[i] = value;
+					CHANNEL_Set(g_cfg.pins.channels[i], value, 0);
 				}
 			}
+			else {
+				g_times2[i] += t_diff;
+			}
+			g_times[i] = 0;
+		}
+	}
+	for (j = 0; j < g_tickPinsCount[PIN_TICK_TOGGLE]; j++) {
+		i = g_tickPins[PIN_TICK_TOGGLE][j];
+		// we must detect a toggle, but with debouncing
+		value = PIN_ReadDigitalInputValue_WithInversionIncluded(i);
+		// debouncing
+		if (g_times[i] <= 0) {
+			if (g_lastValidState[i] != value) {
+				// became up
+				g_lastValidState[i] = value;
+				CHANNEL_Toggle(g_cfg.pins.channels[i]);
+				// fire event - IOR_ToggleChannelOnToggle has been toggle
+				// Argument is a pin number (NOT channel)
+				EventHandlers_FireEvent(CMD_EVENT_PIN_ONTOGGLE, i);
+				// lock for given time
+				g_times[i] = debounceMS;
+			}
+		}
+		else {
+			g_times[i] -= t_diff;
+		}
 	}
 
 #ifdef PLATFORM_BEKEN
@@ -1031,6 +1031,7 @@ extern byte g_defaultDoorWakeEdge;
 #define CHANNEL_SET_FLAG_SILENT		4
 
 void PIN_ticks(void* param);
+void PIN_MarkTickListsDirty();
 
 void PIN_set_wifi_led(int value);
 void PIN_AddCommands(void);
@@ -39,6 +39,8 @@
 #define ENABLE_DRIVER_BL0942SPI 1
 #define ENABLE_DRIVER_CSE7766   1
 #define ENABLE_DRIVER_TUYAMCU   1
+// I2C1/I2C2 go to fake bus
+#define ENABLE_I2C			    1
 #define ENABLE_TEST_COMMANDS	1
 #define ENABLE_CALENDAR_EVENTS	1
 #define ENABLE_TEST_DRIVERS		1
@@ -1,8 +1,79 @@
 #ifdef WINDOWS
 
-#include "selftest_local.h".
+#include "selftest_local.h"
+#include "../driver/drv_dht_internal.h"
+
+static uint32_t g_edges[64];
+static int g_edgeCount;
+
+// Falling edges of a sensor answer: response, 40 bits, end.
+// lowUs is the low part of every bit, jitter is added to every second high part.
+static void Test_DHT_BuildTrace(const byte *d, int lowUs, int zeroUs, int oneUs, int jitter) {
+	uint32_t us;
+	int i;
+
+	g_edgeCount = 0;
+	us = 123456;
+	g_edges[g_edgeCount++] = us;
+	us += 160;
+	for (i = 0; i < 40; i++) {
+		g_edges[g_edgeCount++] = us;
+		us += lowUs + ((d[i / 8] >> (7 - i % 8)) & 1 ? oneUs : zeroUs) + (i & 1) * jitter;
+	}
+	g_edges[g_edgeCount++] = us;
+}
+static void Test_DHT_Decoder() {
+	byte d[5] = { 0x02, 0x8C, 0x01, 0x5F, 0 };
+	byte out[5];
+	int i;
+
+	d[4] = d[0] + d[1] + d[2] + d[3];
+
+	// DHT22 nominal timings
+	Test_DHT_BuildTrace(d, 50, 27, 70, 0);
+	SELFTEST_ASSERT(g_edgeCount == DHT_EDGES_PER_READ);
+	SELFTEST_ASSERT(DHT_DecodeEdges(g_edges, g_edgeCount, out) == DHT_DECODE_OK);
+	SELFTEST_ASSERT(!memcmp(out, d, 5));
+
+	// DHT11 is slower and interrupt latency adds jitter
+	Test_DHT_BuildTrace(d, 54, 24, 75, 8);
+	SELFTEST_ASSERT(DHT_DecodeEdges(g_edges, g_edgeCount, out) == DHT_DECODE_OK);
+	SELFTEST_ASSERT(!memcmp(out, d, 5));
+
+	// response edge was missed because interrupt was enabled late
+	Test_DHT_BuildTrace(d, 50, 27, 70, 0);
+	SELFTEST_ASSERT(DHT_DecodeEdges(g_edges + 1, g_edgeCount - 1, out) == DHT_DECODE_OK);
+	SELFTEST_ASSERT(!memcmp(out, d, 5));
+
+	// glitches on line release are before the answer
+	Test_DHT_BuildTrace(d, 50, 27, 70, 0);
+	memmove(g_edges + 2, g_edges, g_edgeCount * sizeof(g_edges[0]));
+	g_edges[0] = g_edges[2] - 300;
+	g_edges[1] = g_edges[2] - 290;
+	SELFTEST_ASSERT(DHT_DecodeEdges(g_edges, g_edgeCount + 2, out) == DHT_DECODE_OK);
+	SELFTEST_ASSERT(!memcmp(out, d, 5));
+
+	// no answer at all, or it was cut short
+	SELFTEST_ASSERT(DHT_DecodeEdges(g_edges, 0, out) == DHT_DECODE_TOO_FEW_EDGES);
+	Test_DHT_BuildTrace(d, 50, 27, 70, 0);
+	SELFTEST_ASSERT(DHT_DecodeEdges(g_edges, 40, out) == DHT_DECODE_TOO_FEW_EDGES);
+
+	// a lost edge merges two bits into one too long period
+	Test_DHT_BuildTrace(d, 50, 27, 70, 0);
+	memmove(g_edges + 10, g_edges + 11, (g_edgeCount - 11) * sizeof(g_edges[0]));
+	SELFTEST_ASSERT(DHT_DecodeEdges(g_edges, g_edgeCount - 1, out) == DHT_DECODE_BAD_PULSE);
+
+	// bit flipped by noise is caught by checksum
+	Test_DHT_BuildTrace(d, 50, 27, 70, 0);
+	for (i = 20; i < g_edgeCount; i++) {
+		g_edges[i] += 43;
+	}
+	SELFTEST_ASSERT(DHT_DecodeEdges(g_edges, g_edgeCount, out) == DHT_DECODE_CHECKSUM);
+}
 
 void Test_DHT() {
+	Test_DHT_Decoder();
+
 	// reset whole device
 	SIM_ClearOBK(0);
 
@@ -15,9 +86,22 @@ void Test_DHT() {
 	SELFTEST_ASSERT_CHANNEL(1, 190);
 	SELFTEST_ASSERT_CHANNEL(2, 67);
 
+	// second sensor in other format is read in its own second
+	PIN_SetPinRoleForPinIndex(10, IOR_DHT22);
+	PIN_SetPinChannelForPinIndex(10, 3);
+	PIN_SetPinChannel2ForPinIndex(10, 4);
+
+	Sim_RunSeconds(5.0f, false);
+
+	SELFTEST_ASSERT_CHANNEL(1, 190);
+	SELFTEST_ASSERT_CHANNEL(2, 67);
+	SELFTEST_ASSERT_CHANNEL(3, 190);
+	SELFTEST_ASSERT_CHANNEL(4, 67);
+
 	PIN_SetPinRoleForPinIndex(9, IOR_None);
 	PIN_SetPinChannelForPinIndex(9, 1);
 	PIN_SetPinChannel2ForPinIndex(9, 2);
+	PIN_SetPinRoleForPinIndex(10, IOR_None);
 
 	Sim_RunSeconds(5.0f, false);
 }
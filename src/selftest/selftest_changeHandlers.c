@@ -100,6 +100,24 @@ void Test_ChangeHandlers() {
 	SELFTEST_ASSERT_CHANNEL(7, 2);
 	SELFTEST_ASSERT_CHANNEL(8, 8);
 
+	// handlers for channels 1 and 9 share the same argument hash slot,
+	// only the matching one must run
+	CMD_ExecuteCommand("clearAllHandlers", 0);
+	SELFTEST_ASSERT(EventHandlers_GetActiveCount() == 0);
+	CMD_ExecuteCommand("addEventHandler OnChannelChange 1 addChannel 20 1", 0);
+	CMD_ExecuteCommand("addEventHandler OnChannelChange 9 addChannel 21 1", 0);
+	CMD_ExecuteCommand("addChangeHandler Channel9 > 5 addChannel 22 1", 0);
+	SELFTEST_ASSERT(EventHandlers_GetActiveCount() == 3);
+	CMD_ExecuteCommand("setChannel 1 1", 0);
+	SELFTEST_ASSERT_CHANNEL(20, 1);
+	SELFTEST_ASSERT_CHANNEL(21, 0);
+	SELFTEST_ASSERT_CHANNEL(22, 0);
+	CMD_ExecuteCommand("setChannel 9 6", 0);
+	SELFTEST_ASSERT_CHANNEL(20, 1);
+	SELFTEST_ASSERT_CHANNEL(21, 1);
+	SELFTEST_ASSERT_CHANNEL(22, 1);
+	CMD_ExecuteCommand("listEventHandlers", 0);
+
 	SIM_ClearMQTTHistory();
 
 }
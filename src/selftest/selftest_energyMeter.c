@@ -1,6 +1,12 @@
 #ifdef WINDOWS
 
 #include "selftest_local.h"
+#include "../cJSON/cJSON.h"
+#include "../driver/drv_ntp.h"
+#include "../driver/drv_public.h"
+#include "../hal/hal_flashVars.h"
+
+cJSON *Test_GetJSONValue_Generic(const char *keyword, const char *obj);
 
 void Test_EnergyMeter_Basic() {
 	SIM_ClearOBK(0);
@@ -75,9 +81,110 @@ void Test_EnergyMeter_Tasmota() {
 
 	SIM_ClearMQTTHistory();
 }
+static float Test_EnergyMeter_GetHistory(const char *name, int age) {
+	cJSON *arr;
+
+	arr = Test_GetJSONValue_Generic(name, "");
+	if (arr == 0 || cJSON_GetArraySize(arr) <= age)
+		return -1;
+	return cJSON_GetArrayItem(arr, age)->valuedouble;
+}
+// 1kW for 50 hours, with one second updates, just like real BL0942
+void Test_EnergyMeter_Integrator() {
+	int i, start, seconds;
+	double expected, total, oldFloatError;
+	float oldFloatCounter;
+
+	SIM_ClearOBK(0);
+	CMD_ExecuteCommand("startDriver TESTPOWER", 0);
+	CMD_ExecuteCommand("SetupTestPower 230 4.35 1000 0", 0);
+	CMD_ExecuteCommand("startDriver NTP", 0);
+	// 2022-11-01 12:00 UTC, so local midnight is far from start in every time zone used for tests
+	NTP_SetSimulatedTime(1667304000);
+	CMD_ExecuteCommand("SetupEnergyHistory 48 7", 0);
+	Sim_RunSeconds(2, false);
+	CMD_ExecuteCommand("EnergyCntReset", 0);
+	start = rtos_get_time();
+
+	seconds = 50 * 3600;
+	oldFloatCounter = 0;
+	for (i = 0; i < seconds; i++) {
+		Sim_RunFrame(1000);
+		// that's how the counter was kept before
+		oldFloatCounter += 1000.0f * 1000.0f / 3600000.0f;
+	}
+	// last update could be a frame before now
+	expected = (rtos_get_time() - start) * 1000.0 / 3600000.0;
+
+	Test_FakeHTTPClientPacket_JSON("api/energy");
+	total = Test_GetJSONValue_Generic("total", "")->valuedouble;
+	oldFloatError = oldFloatCounter - (seconds * 1000.0 / 3600.0);
+	printf("Test_EnergyMeter_Integrator: %f Wh, expected %f Wh, float counter error would be %f Wh\n",
+		total, expected, oldFloatError);
+	// remainder is carried exactly, so at most the last partial mWh is missing
+	SELFTEST_ASSERT(total <= expected + 0.0005);
+	SELFTEST_ASSERT(total > expected - 0.001);
+
+	// hour before the current one
+	SELFTEST_ASSERT(fabs(Test_EnergyMeter_GetHistory("hours", 1) - 1000.0) < 0.5);
+	SELFTEST_ASSERT(fabs(Test_EnergyMeter_GetHistory("hours", 47) - 1000.0) < 0.5);
+	// start was at noon, 50 hours later we are in third day, so yesterday is a full day
+	SELFTEST_ASSERT(fabs(Test_EnergyMeter_GetHistory("days", 1) - 24000.0) < 1.0);
+	SELFTEST_ASSERT(fabs(Test_EnergyMeter_GetHistory("days", 0) + Test_EnergyMeter_GetHistory("days", 1)
+		+ Test_EnergyMeter_GetHistory("days", 2) - total) < 1.0);
+	SELFTEST_ASSERT(Test_EnergyMeter_GetHistory("days", 3) == 0);
+
+	// simulated reboot - RAM is lost, total and finished days come back from flash
+	SIM_FlashVars_Reset(false);
+	CMD_ExecuteCommand("stopDriver TESTPOWER", 0);
+	CMD_ExecuteCommand("startDriver TESTPOWER", 0);
+	CMD_ExecuteCommand("SetupEnergyHistory 48 7", 0);
+	// total is saved every 10Wh
+	SELFTEST_ASSERT(DRV_GetReading(OBK_CONSUMPTION_TOTAL) <= total);
+	SELFTEST_ASSERT(DRV_GetReading(OBK_CONSUMPTION_TOTAL) > total - 11);
+	Test_FakeHTTPClientPacket_JSON("api/energy");
+	SELFTEST_ASSERT(fabs(Test_EnergyMeter_GetHistory("days", 1) - 24000.0) < 1.0);
+	SELFTEST_ASSERT(Test_EnergyMeter_GetHistory("days", 2) > 0);
+	SELFTEST_ASSERT(Test_EnergyMeter_GetHistory("days", 3) == 0);
+
+	// reset clears history, also the saved one
+	CMD_ExecuteCommand("EnergyCntReset", 0);
+	SIM_FlashVars_Reset(false);
+	CMD_ExecuteCommand("stopDriver TESTPOWER", 0);
+	CMD_ExecuteCommand("startDriver TESTPOWER", 0);
+	Test_FakeHTTPClientPacket_JSON("api/energy");
+	SELFTEST_ASSERT(Test_GetJSONValue_Generic("total", "")->valuedouble == 0);
+	SELFTEST_ASSERT(Test_EnergyMeter_GetHistory("days", 1) == 0);
+}
+// consumption_stats is written by JSON writer into one buffer
+void Test_EnergyMeter_ConsumptionStats() {
+	cJSON *samples;
+
+	SIM_ClearOBK(0);
+	SIM_ClearAndPrepareForMQTTTesting("miscDevice", "bekens");
+	CMD_ExecuteCommand("startDriver TESTPOWER", 0);
+	CMD_ExecuteCommand("SetupTestPower 230 1.6 360 0", 0);
+	CMD_ExecuteCommand("SetupEnergyStats 1 10 12 1", 0);
+	Sim_RunSeconds(2, false);
+	CMD_ExecuteCommand("EnergyCntReset", 0);
+	SIM_ClearMQTTHistory();
+	Sim_RunSeconds(35, false);
+
+	SELFTEST_ASSERT_HAS_MQTT_JSON_SENT("miscDevice/consumption_stats/get", false);
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER(NULL, "consumption_sample_count", 12);
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER(NULL, "consumption_sampling_period", 10);
+	samples = Test_GetJSONValue_Generic("consumption_samples", "");
+	SELFTEST_ASSERT(samples != 0 && cJSON_GetArraySize(samples) == 12);
+	// first publish comes after first sample, 360W for 10 seconds is 1Wh
+	SELFTEST_ASSERT(fabs(cJSON_GetArrayItem(samples, 0)->valuedouble - 1.0) < 0.15);
+	SELFTEST_ASSERT(cJSON_GetArrayItem(samples, 1)->valuedouble == 0);
+	SELFTEST_ASSERT(fabs(Test_GetJSONValue_Generic("consumption_total", "")->valuedouble - 1.0) < 0.15);
+}
 void Test_EnergyMeter() {
 	Test_EnergyMeter_Basic();
 	Test_EnergyMeter_Tasmota();
+	Test_EnergyMeter_Integrator();
+	Test_EnergyMeter_ConsumptionStats();
 }
 
 #endif
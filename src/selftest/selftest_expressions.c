@@ -238,4 +238,117 @@ void Test_Expressions_RunTests_Basic() {
 	//SELFTEST_ASSERT_EXPRESSION("1.50/$CH18+1000\n\r", 0.1f + 1000);
 }
 
+// expressions from the test above, used to check compiled expressions against the interpreter
+static const char *g_expressionCorpus[] = {
+	"-1", "-11", "-1-1", "1-1", "1+1", "-1.0-1.0", "-1 -1", "1 - 1", " 1 + 1 ", "-1.0 - 1.0",
+	"5*10", "10*0.5", "0.5*0.5", "5*  10", "10  *5", "   0.5  *  0.5  ", "  10.0   ",
+	"  10.0*2.4   ", "  10.0+ 3.4   ", "  10.0 + 4.4   ",
+	"$CH12*10.0", "$CH12+10.0", "10.0+$CH12", "10.0+$CH12 \r\n", "10.0+$CH12\n\r",
+	"$CH1*10.0", "10.0+$CH1\n\r", "15.0+$CH18\n\r", "15.0/$CH18\n\r", "1.50/$CH18\n\r",
+	"1&&1\n\r", "1&&0\n\r", "0||1\n\r", "$CH1&&$CH1\n\r", "0&&$CH1\n\r", "$CH1||0\n\r",
+	"!0\n\r", "!1\n\r", "!$CH1\n\r", "$CH1\n\r",
+	"1+1*2", "1*2+1", "100*2+10*2+2*1", "100*2-10*2+2*1", "10*10/10",
+	"1000*2-100*2-10*2+2*1", "1000*$CH1+100*$CH1-10*$CH1+$CH1*1",
+	"1 > -1", "1 >= 1", "1 <= -1", "$CH5 > $CH5", "$CH5 >= -1", "$CH5 <= 0",
+	"1 > -1 && 5 > 4", "1 >= -1 && 5 >= 6", "-1+2 >= 10-10 || 5 >= 3+4",
+	"+++++", "++--++", "++fsfs+", "$led_dimmer+$CH1", "$uptime*0", "$activeRepeatingEvents+1",
+};
+
+void Test_Expressions_RunTests_Compiled() {
+	int i, j, count, loops;
+	int hits, misses;
+	clock_t start;
+	float a, b, sum;
+	long interpretedTime, compiledTime;
+	compiledExpression_t **programs;
+
+	// reset whole device
+	SIM_ClearOBK(0);
+
+	CHANNEL_Set(1, 2, 0);
+	CHANNEL_Set(5, 1, 0);
+	CHANNEL_Set(12, 10, 0);
+	CHANNEL_Set(18, 15, 0);
+
+	count = sizeof(g_expressionCorpus) / sizeof(g_expressionCorpus[0]);
+	for (i = 0; i < count; i++) {
+		a = CMD_InterpretExpression(g_expressionCorpus[i], 0);
+		b = CMD_EvaluateExpression(g_expressionCorpus[i], 0);
+		SELFTEST_ASSERT(Float_Equals(a, b));
+		// second run goes through the cache
+		b = CMD_EvaluateExpression(g_expressionCorpus[i], 0);
+		SELFTEST_ASSERT(Float_Equals(a, b));
+	}
+	// compiled programs must follow channel changes
+	SELFTEST_ASSERT_EXPRESSION("$CH12*10.0", 100.0f);
+	CHANNEL_Set(12, 11, 0);
+	SELFTEST_ASSERT_EXPRESSION("$CH12*10.0", 110.0f);
+	CHANNEL_Set(12, 10, 0);
+
+	// hot expression stays cached while many one-off ones pass through
+	CMD_FreeExpressionCache();
+	for (i = 0; i < 100; i++) {
+		char tmp[16];
+
+		SELFTEST_ASSERT_EXPRESSION("$CH12*10.0", 100.0f);
+		sprintf(tmp, "%i+1", i);
+		SELFTEST_ASSERT_EXPRESSION(tmp, i + 1);
+	}
+	CMD_GetExpressionCacheStats(&hits, &misses);
+	SELFTEST_ASSERT(hits == 99);
+	SELFTEST_ASSERT(misses == 101);
+	SELFTEST_ASSERT(CMD_GetExpressionCacheSize() == 32);
+
+	// cache grows with registered handlers, so all their expressions stay compiled
+	CMD_FreeExpressionCache();
+	for (i = 0; i < 100; i++) {
+		char tmp[64];
+
+		sprintf(tmp, "addEventHandler OnClick %i addChannel 12 1", i);
+		CMD_ExecuteCommand(tmp, 0);
+	}
+	for (j = 0; j < 2; j++) {
+		for (i = 0; i < 100; i++) {
+			char tmp[16];
+
+			sprintf(tmp, "%i+1", i);
+			SELFTEST_ASSERT_EXPRESSION(tmp, i + 1);
+		}
+	}
+	CMD_GetExpressionCacheStats(&hits, &misses);
+	SELFTEST_ASSERT(hits == 100);
+	SELFTEST_ASSERT(misses == 100);
+	SELFTEST_ASSERT(CMD_GetExpressionCacheSize() == 128);
+	CMD_ExecuteCommand("clearAllHandlers", 0);
+
+	// timing comparison, interpreter against programs compiled once up front
+	programs = malloc(count * sizeof(compiledExpression_t*));
+	for (i = 0; i < count; i++) {
+		programs[i] = CMD_CompileExpression(g_expressionCorpus[i], 0);
+		SELFTEST_ASSERT(programs[i] != 0);
+	}
+	loops = 200;
+	sum = 0;
+	start = clock();
+	for (j = 0; j < loops; j++) {
+		for (i = 0; i < count; i++) {
+			sum += CMD_InterpretExpression(g_expressionCorpus[i], 0);
+		}
+	}
+	interpretedTime = clock() - start;
+	start = clock();
+	for (j = 0; j < loops; j++) {
+		for (i = 0; i < count; i++) {
+			sum -= CMD_RunCompiledExpression(programs[i]);
+		}
+	}
+	compiledTime = clock() - start;
+	printf("Expressions: %i evaluations, interpreted %li ms, compiled %li ms (checksum %f)\n",
+		loops * count, interpretedTime * 1000 / CLOCKS_PER_SEC, compiledTime * 1000 / CLOCKS_PER_SEC, sum);
+	for (i = 0; i < count; i++) {
+		free(programs[i]);
+	}
+	free(programs);
+}
+
 #endif
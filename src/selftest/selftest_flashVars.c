@@ -0,0 +1,103 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "../hal/hal_flashVars.h"
+
+void Test_FlashVars() {
+	int erases0, erases1, bytesWritten, busyUs, badWrites;
+	int prevBytes, prevErases;
+	int i;
+	char buffer[64];
+
+	// reset whole device, flash vars are blank after that
+	SIM_ClearOBK(0);
+
+	// blank flash gets a fresh journal sector
+	SIM_FlashVars_GetStats(&erases0, &erases1, &bytesWritten, &busyUs, &badWrites);
+	SELFTEST_ASSERT(erases0 + erases1 == 1);
+	SELFTEST_ASSERT(HAL_FlashVars_GetEraseCount(0) + HAL_FlashVars_GetEraseCount(1) == 1);
+	SELFTEST_ASSERT(HAL_FlashVars_GetBootCount() == 1);
+
+	// slider drag - many saves of the same channel end up as one record
+	CMD_ExecuteCommand("FlashVarsCommitDelay 2", 0);
+	prevBytes = bytesWritten;
+	for (i = 0; i < 100; i++) {
+		sprintf(buffer, "setChannel %i %i", SPECIAL_CHANNEL_FLASHVARS_FIRST + 5, i + 1);
+		CMD_ExecuteCommand(buffer, 0);
+	}
+	SIM_FlashVars_GetStats(&erases0, &erases1, &bytesWritten, &busyUs, &badWrites);
+	SELFTEST_ASSERT(bytesWritten == prevBytes);
+	HAL_FlashVars_RunEverySecond();
+	HAL_FlashVars_RunEverySecond();
+	SIM_FlashVars_GetStats(&erases0, &erases1, &bytesWritten, &busyUs, &badWrites);
+	// 4 byte record header + int
+	SELFTEST_ASSERT(bytesWritten == prevBytes + 8);
+	SELFTEST_ASSERT(HAL_FlashVars_GetChannelValue(5) == 100);
+
+	// channels above old limit of 12 are kept too
+	HAL_FlashVars_SaveChannel(40, -1234);
+	HAL_FlashVars_Flush();
+	// power cycle
+	SIM_FlashVars_Reset(false);
+	SELFTEST_ASSERT(HAL_FlashVars_GetChannelValue(5) == 100);
+	SELFTEST_ASSERT(HAL_FlashVars_GetChannelValue(40) == -1234);
+	SELFTEST_ASSERT(HAL_FlashVars_GetBootCount() == 1);
+
+	// pending change is lost on power cycle without commit
+	HAL_FlashVars_SaveChannel(6, 66);
+	SIM_FlashVars_Reset(false);
+	SELFTEST_ASSERT(HAL_FlashVars_GetChannelValue(6) == 0);
+
+	// write without delay until journal wraps a few times
+	HAL_FlashVars_SetCommitDelay(0);
+	SIM_FlashVars_GetStats(&erases0, &erases1, &bytesWritten, &busyUs, &badWrites);
+	prevErases = erases0 + erases1;
+	for (i = 0; i < 2000; i++) {
+		HAL_FlashVars_SaveChannel(i % 20, i);
+	}
+	SIM_FlashVars_GetStats(&erases0, &erases1, &bytesWritten, &busyUs, &badWrites);
+	// 2000 records of 8 bytes need a few compactions, alternating between sectors
+	SELFTEST_ASSERT(erases0 + erases1 > prevErases + 2);
+	SELFTEST_ASSERT(erases0 + erases1 < prevErases + 8);
+	SELFTEST_ASSERT(erases0 - erases1 <= 1 && erases1 - erases0 <= 1);
+	SELFTEST_ASSERT(HAL_FlashVars_GetEraseCount(0) == erases0);
+	SELFTEST_ASSERT(HAL_FlashVars_GetEraseCount(1) == erases1);
+	// never programmed without erase
+	SELFTEST_ASSERT(badWrites == 0);
+
+	// everything survives the power cycle after compactions
+	SIM_FlashVars_Reset(false);
+	for (i = 0; i < 20; i++) {
+		SELFTEST_ASSERT(HAL_FlashVars_GetChannelValue(i) == 1980 + i);
+	}
+	SELFTEST_ASSERT(HAL_FlashVars_GetChannelValue(40) == -1234);
+	SELFTEST_ASSERT(HAL_FlashVars_GetBootCount() == 1);
+
+	// power lost during compaction - old sector is still used after reboot
+	SIM_FlashVars_GetStats(&erases0, &erases1, &bytesWritten, &busyUs, &badWrites);
+	prevErases = erases0 + erases1;
+	SIM_FlashVars_FailWritesAfterErase(2);
+	for (i = 0; i < 2000 && erases0 + erases1 == prevErases; i++) {
+		HAL_FlashVars_SaveChannel(7, 5000 + i);
+		SIM_FlashVars_GetStats(&erases0, &erases1, &bytesWritten, &busyUs, &badWrites);
+	}
+	SELFTEST_ASSERT(erases0 + erases1 > prevErases);
+	SIM_FlashVars_Reset(false);
+	// value that triggered compaction is lost, the one before it is kept
+	SELFTEST_ASSERT(HAL_FlashVars_GetChannelValue(7) == 5000 + i - 2);
+	SELFTEST_ASSERT(HAL_FlashVars_GetChannelValue(40) == -1234);
+	SELFTEST_ASSERT(HAL_FlashVars_GetBootCount() == 1);
+
+	// boot counters are written at once
+	HAL_FlashVars_IncreaseBootCount();
+	SIM_FlashVars_Reset(false);
+	SELFTEST_ASSERT(HAL_FlashVars_GetBootCount() == 2);
+	SELFTEST_ASSERT(HAL_FlashVars_GetBootFailures() == 2);
+	HAL_FlashVars_SaveBootComplete();
+	SIM_FlashVars_Reset(false);
+	SELFTEST_ASSERT(HAL_FlashVars_GetBootFailures() == 0);
+
+	HAL_FlashVars_SetCommitDelay(2);
+}
+
+#endif
@@ -1,6 +1,8 @@
 #ifdef WINDOWS
 
 #include "selftest_local.h".
+#include "../httpserver/hass.h"
+#include "../mqtt/new_mqtt.h"
 
 void Test_HassDiscovery_Relay_1x() {
 	const char *shortName = "WinRelTest1x";
@@ -186,6 +188,59 @@ void Test_HassDiscovery_BL0942() {
 	SELFTEST_ASSERT_HAS_MQTT_JSON_SENT_ANY("homeassistant", true, 0, 0, "stat_t", "~/voltage/get");
 
 }
+void Test_HassDiscovery_Paced() {
+	int i;
+	int dropped;
+
+	SIM_ClearOBK("WinPacedTest");
+	SIM_ClearAndPrepareForMQTTTesting("testPaced", "bekens");
+
+	CFG_SetShortDeviceName("WinPacedTest");
+	CFG_SetDeviceName("Windows Paced Test");
+
+	// more entities than MQTT queue can hold at once
+	for (i = 0; i < 10; i++) {
+		PIN_SetPinRoleForPinIndex(i, IOR_Relay);
+		PIN_SetPinChannelForPinIndex(i, i + 1);
+	}
+
+	dropped = MQTT_GetQueueDroppedCounter();
+	SIM_ClearMQTTHistory();
+	CMD_ExecuteCommand("scheduleHADiscovery 1", 0);
+	Sim_RunSeconds(10, false);
+	for (i = 0; i < 10; i++) {
+		SELFTEST_ASSERT_HAS_MQTT_JSON_SENT_ANY("homeassistant", true, 0, 0, "stat_t", va("~/%i/get", i + 1));
+	}
+	SELFTEST_ASSERT(MQTT_GetQueueDroppedCounter() == dropped);
+
+	// nothing has changed, so nothing is announced again
+	SIM_ClearMQTTHistory();
+	CMD_ExecuteCommand("scheduleHADiscovery 1", 0);
+	Sim_RunSeconds(10, false);
+	SELFTEST_ASSERT(SIM_GetMQTTHistoryString("homeassistant", true) == 0);
+
+	// new name changes every payload; connection is lost in the middle of the pass
+	CFG_SetShortDeviceName("WinPacedTest2");
+	SIM_ClearMQTTHistory();
+	CMD_ExecuteCommand("scheduleHADiscovery 1", 0);
+	Sim_RunSeconds(2, false);
+	SIM_SetMQTTOffline(true);
+	Sim_RunSeconds(5, false);
+	SIM_SetMQTTOffline(false);
+	Sim_RunSeconds(10, false);
+	for (i = 0; i < 10; i++) {
+		SELFTEST_ASSERT_HAS_MQTT_JSON_SENT_ANY("homeassistant", true, 0, 0, "stat_t", va("~/%i/get", i + 1));
+	}
+	SELFTEST_ASSERT_HAS_MQTT_JSON_SENT_ANY("homeassistant", true, "dev", 0, "name", "WinPacedTest2");
+	SELFTEST_ASSERT(MQTT_GetQueueDroppedCounter() == dropped);
+
+	// long prefix is used whole, one that does not fit MQTT topic is refused
+	SIM_ClearMQTTHistory();
+	SELFTEST_ASSERT(hass_discovery_start("homeassistant/with/rather/long/discovery/prefix", true));
+	Sim_RunSeconds(10, false);
+	SELFTEST_ASSERT_HAS_MQTT_JSON_SENT_ANY("homeassistant/with/rather/long/discovery/prefix/", true, 0, 0, "stat_t", "~/1/get");
+	SELFTEST_ASSERT(!hass_discovery_start("homeassistant/with/a/prefix/that/is/much/too/long/for/mqtt/queue/topic", true));
+}
 void Test_HassDiscovery() {
 	Test_HassDiscovery_SHTSensor();
 	Test_HassDiscovery_BL0942();
@@ -197,6 +252,7 @@ void Test_HassDiscovery() {
 	Test_HassDiscovery_LED_RGBCW();
 	Test_HassDiscovery_LED_SingleColor();
 	Test_HassDiscovery_DHT11();
+	Test_HassDiscovery_Paced();
 }
 
 
@@ -892,7 +892,77 @@ void Test_Http_LED_RGB() {
 	*/
 
 }
+static int Test_Http_Router_A(http_request_t* request) {
+	http_setup(request, httpMimeTypeText);
+	poststr(request, "route A");
+	poststr(request, NULL);
+	return 0;
+}
+static int Test_Http_Router_B(http_request_t* request) {
+	http_setup(request, httpMimeTypeText);
+	poststr(request, "route B");
+	poststr(request, NULL);
+	return 0;
+}
+void Test_Http_Router() {
+	const char *url;
+	int i, method, hits, timeMS, indexHits = -1;
+
+	// reset whole device
+	SIM_ClearOBK(0);
+
+	SELFTEST_ASSERT(HTTP_RegisterCallback("/router_test/", HTTP_GET, Test_Http_Router_A) == 0);
+	SELFTEST_ASSERT(HTTP_RegisterCallback("/router_test/deep", HTTP_ANY, Test_Http_Router_B) == 0);
+	// registering again is harmless
+	SELFTEST_ASSERT(HTTP_RegisterCallback("/router_test/", HTTP_GET, Test_Http_Router_A) >= 0);
+
+	Test_FakeHTTPClientPacket_GET("router_test");
+	SELFTEST_ASSERT_HTML_REPLY("route A");
+	Test_FakeHTTPClientPacket_GET("router_test/something?x=1");
+	SELFTEST_ASSERT_HTML_REPLY("route A");
+	// longest prefix wins, no matter the registration order
+	Test_FakeHTTPClientPacket_GET("router_test/deep");
+	SELFTEST_ASSERT_HTML_REPLY("route B");
+	Test_FakeHTTPClientPacket_GET("router_test/deep/er?a=b");
+	SELFTEST_ASSERT_HTML_REPLY("route B");
+	// segments are matched as a whole
+	Test_FakeHTTPClientPacket_GET("router_test/deeper");
+	SELFTEST_ASSERT_HTML_REPLY("route A");
+	Test_FakeHTTPClientPacket_GET("router_testing");
+	SELFTEST_ASSERT(strstr(Test_GetLastHTMLReply(), "Not found") != 0);
+	// method mask
+	Test_FakeHTTPClientPacket_POST("router_test/deep", "abc");
+	SELFTEST_ASSERT_HTML_REPLY("route B");
+	Test_FakeHTTPClientPacket_POST("router_test/x", "abc");
+	SELFTEST_ASSERT(strstr(Test_GetLastHTMLReply(), "Not found") != 0);
+
+	// builtin pages are exact
+	Test_FakeHTTPClientPacket_GET("index");
+	SELFTEST_ASSERT(strstr(Test_GetLastHTMLReply(), "Not found") == 0);
+	Test_FakeHTTPClientPacket_GET("index?state=1");
+	SELFTEST_ASSERT(strstr(Test_GetLastHTMLReply(), "Not found") == 0);
+	Test_FakeHTTPClientPacket_GET("cfg_ping");
+	SELFTEST_ASSERT(strstr(Test_GetLastHTMLReply(), "Not found") == 0);
+	Test_FakeHTTPClientPacket_GET("index2");
+	SELFTEST_ASSERT(strstr(Test_GetLastHTMLReply(), "Not found") != 0);
+
+	// hit counters
+	for (i = 0; HTTP_GetRouteStats(i, &url, &method, &hits, &timeMS); i++) {
+		if (!strcmp(url, "/index")) {
+			indexHits = hits;
+		}
+	}
+	Test_FakeHTTPClientPacket_GET("index");
+	for (i = 0; HTTP_GetRouteStats(i, &url, &method, &hits, &timeMS); i++) {
+		if (!strcmp(url, "/index")) {
+			SELFTEST_ASSERT(hits == indexHits + 1);
+		}
+	}
+	Test_FakeHTTPClientPacket_JSON("api/info");
+	SELFTEST_ASSERT(strstr(Test_GetLastHTMLReply(), "\"url\":\"/router_test/deep\",\"method\":\"ANY\",\"hits\":3") != 0);
+}
 void Test_Http() {
+	Test_Http_Router();
 	Test_Http_SingleRelayOnChannel1();
 	Test_Http_TwoRelays();
 	Test_Http_FourRelays();
@@ -0,0 +1,334 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "../httpserver/new_http.h"
+#include <timeapi.h>
+
+extern int g_port;
+void HTTPServer_RunQuickTick();
+
+typedef struct testHTTPClient_s {
+	SOCKET s;
+	int used;
+	bool bClosed;
+	char buffer[32768];
+	// headers and body of last reply
+	char headers[2048];
+	char body[32768];
+	int bodyLen;
+	// total size of last reply, with headers and framing
+	int replyBytes;
+} testHTTPClient_t;
+
+static testHTTPClient_t g_clients[3];
+static char g_post[8192];
+
+static bool Test_HTTPServer_Connect(testHTTPClient_t *c) {
+	struct sockaddr_in addr;
+	unsigned long argp = 1;
+
+	memset(c, 0, sizeof(*c));
+	c->s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (c->s == INVALID_SOCKET)
+		return false;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(g_port);
+	addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+	if (connect(c->s, (struct sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR) {
+		closesocket(c->s);
+		c->s = INVALID_SOCKET;
+		return false;
+	}
+	ioctlsocket(c->s, FIONBIO, &argp);
+	return true;
+}
+static void Test_HTTPServer_Close(testHTTPClient_t *c) {
+	if (c->s != INVALID_SOCKET) {
+		closesocket(c->s);
+		c->s = INVALID_SOCKET;
+	}
+}
+static void Test_HTTPServer_Send(testHTTPClient_t *c, const char *data) {
+	send(c->s, data, strlen(data), 0);
+}
+// Decodes chunked body starting at given offset of client buffer into c->body.
+// Returns offset just past the last chunk, or 0 if reply is not complete yet.
+static int Test_HTTPServer_DecodeChunked(testHTTPClient_t *c, int ofs) {
+	const char *line;
+	int chunkLen, bodyLen = 0;
+
+	while (1) {
+		line = strstr(c->buffer + ofs, "\r\n");
+		if (line == 0)
+			return 0;
+		chunkLen = strtol(c->buffer + ofs, 0, 16);
+		ofs = line + 2 - c->buffer;
+		if (ofs + chunkLen + 2 > c->used)
+			return 0;
+		memcpy(c->body + bodyLen, c->buffer + ofs, chunkLen);
+		bodyLen += chunkLen;
+		ofs += chunkLen + 2;
+		if (chunkLen == 0) {
+			c->body[bodyLen] = 0;
+			c->bodyLen = bodyLen;
+			return ofs;
+		}
+	}
+}
+// Runs server until one whole reply is received by client.
+// Returns body length, or -1 if there was no complete reply before close/timeout.
+// Headers of the reply are kept in c->headers.
+static int Test_HTTPServer_ReadReply(testHTTPClient_t *c) {
+	const char *hdrEnd, *cl;
+	int len, total, contentLength, bodyOfs;
+	long start = timeGetTime();
+
+	while (1) {
+		c->buffer[c->used] = 0;
+		hdrEnd = strstr(c->buffer, "\r\n\r\n");
+		if (hdrEnd) {
+			bodyOfs = hdrEnd + 4 - c->buffer;
+			len = bodyOfs < sizeof(c->headers) ? bodyOfs : sizeof(c->headers) - 1;
+			memcpy(c->headers, c->buffer, len);
+			c->headers[len] = 0;
+			contentLength = -1;
+			total = 0;
+			cl = strstr(c->headers, "Content-Length: ");
+			if (cl) {
+				contentLength = atoi(cl + 16);
+				if (c->used >= bodyOfs + contentLength) {
+					total = bodyOfs + contentLength;
+					memcpy(c->body, hdrEnd + 4, contentLength);
+					c->body[contentLength] = 0;
+					c->bodyLen = contentLength;
+				}
+			}
+			else if (strstr(c->headers, "Transfer-Encoding: chunked")) {
+				total = Test_HTTPServer_DecodeChunked(c, bodyOfs);
+			}
+			if (total) {
+				c->replyBytes = total;
+				// keep next pipelined reply
+				c->used -= total;
+				memmove(c->buffer, c->buffer + total, c->used);
+				return c->bodyLen;
+			}
+		}
+		if (c->bClosed) {
+			if (hdrEnd == 0)
+				return -1;
+			// reply without Content-Length ends with close
+			len = c->used - (hdrEnd + 4 - c->buffer);
+			memcpy(c->body, hdrEnd + 4, len);
+			c->body[len] = 0;
+			c->replyBytes = c->used;
+			c->used = 0;
+			return len;
+		}
+		HTTPServer_RunQuickTick();
+		len = recv(c->s, c->buffer + c->used, sizeof(c->buffer) - 1 - c->used, 0);
+		if (len == 0) {
+			c->bClosed = true;
+		}
+		else if (len > 0) {
+			c->used += len;
+		}
+		if (timeGetTime() - start > 2000) {
+			return -1;
+		}
+	}
+}
+static int Test_HTTPServer_CompareLongs(const void *a, const void *b) {
+	long la = *(const long*)a;
+	long lb = *(const long*)b;
+	return (la > lb) - (la < lb);
+}
+static void Test_HTTPServer_LoadTest(int numClients, int requests) {
+	static long latencies[2000];
+	int i, ok = 0, reconnects = 0;
+	clock_t start, total;
+	testHTTPClient_t *c;
+
+	if (requests > 2000)
+		requests = 2000;
+	for (i = 0; i < numClients; i++) {
+		SELFTEST_ASSERT(Test_HTTPServer_Connect(&g_clients[i]));
+	}
+	total = clock();
+	for (i = 0; i < requests; i++) {
+		c = &g_clients[i % numClients];
+		start = clock();
+		if (c->bClosed) {
+			// server limits requests per connection
+			Test_HTTPServer_Close(c);
+			SELFTEST_ASSERT(Test_HTTPServer_Connect(c));
+			reconnects++;
+		}
+		Test_HTTPServer_Send(c, "GET /cm?cmnd=POWER HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+		if (Test_HTTPServer_ReadReply(c) > 0) {
+			ok++;
+		}
+		latencies[i] = (clock() - start) * 1000000 / CLOCKS_PER_SEC;
+	}
+	total = clock() - total;
+	if (total <= 0)
+		total = 1;
+	for (i = 0; i < numClients; i++) {
+		Test_HTTPServer_Close(&g_clients[i]);
+	}
+	SELFTEST_ASSERT(ok == requests);
+	// connections are reused
+	SELFTEST_ASSERT(reconnects < requests / 50);
+	qsort(latencies, requests, sizeof(latencies[0]), Test_HTTPServer_CompareLongs);
+	printf("Test_HTTPServer: %i clients, %i requests, %i reconnects - %li req/s, p50 %li us, p99 %li us\n",
+		numClients, requests, reconnects, (long)((double)requests * CLOCKS_PER_SEC / total),
+		latencies[requests / 2], latencies[requests * 99 / 100]);
+}
+
+// Gets one page with its CSS and JS, like a browser, first with empty cache, then with cached assets
+static void Test_HTTPServer_PageLoad(testHTTPClient_t *c) {
+	static const char *assets[] = { "/style.css", "/script.js" };
+	char etags[2][16];
+	char req[256];
+	const char *p;
+	int pass, i, len, bytes;
+	clock_t start, ttlb;
+
+	for (pass = 0; pass < 2; pass++) {
+		start = clock();
+		Test_HTTPServer_Send(c, "GET /index HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+		SELFTEST_ASSERT(Test_HTTPServer_ReadReply(c) > 0);
+		// page fits in reply buffer, so it has known length
+		SELFTEST_ASSERT(strstr(c->headers, "Content-Length: ") != 0);
+		SELFTEST_ASSERT(strstr(c->body, "href=\"/style.css\"") != 0);
+		SELFTEST_ASSERT(strstr(c->body, "src='/script.js'") != 0);
+		SELFTEST_ASSERT(strstr(c->body, "</html>") != 0);
+		bytes = c->replyBytes;
+		for (i = 0; i < 2; i++) {
+			if (pass == 0) {
+				sprintf(req, "GET %s HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n", assets[i]);
+			}
+			else {
+				sprintf(req, "GET %s HTTP/1.1\r\nHost: 127.0.0.1\r\nIf-None-Match: %s\r\n\r\n", assets[i], etags[i]);
+			}
+			Test_HTTPServer_Send(c, req);
+			len = Test_HTTPServer_ReadReply(c);
+			bytes += c->replyBytes;
+			if (pass == 0) {
+				SELFTEST_ASSERT(len > 0);
+				SELFTEST_ASSERT(!strncmp(c->headers, "HTTP/1.1 200", 12));
+				// sent straight from flash
+				SELFTEST_ASSERT(strstr(c->headers, "Transfer-Encoding: chunked") != 0);
+				p = strstr(c->headers, "ETag: ");
+				SELFTEST_ASSERT(p != 0);
+				sscanf(p + 6, "%15s", etags[i]);
+			}
+			else {
+				SELFTEST_ASSERT(len == 0);
+				SELFTEST_ASSERT(!strncmp(c->headers, "HTTP/1.1 304", 12));
+			}
+		}
+		SELFTEST_ASSERT(c->bClosed == false);
+		ttlb = clock() - start;
+		printf("Test_HTTPServer: /index with assets, %s - %i bytes, TTLB %li us\n",
+			pass ? "cached" : "cold", bytes, (long)(ttlb * 1000000 / CLOCKS_PER_SEC));
+	}
+	// content of assets is taken from inside the inline tags
+	Test_HTTPServer_Send(c, "GET /style.css HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+	SELFTEST_ASSERT(Test_HTTPServer_ReadReply(c) > 0);
+	SELFTEST_ASSERT(!strncmp(c->body, "div,fieldset", 12));
+	SELFTEST_ASSERT(c->body[c->bodyLen - 1] == '}');
+	SELFTEST_ASSERT(strstr(c->body, "<") == 0);
+	Test_HTTPServer_Send(c, "GET /script.js HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+	SELFTEST_ASSERT(Test_HTTPServer_ReadReply(c) > 0);
+	SELFTEST_ASSERT(!strncmp(c->body, "var firstTime", 13));
+	SELFTEST_ASSERT(strstr(c->body, "</script") == 0);
+}
+
+void Test_HTTPServer() {
+	int i, len;
+	testHTTPClient_t *c = &g_clients[0];
+
+	// reset whole device
+	SIM_ClearOBK(0);
+	CMD_ExecuteCommand("lfs_format", 0);
+
+	// listener must be up, a failed connect is a failed test, not a skipped one
+	if (Test_HTTPServer_Connect(c) == false) {
+		printf("Test_HTTPServer: can't connect to port %i\n", g_port);
+		SELFTEST_ASSERT(false);
+		return;
+	}
+
+	// two requests on the same connection
+	Test_HTTPServer_Send(c, "GET /cm?cmnd=POWER HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+	len = Test_HTTPServer_ReadReply(c);
+	SELFTEST_ASSERT(len > 0);
+	SELFTEST_ASSERT(strstr(c->body, "POWER") != 0);
+	Test_HTTPServer_Send(c, "GET /cm?cmnd=Power0%20ON HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+	len = Test_HTTPServer_ReadReply(c);
+	SELFTEST_ASSERT(len > 0);
+	SELFTEST_ASSERT(c->bClosed == false);
+
+	// pipelined requests in one packet are answered in order
+	Test_HTTPServer_Send(c, "GET /cm?cmnd=MQTTHost HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n"
+		"GET /cm?cmnd=POWER HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+	SELFTEST_ASSERT(Test_HTTPServer_ReadReply(c) > 0);
+	SELFTEST_ASSERT(strstr(c->body, "MQTTHost") != 0);
+	SELFTEST_ASSERT(Test_HTTPServer_ReadReply(c) > 0);
+	SELFTEST_ASSERT(strstr(c->body, "POWER") != 0);
+
+	// request split into several pieces with 3 KB body
+	for (i = 0; i < 3000; i++) {
+		g_post[i] = 'a' + (i % 26);
+	}
+	g_post[i] = 0;
+	Test_HTTPServer_Send(c, "POST /api/lfs/big.txt HTTP/1.1\r\nHo");
+	HTTPServer_RunQuickTick();
+	Test_HTTPServer_Send(c, "st: 127.0.0.1\r\nContent-Length: 3000\r\n");
+	HTTPServer_RunQuickTick();
+	Test_HTTPServer_Send(c, "\r\n");
+	HTTPServer_RunQuickTick();
+	send(c->s, g_post, 1000, 0);
+	HTTPServer_RunQuickTick();
+	send(c->s, g_post + 1000, 2000, 0);
+	SELFTEST_ASSERT(Test_HTTPServer_ReadReply(c) > 0);
+	SELFTEST_ASSERT(strstr(c->body, "\"size\":3000") != 0);
+	Test_HTTPServer_Send(c, "GET /api/lfs/big.txt HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+	SELFTEST_ASSERT(Test_HTTPServer_ReadReply(c) == 3000);
+	SELFTEST_ASSERT(memcmp(c->body, g_post, 3000) == 0);
+	// file is sent directly, without copying through reply buffer, so length was not known before
+	SELFTEST_ASSERT(strstr(c->headers, "Transfer-Encoding: chunked") != 0);
+	SELFTEST_ASSERT(c->bClosed == false);
+
+	Test_HTTPServer_PageLoad(c);
+
+	// client asks to close
+	Test_HTTPServer_Send(c, "GET /cm?cmnd=POWER HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n");
+	SELFTEST_ASSERT(Test_HTTPServer_ReadReply(c) > 0);
+	SELFTEST_ASSERT(Test_HTTPServer_ReadReply(c) == -1);
+	SELFTEST_ASSERT(c->bClosed);
+	Test_HTTPServer_Close(c);
+
+	// HTTP/1.0 closes by default
+	SELFTEST_ASSERT(Test_HTTPServer_Connect(c));
+	Test_HTTPServer_Send(c, "GET /cm?cmnd=POWER HTTP/1.0\r\n\r\n");
+	SELFTEST_ASSERT(Test_HTTPServer_ReadReply(c) > 0);
+	SELFTEST_ASSERT(Test_HTTPServer_ReadReply(c) == -1);
+	Test_HTTPServer_Close(c);
+
+	// huge Content-Length must not overflow, it's taken as body that does not fit
+	SELFTEST_ASSERT(Test_HTTPServer_Connect(c));
+	Test_HTTPServer_Send(c, "GET /cm?cmnd=POWER HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Length: 2147483647\r\n\r\n");
+	SELFTEST_ASSERT(Test_HTTPServer_ReadReply(c) > 0);
+	SELFTEST_ASSERT(strstr(c->body, "POWER") != 0);
+	SELFTEST_ASSERT(Test_HTTPServer_ReadReply(c) == -1);
+	SELFTEST_ASSERT(c->bClosed);
+	Test_HTTPServer_Close(c);
+
+	Test_HTTPServer_LoadTest(1, 1000);
+	Test_HTTPServer_LoadTest(3, 1500);
+}
+
+#endif
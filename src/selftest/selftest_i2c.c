@@ -0,0 +1,118 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "../i2c/drv_i2c_public.h"
+
+// MCP23017 registers, bank 0
+#define MCP_IODIRA	0x00
+#define MCP_IODIRB	0x01
+#define MCP_OLATA	0x14
+#define MCP_OLATB	0x15
+
+static int g_lastTransactions, g_lastBytes;
+
+// bus traffic since previous call
+static void Test_I2C_AssertTraffic(int transactions, int bytes) {
+	int t, b;
+
+	SIM_I2C_GetStats(&t, &b);
+	SELFTEST_ASSERT(t - g_lastTransactions == transactions);
+	SELFTEST_ASSERT(b - g_lastBytes == bytes);
+	g_lastTransactions = t;
+	g_lastBytes = b;
+}
+
+void Test_I2C_MCP23017() {
+	// reset whole device
+	SIM_ClearOBK(0);
+	SIM_I2C_Reset();
+	g_lastTransactions = 0;
+	g_lastBytes = 0;
+
+	CMD_ExecuteCommand("startDriver I2C", 0);
+	CMD_ExecuteCommand("addI2CDevice_MCP23017 I2C1 0x27", 0);
+	// nothing is sent until bus queue is serviced
+	CMD_ExecuteCommand("MCP23017_MapPinToChannel I2C1 0x27 7 5", 0);
+	CMD_ExecuteCommand("MCP23017_MapPinToChannel I2C1 0x27 6 6", 0);
+	CMD_ExecuteCommand("MCP23017_MapPinToChannel I2C1 0x27 9 7", 0);
+	Test_I2C_AssertTraffic(0, 0);
+	// latches of both ports in one burst, then directions in another one
+	Sim_RunFrames(1, false);
+	SELFTEST_ASSERT(SIM_I2C_GetRegister(0x27, MCP_IODIRA) == 0);
+	SELFTEST_ASSERT(SIM_I2C_GetRegister(0x27, MCP_IODIRB) == 0);
+	Test_I2C_AssertTraffic(2, 3 + 3);
+
+	// three channels on two ports changed within one tick: single write, no reads
+	CHANNEL_Set(5, 1, 0);
+	CHANNEL_Set(6, 1, 0);
+	CHANNEL_Set(7, 1, 0);
+	Sim_RunFrames(1, false);
+	SELFTEST_ASSERT(SIM_I2C_GetRegister(0x27, MCP_OLATA) == 0xC0);
+	SELFTEST_ASSERT(SIM_I2C_GetRegister(0x27, MCP_OLATB) == 0x02);
+	Test_I2C_AssertTraffic(1, 3);
+
+	// same channel toggled many times in one tick is sent once, with last value
+	CHANNEL_Set(5, 0, 0);
+	CHANNEL_Set(5, 1, 0);
+	CHANNEL_Set(5, 0, 0);
+	Sim_RunFrames(1, false);
+	SELFTEST_ASSERT(SIM_I2C_GetRegister(0x27, MCP_OLATA) == 0x40);
+	SELFTEST_ASSERT(SIM_I2C_GetRegister(0x27, MCP_OLATB) == 0x02);
+	Test_I2C_AssertTraffic(1, 2);
+
+	// channel not mapped to any pin, or already in that state, costs nothing
+	CHANNEL_Set(8, 1, 0);
+	CHANNEL_Set(6, 1, 0);
+	Sim_RunFrames(1, false);
+	Test_I2C_AssertTraffic(0, 0);
+
+	// port B only
+	CHANNEL_Set(7, 0, 0);
+	Sim_RunFrames(1, false);
+	SELFTEST_ASSERT(SIM_I2C_GetRegister(0x27, MCP_OLATA) == 0x40);
+	SELFTEST_ASSERT(SIM_I2C_GetRegister(0x27, MCP_OLATB) == 0x00);
+	Test_I2C_AssertTraffic(1, 2);
+
+	// second expander on the same bus is independent
+	CMD_ExecuteCommand("addI2CDevice_MCP23017 I2C1 0x20", 0);
+	CMD_ExecuteCommand("MCP23017_MapPinToChannel I2C1 0x20 0 5", 0);
+	Sim_RunFrames(1, false);
+	Test_I2C_AssertTraffic(2, 6);
+	CHANNEL_Set(5, 1, 0);
+	Sim_RunFrames(1, false);
+	SELFTEST_ASSERT(SIM_I2C_GetRegister(0x27, MCP_OLATA) == 0xC0);
+	SELFTEST_ASSERT(SIM_I2C_GetRegister(0x20, MCP_OLATA) == 0x01);
+	Test_I2C_AssertTraffic(2, 4);
+
+	// many expanders changed in one tick: nothing is dropped, each gets its burst
+	CMD_ExecuteCommand("addI2CDevice_MCP23017 I2C1 0x21", 0);
+	CMD_ExecuteCommand("addI2CDevice_MCP23017 I2C1 0x22", 0);
+	CMD_ExecuteCommand("addI2CDevice_MCP23017 I2C1 0x23", 0);
+	CMD_ExecuteCommand("addI2CDevice_MCP23017 I2C1 0x24", 0);
+	CMD_ExecuteCommand("addI2CDevice_MCP23017 I2C1 0x25", 0);
+	CMD_ExecuteCommand("MCP23017_MapPinToChannel I2C1 0x21 0 5", 0);
+	CMD_ExecuteCommand("MCP23017_MapPinToChannel I2C1 0x22 0 5", 0);
+	CMD_ExecuteCommand("MCP23017_MapPinToChannel I2C1 0x23 0 5", 0);
+	CMD_ExecuteCommand("MCP23017_MapPinToChannel I2C1 0x24 0 5", 0);
+	CMD_ExecuteCommand("MCP23017_MapPinToChannel I2C1 0x25 0 5", 0);
+	Test_I2C_AssertTraffic(0, 0);
+	Sim_RunFrames(1, false);
+	Test_I2C_AssertTraffic(10, 30);
+	SELFTEST_ASSERT(SIM_I2C_GetRegister(0x21, MCP_OLATA) == 0x01);
+	SELFTEST_ASSERT(SIM_I2C_GetRegister(0x25, MCP_OLATA) == 0x01);
+	// channel shared by seven expanders
+	CHANNEL_Set(5, 0, 0);
+	Sim_RunFrames(1, false);
+	Test_I2C_AssertTraffic(7, 14);
+	SELFTEST_ASSERT(SIM_I2C_GetRegister(0x27, MCP_OLATA) == 0x40);
+	SELFTEST_ASSERT(SIM_I2C_GetRegister(0x20, MCP_OLATA) == 0x00);
+	SELFTEST_ASSERT(SIM_I2C_GetRegister(0x25, MCP_OLATA) == 0x00);
+
+	// stopping the driver sends whatever is still dirty
+	CHANNEL_Set(6, 0, 0);
+	CMD_ExecuteCommand("stopDriver I2C", 0);
+	SELFTEST_ASSERT(SIM_I2C_GetRegister(0x27, MCP_OLATA) == 0x00);
+	Test_I2C_AssertTraffic(1, 2);
+}
+
+#endif
@@ -0,0 +1,208 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "../cJSON/cJSON.h"
+#include "../httpserver/json_writer.h"
+
+#define SELFTEST_ASSERT_JSON_STRING(a, b) SELFTEST_ASSERT(!strcmp(a, b));
+
+static char g_printed[2048];
+static int g_printedLen;
+
+static int Test_JSONWriter_Printer(void *userData, const char *fmt, ...) {
+	va_list argList;
+
+	va_start(argList, fmt);
+	g_printedLen += vsnprintf(g_printed + g_printedLen, sizeof(g_printed) - g_printedLen, fmt, argList);
+	va_end(argList);
+	return 0;
+}
+
+// cJSON allocations are counted to compare peak heap use with tree building
+static int g_heapNow, g_heapPeak;
+
+static void *Test_JSONWriter_Malloc(size_t size) {
+	size_t *p = malloc(size + sizeof(size_t));
+	if (p == 0)
+		return 0;
+	*p = size;
+	g_heapNow += size;
+	if (g_heapNow > g_heapPeak)
+		g_heapPeak = g_heapNow;
+	return p + 1;
+}
+static void Test_JSONWriter_Free(void *ptr) {
+	size_t *p = ptr;
+	if (p == 0)
+		return;
+	p--;
+	g_heapNow -= *p;
+	free(p);
+}
+
+static void Test_JSONWriter_CompareNumber(double d) {
+	cJSON *n;
+	char *printed;
+	char buffer[64];
+	jsonWriter_t w;
+
+	n = cJSON_CreateNumber(d);
+	printed = cJSON_PrintUnformatted(n);
+	JSONWriter_InitBuffer(&w, buffer, sizeof(buffer));
+	JSONWriter_AddNumber(&w, NULL, d);
+	SELFTEST_ASSERT(JSONWriter_Finish(&w) > 0);
+	SELFTEST_ASSERT_JSON_STRING(buffer, printed);
+	free(printed);
+	cJSON_Delete(n);
+}
+
+// Same shape as consumption_stats, samples are whole mWh
+static void Test_JSONWriter_WriteStats(jsonWriter_t *w, int samples) {
+	int i;
+
+	JSONWriter_BeginObject(w, NULL);
+	JSONWriter_AddInt(w, "uptime", 123456);
+	JSONWriter_AddFloat(w, "consumption_total", 123456.789, 3);
+	JSONWriter_AddFloat(w, "consumption_last_hour", 45.678, 3);
+	JSONWriter_AddInt(w, "consumption_stat_index", 7);
+	JSONWriter_AddInt(w, "consumption_sample_count", samples);
+	JSONWriter_AddInt(w, "consumption_sampling_period", 60);
+	JSONWriter_AddString(w, "consumption_clear_date", "2022-11-01T12:00+01:00");
+	JSONWriter_BeginArray(w, "consumption_samples");
+	for (i = 0; i < samples; i++) {
+		JSONWriter_AddFloat(w, NULL, (i * 137 % 1000) * 0.001 + i, 3);
+	}
+	JSONWriter_EndArray(w);
+	JSONWriter_EndObject(w);
+}
+static cJSON *Test_JSONWriter_BuildStatsTree(int samples) {
+	cJSON *root, *stats;
+	int i;
+
+	root = cJSON_CreateObject();
+	cJSON_AddNumberToObject(root, "uptime", 123456);
+	cJSON_AddNumberToObject(root, "consumption_total", 123456.789);
+	cJSON_AddNumberToObject(root, "consumption_last_hour", 45.678);
+	cJSON_AddNumberToObject(root, "consumption_stat_index", 7);
+	cJSON_AddNumberToObject(root, "consumption_sample_count", samples);
+	cJSON_AddNumberToObject(root, "consumption_sampling_period", 60);
+	cJSON_AddStringToObject(root, "consumption_clear_date", "2022-11-01T12:00+01:00");
+	stats = cJSON_CreateArray();
+	for (i = 0; i < samples; i++) {
+		cJSON_AddItemToArray(stats, cJSON_CreateNumber((i * 137 % 1000) * 0.001 + i));
+	}
+	cJSON_AddItemToObject(root, "consumption_samples", stats);
+	return root;
+}
+
+void Test_JSONWriter() {
+	char buffer[1024];
+	char small[16];
+	jsonWriter_t w;
+	cJSON *parsed, *tree;
+	struct cJSON_Hooks hooks;
+	char *printed;
+	int len, treePeak;
+	const char *tricky = "quote\" slash\\ tab\t nl\n ctl\x01 utf8 \xC2\xB0" "C";
+
+	// commas, nesting, escaping
+	JSONWriter_InitBuffer(&w, buffer, sizeof(buffer));
+	JSONWriter_BeginObject(&w, NULL);
+	JSONWriter_AddString(&w, "a", "b");
+	JSONWriter_AddInt(&w, "i", -2147483647 - 1);
+	JSONWriter_AddBool(&w, "t", true);
+	JSONWriter_AddString(&w, "n", NULL);
+	JSONWriter_BeginArray(&w, "arr");
+	JSONWriter_AddInt(&w, NULL, 1);
+	JSONWriter_BeginObject(&w, NULL);
+	JSONWriter_EndObject(&w);
+	JSONWriter_BeginArray(&w, NULL);
+	JSONWriter_EndArray(&w);
+	JSONWriter_AddStringf(&w, NULL, "~/%i/get", 5);
+	JSONWriter_EndArray(&w);
+	JSONWriter_AddString(&w, "k\"", "\"\\\r\x1f");
+	JSONWriter_EndObject(&w);
+	len = JSONWriter_Finish(&w);
+	SELFTEST_ASSERT_JSON_STRING(buffer, "{\"a\":\"b\",\"i\":-2147483648,\"t\":true,\"n\":null,"
+		"\"arr\":[1,{},[],\"~/5/get\"],\"k\\\"\":\"\\\"\\\\\\r\\u001f\"}");
+	SELFTEST_ASSERT(len == strlen(buffer));
+
+	// escaped string must parse back to the original one
+	JSONWriter_InitBuffer(&w, buffer, sizeof(buffer));
+	JSONWriter_BeginObject(&w, NULL);
+	JSONWriter_AddString(&w, "s", tricky);
+	JSONWriter_EndObject(&w);
+	SELFTEST_ASSERT(JSONWriter_Finish(&w) > 0);
+	parsed = cJSON_Parse(buffer);
+	SELFTEST_ASSERT(parsed != 0);
+	SELFTEST_ASSERT_JSON_STRING(cJSON_GetObjectItemCaseSensitive(parsed, "s")->valuestring, tricky);
+	cJSON_Delete(parsed);
+
+	// numbers are printed the same way cJSON does it
+	Test_JSONWriter_CompareNumber(0);
+	Test_JSONWriter_CompareNumber(-17);
+	Test_JSONWriter_CompareNumber(0.1);
+	Test_JSONWriter_CompareNumber(1.0 / 3.0);
+	Test_JSONWriter_CompareNumber(1e300);
+	Test_JSONWriter_CompareNumber(-2.5e-7);
+	Test_JSONWriter_CompareNumber(0.26f);
+	Test_JSONWriter_CompareNumber(NAN);
+
+	// fixed decimals
+	JSONWriter_InitBuffer(&w, buffer, sizeof(buffer));
+	JSONWriter_BeginArray(&w, NULL);
+	JSONWriter_AddFloat(&w, NULL, 1234 * 0.001f, 3);
+	JSONWriter_AddFloat(&w, NULL, 1000.0, 2);
+	JSONWriter_AddFloat(&w, NULL, -0.0001, 3);
+	JSONWriter_AddFloat(&w, NULL, 0.26f, 6);
+	JSONWriter_AddFloat(&w, NULL, INFINITY, 2);
+	JSONWriter_AddFloat(&w, NULL, 2.6, 0);
+	JSONWriter_EndArray(&w);
+	SELFTEST_ASSERT(JSONWriter_Finish(&w) > 0);
+	SELFTEST_ASSERT_JSON_STRING(buffer, "[1.234,1000,0,0.26,null,3]");
+
+	// overflow is reported and output stays terminated inside the buffer
+	JSONWriter_InitBuffer(&w, small, sizeof(small));
+	JSONWriter_BeginObject(&w, NULL);
+	JSONWriter_AddString(&w, "key", "longer than sixteen bytes");
+	JSONWriter_EndObject(&w);
+	SELFTEST_ASSERT(JSONWriter_Finish(&w) == -1);
+	SELFTEST_ASSERT(strlen(small) < sizeof(small));
+	// so is nesting that is not closed
+	JSONWriter_InitBuffer(&w, buffer, sizeof(buffer));
+	JSONWriter_BeginObject(&w, NULL);
+	SELFTEST_ASSERT(JSONWriter_Finish(&w) == -1);
+
+	// printer gets the same output as buffer, in chunks
+	JSONWriter_InitBuffer(&w, buffer, sizeof(buffer));
+	Test_JSONWriter_WriteStats(&w, 60);
+	SELFTEST_ASSERT(JSONWriter_Finish(&w) > 0);
+	g_printedLen = 0;
+	JSONWriter_InitPrinter(&w, 0, Test_JSONWriter_Printer);
+	Test_JSONWriter_WriteStats(&w, 60);
+	SELFTEST_ASSERT(JSONWriter_Finish(&w) == g_printedLen);
+	SELFTEST_ASSERT_JSON_STRING(g_printed, buffer);
+	parsed = cJSON_Parse(buffer);
+	SELFTEST_ASSERT(parsed != 0);
+	SELFTEST_ASSERT(cJSON_GetArraySize(cJSON_GetObjectItemCaseSensitive(parsed, "consumption_samples")) == 60);
+	SELFTEST_ASSERT(Float_Equals(cJSON_GetArrayItem(cJSON_GetObjectItemCaseSensitive(parsed, "consumption_samples"), 3)->valuedouble, 3.411));
+	cJSON_Delete(parsed);
+
+	// peak heap of the old way: tree plus printed copy
+	hooks.malloc_fn = Test_JSONWriter_Malloc;
+	hooks.free_fn = Test_JSONWriter_Free;
+	cJSON_InitHooks(&hooks);
+	g_heapNow = g_heapPeak = 0;
+	tree = Test_JSONWriter_BuildStatsTree(60);
+	printed = cJSON_PrintUnformatted(tree);
+	cJSON_Delete(tree);
+	cJSON_free(printed);
+	treePeak = g_heapPeak;
+	SELFTEST_ASSERT(g_heapNow == 0);
+	cJSON_InitHooks(0);
+	printf("Test_JSONWriter: 60 samples stats, cJSON peak heap %i bytes, writer needs %i bytes output buffer only\n",
+		treePeak, (int)strlen(buffer) + 1);
+	SELFTEST_ASSERT(treePeak > (int)strlen(buffer) * 2);
+}
+
+#endif
@@ -68,6 +68,9 @@ void Test_ClockEvents();
 void Test_Commands_Channels();
 void Test_LEDDriver();
 void Test_TuyaMCU_Basic();
+void Test_TuyaMCU_Parser();
+void Test_TuyaMCU_Mappings();
+void Test_TuyaMCU_Benchmark();
 void Test_Command_If();
 void Test_Command_If_Else();
 void Test_LFS();
@@ -82,6 +85,7 @@ void Test_NTP();
 void Test_MQTT();
 void Test_Tasmota();
 void Test_EnergyMeter();
+void Test_JSONWriter();
 void Test_DHT();
 void Test_Flags();
 void Test_MultiplePinsOnChannel();
@@ -101,6 +105,16 @@ void Test_Demo_ButtonToggleGroup();
 void Test_Role_ToggleAll_2();
 void Test_WaitFor();
 void Test_IF_Inside_Backlog();
+void Test_Expressions_RunTests_Compiled();
+void Test_Logging();
+void Test_FlashVars();
+void Test_PinTicks();
+void Test_HTTPServer();
+void Test_TimerHeap();
+void Test_IRCapture();
+void Test_I2C_MCP23017();
+void Test_SoftBus();
+void Test_SensorSched();
 
 void Test_GetJSONValue_Setup(const char *text);
 void Test_FakeHTTPClientPacket_GET(const char *tg);
@@ -112,6 +126,8 @@ const char *Test_GetLastHTMLReply();
 void Sim_RunMiliseconds(int ms, bool bApplyRealtimeWait);
 void Sim_RunSeconds(float f, bool bApplyRealtimeWait);
 void Sim_RunFrames(int n, bool bApplyRealtimeWait);
+void Sim_RunFrame(int frameTime);
+int rtos_get_time();
 
 int Test_GetJSONValue_Integer_Nested2(const char *par1, const char *par2, const char *keyword);
 float Test_GetJSONValue_Float_Nested2(const char *par1, const char *par2, const char *keyword);
@@ -120,12 +136,14 @@ const char *Test_GetJSONValue_String(const char *keyword, const char *obj);
 const char *Test_GetJSONValue_String_Nested(const char *par1, const char *keyword);
 const char *Test_GetJSONValue_String_Nested2(const char *par1, const char *par2, const char *keyword);
 
+void SIM_ClearAndPrepareForMQTTTesting(const char *clientName, const char *groupName);
 void SIM_SendFakeMQTT(const char *text, const char *arguments);
 void SIM_SendFakeMQTTAndRunSimFrame_CMND(const char *command, const char *arguments);
 void SIM_SendFakeMQTTAndRunSimFrame_CMND_ViaGroupTopic(const char *command, const char *arguments);
 void SIM_SendFakeMQTTRawChannelSet(int channelIndex, const char *arguments);
 void SIM_SendFakeMQTTRawChannelSet_ViaGroupTopic(int channelIndex, const char *arguments);
 void SIM_ClearMQTTHistory();
+void SIM_SetMQTTOffline(bool bOffline);
 bool SIM_CheckMQTTHistoryForString(const char *topic, const char *value, bool bRetain);
 bool SIM_HasMQTTHistoryStringWithJSONPayload(const char *topic, bool bPrefixMode, const char *object1, const char *object2, const char *key, const char *value);
 bool SIM_CheckMQTTHistoryForFloat(const char *topic, float value, bool bRetain);
@@ -133,5 +151,7 @@ const char *SIM_GetMQTTHistoryString(const char *topic, bool bPrefixMode);
 bool SIM_BeginParsingMQTTJSON(const char *topic, bool bPrefixMode);
 
 void SIM_SimulateUserClickOnPin(int pin);
+int SIM_GetPWMValue(int index);
+int SIM_GetPWMUpdatesCount();
 
 #endif
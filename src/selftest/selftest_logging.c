@@ -0,0 +1,69 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "../logging/logging.h"
+
+void Test_Logging() {
+	const char *reply;
+	const char *first, *second;
+	int i;
+	int evaluated;
+	unsigned int suppressed, emitted;
+
+	// reset whole device
+	SIM_ClearOBK(0);
+
+	// drain whatever was logged during startup
+	Test_FakeHTTPClientPacket_GET("lograw");
+
+	ADDLOG_INFO(LOG_FEATURE_CMD, "Plain log %i", 5);
+	Test_FakeHTTPClientPacket_GET("lograw");
+	reply = Test_GetLastHTMLReply();
+	SELFTEST_ASSERT(strstr(reply, "Info:CMD:Plain log 5\r\n") != 0);
+
+	// deferred formatting must give the same text as vsnprintf
+	CMD_ExecuteCommand("logdeferred 1", 0);
+	ADDLOG_INFO(LOG_FEATURE_CMD, "Deferred %i %.2f %x%% %5ld", 12, 3.5f, 255, 7L);
+	Test_FakeHTTPClientPacket_GET("lograw");
+	reply = Test_GetLastHTMLReply();
+	SELFTEST_ASSERT(strstr(reply, "Info:CMD:Deferred 12 3.50 ff%     7\r\n") != 0);
+
+	// string arguments are never deferred, but order must be kept
+	ADDLOG_INFO(LOG_FEATURE_CMD, "First %i", 1);
+	ADDLOG_INFO(LOG_FEATURE_CMD, "Second %s", "text");
+	Test_FakeHTTPClientPacket_GET("lograw");
+	reply = Test_GetLastHTMLReply();
+	first = strstr(reply, "Info:CMD:First 1\r\n");
+	second = strstr(reply, "Info:CMD:Second text\r\n");
+	SELFTEST_ASSERT(first != 0);
+	SELFTEST_ASSERT(second != 0);
+	SELFTEST_ASSERT(first < second);
+	CMD_ExecuteCommand("logdeferred 0", 0);
+
+	// more than log memory can hold, reader must see the overflow marker
+	for (i = 0; i < 100; i++) {
+		ADDLOG_INFO(LOG_FEATURE_CMD, "Overflow test line %i, some more text to make it longer", i);
+	}
+	Test_FakeHTTPClientPacket_GET("lograw");
+	reply = Test_GetLastHTMLReply();
+	SELFTEST_ASSERT(reply[0] == '^');
+	SELFTEST_ASSERT(strstr(reply, "Overflow test line 99,") != 0);
+	SELFTEST_ASSERT(strstr(reply, "Overflow test line 0,") == 0);
+
+	// filtered logs must not evaluate their arguments, but must be counted
+	CMD_ExecuteCommand("loglevel 3", 0);
+	evaluated = 0;
+	suppressed = g_logSuppressed[LOG_FEATURE_CMD];
+	emitted = g_logEmitted[LOG_FEATURE_CMD];
+	ADDLOG_DEBUG(LOG_FEATURE_CMD, "Debug log %i", evaluated++);
+	ADDLOG_EXTRADEBUG(LOG_FEATURE_CMD, "Extra debug log %i", evaluated++);
+	SELFTEST_ASSERT(evaluated == 0);
+	SELFTEST_ASSERT(g_logSuppressed[LOG_FEATURE_CMD] == suppressed + 2);
+	ADDLOG_INFO(LOG_FEATURE_CMD, "Info log %i", evaluated++);
+	SELFTEST_ASSERT(evaluated == 1);
+	SELFTEST_ASSERT(g_logEmitted[LOG_FEATURE_CMD] == emitted + 1);
+	Test_FakeHTTPClientPacket_JSON("api/logconfig");
+	SELFTEST_ASSERT(Test_GetJSONValue_Integer("level", 0) == 3);
+}
+
+#endif
@@ -2,6 +2,7 @@
 
 #include "selftest_local.h"
 #include "../hal/hal_wifi.h"
+#include "../mqtt/new_mqtt.h"
 
 void SIM_ClearAndPrepareForMQTTTesting(const char *clientName, const char *groupName) {
 	SIM_ClearOBK(0);
@@ -43,6 +44,8 @@ void Test_MQTT_Get_And_Reply() {
 	}
 }
 void Test_MQTT_Channels() {
+	unsigned int bytes;
+
 	SIM_ClearOBK(0);
 	SIM_ClearAndPrepareForMQTTTesting("myTestDevice", "bekens");
 
@@ -98,8 +101,11 @@ void Test_MQTT_Channels() {
 	SIM_ClearMQTTHistory();
 
 	// This should trigger MQTT publish
+	bytes = MQTT_GetPublishedBytesCounter();
 	CMD_ExecuteCommand("publish myTestVal 123", 0);
 	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("myTestDevice/myTestVal/get", "123", false);
+	// topic and payload lengths are counted
+	SELFTEST_ASSERT(MQTT_GetPublishedBytesCounter() == bytes + strlen("myTestDevice/myTestVal/get") + strlen("123"));
 	// if assert has passed, we can clear SIM MQTT history, it's no longer needed
 	SIM_ClearMQTTHistory();
 
@@ -403,6 +409,120 @@ void Test_MQTT_Topic_With_Slash() {
 }
 
 
+void Test_MQTT_Queue() {
+	int dropped, coalesced, i;
+	char buffer[32];
+
+	SIM_ClearOBK(0);
+	SIM_ClearAndPrepareForMQTTTesting("queueDevice", "bekens");
+	SIM_ClearMQTTHistory();
+	SELFTEST_ASSERT(MQTT_GetQueueDepth() == 0);
+
+	dropped = MQTT_GetQueueDroppedCounter();
+	coalesced = MQTT_GetQueueCoalescedCounter();
+	// same topic and channel are merged, newest value wins
+	MQTT_QueuePublish("queueDevice", "a", "1", 0);
+	MQTT_QueuePublish("queueDevice", "b", "2", 0);
+	MQTT_QueuePublish("queueDevice", "a", "3", 0);
+	SELFTEST_ASSERT(MQTT_GetQueueDepth() == 2);
+	SELFTEST_ASSERT(MQTT_GetQueueCoalescedCounter() == coalesced + 1);
+
+	// fill the ring, the rest is dropped
+	for (i = 0; i < MQTT_MAX_QUEUE_SIZE + 2; i++) {
+		sprintf(buffer, "c%i", i);
+		MQTT_QueuePublish("queueDevice", buffer, "x", 0);
+	}
+	SELFTEST_ASSERT(MQTT_GetQueueDepth() == MQTT_MAX_QUEUE_SIZE);
+	SELFTEST_ASSERT(MQTT_GetQueueDroppedCounter() == dropped + 4);
+
+	// dequeue happens in FIFO order
+	PublishQueuedItems();
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("queueDevice/a", "3", false);
+	SELFTEST_ASSERT(MQTT_GetQueueDepth() == MQTT_MAX_QUEUE_SIZE - MQTT_QUEUED_ITEMS_PUBLISHED_AT_ONCE);
+	// every update sends a batch, so a few of them must be enough
+	for (i = 0; i < MQTT_MAX_QUEUE_SIZE && MQTT_GetQueueDepth() > 0; i++) {
+		MQTT_RunEverySecondUpdate();
+	}
+	SELFTEST_ASSERT(MQTT_GetQueueDepth() == 0);
+	SIM_ClearMQTTHistory();
+
+	// ring wraps around and is reusable
+	MQTT_QueuePublish("queueDevice", "d", "4", 0);
+	SELFTEST_ASSERT(MQTT_GetQueueDepth() == 1);
+	PublishQueuedItems();
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("queueDevice/d", "4", false);
+	SELFTEST_ASSERT(MQTT_GetQueueDepth() == 0);
+	SIM_ClearMQTTHistory();
+}
+
+void Test_MQTT_Dedup() {
+	int i;
+
+	SIM_ClearOBK(0);
+	SIM_ClearAndPrepareForMQTTTesting("dedupDevice", "bekens");
+	SIM_ClearMQTTHistory();
+
+	// absolute deadband for script publishes
+	CMD_ExecuteCommand("mqttDedup myVal 0 1", 0);
+	CMD_ExecuteCommand("publishFloat myVal 10", 0);
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_FLOAT("dedupDevice/myVal/get", 10.0f, false);
+	SIM_ClearMQTTHistory();
+	CMD_ExecuteCommand("publishFloat myVal 10.5", 0);
+	SELFTEST_ASSERT(SIM_GetMQTTHistoryString("dedupDevice/myVal/get", false) == 0);
+	CMD_ExecuteCommand("publishFloat myVal 12", 0);
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_FLOAT("dedupDevice/myVal/get", 12.0f, false);
+	SIM_ClearMQTTHistory();
+
+	// percentage deadband, 10% of 12 is 1.2
+	CMD_ExecuteCommand("mqttDedup myVal 0 0 10", 0);
+	CMD_ExecuteCommand("publishInt myVal 13", 0);
+	SELFTEST_ASSERT(SIM_GetMQTTHistoryString("dedupDevice/myVal/get", false) == 0);
+	CMD_ExecuteCommand("publishInt myVal 14", 0);
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("dedupDevice/myVal/get", "14", false);
+	SIM_ClearMQTTHistory();
+
+	// channel publishes, minimal interval keeps only the newest value
+	PIN_SetPinRoleForPinIndex(9, IOR_Relay);
+	PIN_SetPinChannelForPinIndex(9, 5);
+	PIN_SetPinRoleForPinIndex(10, IOR_Relay);
+	PIN_SetPinChannelForPinIndex(10, 6);
+	CMD_ExecuteCommand("mqttDedup 5 3", 0);
+	CMD_ExecuteCommand("setChannel 5 1", 0);
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("dedupDevice/5/get", "1", false);
+	SIM_ClearMQTTHistory();
+	CMD_ExecuteCommand("setChannel 5 2", 0);
+	CMD_ExecuteCommand("setChannel 5 3", 0);
+	SELFTEST_ASSERT(SIM_GetMQTTHistoryString("dedupDevice/5/get", false) == 0);
+	for (i = 0; i < 3; i++) {
+		MQTT_Dedup_Tick();
+	}
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("dedupDevice/5/get", "3", false);
+	SIM_ClearMQTTHistory();
+
+	// forced publish is not held back and replaces the delayed value
+	CMD_ExecuteCommand("setChannel 5 4", 0);
+	SELFTEST_ASSERT(SIM_GetMQTTHistoryString("dedupDevice/5/get", false) == 0);
+	CMD_ExecuteCommand("publishChannel 5", 0);
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("dedupDevice/5/get", "4", false);
+	SIM_ClearMQTTHistory();
+	for (i = 0; i < 3; i++) {
+		MQTT_Dedup_Tick();
+	}
+	SELFTEST_ASSERT(SIM_GetMQTTHistoryString("dedupDevice/5/get", false) == 0);
+
+	// topics without rules are not affected
+	CMD_ExecuteCommand("setChannel 6 1", 0);
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("dedupDevice/6/get", "1", false);
+	SIM_ClearMQTTHistory();
+	CMD_ExecuteCommand("setChannel 6 2", 0);
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("dedupDevice/6/get", "2", false);
+	SIM_ClearMQTTHistory();
+
+	CMD_ExecuteCommand("clearAll", 0);
+	SELFTEST_ASSERT(MQTT_Dedup_IsActive() == false);
+}
+
+
 void Test_MQTT(){
 	Test_MQTT_Get_And_Reply();
 	Test_MQTT_Misc();
@@ -411,6 +531,8 @@ void Test_MQTT(){
 	Test_MQTT_LED_RGB();
 	Test_MQTT_Topic_With_Slash();
 	Test_MQTT_Topic_With_Slashes();
+	Test_MQTT_Queue();
+	Test_MQTT_Dedup();
 }
 
 #endif
@@ -0,0 +1,100 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+
+static void Test_PinTicks_Benchmark(const char *desc) {
+	int i;
+	int loops = 100000;
+	long t;
+	clock_t start;
+
+	start = clock();
+	for (i = 0; i < loops; i++) {
+		PIN_ticks(0);
+	}
+	t = clock() - start;
+	if (t <= 0)
+		t = 1;
+	printf("Test_PinTicks: %s - %i ticks took %li ms, %li ticks/sec\n", desc, loops,
+		t * 1000 / CLOCKS_PER_SEC, (long)((double)loops * CLOCKS_PER_SEC / t));
+}
+
+void Test_PinTicks() {
+	int i;
+	int updates;
+
+	// reset whole device
+	SIM_ClearOBK(0);
+
+	Test_PinTicks_Benchmark("no pins");
+
+	// PWM is written on first tick and then only when value changes
+	PIN_SetPinRoleForPinIndex(24, IOR_PWM);
+	PIN_SetPinChannelForPinIndex(24, 1);
+	PIN_SetPinRoleForPinIndex(26, IOR_PWM_n);
+	PIN_SetPinChannelForPinIndex(26, 1);
+	CMD_ExecuteCommand("setChannel 1 30", 0);
+	PIN_ticks(0);
+	SELFTEST_ASSERT(SIM_GetPWMValue(24) == 30);
+	SELFTEST_ASSERT(SIM_GetPWMValue(26) == 70);
+	updates = SIM_GetPWMUpdatesCount();
+	for (i = 0; i < 100; i++) {
+		PIN_ticks(0);
+	}
+	SELFTEST_ASSERT(SIM_GetPWMUpdatesCount() == updates);
+	CMD_ExecuteCommand("setChannel 1 40", 0);
+	PIN_ticks(0);
+	SELFTEST_ASSERT(SIM_GetPWMValue(24) == 40);
+	SELFTEST_ASSERT(SIM_GetPWMValue(26) == 60);
+
+	// role change is picked up without restart
+	PIN_SetPinRoleForPinIndex(26, IOR_None);
+	CMD_ExecuteCommand("setChannel 1 50", 0);
+	PIN_ticks(0);
+	SELFTEST_ASSERT(SIM_GetPWMValue(24) == 50);
+	SELFTEST_ASSERT(SIM_GetPWMValue(26) == 60);
+
+	// digital input and toggle are still handled
+	PIN_SetPinRoleForPinIndex(6, IOR_DigitalInput);
+	PIN_SetPinChannelForPinIndex(6, 2);
+	PIN_SetPinRoleForPinIndex(7, IOR_ToggleChannelOnToggle);
+	PIN_SetPinChannelForPinIndex(7, 3);
+	PIN_SetPinRoleForPinIndex(8, IOR_Relay);
+	PIN_SetPinChannelForPinIndex(8, 3);
+	SIM_SetSimulatedPinValue(6, true);
+	Sim_RunSeconds(1, false);
+	SELFTEST_ASSERT_CHANNEL(2, 1);
+	SELFTEST_ASSERT_CHANNEL(3, 0);
+	SIM_SetSimulatedPinValue(6, false);
+	SIM_SetSimulatedPinValue(7, true);
+	Sim_RunSeconds(1, false);
+	SELFTEST_ASSERT_CHANNEL(2, 0);
+	SELFTEST_ASSERT_CHANNEL(3, 1);
+	SIM_SetSimulatedPinValue(7, false);
+	Sim_RunSeconds(1, false);
+	SELFTEST_ASSERT_CHANNEL(3, 0);
+
+	// clearing pins drops them from tick lists
+	CFG_ClearPins();
+	CMD_ExecuteCommand("setChannel 1 10", 0);
+	PIN_ticks(0);
+	SELFTEST_ASSERT(SIM_GetPWMValue(24) == 50);
+
+	// 8 pins
+	for (i = 0; i < 8; i++) {
+		PIN_SetPinRoleForPinIndex(i, i % 2 ? IOR_Button : IOR_DigitalInput);
+		PIN_SetPinChannelForPinIndex(i, 1);
+	}
+	Test_PinTicks_Benchmark("8 pins");
+
+	// all pins
+	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
+		PIN_SetPinRoleForPinIndex(i, i % 2 ? IOR_Button : IOR_DigitalInput);
+		PIN_SetPinChannelForPinIndex(i, 1);
+	}
+	Test_PinTicks_Benchmark("all pins");
+
+	CFG_ClearPins();
+}
+
+#endif
@@ -20,6 +20,25 @@ void Test_RepeatingEvents() {
 	SELFTEST_ASSERT_CHANNEL(11, 2);
 	Sim_RunSeconds(6.0f, false);
 	SELFTEST_ASSERT_CHANNEL(11, 2);
+
+	// repeating event for a command that is registered later
+	CMD_ExecuteCommand("addRepeatingEventID 2 -1 7 myTestAlias", 0);
+	Sim_RunSeconds(3.0f, false);
+	SELFTEST_ASSERT_CHANNEL(12, 0);
+	CMD_ExecuteCommand("alias myTestAlias addChannel 12 1", 0);
+	Sim_RunSeconds(2.0f, false);
+	SELFTEST_ASSERT_CHANNEL(12, 1);
+	CMD_ExecuteCommand("cancelRepeatingEvent 7", 0);
+	Sim_RunSeconds(4.0f, false);
+	SELFTEST_ASSERT_CHANNEL(12, 1);
+
+	// constants in arguments are still expanded on every run
+	CMD_ExecuteCommand("addRepeatingEvent 2 2 addChannel 13 $CH12", 0);
+	Sim_RunSeconds(2.5f, false);
+	SELFTEST_ASSERT_CHANNEL(13, 1);
+	CMD_ExecuteCommand("setChannel 12 5", 0);
+	Sim_RunSeconds(2.0f, false);
+	SELFTEST_ASSERT_CHANNEL(13, 6);
 }
 
 
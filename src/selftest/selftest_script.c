@@ -1,6 +1,7 @@
 #ifdef WINDOWS
 
 #include "selftest_local.h".
+#include <timeapi.h>
 
 const char *demo_loop_1 =
 "setChannel 10 0\r\n"
@@ -108,10 +109,87 @@ void Test_Scripting_Loop3() {
 	SELFTEST_ASSERT_CHANNEL(20, 0);
 	//system("pause");
 }
+const char *demo_labels =
+"// comments and labels are not executed\r\n"
+"addChannel 13 1\r\n"
+"goto second\r\n"
+"first:\r\n"
+"    setChannel 11 1\r\n"
+"    goto third\r\n"
+"second:\r\n"
+"    // comment inside\r\n"
+"    addChannel 10 1\r\n"
+"    goto first\r\n"
+"third:\r\n"
+"    setChannel 12 1\r\n"
+"    goto missing\r\n";
+
+void Test_Scripting_Labels() {
+	// reset whole device
+	SIM_ClearOBK(0);
+	CMD_ExecuteCommand("lfs_format", 0);
+
+	Test_FakeHTTPClientPacket_POST("api/lfs/demo_labels.txt", demo_labels);
+	CMD_ExecuteCommand("startScript demo_labels.txt second 5", 0);
+	SELFTEST_ASSERT_INTEGER(CMD_GetCountActiveScriptThreads(), 1);
+	// one line per frame
+	CMD_ExecuteCommand("setScriptMaxLoops 1 5", 0);
+	Sim_RunFrames(1, false);
+	SELFTEST_ASSERT_CHANNEL(10, 1);
+	SELFTEST_ASSERT_CHANNEL(11, 0);
+	Sim_RunFrames(2, false);
+	SELFTEST_ASSERT_CHANNEL(11, 1);
+	SELFTEST_ASSERT_CHANNEL(12, 0);
+	Sim_RunFrames(2, false);
+	SELFTEST_ASSERT_CHANNEL(12, 1);
+	// missing label goes to the start of file, so script runs forever
+	CMD_ExecuteCommand("setScriptMaxLoops 10 5", 0);
+	Sim_RunFrames(10, false);
+	SELFTEST_ASSERT_INTEGER(CMD_GetCountActiveScriptThreads(), 1);
+	SELFTEST_ASSERT(CHANNEL_Get(13) > 5);
+	CMD_ExecuteCommand("stopScript 5", 0);
+	SELFTEST_ASSERT_INTEGER(CMD_GetCountActiveScriptThreads(), 0);
+}
+
+// Tight loop at the end of long file with many labels
+void Test_Scripting_Benchmark() {
+	static char script[16384];
+	int i, len, frames;
+	long start, ms;
+
+	SIM_ClearOBK(0);
+	CMD_ExecuteCommand("lfs_format", 0);
+
+	len = sprintf(script, "setScriptMaxLoops 1000\r\nsetChannel 30 0\r\ngoto loop\r\n");
+	for (i = 0; i < 100; i++) {
+		len += sprintf(script + len, "// filler %i\r\nlabel%i:\r\n    setChannel 31 %i\r\n", i, i, i);
+	}
+	len += sprintf(script + len, "loop:\r\n    addChannel 30 1\r\n    if $CH30<20000 then goto loop\r\n    setChannel 32 1\r\n");
+	Test_FakeHTTPClientPacket_POST("api/lfs/bench.txt", script);
+	CMD_ExecuteCommand("startScript bench.txt", 0);
+
+	start = timeGetTime();
+	frames = 0;
+	while (CMD_GetCountActiveScriptThreads() > 0 && frames < 1000) {
+		Sim_RunFrames(1, false);
+		frames++;
+	}
+	ms = timeGetTime() - start;
+	if (ms <= 0)
+		ms = 1;
+	SELFTEST_ASSERT_CHANNEL(30, 20000);
+	SELFTEST_ASSERT_CHANNEL(31, 0);
+	SELFTEST_ASSERT_CHANNEL(32, 1);
+	printf("Test_Scripting_Benchmark: 40000 lines in %i frames, %li ms, %li lines/s\n",
+		frames, ms, 40000 * 1000 / ms);
+}
+
 void Test_Scripting() {
 	Test_Scripting_Loop1();
 	Test_Scripting_Loop2();
 	Test_Scripting_Loop3();
+	Test_Scripting_Labels();
+	Test_Scripting_Benchmark();
 }
 
 #endif
@@ -0,0 +1,196 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "../driver/drv_sensor_sched.h"
+
+// what fake sensors did and when
+typedef struct sensorEvent_s {
+	int ms;
+	char job;
+	char what;
+} sensorEvent_t;
+
+static sensorEvent_t g_events[64];
+static int g_eventCount;
+static int g_nowMs;
+static bool g_fetchOk;
+// scheduler reads simulated tick count
+extern int g_simulatedTimeNow;
+
+static void Test_SensorSched_Log(sensorJob_t *job, char what) {
+	if (g_eventCount >= sizeof(g_events) / sizeof(g_events[0]))
+		return;
+	g_events[g_eventCount].ms = g_nowMs;
+	g_events[g_eventCount].job = job->name[0];
+	g_events[g_eventCount].what = what;
+	g_eventCount++;
+}
+static int Test_SensorSched_Start20(sensorJob_t *job) {
+	Test_SensorSched_Log(job, 'S');
+	return 20;
+}
+static int Test_SensorSched_StartFail(sensorJob_t *job) {
+	Test_SensorSched_Log(job, 'S');
+	return SENSOR_SCHED_ERROR;
+}
+static bool Test_SensorSched_Fetch(sensorJob_t *job) {
+	Test_SensorSched_Log(job, 'F');
+	return g_fetchOk;
+}
+static void Test_SensorSched_Run(int ms) {
+	for (; ms > 0; ms -= 5) {
+		g_nowMs += 5;
+		g_simulatedTimeNow += 5;
+		SensorSched_RunQuickTick();
+	}
+}
+static int Test_SensorSched_Count(char job, char what) {
+	int i, c = 0;
+
+	for (i = 0; i < g_eventCount; i++) {
+		if (g_events[i].job == job && g_events[i].what == what)
+			c++;
+	}
+	return c;
+}
+
+static void Test_SensorSched_Jobs() {
+	sensorJob_t a = { "A", Test_SensorSched_Start20, Test_SensorSched_Fetch, 1000 };
+	sensorJob_t b = { "B", Test_SensorSched_Start20, Test_SensorSched_Fetch, 1000 };
+	sensorJob_t p = { "P", Test_SensorSched_Start20, Test_SensorSched_Fetch, 500, true };
+	sensorJob_t d = { "D", Test_SensorSched_StartFail, Test_SensorSched_Fetch, 0 };
+	int i;
+
+	g_eventCount = 0;
+	g_nowMs = 0;
+	g_fetchOk = true;
+	SensorSched_Add(&a);
+	SensorSched_Add(&b);
+	SensorSched_Add(&p);
+	// never due by itself
+	SensorSched_Add(&d);
+	SELFTEST_ASSERT(SensorSched_GetJobCount() == 4);
+
+	Test_SensorSched_Run(2000);
+	// spread over the second, command and result are separate ticks
+	SELFTEST_ASSERT(g_events[0].job == 'A' && g_events[0].what == 'S' && g_events[0].ms == 100);
+	SELFTEST_ASSERT(g_events[1].job == 'A' && g_events[1].what == 'F' && g_events[1].ms == 120);
+	SELFTEST_ASSERT(g_events[2].job == 'B' && g_events[2].what == 'S' && g_events[2].ms == 350);
+	SELFTEST_ASSERT(g_events[3].job == 'B' && g_events[3].what == 'F' && g_events[3].ms == 370);
+	// periodic mode has no start phase
+	SELFTEST_ASSERT(g_events[4].job == 'P' && g_events[4].what == 'F' && g_events[4].ms == 600);
+	SELFTEST_ASSERT(Test_SensorSched_Count('P', 'S') == 0);
+	SELFTEST_ASSERT(Test_SensorSched_Count('P', 'F') == 3);
+	SELFTEST_ASSERT(Test_SensorSched_Count('A', 'F') == 2);
+	SELFTEST_ASSERT(Test_SensorSched_Count('B', 'F') == 2);
+	SELFTEST_ASSERT(Test_SensorSched_Count('D', 'S') == 0);
+	// one bus access per tick
+	for (i = 1; i < g_eventCount; i++) {
+		SELFTEST_ASSERT(g_events[i].ms > g_events[i - 1].ms);
+	}
+	// interval grid is kept, not shifted by conversion time
+	SELFTEST_ASSERT(g_events[5].job == 'A' && g_events[5].ms == 1100);
+	SELFTEST_ASSERT(a.reads == 2 && a.errors == 0);
+	SELFTEST_ASSERT(a.lastLatencyMs == 20 && a.maxLatencyMs == 20);
+	SELFTEST_ASSERT(p.lastLatencyMs == 0);
+
+	// due at the same time: second one waits for next tick
+	SensorSched_Trigger(&a, 0);
+	SensorSched_Trigger(&b, 0);
+	g_eventCount = 0;
+	Test_SensorSched_Run(50);
+	SELFTEST_ASSERT(g_events[0].job == 'A' && g_events[0].what == 'S');
+	SELFTEST_ASSERT(g_events[1].job == 'B' && g_events[1].what == 'S');
+	SELFTEST_ASSERT(g_events[1].ms == g_events[0].ms + 5);
+	// latency counts from the tick that took the trigger
+	SELFTEST_ASSERT(b.lastLatencyMs == 25);
+
+	// errors of both phases are counted
+	SensorSched_Trigger(&d, 0);
+	g_fetchOk = false;
+	SensorSched_Trigger(&p, 0);
+	Test_SensorSched_Run(50);
+	SELFTEST_ASSERT(d.errors == 1 && d.reads == 0);
+	SELFTEST_ASSERT(p.errors == 1);
+	SELFTEST_ASSERT(Test_SensorSched_Count('D', 'F') == 0);
+
+	// trigger during conversion is kept, job runs again after result
+	g_fetchOk = true;
+	SensorSched_Trigger(&a, 0);
+	g_eventCount = 0;
+	Test_SensorSched_Run(10);
+	SELFTEST_ASSERT(g_eventCount == 1 && g_events[0].what == 'S');
+	SensorSched_Trigger(&a, 0);
+	Test_SensorSched_Run(50);
+	SELFTEST_ASSERT(Test_SensorSched_Count('A', 'S') == 2);
+	SELFTEST_ASSERT(Test_SensorSched_Count('A', 'F') == 2);
+
+	// ticks skipped while drivers were busy don't delay the job
+	SensorSched_Trigger(&b, 50);
+	Test_SensorSched_Run(5);
+	g_eventCount = 0;
+	g_nowMs += 50;
+	g_simulatedTimeNow += 50;
+	Test_SensorSched_Run(5);
+	SELFTEST_ASSERT(g_eventCount == 1 && g_events[0].job == 'B' && g_events[0].what == 'S');
+
+	// removed job is not touched anymore
+	SensorSched_Remove(&a);
+	SensorSched_Remove(&b);
+	SensorSched_Remove(&p);
+	SensorSched_Remove(&d);
+	SELFTEST_ASSERT(SensorSched_GetJobCount() == 0);
+	g_eventCount = 0;
+	Test_SensorSched_Run(2000);
+	SELFTEST_ASSERT(g_eventCount == 0);
+}
+
+static void Test_SensorSched_SHT3X() {
+	SIM_ClearOBK(0);
+
+	PIN_SetPinRoleForPinIndex(24, IOR_SHT3X_CLK);
+	PIN_SetPinRoleForPinIndex(26, IOR_SHT3X_DAT);
+	PIN_SetPinChannelForPinIndex(26, 2);
+	PIN_SetPinChannel2ForPinIndex(26, 3);
+	CMD_ExecuteCommand("startDriver SHT3X", 0);
+	SELFTEST_ASSERT(SensorSched_GetJobCount() == 1);
+	// measurement does not wait for every second callback
+	Sim_RunMiliseconds(200, false);
+	SELFTEST_ASSERT_CHANNEL(2, 234);
+	SELFTEST_ASSERT_CHANNEL(3, 56);
+
+	CMD_ExecuteCommand("setChannel 2 0", 0);
+	CMD_ExecuteCommand("SHT_Measure", 0);
+	// command only schedules it
+	SELFTEST_ASSERT_CHANNEL(2, 0);
+	Sim_RunMiliseconds(100, false);
+	SELFTEST_ASSERT_CHANNEL(2, 234);
+	CMD_ExecuteCommand("SensorStats", 0);
+
+	// periodic mode is started by the job, first result is late
+	CMD_ExecuteCommand("setChannel 2 0", 0);
+	CMD_ExecuteCommand("SHT_LaunchPer", 0);
+	Sim_RunMiliseconds(1000, false);
+	SELFTEST_ASSERT_CHANNEL(2, 0);
+	Sim_RunMiliseconds(1500, false);
+	SELFTEST_ASSERT_CHANNEL(2, 234);
+	// leaving it reads once more, then single shot follows after break
+	CMD_ExecuteCommand("setChannel 2 0", 0);
+	CMD_ExecuteCommand("SHT_StopPer", 0);
+	Sim_RunMiliseconds(20, false);
+	SELFTEST_ASSERT_CHANNEL(2, 234);
+	CMD_ExecuteCommand("setChannel 2 0", 0);
+	Sim_RunMiliseconds(100, false);
+	SELFTEST_ASSERT_CHANNEL(2, 234);
+
+	CMD_ExecuteCommand("stopDriver SHT3X", 0);
+	SELFTEST_ASSERT(SensorSched_GetJobCount() == 0);
+}
+
+void Test_SensorSched() {
+	SIM_ClearOBK(0);
+	Test_SensorSched_Jobs();
+	Test_SensorSched_SHT3X();
+}
+
+#endif
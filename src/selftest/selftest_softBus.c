@@ -0,0 +1,272 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "../driver/drv_local.h"
+#include "../driver/drv_soft_spi.h"
+
+#define SCL_PIN		4
+#define SDA_PIN		5
+#define SCK_PIN		6
+#define MISO_PIN	7
+#define MOSI_PIN	8
+#define SS_PIN		9
+
+static bbEdge_t g_edges[1024];
+static int g_edgeCount;
+static byte g_answer[8];
+static int g_answerBits;
+
+// What was seen on the wire, decoded from recorded edges
+typedef struct busTrace_s {
+	int starts, stops;
+	int byteCount;
+	byte bytes[16];
+	// level of data line at 9th clock, 0 is ACK
+	byte acks[16];
+	unsigned int minHigh, minLow, minPeriod;
+} busTrace_t;
+
+static busTrace_t g_trace;
+
+static void Test_SoftBus_Answer(int value, int bits) {
+	int i;
+
+	for (i = bits - 1; i >= 0; i--, g_answerBits++) {
+		if ((value >> i) & 1)
+			g_answer[g_answerBits / 8] |= 0x80 >> (g_answerBits % 8);
+		else
+			g_answer[g_answerBits / 8] &= ~(0x80 >> (g_answerBits % 8));
+	}
+}
+static void Test_SoftBus_StartTrace() {
+	memset(&g_trace, 0, sizeof(g_trace));
+	SIM_BitBang_StartTrace(g_edges, sizeof(g_edges) / sizeof(g_edges[0]));
+}
+static void Test_SoftBus_UpdateTiming(unsigned int *min, unsigned int v) {
+	if (*min == 0 || v < *min)
+		*min = v;
+}
+// Data is sampled on rising edge of clock, for I2C data changing while clock is high is start or stop.
+// Lines are given levels they had when trace was started.
+static void Test_SoftBus_Decode(int clkPin, int clkLevel, int dataPin, int dataLevel, int bitsPerByte) {
+	int i, clk, data, bit;
+	unsigned int lastRise, lastFall, shift;
+	bbEdge_t *e;
+
+	g_edgeCount = SIM_BitBang_StopTrace();
+	SELFTEST_ASSERT(g_edgeCount < sizeof(g_edges) / sizeof(g_edges[0]));
+	clk = clkLevel;
+	data = dataLevel;
+	bit = 0;
+	shift = 0;
+	lastRise = lastFall = 0;
+	for (i = 0; i < g_edgeCount; i++) {
+		e = &g_edges[i];
+		if (e->pin == clkPin) {
+			if (e->level) {
+				if (lastRise && bit)
+					Test_SoftBus_UpdateTiming(&g_trace.minPeriod, e->ns - lastRise);
+				Test_SoftBus_UpdateTiming(&g_trace.minLow, e->ns - lastFall);
+				lastRise = e->ns;
+				shift = (shift << 1) | data;
+				bit++;
+				if (bit == bitsPerByte) {
+					if (bitsPerByte == 9) {
+						g_trace.bytes[g_trace.byteCount] = shift >> 1;
+						g_trace.acks[g_trace.byteCount] = shift & 1;
+					}
+					else {
+						g_trace.bytes[g_trace.byteCount] = shift;
+					}
+					g_trace.byteCount++;
+					bit = 0;
+					shift = 0;
+				}
+			}
+			else {
+				Test_SoftBus_UpdateTiming(&g_trace.minHigh, e->ns - lastRise);
+				lastFall = e->ns;
+			}
+			clk = e->level;
+		}
+		else if (e->pin == dataPin) {
+			if (clk && bitsPerByte == 9) {
+				if (e->level) {
+					g_trace.stops++;
+				}
+				else {
+					g_trace.starts++;
+					bit = 0;
+					shift = 0;
+				}
+			}
+			data = e->level;
+		}
+	}
+}
+
+static void Test_SoftBus_I2C() {
+	softI2C_t i2c;
+	byte tx[2] = { 0x12, 0x34 };
+	byte rx[2];
+
+	memset(&i2c, 0, sizeof(i2c));
+	i2c.pin_clk = SCL_PIN;
+	i2c.pin_data = SDA_PIN;
+	SELFTEST_ASSERT(Soft_I2C_PreInit(&i2c));
+
+	// register write, device ACKs address and both bytes
+	g_answerBits = 0;
+	Test_SoftBus_Answer(0, 3);
+	SIM_BitBang_SetInputBits(SDA_PIN, g_answer, g_answerBits);
+	Test_SoftBus_StartTrace();
+	SELFTEST_ASSERT(Soft_I2C_Transfer(&i2c, 0x40 << 1, tx, 2, 0, 0));
+	Test_SoftBus_Decode(SCL_PIN, 1, SDA_PIN, 1, 9);
+	SELFTEST_ASSERT(SIM_BitBang_GetInputBitsUsed() == 3);
+	SELFTEST_ASSERT(g_trace.starts == 1);
+	SELFTEST_ASSERT(g_trace.stops == 1);
+	SELFTEST_ASSERT(g_trace.byteCount == 3);
+	SELFTEST_ASSERT(g_trace.bytes[0] == 0x80);
+	SELFTEST_ASSERT(g_trace.bytes[1] == 0x12);
+	SELFTEST_ASSERT(g_trace.bytes[2] == 0x34);
+	// 100kHz by default, never faster
+	SELFTEST_ASSERT(g_trace.minPeriod == 10000);
+	SELFTEST_ASSERT(g_trace.minHigh >= 5000);
+	SELFTEST_ASSERT(g_trace.minLow >= 5000);
+
+	// register read: repeated start, master ACKs all but the last byte
+	g_answerBits = 0;
+	Test_SoftBus_Answer(0, 3);
+	Test_SoftBus_Answer(0xBE, 8);
+	Test_SoftBus_Answer(0xEF, 8);
+	SIM_BitBang_SetInputBits(SDA_PIN, g_answer, g_answerBits);
+	Test_SoftBus_StartTrace();
+	SELFTEST_ASSERT(Soft_I2C_Transfer(&i2c, 0x40 << 1, tx, 1, rx, 2));
+	Test_SoftBus_Decode(SCL_PIN, 1, SDA_PIN, 1, 9);
+	SELFTEST_ASSERT(rx[0] == 0xBE);
+	SELFTEST_ASSERT(rx[1] == 0xEF);
+	SELFTEST_ASSERT(g_trace.starts == 2);
+	SELFTEST_ASSERT(g_trace.stops == 1);
+	SELFTEST_ASSERT(g_trace.byteCount == 5);
+	SELFTEST_ASSERT(g_trace.bytes[0] == 0x80);
+	SELFTEST_ASSERT(g_trace.bytes[1] == 0x12);
+	SELFTEST_ASSERT(g_trace.bytes[2] == 0x81);
+	SELFTEST_ASSERT(g_trace.acks[3] == 0);
+	SELFTEST_ASSERT(g_trace.acks[4] == 1);
+
+	// nobody answers: whole write is still clocked out, read is skipped
+	SIM_BitBang_SetInputBits(SDA_PIN, 0, 0);
+	Test_SoftBus_StartTrace();
+	SELFTEST_ASSERT(Soft_I2C_Transfer(&i2c, 0x40 << 1, tx, 2, 0, 0) == false);
+	Test_SoftBus_Decode(SCL_PIN, 1, SDA_PIN, 1, 9);
+	SELFTEST_ASSERT(g_trace.byteCount == 3);
+	SELFTEST_ASSERT(g_trace.stops == 1);
+	Test_SoftBus_StartTrace();
+	SELFTEST_ASSERT(Soft_I2C_Transfer(&i2c, 0x40 << 1, 0, 0, rx, 2) == false);
+	Test_SoftBus_Decode(SCL_PIN, 1, SDA_PIN, 1, 9);
+	SELFTEST_ASSERT(g_trace.byteCount == 1);
+	SELFTEST_ASSERT(g_trace.bytes[0] == 0x81);
+	SELFTEST_ASSERT(rx[0] == 0xFF);
+	SELFTEST_ASSERT(rx[1] == 0xFF);
+
+	// speed change is picked up without init
+	i2c.speedKHz = 400;
+	Test_SoftBus_StartTrace();
+	Soft_I2C_Transfer(&i2c, 0x40 << 1, tx, 2, 0, 0);
+	Test_SoftBus_Decode(SCL_PIN, 1, SDA_PIN, 1, 9);
+	SELFTEST_ASSERT(g_trace.byteCount == 3);
+	SELFTEST_ASSERT(g_trace.minPeriod == 2500);
+}
+
+static void Test_SoftBus_SPI() {
+	softSPI_t spi;
+	byte tx[3] = { 0x9F, 0x00, 0x5A };
+	byte rx[3];
+
+	memset(&spi, 0, sizeof(spi));
+	spi.sck = SCK_PIN;
+	spi.miso = MISO_PIN;
+	spi.mosi = MOSI_PIN;
+	spi.ss = SS_PIN;
+	spi.speedKHz = 1000;
+	SPI_Setup(&spi);
+
+	g_answerBits = 0;
+	Test_SoftBus_Answer(0xFF, 8);
+	Test_SoftBus_Answer(0xA5, 8);
+	Test_SoftBus_Answer(0x3C, 8);
+	SIM_BitBang_SetInputBits(MISO_PIN, g_answer, g_answerBits);
+	Test_SoftBus_StartTrace();
+	SPI_Begin(&spi);
+	Soft_SPI_Transfer(&spi, tx, rx, 3);
+	SPI_End(&spi);
+	Test_SoftBus_Decode(SCK_PIN, 0, MOSI_PIN, 0, 8);
+	SELFTEST_ASSERT(rx[0] == 0xFF);
+	SELFTEST_ASSERT(rx[1] == 0xA5);
+	SELFTEST_ASSERT(rx[2] == 0x3C);
+	SELFTEST_ASSERT(g_trace.byteCount == 3);
+	SELFTEST_ASSERT(g_trace.bytes[0] == 0x9F);
+	SELFTEST_ASSERT(g_trace.bytes[1] == 0x00);
+	SELFTEST_ASSERT(g_trace.bytes[2] == 0x5A);
+	SELFTEST_ASSERT(g_trace.minPeriod == 1000);
+	// chip select frames the transfer
+	SELFTEST_ASSERT(g_edges[0].pin == SS_PIN && g_edges[0].level == 0);
+	SELFTEST_ASSERT(g_edges[g_edgeCount - 1].pin == SS_PIN && g_edges[g_edgeCount - 1].level == 1);
+
+	// byte helpers are the same thing, send clocks in a byte too
+	g_answerBits = 0;
+	Test_SoftBus_Answer(0xFF, 8);
+	Test_SoftBus_Answer(0xC3, 8);
+	SIM_BitBang_SetInputBits(MISO_PIN, g_answer, g_answerBits);
+	Test_SoftBus_StartTrace();
+	SPI_Send(&spi, 0x03);
+	SELFTEST_ASSERT(SPI_Read(&spi) == 0xC3);
+	Test_SoftBus_Decode(SCK_PIN, 0, MOSI_PIN, 0, 8);
+	SELFTEST_ASSERT(g_trace.byteCount == 2);
+	SELFTEST_ASSERT(g_trace.bytes[0] == 0x03);
+	SELFTEST_ASSERT(g_trace.bytes[1] == 0xFF);
+}
+
+// LED drivers are started with their pin roles and clock checked on a color write
+static void Test_SoftBus_LEDDriver(const char *name, int clkRole, int datRole, int expectedPeriod) {
+	char buffer[64];
+
+	SIM_ClearOBK(0);
+	PIN_SetPinRoleForPinIndex(SCL_PIN, clkRole);
+	PIN_SetPinRoleForPinIndex(SDA_PIN, datRole);
+	sprintf(buffer, "startDriver %s", name);
+	CMD_ExecuteCommand(buffer, 0);
+	if (expectedPeriod != 2500) {
+		sprintf(buffer, "LED_I2CSpeed %i", 1000000 / expectedPeriod);
+		CMD_ExecuteCommand(buffer, 0);
+	}
+	Test_SoftBus_StartTrace();
+	sprintf(buffer, "%s_RGBCW FF00FF00FF", name);
+	CMD_ExecuteCommand(buffer, 0);
+	Test_SoftBus_Decode(SCL_PIN, 1, SDA_PIN, 1, 9);
+	SELFTEST_ASSERT(g_trace.starts >= 1);
+	SELFTEST_ASSERT(g_trace.byteCount >= 3);
+	SELFTEST_ASSERT(g_trace.minPeriod == expectedPeriod);
+	SELFTEST_ASSERT(g_trace.minHigh >= expectedPeriod / 2);
+	SELFTEST_ASSERT(g_trace.minLow >= expectedPeriod / 2);
+}
+static void Test_SoftBus_LEDDrivers() {
+	// 400kHz unless changed
+	Test_SoftBus_LEDDriver("SM2135", IOR_SM2135_CLK, IOR_SM2135_DAT, 2500);
+	Test_SoftBus_LEDDriver("BP5758D", IOR_BP5758D_CLK, IOR_BP5758D_DAT, 2500);
+	Test_SoftBus_LEDDriver("BP1658CJ", IOR_BP1658CJ_CLK, IOR_BP1658CJ_DAT, 2500);
+	Test_SoftBus_LEDDriver("SM2235", IOR_SM2235_CLK, IOR_SM2235_DAT, 2500);
+	// speed is applied to running driver
+	Test_SoftBus_LEDDriver("SM2235", IOR_SM2235_CLK, IOR_SM2235_DAT, 5000);
+	CMD_ExecuteCommand("LED_I2CSpeed 400", 0);
+	SIM_ClearOBK(0);
+}
+
+void Test_SoftBus() {
+	Test_SoftBus_I2C();
+	Test_SoftBus_SPI();
+	Test_SoftBus_LEDDrivers();
+	SIM_BitBang_SetInputBits(-1, 0, 0);
+}
+
+#endif
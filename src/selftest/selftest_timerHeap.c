@@ -0,0 +1,94 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "../driver/drv_ntp.h"
+
+static heapTimer_t g_testTimers[200];
+
+static void Test_TimerHeap_Order(unsigned int base) {
+	timerHeap_t h;
+	heapTimer_t *t;
+	unsigned int prev;
+	int i, popped;
+
+	memset(&h, 0, sizeof(h));
+	for (i = 0; i < 200; i++) {
+		TimerHeap_InitTimer(&g_testTimers[i]);
+		TimerHeap_Schedule(&h, &g_testTimers[i], base + rand() % 1000);
+	}
+	// move some, remove some
+	for (i = 0; i < 200; i += 3) {
+		TimerHeap_Schedule(&h, &g_testTimers[i], base + rand() % 1000);
+	}
+	for (i = 0; i < 200; i += 7) {
+		TimerHeap_Remove(&h, &g_testTimers[i]);
+		SELFTEST_ASSERT(TimerHeap_IsScheduled(&g_testTimers[i]) == false);
+	}
+	SELFTEST_ASSERT(TimerHeap_PopExpired(&h, base - 1) == 0);
+	popped = 0;
+	prev = base;
+	while ((t = TimerHeap_PopExpired(&h, base + 1000)) != 0) {
+		// ordered even when counter wraps
+		SELFTEST_ASSERT((int)(t->deadline - prev) >= 0);
+		prev = t->deadline;
+		popped++;
+	}
+	SELFTEST_ASSERT(popped == 200 - 29);
+	SELFTEST_ASSERT(h.count == 0);
+	free(h.items);
+}
+
+void Test_TimerHeap() {
+	char buffer[128];
+	int i;
+	clock_t start;
+	long t;
+
+	Test_TimerHeap_Order(0);
+	Test_TimerHeap_Order(0xFFFFFE00);
+
+	// reset whole device
+	SIM_ClearOBK(0);
+
+	// hundreds of rarely repeating events don't slow down each tick
+	for (i = 0; i < 500; i++) {
+		sprintf(buffer, "addRepeatingEvent %i -1 addChannel 5 1", 1000 + i);
+		CMD_ExecuteCommand(buffer, 0);
+	}
+	CMD_ExecuteCommand("addRepeatingEvent 0.1 -1 addChannel 6 1", 0);
+	start = clock();
+	for (i = 0; i < 100000; i++) {
+		// 100 seconds
+		RepeatingEvents_RunUpdate(1);
+	}
+	t = clock() - start;
+	SELFTEST_ASSERT_CHANNEL(5, 0);
+	SELFTEST_ASSERT_CHANNEL(6, 1000);
+	printf("Test_TimerHeap: 501 repeating events, 100000 ticks took %li ms\n", t * 1000 / CLOCKS_PER_SEC);
+	CMD_ExecuteCommand("clearRepeatingEvents", 0);
+	SELFTEST_ASSERT(RepeatingEvents_GetActiveCount() == 0);
+
+	// clock events spread over the day, run second by second
+	CMD_ExecuteCommand("startDriver NTP", 0);
+	NTP_ClearEvents();
+	// forget time left by previous tests, so there is no catching up
+	NTP_RunEvents(0, false);
+	for (i = 0; i < 500; i++) {
+		sprintf(buffer, "addClockEvent %i:%i:%i 0xff %i addChannel 7 1", i / 24, (i * 7) % 60, i % 60, i);
+		CMD_ExecuteCommand(buffer, 0);
+	}
+	// only on sundays
+	CMD_ExecuteCommand("addClockEvent 12:00:00 0x01 1000 addChannel 8 1", 0);
+	start = clock();
+	// two days
+	for (i = 0; i < 2 * 24 * 60 * 60; i++) {
+		NTP_RunEvents(1681941600 + i, true);
+	}
+	t = clock() - start;
+	SELFTEST_ASSERT_CHANNEL(7, 1000);
+	SELFTEST_ASSERT_CHANNEL(8, 0);
+	printf("Test_TimerHeap: 501 clock events, 2 days of seconds took %li ms\n", t * 1000 / CLOCKS_PER_SEC);
+	NTP_ClearEvents();
+}
+
+#endif
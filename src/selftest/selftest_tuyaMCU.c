@@ -1,6 +1,9 @@
 #ifdef WINDOWS
 
 #include "selftest_local.h".
+#include "../driver/drv_uart.h"
+#include "../driver/drv_tuyaMCU.h"
+#include "../logging/logging.h"
 
 void Test_TuyaMCU_Basic() {
 	// reset whole device
@@ -43,4 +46,182 @@ void Test_TuyaMCU_Basic() {
 	//SELFTEST_ASSERT_CHANNEL(15, 666);
 }
 
+static int Test_TuyaMCU_MakeFrame(byte *out, int cmd, const byte *payload, int payloadLen) {
+	int i, sum;
+
+	out[0] = 0x55;
+	out[1] = 0xAA;
+	out[2] = 0x03;
+	out[3] = cmd;
+	out[4] = payloadLen >> 8;
+	out[5] = payloadLen & 0xFF;
+	memcpy(out + 6, payload, payloadLen);
+	sum = 0;
+	for (i = 0; i < 6 + payloadLen; i++)
+		sum += out[i];
+	out[6 + payloadLen] = sum;
+	return 7 + payloadLen;
+}
+static void Test_TuyaMCU_Feed(const byte *data, int len) {
+	int i;
+
+	for (i = 0; i < len; i++)
+		UART_AppendByteToCircularBuffer(data[i]);
+}
+// fnID 2 of type Value set to given value
+static int Test_TuyaMCU_MakeValueFrame(byte *out, int value) {
+	byte payload[8] = { 0x02, 0x02, 0x00, 0x04, 0, 0, 0, 0 };
+
+	payload[6] = value >> 8;
+	payload[7] = value & 0xFF;
+	return Test_TuyaMCU_MakeFrame(out, 0x07, payload, sizeof(payload));
+}
+
+void Test_TuyaMCU_Parser() {
+	static byte payload[260];
+	byte frame[300];
+	byte garbage[] = { 0x00, 0x55, 0x12, 0x55, 0x55 };
+	int len, i;
+
+	SIM_ClearOBK(0);
+	CMD_ExecuteCommand("startDriver TuyaMCU", 0);
+	CMD_ExecuteCommand("linkTuyaMCUOutputToChannel 2 val 15", 0);
+
+	// frame split between two reads is parsed once it's complete
+	len = Test_TuyaMCU_MakeValueFrame(frame, 100);
+	SELFTEST_ASSERT(len == 15);
+	SELFTEST_ASSERT(!memcmp(frame, "\x55\xAA\x03\x07\x00\x08\x02\x02\x00\x04\x00\x00\x00\x64\x7D", 15));
+	Test_TuyaMCU_Feed(frame, 5);
+	SELFTEST_ASSERT_INTEGER(TuyaMCU_ProcessReceivedFrames(), 0);
+	Test_TuyaMCU_Feed(frame + 5, 4);
+	SELFTEST_ASSERT_INTEGER(TuyaMCU_ProcessReceivedFrames(), 0);
+	Test_TuyaMCU_Feed(frame + 9, len - 9);
+	SELFTEST_ASSERT_INTEGER(TuyaMCU_ProcessReceivedFrames(), 1);
+	SELFTEST_ASSERT_CHANNEL(15, 100);
+	SELFTEST_ASSERT_INTEGER(UART_GetDataSize(), 0);
+
+	// garbage before header is skipped
+	Test_TuyaMCU_Feed(garbage, sizeof(garbage));
+	len = Test_TuyaMCU_MakeValueFrame(frame, 90);
+	Test_TuyaMCU_Feed(frame, len);
+	SELFTEST_ASSERT_INTEGER(TuyaMCU_ProcessReceivedFrames(), 1);
+	SELFTEST_ASSERT_CHANNEL(15, 90);
+	SELFTEST_ASSERT_INTEGER(UART_GetDataSize(), 0);
+
+	// bad checksum drops the frame, but next one is still found
+	len = Test_TuyaMCU_MakeValueFrame(frame, 110);
+	frame[len - 1]++;
+	Test_TuyaMCU_Feed(frame, len);
+	len = Test_TuyaMCU_MakeValueFrame(frame, 120);
+	Test_TuyaMCU_Feed(frame, len);
+	SELFTEST_ASSERT_INTEGER(TuyaMCU_ProcessReceivedFrames(), 1);
+	SELFTEST_ASSERT_CHANNEL(15, 120);
+	SELFTEST_ASSERT_INTEGER(UART_GetDataSize(), 0);
+
+	// frames crossing the end of ring buffer, fed in odd sized parts
+	for (i = 0; i < 200; i++) {
+		len = Test_TuyaMCU_MakeValueFrame(frame, i);
+		Test_TuyaMCU_Feed(frame, 7);
+		TuyaMCU_ProcessReceivedFrames();
+		Test_TuyaMCU_Feed(frame + 7, len - 7);
+		SELFTEST_ASSERT_INTEGER(TuyaMCU_ProcessReceivedFrames(), 1);
+		SELFTEST_ASSERT_CHANNEL(15, i);
+	}
+
+	// data length above 255 - raw dpID 3 with 256 bytes - followed by normal frame
+	payload[0] = 0x03;
+	payload[1] = 0x00;
+	payload[2] = 0x01;
+	payload[3] = 0x00;
+	for (i = 4; i < sizeof(payload); i++)
+		payload[i] = i;
+	len = Test_TuyaMCU_MakeFrame(frame, 0x07, payload, sizeof(payload));
+	SELFTEST_ASSERT(len == 267);
+	Test_TuyaMCU_Feed(frame, len);
+	len = Test_TuyaMCU_MakeValueFrame(frame, 77);
+	Test_TuyaMCU_Feed(frame, len);
+	SELFTEST_ASSERT_INTEGER(TuyaMCU_ProcessReceivedFrames(), 2);
+	SELFTEST_ASSERT_CHANNEL(15, 77);
+	SELFTEST_ASSERT_INTEGER(UART_GetDataSize(), 0);
+}
+
+void Test_TuyaMCU_Mappings() {
+	byte frame[32];
+	char cmd[64];
+	int i, len;
+
+	SIM_ClearOBK(0);
+	CMD_ExecuteCommand("startDriver TuyaMCU", 0);
+
+	// many mappings, dpIDs spread over whole range
+	for (i = 0; i < 40; i++) {
+		sprintf(cmd, "linkTuyaMCUOutputToChannel %i val %i", 200 + i, 20 + i);
+		CMD_ExecuteCommand(cmd, 0);
+	}
+	CMD_ExecuteCommand("linkTuyaMCUOutputToChannel 2 val 15", 0);
+	SELFTEST_ASSERT(TuyaMCU_IsChannelUsedByTuyaMCU(15));
+	SELFTEST_ASSERT(TuyaMCU_IsChannelUsedByTuyaMCU(20));
+	SELFTEST_ASSERT(TuyaMCU_IsChannelUsedByTuyaMCU(59));
+	SELFTEST_ASSERT(!TuyaMCU_IsChannelUsedByTuyaMCU(60));
+	SELFTEST_ASSERT(!TuyaMCU_IsChannelUsedByTuyaMCU(-1));
+	SELFTEST_ASSERT(!TuyaMCU_IsChannelUsedByTuyaMCU(1000));
+
+	len = Test_TuyaMCU_MakeValueFrame(frame, 55);
+	Test_TuyaMCU_Feed(frame, len);
+	SELFTEST_ASSERT_INTEGER(TuyaMCU_ProcessReceivedFrames(), 1);
+	SELFTEST_ASSERT_CHANNEL(15, 55);
+
+	// relinking dpID moves it to another channel and frees the old one
+	CMD_ExecuteCommand("linkTuyaMCUOutputToChannel 2 val 16", 0);
+	SELFTEST_ASSERT(!TuyaMCU_IsChannelUsedByTuyaMCU(15));
+	SELFTEST_ASSERT(TuyaMCU_IsChannelUsedByTuyaMCU(16));
+	len = Test_TuyaMCU_MakeValueFrame(frame, 66);
+	Test_TuyaMCU_Feed(frame, len);
+	SELFTEST_ASSERT_INTEGER(TuyaMCU_ProcessReceivedFrames(), 1);
+	SELFTEST_ASSERT_CHANNEL(15, 55);
+	SELFTEST_ASSERT_CHANNEL(16, 66);
+
+	// link back, so following tests see the usual setup
+	CMD_ExecuteCommand("linkTuyaMCUOutputToChannel 2 val 15", 0);
+	SELFTEST_ASSERT(TuyaMCU_IsChannelUsedByTuyaMCU(15));
+	SELFTEST_ASSERT(!TuyaMCU_IsChannelUsedByTuyaMCU(16));
+}
+
+static long Test_TuyaMCU_TimeFrames(int count) {
+	byte frame[32];
+	int len, i, c;
+	long start, ms;
+
+	start = timeGetTime();
+	c = 0;
+	for (i = 0; i < count; i++) {
+		len = Test_TuyaMCU_MakeValueFrame(frame, i & 0xFF);
+		Test_TuyaMCU_Feed(frame, len);
+		c += TuyaMCU_ProcessReceivedFrames();
+	}
+	ms = timeGetTime() - start;
+	SELFTEST_ASSERT_INTEGER(c, count);
+	if (ms <= 0)
+		ms = 1;
+	return count * 1000 / ms;
+}
+void Test_TuyaMCU_Benchmark() {
+	int oldLevel;
+	long quiet, verbose;
+
+	SIM_ClearOBK(0);
+	CMD_ExecuteCommand("startDriver TuyaMCU", 0);
+	CMD_ExecuteCommand("linkTuyaMCUOutputToChannel 2 val 15", 0);
+
+	oldLevel = loglevel;
+	loglevel = LOG_WARN;
+	quiet = Test_TuyaMCU_TimeFrames(20000);
+	loglevel = LOG_INFO;
+	verbose = Test_TuyaMCU_TimeFrames(2000);
+	loglevel = oldLevel;
+	SELFTEST_ASSERT_CHANNEL(15, (2000 - 1) & 0xFF);
+	printf("Test_TuyaMCU_Benchmark: %li frames/s with log level WARN, %li frames/s with INFO\n",
+		quiet, verbose);
+}
+
 #endif
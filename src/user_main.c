@@ -11,6 +11,7 @@
 
 //#include "driver/drv_ir.h"
 #include "driver/drv_public.h"
+#include "driver/drv_bitbang.h"
 //#include "ir/ir_local.h"
 
 // Commands register, execution API and cmd tokenizer
@@ -21,6 +22,7 @@
 
 #include "httpserver/new_http.h"
 #include "httpserver/http_fns.h"
+#include "httpserver/hass.h"
 #include "new_pins.h"
 #include "quicktick.h"
 #include "new_cfg.h"
@@ -397,6 +399,7 @@ void Main_OnEverySecond()
 	g_noMQTTTime = i;
 
 	MQTT_Dedup_Tick();
+	HAL_FlashVars_RunEverySecond();
 #ifndef OBK_DISABLE_ALL_DRIVERS
 	DRV_OnEverySecond();
 #endif
@@ -550,6 +553,8 @@ void Main_OnEverySecond()
 			ADDLOGF_INFO("HA discovery is scheduled, but MQTT connection is not present yet\n");
 		}
 	}
+	// publishes pending discovery entities, paced by MQTT queue
+	hass_discovery_run();
 	if (g_openAP)
 	{
 		if (g_bHasWiFiConnected)
@@ -620,6 +625,7 @@ void Main_OnEverySecond()
 		if (!g_reset) {
 			// ensure any config changes are saved before reboot.
 			CFG_Save_IfThereArePendingChanges();
+			HAL_FlashVars_Flush();
 #ifndef OBK_DISABLE_ALL_DRIVERS
 			if (DRV_IsMeasuringPower())
 			{
@@ -699,12 +705,17 @@ void QuickTick(void* param)
 #if (defined WINDOWS) || (defined PLATFORM_BEKEN)
 	SVM_RunThreads(g_deltaTimeMS);
 #endif
-	RepeatingEvents_RunUpdate(g_deltaTimeMS * 0.001f);
+	RepeatingEvents_RunUpdate(g_deltaTimeMS);
 #ifndef OBK_DISABLE_ALL_DRIVERS
 	DRV_RunQuickTick();
 #endif
 #ifdef WINDOWS
 	NewTuyaMCUSimulator_RunQuickTick(g_deltaTimeMS);
+#endif
+#if defined(PLATFORM_BEKEN) || defined(PLATFORM_BL602) || defined(PLATFORM_W600) || defined(WINDOWS)
+	if (g_dhtsCount > 0) {
+		DHT_OnQuickTick();
+	}
 #endif
 	CMD_RunUartCmndIfRequired();
 
@@ -862,6 +873,8 @@ void Main_Init_AfterDelay_Unsafe(bool bStartAutoRunScripts) {
 void Main_Init_BeforeDelay_Unsafe(bool bAutoRunScripts) {
 	g_unsafeInitDone = true;
 #ifndef OBK_DISABLE_ALL_DRIVERS
+	// before any driver starts bit-banging
+	BitBang_Calibrate();
 	DRV_Generic_Init();
 #endif
 	RepeatingEvents_Init();
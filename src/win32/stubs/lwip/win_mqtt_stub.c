@@ -58,6 +58,11 @@ extern int g_bDoingUnitTestsNow;
 bool MQTT_IsFakingOnlineMQTT() {
 	return g_bDoingUnitTestsNow;
 }
+// lets unit tests drop the fake connection for a while
+static bool g_simMQTTOffline = false;
+void SIM_SetMQTTOffline(bool bOffline) {
+	g_simMQTTOffline = bOffline;
+}
 /**
  * MQTT connect flags, only used in CONNECT message
  */
@@ -742,7 +747,7 @@ mqtt_client_t *mqtt_client_new(void) {
 /** Check connection status */
 u8_t mqtt_client_is_connected(mqtt_client_t *client) {
 	if (MQTT_IsFakingOnlineMQTT())
-		return 1;
+		return !g_simMQTTOffline;
 	return client->conn_state == MQTT_CONNECTED;
 }
 
@@ -944,6 +949,8 @@ err_t mqtt_publish(mqtt_client_t *client, const char *topic, const void *payload
 	}
 #endif
 	if (MQTT_IsFakingOnlineMQTT()) {
+		if (g_simMQTTOffline)
+			return ERR_CONN;
 		// on Windows simulator, forward MQTT publish for unit testing
 		SIM_OnMQTTPublish(topic, payload, payload_length, qos, retain);
 		return 0;
@@ -1425,6 +1432,7 @@ void WIN_ResetMQTT() {
 	}
 	memset(g_clients, 0, sizeof(g_clients));
 	g_numClients = 0;
+	g_simMQTTOffline = false;
 }
 void WIN_RunMQTTFrame() {
 	for (int i = 0; i < g_numClients; i++) {
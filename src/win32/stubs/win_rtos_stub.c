@@ -23,8 +23,10 @@ int delay_ms(int sec) {
 	return 0;
 }
 
+// simulated time, so timing code works in unit tests
+extern int g_simulatedTimeNow;
 int xTaskGetTickCount() {
-	return 9999;
+	return g_simulatedTimeNow;
 }
 
 int xPortGetFreeHeapSize() {
@@ -114,6 +114,7 @@ void SIM_ClearOBK(const char *flashPath) {
 		release_lfs();
 		SIM_Hack_ClearSimulatedPinRoles();
 		WIN_ResetMQTT();
+		hass_discovery_clear();
 		UART_ResetForSimulator();
 		CMD_ExecuteCommand("clearAll", 0);
 		CMD_ExecuteCommand("led_expoMode", 0);
@@ -123,6 +124,8 @@ void SIM_ClearOBK(const char *flashPath) {
 	if (flashPath) {
 		SIM_SetupFlashFileReading(flashPath);
 	}
+	// every test starts with blank flash vars
+	SIM_FlashVars_Reset(true);
 	bObkStarted = true;
 	Main_Init();
 }
@@ -148,6 +151,7 @@ void Win_DoUnitTests() {
 	Test_MultiplePinsOnChannel();
 	Test_Flags();
 	Test_DHT();
+	Test_JSONWriter();
 	Test_EnergyMeter();
 	Test_Tasmota();
 	Test_NTP();
@@ -157,11 +161,21 @@ void Win_DoUnitTests() {
 	Test_ChangeHandlers_MQTT();
 	Test_ChangeHandlers();
 	Test_RepeatingEvents();
+	Test_TimerHeap();
+	Test_IRCapture();
+	Test_I2C_MCP23017();
+	Test_SoftBus();
+	Test_SensorSched();
 	Test_ButtonEvents();
 	Test_Commands_Alias();
 	Test_Expressions_RunTests_Basic();
+	Test_Expressions_RunTests_Compiled();
 	Test_LEDDriver();
 	Test_LFS();
+	Test_Logging();
+	Test_FlashVars();
+	Test_PinTicks();
+	Test_HTTPServer();
 	Test_Scripting();
 	Test_Commands_Channels();
 	Test_Command_If();
@@ -172,6 +186,9 @@ void Win_DoUnitTests() {
 
 	// this is slowest
 	Test_TuyaMCU_Basic();
+	Test_TuyaMCU_Parser();
+	Test_TuyaMCU_Mappings();
+	Test_TuyaMCU_Benchmark();
 
 
 